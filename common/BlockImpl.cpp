@@ -21,45 +21,76 @@
 BOOL CInEndpointBase::Connect(signals::IEPRecvFrom* recv)
 {
 	WriteLocker lock(m_connRecvLock);
-	if(recv != m_connRecv)
+	if(recv != m_connRecv.current())
 	{
-		if(recv) recv->onSinkConnected(this);
+		if(recv)
+		{
+			// the sink connection is what keeps the buffer alive, it lasts as long as the connection object
+			recv->onSinkConnected(this);
+			Locker retireLock(m_retireLock);
+			m_liveConns++;
+		}
 		OnConnection(recv);
-		if(m_connRecv) m_connRecv->onSinkDisconnected(this);
-		m_connRecv = recv;
-		if(m_connRecv) m_connRecvConnected.wakeAll();
+		TConnSlot::conn_type* oldConn = m_connRecv.exchange(recv ? new TConnSlot::conn_type(this, recv) : NULL);
+		if(oldConn) oldConn->Release();		// a read still running through it finishes the disconnection
+		if(recv) m_connRecvConnected.wakeAll();
 	}
 	return true;
 }
 
+CInEndpointBase::~CInEndpointBase()
+{
+	Disconnect();
+
+	// a read that outlasted the disconnection still points at us
+	Locker lock(m_retireLock);
+	while(m_liveConns) m_allRetired.sleep(lock);
+}
+
+void CInEndpointBase::retireConnection(signals::IEPRecvFrom* recv)
+{
+	// the buffer counts its sink connections, so this doesn't undo the endpoint connecting to it again since
+	recv->onSinkDisconnected(this);
+	Locker lock(m_retireLock);
+	if(!--m_liveConns) m_allRetired.wakeAll();
+}
+
 unsigned CInEndpointBase::Read(signals::EType type, void* buffer, unsigned numAvail, BOOL bFillAll, unsigned msTimeout)
 {
-	ReadLocker lock(m_connRecvLock);
-	if(!m_connRecv)
+	TConnSlot::ref conn(m_connRecv);
+	if(!conn)
 	{
 		if(!msTimeout) return 0;
-		if(!m_connRecvConnected.sleep(lock, msTimeout)) return 0;
+		{
+			ReadLocker lock(m_connRecvLock);
+			if(!m_connRecv.current() && !m_connRecvConnected.sleep(lock, msTimeout)) return 0;
+		}
+		conn.reacquire(m_connRecv);
+		if(!conn) return 0;
 	}
-	ASSERT(m_connRecv);
-	return m_connRecv->Read(type, buffer, numAvail, bFillAll, msTimeout);
+	return conn->Read(type, buffer, numAvail, bFillAll, msTimeout);
 }
 
 BOOL CInEndpointBase::ReadOne(signals::EType type, void* buffer, unsigned msTimeout)
 {
-	ReadLocker lock(m_connRecvLock);
-	if(!m_connRecv)
+	TConnSlot::ref conn(m_connRecv);
+	if(!conn)
 	{
 		if(!msTimeout) return FALSE;
-		if(!m_connRecvConnected.sleep(lock, msTimeout)) return FALSE;
+		{
+			ReadLocker lock(m_connRecvLock);
+			if(!m_connRecv.current() && !m_connRecvConnected.sleep(lock, msTimeout)) return FALSE;
+		}
+		conn.reacquire(m_connRecv);
+		if(!conn) return FALSE;
 	}
-	ASSERT(m_connRecv);
-	return m_connRecv->ReadOne(type, buffer, msTimeout);
+	return conn->ReadOne(type, buffer, msTimeout);
 }
 
 signals::IAttributes* CInEndpointBase::RemoteAttributes()
 {
-	ReadLocker lock(m_connRecvLock);
-	return m_connRecv ? m_connRecv->OutputAttributes() : NULL;
+	TConnSlot::ref conn(m_connRecv);
+	return conn ? conn->OutputAttributes() : NULL;
 }
 
 // ------------------------------------------------------------------ class COutEndpointBase
@@ -67,45 +98,111 @@ signals::IAttributes* CInEndpointBase::RemoteAttributes()
 BOOL COutEndpointBase::Connect(signals::IEPSendTo* send)
 {
 	WriteLocker lock(m_connSendLock);
-	if(send != m_connSend)
+	if(send != m_connSend.current())
 	{
-		if(send) send->AddRef(this);
+		if(send)
+		{
+			send->AddRef(this);
+			Locker retireLock(m_retireLock);
+			m_liveConns++;
+		}
 		OnConnection(send);
-		if(m_connSend) m_connSend->Release(this);
-		m_connSend = send;
-		if(m_connSend) m_connSendConnected.wakeAll();
+		TConnSlot::conn_type* oldConn = m_connSend.exchange(send ? new TConnSlot::conn_type(this, send) : NULL);
+		if(oldConn)
+		{
+			// detach now, so the buffer can be connected again straight away, but keep it alive for a write still
+			// running through the old connection; the reference is dropped when the connection is retired
+			signals::IEPSendTo* oldSend = oldConn->get();
+			oldSend->AddRef(NULL);
+			oldSend->Release(this);
+			oldConn->Release();
+		}
+		if(send) m_connSendConnected.wakeAll();
 	}
 	return true;
 }
 
+COutEndpointBase::~COutEndpointBase()
+{
+	Disconnect();
+
+	// a write that outlasted the disconnection still points at us
+	Locker lock(m_retireLock);
+	while(m_liveConns) m_allRetired.sleep(lock);
+}
+
+void COutEndpointBase::retireConnection(signals::IEPSendTo* send)
+{
+	send->Release(NULL);
+	Locker lock(m_retireLock);
+	if(!--m_liveConns) m_allRetired.wakeAll();
+}
+
 unsigned COutEndpointBase::Write(signals::EType type, void* buffer, unsigned numElem, unsigned msTimeout)
 {
-	ReadLocker lock(m_connSendLock);
-	if(!m_connSend)
+	TConnSlot::ref conn(m_connSend);
+	if(!conn)
 	{
 		if(!msTimeout) return 0;
-		if(!m_connSendConnected.sleep(lock, msTimeout)) return 0;
+		{
+			ReadLocker lock(m_connSendLock);
+			if(!m_connSend.current() && !m_connSendConnected.sleep(lock, msTimeout)) return 0;
+		}
+		conn.reacquire(m_connSend);
+		if(!conn) return 0;
 	}
-	ASSERT(m_connSend);
-	return m_connSend->Write(type, buffer, numElem, msTimeout);
+	return conn->Write(type, buffer, numElem, msTimeout);
 }
 
 BOOL COutEndpointBase::WriteOne(signals::EType type, void* buffer, unsigned msTimeout)
 {
-	ReadLocker lock(m_connSendLock);
-	if(!m_connSend)
+	TConnSlot::ref conn(m_connSend);
+	if(!conn)
 	{
-		if(!msTimeout) return 0;
-		if(!m_connSendConnected.sleep(lock, msTimeout)) return 0;
+		if(!msTimeout) return FALSE;
+		{
+			ReadLocker lock(m_connSendLock);
+			if(!m_connSend.current() && !m_connSendConnected.sleep(lock, msTimeout)) return FALSE;
+		}
+		conn.reacquire(m_connSend);
+		if(!conn) return FALSE;
 	}
-	ASSERT(m_connSend);
-	return m_connSend->WriteOne(type, buffer, msTimeout);
+	return conn->WriteOne(type, buffer, msTimeout);
 }
 
 signals::IAttributes* COutEndpointBase::RemoteAttributes()
 {
-	ReadLocker lock(m_connSendLock);
-	return m_connSend ? m_connSend->InputAttributes() : NULL;
+	TConnSlot::ref conn(m_connSend);
+	return conn ? conn->InputAttributes() : NULL;
+}
+
+// ------------------------------------------------------------------ class CSinkConnections
+
+bool CSinkConnections::connect(signals::IInEndpoint* src)
+{
+	ASSERT(src);
+	src->AddRef();
+	Locker lock(m_lock);
+	const bool first = m_conns.empty();
+	m_conns[src]++;
+	m_iep = src;
+	return first;
+}
+
+bool CSinkConnections::disconnect(signals::IInEndpoint* src)
+{
+	bool last;
+	{
+		Locker lock(m_lock);
+		TConnCount::iterator found = m_conns.find(src);
+		ASSERT(found != m_conns.end());
+		if(found == m_conns.end()) return false;
+		if(!--found->second) m_conns.erase(found);
+		if(m_conns.find(m_iep) == m_conns.end()) m_iep = m_conns.empty() ? NULL : m_conns.begin()->first;
+		last = m_conns.empty();
+	}
+	src->Release();
+	return last;
 }
 
 // ------------------------------------------------------------------ class CAttributeBase
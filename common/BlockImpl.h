@@ -40,17 +40,110 @@ private:
 	volatile long m_refCount;
 };
 
+template<class EP, class CONN>
+class CConnection
+{	// one endpoint's hold on the thing it's connected to, kept alive by every call still running through it
+public:
+	inline CConnection(EP* owner, CONN* conn):m_owner(owner),m_conn(conn),m_refCount(1) { }
+	inline CONN* get() const	{ return m_conn; }
+	inline void AddRef()		{ _InterlockedIncrement(&m_refCount); }
+	inline void Release()
+	{
+		// the last one out (the endpoint or a call that outlasted the reconnection) lets go of the connection
+		if(!_InterlockedDecrement(&m_refCount))
+		{
+			m_owner->retireConnection(m_conn);
+			delete this;
+		}
+	}
+
+private:
+	EP* const m_owner;
+	CONN* const m_conn;
+	volatile long m_refCount;
+
+	CConnection(const CConnection& other);
+	CConnection& operator=(const CConnection& other);
+};
+
+template<class T>
+class CSnapshotSlot
+{	// read-copy-update style pointer to a reference-counted object: readers take a reference without locking, and
+	// a replaced object is only let go of once the readers using it have finished
+public:
+	inline CSnapshotSlot():m_current(NULL),m_pinning(0) { }
+	inline T* peek() const			{ return m_current; }
+
+	T* acquire()
+	{
+		// the window between reading the pointer and taking the reference is all a writer waits on
+		_InterlockedIncrement(&m_pinning);
+		T* obj = m_current;
+		if(obj) obj->AddRef();
+		_InterlockedDecrement(&m_pinning);
+		return obj;
+	}
+
+	T* exchange(T* newObj)
+	{
+		// returns the previous object (and the slot's reference to it), which no reader can still be picking up
+		T* oldObj = (T*)InterlockedExchangePointer((PVOID volatile*)&m_current, newObj);
+		while(m_pinning) YieldProcessor();
+		return oldObj;
+	}
+
+private:
+	T* volatile m_current;
+	volatile long m_pinning;			// readers between reading m_current and referencing it
+
+	CSnapshotSlot(const CSnapshotSlot& other);
+	CSnapshotSlot& operator=(const CSnapshotSlot& other);
+};
+
+template<class EP, class CONN>
+class CConnectionSlot : public CSnapshotSlot<CConnection<EP,CONN> >
+{	// the current connection of an endpoint: calls take a reference without locking, and a replaced connection
+	// is only retired once the calls using it have returned
+public:
+	typedef CConnection<EP,CONN> conn_type;
+
+	inline CConnectionSlot() { }
+	inline CONN* current() const	{ conn_type* conn = this->peek(); return conn ? conn->get() : NULL; }
+
+	class ref
+	{	// a call's reference to the connection, held for as long as the call runs
+	public:
+		inline explicit ref(CConnectionSlot& slot):m_conn(slot.acquire()) { }
+		inline ~ref()						{ if(m_conn) m_conn->Release(); }
+		inline void reacquire(CConnectionSlot& slot)
+		{
+			if(m_conn) m_conn->Release();
+			m_conn = slot.acquire();
+		}
+		inline operator bool() const		{ return !!m_conn; }
+		inline CONN* operator->() const		{ return m_conn->get(); }
+	private:
+		conn_type* m_conn;
+		ref(const ref& other);
+		ref& operator=(const ref& other);
+	};
+
+private:
+	CConnectionSlot(const CConnectionSlot& other);
+	CConnectionSlot& operator=(const CConnectionSlot& other);
+};
+
 class CInEndpointBase : public signals::IInEndpoint
 {
 protected:
-	inline CInEndpointBase():m_connRecv(NULL) {}
+	inline CInEndpointBase():m_liveConns(0) {}
 public:
-	virtual ~CInEndpointBase() { Disconnect(); }
+	virtual ~CInEndpointBase();
 	unsigned Read(signals::EType type, void* buffer, unsigned numAvail, BOOL bFillAll, unsigned msTimeout);
 	BOOL ReadOne(signals::EType type, void* buffer, unsigned msTimeout);
 
 	virtual BOOL Connect(signals::IEPRecvFrom* recv);
-	virtual BOOL isConnected() { return !!m_connRecv; }
+	virtual BOOL isConnected() { return !!m_connRecv.current(); }
 	virtual BOOL Disconnect()  { return Connect(NULL); }
 //	virtual const char* EPName();
 //	virtual unsigned AddRef() = 0;
@@ -60,28 +153,34 @@ public:
 	signals::IAttributes* RemoteAttributes();
 
 protected:
+	typedef CConnectionSlot<CInEndpointBase, signals::IEPRecvFrom> TConnSlot;
 	virtual void OnConnection(signals::IEPRecvFrom*) { }
-	inline signals::IEPRecvFrom* CurrentEndpoint() const { return m_connRecv; }
+	inline signals::IEPRecvFrom* CurrentEndpoint() const { return m_connRecv.current(); }
 private:
 	CInEndpointBase(const CInEndpointBase& other);
 	CInEndpointBase& operator=(const CInEndpointBase& other);
+	void retireConnection(signals::IEPRecvFrom* recv);
+	friend class CConnection<CInEndpointBase, signals::IEPRecvFrom>;
 protected:
-	RWLock m_connRecvLock;
+	RWLock m_connRecvLock;				// serializes reconnection, calls in progress never hold it
 	Condition m_connRecvConnected;
-	signals::IEPRecvFrom* m_connRecv;
+	TConnSlot m_connRecv;
+	Lock m_retireLock;
+	Condition m_allRetired;				// woken by the last connection to retire
+	unsigned m_liveConns;				// protected by m_retireLock, connections not yet retired
 };
 
 class COutEndpointBase : public signals::IOutEndpoint
 {
 protected:
-	inline COutEndpointBase():m_connSend(NULL) {}
+	inline COutEndpointBase():m_liveConns(0) {}
 public:
-	virtual ~COutEndpointBase() { Disconnect(); }
+	virtual ~COutEndpointBase();
 	unsigned Write(signals::EType type, void* buffer, unsigned numElem, unsigned msTimeout);
 	BOOL WriteOne(signals::EType type, void* buffer, unsigned msTimeout);
 
 	virtual BOOL Connect(signals::IEPSendTo* send);
-	virtual BOOL isConnected() { return !!m_connSend; }
+	virtual BOOL isConnected() { return !!m_connSend.current(); }
 	virtual BOOL Disconnect()  { return Connect(NULL); }
 //	virtual const char* EPName();
 //	virtual signals::EType Type() = 0;
@@ -89,15 +188,21 @@ public:
 //	virtual signals::IEPBuffer* CreateBuffer() = 0;
 	signals::IAttributes* RemoteAttributes();
 protected:
+	typedef CConnectionSlot<COutEndpointBase, signals::IEPSendTo> TConnSlot;
 	virtual void OnConnection(signals::IEPSendTo*) { }
-	inline signals::IEPSendTo* CurrentEndpoint() const { return m_connSend; }
+	inline signals::IEPSendTo* CurrentEndpoint() const { return m_connSend.current(); }
 private:
 	COutEndpointBase(const COutEndpointBase& other);
 	COutEndpointBase& operator=(const COutEndpointBase& other);
+	void retireConnection(signals::IEPSendTo* send);
+	friend class CConnection<COutEndpointBase, signals::IEPSendTo>;
 private:
-	RWLock m_connSendLock;
+	RWLock m_connSendLock;				// serializes reconnection, calls in progress never hold it
 	Condition m_connSendConnected;
-	signals::IEPSendTo* m_connSend;
+	TConnSlot m_connSend;
+	Lock m_retireLock;
+	Condition m_allRetired;				// woken by the last connection to retire
+	unsigned m_liveConns;				// protected by m_retireLock, connections not yet retired
 };
 
 class CAttributeBase : public signals::IAttribute
@@ -403,6 +508,13 @@ template<> struct StoreType<signals::etypDouble>
 	enum { is_blittable = 1, is_vector = 0 };
 };
 
+template<> struct StoreType<signals::etypComplexShort>
+{	// fixed-point fractions, full scale is +/-1.0 in the floating-point complex types
+	typedef std::complex<short> type;
+	typedef Buffer<type> buffer_type;
+	enum { is_blittable = 0, is_vector = 0 };
+};
+
 template<> struct StoreType<signals::etypComplex>
 {
 	typedef std::complex<float> type;
@@ -493,6 +605,15 @@ template<> struct StoreType<signals::etypVecDouble>
 	enum { is_vector = 1, base_enum = signals::etypDouble };
 };
 
+template<> struct StoreType<signals::etypVecComplexShort>
+{
+	typedef signals::IVector* type;
+	typedef std::complex<short> base_type;
+	typedef Vector<signals::etypComplexShort> buffer_templ;
+	typedef Buffer<type> buffer_type;
+	enum { is_vector = 1, base_enum = signals::etypComplexShort };
+};
+
 template<> struct StoreType<signals::etypVecComplex>
 {
 	typedef signals::IVector* type;
@@ -520,6 +641,12 @@ template<> struct StoreType<signals::etypVecLRSingle>
 	enum { is_vector = 1, base_enum = signals::etypLRSingle };
 };
 
+enum EVectorLayout
+{	// arrangement of the values in a complex vector
+	layoutInterleaved,		// std::complex pairs, the only layout seen outside of C++ blocks
+	layoutPlanar			// every real part followed by every imaginary part
+};
+
 template<signals::EType ET>
 class VectorPool
 {
@@ -552,21 +679,25 @@ public:
 	virtual const void* Data()		{ ASSERT(m_refCount > 0); return data; }
 
 protected:
-	inline Vector(unsigned s):size(s),m_refCount(0){}
+	inline Vector(unsigned s):m_tag(NATIVE_TAG),m_refCount(0),size(s),layout(layoutInterleaved){}
 	static VectorPool<ET> gl_pool;
 private:
 	Vector(const Vector&);
 	Vector& operator=(const Vector&);
 	~Vector() {}
 
+	enum { NATIVE_TAG = 0x56454354 };	// "VECT"
+	const unsigned long m_tag;		// marks the vectors we built, see native()
 	volatile long m_refCount;
 
 public:
 	static Vector* retrieve(unsigned size) { return gl_pool.retrieve(size); }
+	static Vector* native(signals::IVector* vec);	// NULL unless vec is one of ours
 	static Vector* construct(unsigned size);
 	void destruct();
 
 	const unsigned size;
+	EVectorLayout layout;		// see planar.h, only complex vectors are ever anything but interleaved
 	EntryType data[0];
 };
 #pragma warning(pop)
@@ -799,6 +930,116 @@ private:
 	Lock m_valueLock;
 };
 
+template<signals::EType ET>
+class CRWVectorAttribute : public CAttributeBase
+{	// holds a reference to its vector; getValue() and setValue() pass the signals::IVector* itself, and what
+	// getValue() returns stays valid until its next call even if the value is replaced in the meantime
+private:
+	typedef CRWVectorAttribute<ET> my_type;
+	CRWVectorAttribute(const my_type& other);
+	my_type& operator=(const my_type& other);
+public:
+	inline CRWVectorAttribute(const char* pName, const char* pDescr)
+		:CAttributeBase(pName, pDescr), m_func(this, &my_type::catcher), m_value(NULL), m_lent(NULL) { }
+	virtual ~CRWVectorAttribute()
+	{
+		if(m_value) m_value->Release();
+		if(m_lent) m_lent->Release();
+	}
+	virtual signals::EType Type()		{ return ET; }
+	virtual BOOL isReadOnly() const		{ return false; }
+
+	virtual const void* getValue()
+	{
+		signals::IVector* oldLent;
+		signals::IVector* value;
+		{
+			Locker lock(m_valueLock);
+			value = m_value;
+			if(value) value->AddRef();
+			oldLent = m_lent;
+			m_lent = value;
+		}
+		if(oldLent) oldLent->Release();
+		return value;
+	}
+	virtual BOOL setValue(const void* newVal) { return nativeSetValue((signals::IVector*)newVal); }
+
+	signals::IVector* nativeGetValue()	// returns an added reference
+	{
+		Locker lock(m_valueLock);
+		if(m_value) m_value->AddRef();
+		return m_value;
+	}
+
+	bool nativeSetValue(signals::IVector* newVal)
+	{
+		if(newVal && newVal->Type() != StoreType<ET>::base_enum) return false;
+		if(!isValidValue(newVal)) return false;
+		signals::IVector* oldVal;
+		{
+			Locker lock(m_valueLock);
+			if(newVal == m_value) return true;
+			if(newVal) newVal->AddRef();
+			oldVal = m_value;
+			m_value = newVal;
+			if(newVal) newVal->AddRef();		// held across the notification
+		}
+		if(oldVal) oldVal->Release();
+		onSetValue(newVal);
+		if(newVal) newVal->Release();
+		return true;
+	}
+
+	virtual bool isValidValue(signals::IVector* newVal) const { UNUSED_ALWAYS(newVal); return true; }
+
+protected:
+	virtual void onSetValue(signals::IVector* value)
+	{
+		TObserverList transList;
+		{
+			ReadLocker obslock(m_observersLock);
+			transList = m_observers;
+		}
+		Locker listlock(m_funcListLock);
+		TFuncList::iterator nextFunc = m_funcList.begin();
+		for(TObserverList::const_iterator trans = transList.begin(); trans != transList.end(); trans++)
+		{
+			while(nextFunc != m_funcList.end() && nextFunc->isPending()) nextFunc++;
+			if(nextFunc == m_funcList.end())
+			{
+				m_funcList.push_back(TFuncType(m_func));
+				nextFunc--;
+			}
+			ASSERT(nextFunc != m_funcList.end() && !nextFunc->isPending());
+			if(value) value->AddRef();		// released by catcher
+			nextFunc->fire(*trans, value);
+		}
+	}
+
+private:
+	fastdelegate::FastDelegate2<signals::IAttributeObserver*, signals::IVector*> m_func;
+	typedef AsyncDelegate<signals::IAttributeObserver*, signals::IVector*> TFuncType;
+	typedef std::list<TFuncType> TFuncList;
+	TFuncList  m_funcList;
+	Lock       m_funcListLock;
+	Lock       m_valueLock;
+	signals::IVector* m_value;
+	signals::IVector* m_lent;		// the reference behind the last getValue()
+
+	void catcher(signals::IAttributeObserver* obs, signals::IVector* value)
+	{
+		{
+			ReadLocker obslock(m_observersLock);
+			if(m_observers.find(obs) != m_observers.end())
+			{
+				obs->OnChanged(this, value);
+			}
+		}
+		if(value) value->Release();
+	}
+};
+
 class CEventAttribute : public CAttributeBase
 {
 public:
@@ -848,6 +1089,28 @@ public:
 	virtual BOOL setValue(const void* /* newVal */) { return false; }
 };
 
+class CSinkConnections
+{	// the incoming endpoints reading a buffer.  An endpoint's last connection can still be retiring (behind a read
+	// that outlasted it) when it or another endpoint connects, so connections are counted per endpoint and the
+	// newest endpoint is the one reported.  Each connection holds a reference to the endpoint.
+public:
+	inline CSinkConnections():m_iep(NULL) { }
+	inline signals::IInEndpoint* current() const { return m_iep; }
+
+	// both return true when the buffer goes from having no sink to having one, or back
+	bool connect(signals::IInEndpoint* src);
+	bool disconnect(signals::IInEndpoint* src);
+
+private:
+	typedef std::map<signals::IInEndpoint*,unsigned> TConnCount;
+	Lock m_lock;
+	TConnCount m_conns;				// protected by m_lock
+	signals::IInEndpoint* volatile m_iep;
+
+	CSinkConnections(const CSinkConnections& other);
+	CSinkConnections& operator=(const CSinkConnections& other);
+};
+
 template<signals::EType ET>
 class CEPBuffer : public signals::IEPBuffer, protected CRefcountObject
 {
@@ -856,11 +1119,11 @@ protected:
 	typedef typename StoreType<ET>::buffer_type buffer_type;
 
 	buffer_type buffer;
-	signals::IInEndpoint* m_iep;
+	CSinkConnections m_sinks;
 	signals::IOutEndpoint* m_oep;
 
 public:
-	inline CEPBuffer(typename buffer_type::size_type capacity):buffer(capacity), m_iep(NULL), m_oep(NULL)
+	inline CEPBuffer(typename buffer_type::size_type capacity):buffer(capacity), m_oep(NULL)
 	{
 	}
 
@@ -896,26 +1159,21 @@ public: // IEPSendTo
 
 	virtual void onSinkConnected(signals::IInEndpoint* src)
 	{
-		ASSERT(!m_iep);
-		signals::IInEndpoint* oldEp(m_iep);
-		m_iep = src;
-		if(m_iep) m_iep->AddRef();
-		if(oldEp) oldEp->Release();
+		// a connected sink keeps us alive, a read may still be running through it after it has been replaced
+		CRefcountObject::AddRef();
+		m_sinks.connect(src);
 	}
 
 	virtual void onSinkDisconnected(signals::IInEndpoint* src)
 	{
-		ASSERT(m_iep == src);
-		if(m_iep == src)
-		{
-			m_iep = NULL;
-			if(src) src->Release();
-		}
+		m_sinks.disconnect(src);
+		CRefcountObject::Release();
 	}
 
 	virtual signals::IAttributes* InputAttributes()
 	{
-		return m_iep ? m_iep->Attributes() : NULL;
+		signals::IInEndpoint* iep = m_sinks.current();
+		return iep ? iep->Attributes() : NULL;
 	}
 
 public: // IEPRecvFrom
@@ -1017,6 +1275,7 @@ typename VectorPool<ET>::vector_type* VectorPool<ET>::retrieve(unsigned size)
 			if(result->size == size)
 			{
 				m_pool.erase(trans);
+				result->layout = layoutInterleaved;
 				result->AddRef();
 				return result;
 			}
@@ -1051,6 +1310,17 @@ Vector<ET>* Vector<ET>::construct(unsigned size)
 	return result;
 }
 
+template<signals::EType ET>
+Vector<ET>* Vector<ET>::native(signals::IVector* vec)
+{
+	// vectors from elsewhere (the managed host, for one) implement IVector over their own storage, so the header
+	// is only looked at once Data() says the values sit directly behind it, and then it has to carry our tag
+	if(!vec || vec->Type() != ET) return NULL;
+	Vector* candidate = reinterpret_cast<Vector*>(vec);
+	if(vec->Data() != candidate->data) return NULL;
+	return candidate->m_tag == NATIVE_TAG ? candidate : NULL;
+}
+
 template<signals::EType ET>
 void Vector<ET>::destruct()
 {
@@ -45,6 +45,7 @@ namespace signals
 		etypInt64	= 0x14,
 		etypSingle	= 0x23,
 		etypDouble	= 0x24,
+		etypComplexShort = 0x33,
 		etypComplex	= 0x34,
 		etypCmplDbl = 0x35,
 		etypLRSingle = 0x44,
@@ -56,6 +57,7 @@ namespace signals
 		etypVecInt64	= 0x1C,
 		etypVecSingle	= 0x2B,
 		etypVecDouble	= 0x2C,
+		etypVecComplexShort = 0x3B,
 		etypVecComplex	= 0x3C,
 		etypVecCmplDbl	= 0x3D,
 		etypVecLRSingle	= 0x4C
@@ -0,0 +1,438 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+#include "BlockImpl.h"
+#include <vector>
+
+// Broadcast ring
+//
+// One writer feeds any number of readers through a single ring.  Each value is stored once and every reader keeps
+// its own cursor, so fanning a stream out costs the same however many readers there are.  Each reader is handed to a
+// sink as its IEPBuffer; a reader either holds the writer back when it falls a full ring behind (the way a CEPBuffer
+// would) or is left to lag, losing whatever it was too slow to read.
+
+class CBroadcastReaderBase : public signals::IEPBuffer, protected CRefcountObject
+{
+protected:
+	inline CBroadcastReaderBase():m_cursor(0),m_dropped(0),m_dropOnOverrun(0),m_oep(NULL) { }
+
+public:
+	inline void setDropOnOverrun(bool drop)	{ InterlockedExchange(&m_dropOnOverrun, drop ? 1 : 0); }
+	inline bool dropsOnOverrun() const		{ return !!m_dropOnOverrun; }
+
+protected:
+	typedef unsigned __int64 TPosition;		// counts every value ever written, so cursors never wrap
+
+	// guarded by the ring's lock
+	TPosition m_cursor;						// next value this reader will see
+	unsigned m_dropped;						// values overwritten before this reader got to them
+
+	volatile long m_dropOnOverrun;
+	CSinkConnections m_sinks;
+	Lock m_sinkLock;						// keeps attaching to the ring in step with m_sinks
+	signals::IOutEndpoint* m_oep;
+
+private:
+	CBroadcastReaderBase(const CBroadcastReaderBase& other);
+	CBroadcastReaderBase& operator=(const CBroadcastReaderBase& other);
+};
+
+template<signals::EType ET> class CBroadcastReader;
+
+template<signals::EType ET>
+class CBroadcastRing : protected CRefcountObject
+{
+public:
+	typedef typename StoreType<ET>::type store_type;
+	typedef CBroadcastReader<ET> reader_type;
+	enum { is_vector = StoreType<ET>::is_vector };
+
+	explicit CBroadcastRing(unsigned capacity);
+	virtual ~CBroadcastRing();
+	inline unsigned AddRef()				{ return CRefcountObject::AddRef(); }
+	inline unsigned Release()				{ return CRefcountObject::Release(); }
+
+	reader_type* CreateReader();			// the new reader carries one reference, the same as CreateBuffer
+	reader_type* findReader(signals::IEPSendTo* send);	// NULL unless send is one of this ring's readers
+	unsigned Write(const store_type* values, unsigned numElem, unsigned msTimeout);
+	unsigned takeFaults(signals::IOutEndpoint** faulted, unsigned availElem);	// endpoints whose readers lost values
+
+	inline unsigned capacity() const		{ return m_values.size(); }
+	bool hasReaders() const;
+
+private:
+	typedef typename reader_type::TPosition TPosition;
+	typedef std::vector<reader_type*> TReaderList;
+
+	std::vector<store_type> m_values;
+	TPosition m_head;						// values written so far
+	TPosition m_tail;						// oldest value still held in the ring
+	TReaderList m_created;					// every reader still alive
+	TReaderList m_attached;					// readers with a sink connected, only these are written for
+	mutable Lock m_lock;
+	Condition m_notEmpty;
+	Condition m_notFull;
+
+	void attach(reader_type* reader);
+	void detach(reader_type* reader);
+	void forget(reader_type* reader);
+	unsigned read(reader_type* reader, store_type* values, unsigned numAvail, bool fillAll, unsigned msTimeout);
+	TPosition slowestBlocking() const;
+	void reclaim();
+
+	CBroadcastRing(const CBroadcastRing& other);
+	CBroadcastRing& operator=(const CBroadcastRing& other);
+	friend class CBroadcastReader<ET>;
+};
+
+template<signals::EType ET>
+class CBroadcastReader : public CBroadcastReaderBase
+{
+protected:
+	typedef typename StoreType<ET>::type store_type;
+	typedef CBroadcastRing<ET> ring_type;
+	friend class CBroadcastRing<ET>;
+
+	ring_type* m_ring;
+
+	inline CBroadcastReader(ring_type* ring):m_ring(ring) { m_ring->AddRef(); }
+
+public:
+	virtual ~CBroadcastReader()
+	{
+		m_ring->forget(this);
+		m_ring->Release();
+	}
+
+public: // IEPBuffer
+	virtual signals::EType Type()	{ return ET; }
+	virtual unsigned Capacity()		{ return m_ring->capacity(); }
+	virtual unsigned Used()
+	{
+		Locker lock(m_ring->m_lock);
+		return unsigned(m_ring->m_head - m_cursor);
+	}
+
+public: // IEPSendTo
+	// values only arrive through the ring, a single reader has nothing to write into
+	virtual unsigned Write(signals::EType /* type */, const void* /* pBuffer */, unsigned /* numElem */, unsigned /* msTimeout */)
+	{
+		ASSERT(FALSE);
+		return 0;
+	}
+
+	virtual BOOL WriteOne(signals::EType /* type */, const void* /* pBuffer */, unsigned /* msTimeout */)
+	{
+		ASSERT(FALSE);
+		return FALSE;
+	}
+
+	virtual unsigned AddRef(signals::IOutEndpoint* oep)
+	{
+		if(oep) m_oep = oep;
+		return CRefcountObject::AddRef();
+	}
+
+	virtual unsigned Release(signals::IOutEndpoint* oep)
+	{
+		if(oep && oep == m_oep) m_oep = NULL;
+		return CRefcountObject::Release();
+	}
+
+	virtual signals::IAttributes* InputAttributes()
+	{
+		signals::IInEndpoint* iep = m_sinks.current();
+		return iep ? iep->Attributes() : NULL;
+	}
+
+public: // IEPRecvFrom
+	virtual unsigned Read(signals::EType type, void* pBuffer, unsigned numAvail, BOOL bFillAll, unsigned msTimeout)
+	{
+		if(type != ET) return 0; // implicit translation not yet supported
+		return m_ring->read(this, (store_type*)pBuffer, numAvail, !!bFillAll, msTimeout);
+	}
+
+	virtual BOOL ReadOne(signals::EType type, void* pBuffer, unsigned msTimeout)
+	{
+		if(type != ET) return FALSE; // implicit translation not yet supported
+		return m_ring->read(this, (store_type*)pBuffer, 1, false, msTimeout) ? TRUE : FALSE;
+	}
+
+	virtual void onSinkConnected(signals::IInEndpoint* src)
+	{
+		// a connected sink keeps us alive, and the ring only writes for us while one is
+		CRefcountObject::AddRef();
+		Locker lock(m_sinkLock);
+		if(m_sinks.connect(src)) m_ring->attach(this);
+	}
+
+	virtual void onSinkDisconnected(signals::IInEndpoint* src)
+	{
+		{
+			Locker lock(m_sinkLock);
+			if(m_sinks.disconnect(src)) m_ring->detach(this);
+		}
+		CRefcountObject::Release();
+	}
+
+	virtual signals::IAttributes* OutputAttributes()
+	{
+		return m_oep ? m_oep->Attributes() : NULL;
+	}
+
+	virtual signals::IEPBuffer* CreateBuffer()
+	{
+		signals::IEPBuffer* buff = new CEPBuffer<ET>(m_ring->capacity());
+		buff->AddRef(NULL);
+		return buff;
+	}
+
+private:
+	CBroadcastReader(const CBroadcastReader& other);
+	CBroadcastReader& operator=(const CBroadcastReader& other);
+};
+
+// ------------------------------------------------------------------ class CBroadcastRing
+
+template<signals::EType ET>
+CBroadcastRing<ET>::CBroadcastRing(unsigned capacity)
+	:m_values(capacity < 1 ? 1 : capacity, store_type()),m_head(0),m_tail(0)
+{
+}
+
+template<signals::EType ET>
+CBroadcastRing<ET>::~CBroadcastRing()
+{
+	// every reader holds a reference to us, so none are left by now
+	ASSERT(m_created.empty());
+	if(is_vector)
+	{
+		const unsigned size = m_values.size();
+		for(unsigned idx = 0; idx < size; idx++)
+		{
+			signals::IVector* vec = *(signals::IVector**)&m_values[idx];
+			if(vec) vec->Release();
+		}
+	}
+}
+
+template<signals::EType ET>
+typename CBroadcastRing<ET>::reader_type* CBroadcastRing<ET>::CreateReader()
+{
+	reader_type* reader = new reader_type(this);
+	reader->AddRef(NULL);
+	Locker lock(m_lock);
+	m_created.push_back(reader);
+	return reader;
+}
+
+template<signals::EType ET>
+typename CBroadcastRing<ET>::reader_type* CBroadcastRing<ET>::findReader(signals::IEPSendTo* send)
+{
+	if(!send) return NULL;
+	Locker lock(m_lock);
+	for(typename TReaderList::const_iterator trans = m_created.begin(); trans != m_created.end(); trans++)
+	{
+		if(static_cast<signals::IEPSendTo*>(*trans) == send) return *trans;
+	}
+	return NULL;
+}
+
+template<signals::EType ET>
+bool CBroadcastRing<ET>::hasReaders() const
+{
+	Locker lock(m_lock);
+	return !m_attached.empty();
+}
+
+template<signals::EType ET>
+void CBroadcastRing<ET>::attach(reader_type* reader)
+{
+	// a new reader starts with whatever is written next
+	Locker lock(m_lock);
+	reader->m_cursor = m_head;
+	reader->m_dropped = 0;
+	m_attached.push_back(reader);
+}
+
+template<signals::EType ET>
+void CBroadcastRing<ET>::detach(reader_type* reader)
+{
+	Locker lock(m_lock);
+	for(typename TReaderList::iterator trans = m_attached.begin(); trans != m_attached.end(); trans++)
+	{
+		if(*trans == reader)
+		{
+			m_attached.erase(trans);
+			break;
+		}
+	}
+	if(is_vector) reclaim();
+	m_notFull.wakeAll();		// the writer may have been waiting on this one
+}
+
+template<signals::EType ET>
+void CBroadcastRing<ET>::forget(reader_type* reader)
+{
+	detach(reader);
+	Locker lock(m_lock);
+	for(typename TReaderList::iterator trans = m_created.begin(); trans != m_created.end(); trans++)
+	{
+		if(*trans == reader)
+		{
+			m_created.erase(trans);
+			break;
+		}
+	}
+}
+
+template<signals::EType ET>
+typename CBroadcastRing<ET>::TPosition CBroadcastRing<ET>::slowestBlocking() const
+{
+	TPosition slowest = m_head;
+	for(typename TReaderList::const_iterator trans = m_attached.begin(); trans != m_attached.end(); trans++)
+	{
+		if(!(*trans)->dropsOnOverrun() && (*trans)->m_cursor < slowest) slowest = (*trans)->m_cursor;
+	}
+	return slowest;
+}
+
+template<signals::EType ET>
+void CBroadcastRing<ET>::reclaim()
+{
+	// vectors nobody can read any more are let go now rather than whenever their slot is next written
+	TPosition oldest = m_head;
+	for(typename TReaderList::const_iterator trans = m_attached.begin(); trans != m_attached.end(); trans++)
+	{
+		if((*trans)->m_cursor < oldest) oldest = (*trans)->m_cursor;
+	}
+	const unsigned size = m_values.size();
+	for(; m_tail < oldest; m_tail++)
+	{
+		signals::IVector*& vec = *(signals::IVector**)&m_values[unsigned(m_tail % size)];
+		if(vec)
+		{
+			vec->Release();
+			vec = NULL;
+		}
+	}
+}
+
+template<signals::EType ET>
+unsigned CBroadcastRing<ET>::Write(const store_type* values, unsigned numElem, unsigned msTimeout)
+{
+	Locker lock(m_lock);
+	const unsigned size = m_values.size();
+	unsigned idx = 0;
+	while(idx < numElem)
+	{
+		// only readers that hold the writer back are owed room, anyone else is pushed along
+		TPosition floor = slowestBlocking();
+		if(floor + size == m_head)
+		{
+			if(!m_notFull.sleep(lock, msTimeout))
+			{
+				// a stalled reader loses the values it hasn't read rather than stalling every other reader with it
+				floor = m_head;
+			} else {
+				continue;
+			}
+		}
+		const unsigned numWrite = unsigned(min(TPosition(numElem - idx), floor + size - m_head));
+		const TPosition newTail = m_head + numWrite > size ? m_head + numWrite - size : 0;
+		for(typename TReaderList::iterator trans = m_attached.begin(); trans != m_attached.end(); trans++)
+		{
+			reader_type* reader = *trans;
+			if(reader->m_cursor < newTail)
+			{
+				reader->m_dropped += unsigned(newTail - reader->m_cursor);
+				reader->m_cursor = newTail;
+			}
+		}
+
+		for(unsigned elm = 0; elm < numWrite; elm++)
+		{
+			store_type& slot = m_values[unsigned((m_head + elm) % size)];
+			if(is_vector)
+			{
+				signals::IVector* oldVec = *(signals::IVector**)&slot;
+				signals::IVector* newVec = *(signals::IVector**)&values[idx + elm];
+				if(newVec) newVec->AddRef();
+				if(oldVec) oldVec->Release();
+			}
+			slot = values[idx + elm];
+		}
+		m_head += numWrite;
+		if(m_tail < newTail) m_tail = newTail;
+		idx += numWrite;
+		m_notEmpty.wakeAll();
+	}
+	if(is_vector) reclaim();
+	return idx;
+}
+
+template<signals::EType ET>
+unsigned CBroadcastRing<ET>::read(reader_type* reader, store_type* values, unsigned numAvail, bool fillAll, unsigned msTimeout)
+{
+	Locker lock(m_lock);
+	const unsigned size = m_values.size();
+	unsigned idx = 0;
+	while(idx < numAvail)
+	{
+		while(reader->m_cursor == m_head)
+		{
+			if(!m_notEmpty.sleep(lock, msTimeout)) return idx;
+		}
+		if(reader->m_cursor < m_tail)
+		{
+			// only a detached reader can be overtaken like this
+			reader->m_dropped += unsigned(m_tail - reader->m_cursor);
+			reader->m_cursor = m_tail;
+			if(reader->m_cursor == m_head) continue;
+		}
+		const unsigned numRead = unsigned(min(TPosition(numAvail - idx), m_head - reader->m_cursor));
+		for(unsigned elm = 0; elm < numRead; elm++)
+		{
+			store_type& slot = m_values[unsigned((reader->m_cursor + elm) % size)];
+			if(is_vector) (*(signals::IVector**)&slot)->AddRef();
+			values[idx + elm] = slot;
+		}
+		reader->m_cursor += numRead;
+		idx += numRead;
+		if(is_vector) reclaim();
+		m_notFull.wakeAll();
+		if(is_vector || !fillAll) break;
+	}
+	return idx;
+}
+
+template<signals::EType ET>
+unsigned CBroadcastRing<ET>::takeFaults(signals::IOutEndpoint** faulted, unsigned availElem)
+{
+	Locker lock(m_lock);
+	unsigned numFaulted = 0;
+	for(typename TReaderList::iterator trans = m_attached.begin(); trans != m_attached.end(); trans++)
+	{
+		reader_type* reader = *trans;
+		if(reader->m_dropped)
+		{
+			if(numFaulted < availElem) faulted[numFaulted] = reader->m_oep;
+			numFaulted++;
+			reader->m_dropped = 0;
+		}
+	}
+	return numFaulted;
+}
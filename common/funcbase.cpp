@@ -35,21 +35,15 @@ BOOL InputFunctionBase::Connect(signals::IEPRecvFrom* recv)
 
 void InputFunctionBase::onSinkConnected(signals::IInEndpoint* src)
 {
-	ASSERT(!m_readTo);
-	signals::IInEndpoint* oldEp(m_readTo);
-	m_readTo = src;
-	if(m_readTo) m_readTo->AddRef();
-	if(oldEp) oldEp->Release();
+	// a connected sink keeps us alive, a read may still be running through it after it has been replaced
+	AddRef();
+	m_readTo.connect(src);
 }
 
 void InputFunctionBase::onSinkDisconnected(signals::IInEndpoint* src)
 {
-	ASSERT(m_readTo == src);
-	if(m_readTo == src)
-	{
-		m_readTo = NULL;
-		if(src) src->Release();
-	}
+	m_readTo.disconnect(src);
+	Release();
 }
 
 // ---------------------------------------------------------------------------- class OutputFunctionBase
@@ -15,6 +15,7 @@
 */
 #pragma once
 #include "blockImpl.h"
+#include "planar.h"
 
 class InputFunctionBase : public signals::IInputFunction
 {
@@ -22,11 +23,11 @@ protected:
 	signals::IFunction* m_parent;
 	signals::IFunctionSpec* m_spec;
 	signals::IEPRecvFrom* m_readFrom;
-	signals::IInEndpoint* m_readTo;
+	CSinkConnections m_readTo;
 
 public:
 	inline InputFunctionBase(signals::IFunction* parent, signals::IFunctionSpec* spec)
-		:m_spec(spec),m_parent(parent),m_readFrom(NULL),m_readTo(NULL) {}
+		:m_spec(spec),m_parent(parent),m_readFrom(NULL) {}
 
 public: // IInEndpoint implementaton
 	virtual unsigned AddRef()		{ return m_parent->AddRef(); }
@@ -36,7 +37,11 @@ public: // IInEndpoint implementaton
 //	virtual signals::EType Type() = 0;
 	virtual BOOL isConnected()		{ return !!m_readFrom; }
 	virtual BOOL Disconnect()		{ return Connect(NULL); }
-	virtual signals::IAttributes* Attributes() { return m_readTo ? m_readTo->Attributes() : NULL; }
+	virtual signals::IAttributes* Attributes()
+	{
+		signals::IInEndpoint* readTo = m_readTo.current();
+		return readTo ? readTo->Attributes() : NULL;
+	}
 	virtual BOOL Connect(signals::IEPRecvFrom* recv);
 
 public: // IEPRecvFrom implementaton
@@ -293,6 +298,7 @@ struct VectorElementOperator : public std::unary_function<signals::IVector*,sign
 			ASSERT(FALSE);
 			return parm;
 		}
+		parm = toInterleaved<(signals::EType)StoreType<INN>::base_enum>(parm);
 		unsigned width = parm->Size();
 		out_buffer_templ* out = out_buffer_templ::retrieve(width);
 		const in_base_type* inData = (in_base_type*)parm->Data();
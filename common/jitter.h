@@ -0,0 +1,226 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+#include "BlockImpl.h"
+#include <vector>
+
+// Jitter buffer
+//
+// An incoming endpoint for a consumer that runs on a clock of its own (a radio, a sound card) and must be handed
+// a fixed number of samples on every tick whether or not the producer has kept up.  Whatever the producer has
+// written is pulled into a local ring holding roughly latencyTarget worth of samples; the ring is played out
+// through a four-point interpolator whose step is nudged a few hundred ppm either side of one, so a producer
+// running slightly fast or slow is absorbed without dropping or repeating whole samples.  Running dry (underrun)
+// plays silence until the ring has refilled, and a producer far ahead (overrun) has its oldest samples dropped.
+
+template<signals::EType ET>
+class CJitterIncomingChild : public CSimpleIncomingChild
+{	// This class is assumed to be a static (non-dynamic) member of its parent
+public:
+	typedef typename StoreType<ET>::type store_type;
+
+	inline CJitterIncomingChild(signals::IBlock* parent, unsigned rate, long msTarget)
+		:CSimpleIncomingChild(ET, parent),m_rate(rate),m_msDefault(msTarget),m_ring(rate * MAX_LATENCY_MS / 1000),
+		 m_head(0),m_count(0),m_frac(0.0),m_history(),m_avgFill(0.0),m_priming(true),m_target(0),
+		 m_underruns(0),m_overruns(0),m_sinceStats(0)
+	{
+	}
+
+	// always fills count values, returns how many of them came from the producer rather than being silence
+	unsigned ReadPaced(store_type* dest, unsigned count);
+
+protected:
+	void buildJitterAttrs();
+
+private:
+	enum
+	{
+		MAX_LATENCY_MS = 1000,				// ring size, a third of which is the most latencyTarget can ask for
+		STATS_INTERVAL = 256				// reads between refreshes of the latency attribute
+	};
+	static const double FILL_WEIGHT;		// smoothing of the fill level, the producer may write in large blocks
+	static const double STEER_GAIN;			// step adjustment per unit of (fill - target) / target
+	static const double MAX_STEER;			// largest step adjustment
+
+	template<signals::EType SET>
+	class CAttr_stat : public CROAttribute<SET>
+	{
+	public:
+		inline CAttr_stat(const char* name, const char* descr):CROAttribute<SET>(name, descr, 0) { }
+		inline void update(const typename StoreType<SET>::type& newVal) { this->privateSetValue(newVal); }
+	};
+
+	struct
+	{
+		CAttributeBase* target;
+		CAttr_stat<signals::etypSingle>* latency;
+		CAttr_stat<signals::etypLong>* underruns;
+		CAttr_stat<signals::etypLong>* overruns;
+	} attrs;
+
+	void setLatencyTarget(const long& msTarget);
+	void pull();
+	void drop(unsigned count);
+	inline const store_type& at(unsigned idx) const { return m_ring[(m_head + idx) % m_ring.size()]; }
+
+	const unsigned m_rate;
+	const long m_msDefault;
+	volatile long m_target;					// in samples, set from any thread
+
+	// private to the reading thread
+	std::vector<store_type> m_ring;
+	unsigned m_head;
+	unsigned m_count;
+	double m_frac;							// position between at(0) and at(1) of the next output
+	store_type m_history;					// the value before at(0), for the interpolator
+	double m_avgFill;
+	bool m_priming;
+	long m_underruns;
+	long m_overruns;
+	unsigned m_sinceStats;
+
+	CJitterIncomingChild(const CJitterIncomingChild& other);
+	CJitterIncomingChild& operator=(const CJitterIncomingChild& other);
+};
+
+template<signals::EType ET> const double CJitterIncomingChild<ET>::FILL_WEIGHT = 0.002;
+template<signals::EType ET> const double CJitterIncomingChild<ET>::STEER_GAIN = 0.01;
+template<signals::EType ET> const double CJitterIncomingChild<ET>::MAX_STEER = 0.001;
+
+template<signals::EType ET>
+void CJitterIncomingChild<ET>::buildJitterAttrs()
+{
+	attrs.latency = addLocalAttr(true, new CAttr_stat<signals::etypSingle>("latency", "Milliseconds of samples currently held"));
+	attrs.underruns = addLocalAttr(true, new CAttr_stat<signals::etypLong>("underruns", "Times the producer fell behind and silence was sent"));
+	attrs.overruns = addLocalAttr(true, new CAttr_stat<signals::etypLong>("overruns", "Times the producer got too far ahead and samples were dropped"));
+	attrs.target = addLocalAttr(true, new CAttr_callback<signals::etypLong,CJitterIncomingChild<ET> >
+		(*this, "latencyTarget", "Milliseconds of samples to hold against producer jitter", &CJitterIncomingChild<ET>::setLatencyTarget, m_msDefault));
+}
+
+template<signals::EType ET>
+void CJitterIncomingChild<ET>::setLatencyTarget(const long& msTarget)
+{
+	long target = long(__int64(msTarget) * m_rate / 1000);
+	target = max(target, 16L);
+	target = min(target, long(m_ring.size() / 3));
+	InterlockedExchange(&m_target, target);
+}
+
+template<signals::EType ET>
+void CJitterIncomingChild<ET>::pull()
+{
+	// take whatever the producer has without waiting, a segment at a time around the end of the ring
+	const unsigned capacity = m_ring.size();
+	while(m_count < capacity)
+	{
+		const unsigned tail = (m_head + m_count) % capacity;
+		const unsigned span = min(capacity - m_count, capacity - tail);
+		const unsigned numRead = Read(ET, &m_ring[tail], span, FALSE, 0);
+		m_count += numRead;
+		if(numRead < span) break;
+	}
+}
+
+template<signals::EType ET>
+void CJitterIncomingChild<ET>::drop(unsigned count)
+{
+	ASSERT(count <= m_count);
+	if(!count) return;
+	m_head = (m_head + count - 1) % m_ring.size();
+	m_history = m_ring[m_head];
+	m_head = (m_head + 1) % m_ring.size();
+	m_count -= count;
+}
+
+template<signals::EType ET>
+unsigned CJitterIncomingChild<ET>::ReadPaced(store_type* dest, unsigned count)
+{
+	enum { LOOKAHEAD = 3 };					// the interpolator reads at(0) through at(2)
+	pull();
+	const long target = m_target;
+	bool statsChanged = false;
+
+	if(m_priming)
+	{
+		if(m_count < unsigned(target) + LOOKAHEAD)
+		{
+			for(unsigned idx = 0; idx < count; idx++) dest[idx] = store_type();
+			return 0;
+		}
+		m_priming = false;
+		m_frac = 0.0;
+		m_avgFill = m_count;
+	}
+
+	if(m_count > 2 * unsigned(target) + count)
+	{
+		drop(m_count - unsigned(target));
+		m_avgFill = m_count;
+		m_overruns++;
+		statsChanged = true;
+	}
+
+	// steer the step so the (smoothed) fill level settles on the target
+	m_avgFill += FILL_WEIGHT * ((m_count - m_frac) - m_avgFill);
+	double step = 1.0 + STEER_GAIN * (m_avgFill - target) / target;
+	step = max(1.0 - MAX_STEER, min(step, 1.0 + MAX_STEER));
+
+	unsigned idx = 0;
+	for(; idx < count; idx++)
+	{
+		if(m_count < LOOKAHEAD)
+		{
+			m_underruns++;
+			m_priming = true;
+			statsChanged = true;
+			break;
+		}
+
+		// four-point, third-order Hermite interpolation
+		const float t = float(m_frac);
+		const store_type& xm1 = m_history;
+		const store_type& x0 = at(0);
+		const store_type& x1 = at(1);
+		const store_type& x2 = at(2);
+		const store_type c1 = 0.5f * (x1 - xm1);
+		const store_type c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+		const store_type c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+		dest[idx] = ((c3 * t + c2) * t + c1) * t + x0;
+
+		m_frac += step;
+		while(m_frac >= 1.0)
+		{
+			m_history = at(0);
+			m_head = (m_head + 1) % m_ring.size();
+			m_count--;
+			m_frac -= 1.0;
+		}
+	}
+	const unsigned numReal = idx;
+	for(; idx < count; idx++) dest[idx] = store_type();
+
+	if(statsChanged)
+	{
+		attrs.underruns->update(m_underruns);
+		attrs.overruns->update(m_overruns);
+	}
+	if(++m_sinceStats >= STATS_INTERVAL)
+	{
+		m_sinceStats = 0;
+		attrs.latency->update(float(m_avgFill * 1000.0 / m_rate));
+	}
+	return numReal;
+}
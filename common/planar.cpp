@@ -0,0 +1,169 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#include "stdafx.h"
+#include "planar.h"
+#include <xmmintrin.h>
+
+const char* CAttr_planarInput::NAME = "planarInput";
+
+// ------------------------------------------------------------------ layout conversions
+
+void deinterleave(const float* src, unsigned count, float* re, float* im)
+{
+	unsigned idx = 0;
+	for(; idx + 4 <= count; idx += 4)
+	{
+		__m128 a = _mm_loadu_ps(src + idx * 2);
+		__m128 b = _mm_loadu_ps(src + idx * 2 + 4);
+		_mm_storeu_ps(re + idx, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(im + idx, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+	for(; idx < count; idx++)
+	{
+		re[idx] = src[idx * 2];
+		im[idx] = src[idx * 2 + 1];
+	}
+}
+
+void interleave(const float* re, const float* im, unsigned count, float* dest)
+{
+	unsigned idx = 0;
+	for(; idx + 4 <= count; idx += 4)
+	{
+		__m128 r = _mm_loadu_ps(re + idx);
+		__m128 i = _mm_loadu_ps(im + idx);
+		_mm_storeu_ps(dest + idx * 2, _mm_unpacklo_ps(r, i));
+		_mm_storeu_ps(dest + idx * 2 + 4, _mm_unpackhi_ps(r, i));
+	}
+	for(; idx < count; idx++)
+	{
+		dest[idx * 2] = re[idx];
+		dest[idx * 2 + 1] = im[idx];
+	}
+}
+
+// ------------------------------------------------------------------ planar kernels
+
+void planarPower(const float* re, const float* im, unsigned count, float* out)
+{
+	unsigned idx = 0;
+	for(; idx + 4 <= count; idx += 4)
+	{
+		__m128 r = _mm_loadu_ps(re + idx);
+		__m128 i = _mm_loadu_ps(im + idx);
+		_mm_storeu_ps(out + idx, _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(i, i)));
+	}
+	for(; idx < count; idx++)
+	{
+		out[idx] = re[idx] * re[idx] + im[idx] * im[idx];
+	}
+}
+
+void planarMagnitude(const float* re, const float* im, unsigned count, float* out)
+{
+	unsigned idx = 0;
+	for(; idx + 4 <= count; idx += 4)
+	{
+		__m128 r = _mm_loadu_ps(re + idx);
+		__m128 i = _mm_loadu_ps(im + idx);
+		_mm_storeu_ps(out + idx, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(i, i))));
+	}
+	for(; idx < count; idx++)
+	{
+		out[idx] = std::sqrt(re[idx] * re[idx] + im[idx] * im[idx]);
+	}
+}
+
+void planarMix(float* re, float* im, const float* oscRe, const float* oscIm, unsigned count)
+{
+	unsigned idx = 0;
+	for(; idx + 4 <= count; idx += 4)
+	{
+		__m128 r = _mm_loadu_ps(re + idx);
+		__m128 i = _mm_loadu_ps(im + idx);
+		__m128 oR = _mm_loadu_ps(oscRe + idx);
+		__m128 oI = _mm_loadu_ps(oscIm + idx);
+		_mm_storeu_ps(re + idx, _mm_sub_ps(_mm_mul_ps(r, oR), _mm_mul_ps(i, oI)));
+		_mm_storeu_ps(im + idx, _mm_add_ps(_mm_mul_ps(r, oI), _mm_mul_ps(i, oR)));
+	}
+	for(; idx < count; idx++)
+	{
+		const float r = re[idx];
+		const float i = im[idx];
+		re[idx] = r * oscRe[idx] - i * oscIm[idx];
+		im[idx] = r * oscIm[idx] + i * oscRe[idx];
+	}
+}
+
+void planarFir(const float* re, const float* im, unsigned count, const float* taps, unsigned numTaps,
+	float* outRe, float* outIm)
+{
+	// four outputs at a time with each tap broadcast, the real and imaginary arrays share the tap
+	unsigned idx = 0;
+	for(; idx + 4 <= count; idx += 4)
+	{
+		__m128 accRe = _mm_setzero_ps();
+		__m128 accIm = _mm_setzero_ps();
+		for(unsigned tap = 0; tap < numTaps; tap++)
+		{
+			__m128 coef = _mm_set1_ps(taps[tap]);
+			accRe = _mm_add_ps(accRe, _mm_mul_ps(coef, _mm_loadu_ps(re + idx + tap)));
+			accIm = _mm_add_ps(accIm, _mm_mul_ps(coef, _mm_loadu_ps(im + idx + tap)));
+		}
+		_mm_storeu_ps(outRe + idx, accRe);
+		_mm_storeu_ps(outIm + idx, accIm);
+	}
+	for(; idx < count; idx++)
+	{
+		float accRe = 0.0f, accIm = 0.0f;
+		for(unsigned tap = 0; tap < numTaps; tap++)
+		{
+			accRe += taps[tap] * re[idx + tap];
+			accIm += taps[tap] * im[idx + tap];
+		}
+		outRe[idx] = accRe;
+		outIm[idx] = accIm;
+	}
+}
+
+// ------------------------------------------------------------------ class CPlanarSink
+
+bool CPlanarSink::accepts(COutEndpointBase& ep)
+{
+	// the sink's attributes only change identity on reconnection, so they're only searched then
+	signals::IAttributes* sink = ep.RemoteAttributes();
+	if(sink == m_lastSink) return m_accepts;
+	m_lastSink = sink;
+	m_accepts = false;
+	if(!sink) return false;
+
+	// only the sink's own attributes count, anything cascaded in from further downstream can't read our vectors
+	static const unsigned FLAGS = signals::flgLocalOnly | signals::flgIncludeHidden;
+	unsigned count = sink->Itemize(NULL, 0, FLAGS);
+	if(!count) return false;
+	std::vector<signals::IAttribute*> attrList(count);
+	count = sink->Itemize(&attrList[0], count, FLAGS);
+	for(unsigned idx = 0; idx < count && idx < attrList.size(); idx++)
+	{
+		signals::IAttribute* attr = attrList[idx];
+		if(attr && attr->Type() == signals::etypBoolean && strcmp(attr->Name(), CAttr_planarInput::NAME) == 0)
+		{
+			m_accepts = !!*(const unsigned char*)attr->getValue();
+			break;
+		}
+	}
+	return m_accepts;
+}
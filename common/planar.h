@@ -0,0 +1,146 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+#include "BlockImpl.h"
+#include <vector>
+
+// Planar (split real/imaginary) complex vectors
+//
+// A complex Vector may carry its values as all the real parts followed by all the imaginary parts, which lets
+// magnitude, mixing and filter kernels run straight down each array instead of shuffling pairs apart.  The layout
+// travels with each vector, but a block only sends planar vectors when the endpoint it writes to declared a
+// CAttr_planarInput; everything else (including the managed host) continues to see interleaved vectors.  The frame
+// builder sends planar frames to the frame magnitude block (dsp), which runs its kernels on them directly; an input
+// should only declare CAttr_planarInput once it runs one of the kernels below on what it reads.
+
+template<signals::EType ET>
+struct ComplexParts
+{
+	enum { is_complex = 0 };
+};
+
+template<> struct ComplexParts<signals::etypComplexShort>
+{
+	typedef short part_type;
+	enum { is_complex = 1 };
+};
+
+template<> struct ComplexParts<signals::etypComplex>
+{
+	typedef float part_type;
+	enum { is_complex = 1 };
+};
+
+template<> struct ComplexParts<signals::etypCmplDbl>
+{
+	typedef double part_type;
+	enum { is_complex = 1 };
+};
+
+// layout conversions, src and dest hold count complex values (2*count parts) and may not overlap
+template<class T>
+void deinterleave(const T* src, unsigned count, T* re, T* im)
+{
+	for(unsigned idx = 0; idx < count; idx++)
+	{
+		re[idx] = src[idx * 2];
+		im[idx] = src[idx * 2 + 1];
+	}
+}
+
+template<class T>
+void interleave(const T* re, const T* im, unsigned count, T* dest)
+{
+	for(unsigned idx = 0; idx < count; idx++)
+	{
+		dest[idx * 2] = re[idx];
+		dest[idx * 2 + 1] = im[idx];
+	}
+}
+
+void deinterleave(const float* src, unsigned count, float* re, float* im);
+void interleave(const float* re, const float* im, unsigned count, float* dest);
+
+// planar kernels
+void planarMagnitude(const float* re, const float* im, unsigned count, float* out);
+void planarPower(const float* re, const float* im, unsigned count, float* out);
+void planarMix(float* re, float* im, const float* oscRe, const float* oscIm, unsigned count);	// in place
+void planarFir(const float* re, const float* im, unsigned count, const float* taps, unsigned numTaps,
+	float* outRe, float* outIm);		// re/im hold count+numTaps-1 values, out[n] = sum(taps[k] * in[n+k])
+
+template<signals::EType ET, int IS_COMPLEX = ComplexParts<ET>::is_complex>
+struct VectorLayout
+{	// vectors of anything other than complex values only have the one layout
+	static inline Vector<ET>* convert(Vector<ET>* vec, EVectorLayout /* layout */) { return vec; }
+};
+
+template<signals::EType ET>
+struct VectorLayout<ET, 1>
+{
+	typedef typename ComplexParts<ET>::part_type part_type;
+
+	static Vector<ET>* convert(Vector<ET>* vec, EVectorLayout layout)
+	{
+		// consumes the reference to vec; the copy keeps a vector shared with other readers intact
+		if(!vec || vec->layout == layout) return vec;
+		const unsigned size = vec->size;
+		Vector<ET>* out = Vector<ET>::retrieve(size);
+		const part_type* src = (const part_type*)vec->data;
+		part_type* dest = (part_type*)out->data;
+		if(layout == layoutPlanar)
+		{
+			deinterleave(src, size, dest, dest + size);
+		} else {
+			interleave(src, src + size, size, dest);
+		}
+		out->layout = layout;
+		vec->Release();
+		return out;
+	}
+};
+
+template<signals::EType ET>
+inline Vector<ET>* toLayout(Vector<ET>* vec, EVectorLayout layout)
+{
+	return VectorLayout<ET>::convert(vec, layout);
+}
+
+template<signals::EType ET>
+signals::IVector* toInterleaved(signals::IVector* vec)
+{	// for readers that index values directly, consumes the reference to vec
+	if(!ComplexParts<ET>::is_complex) return vec;
+	Vector<ET>* ours = Vector<ET>::native(vec);
+	return ours ? toLayout(ours, layoutInterleaved) : vec;
+}
+
+class CAttr_planarInput : public CROAttribute<signals::etypBoolean>
+{	// added (hidden) to an incoming endpoint that reads planar complex vectors as well as interleaved ones
+public:
+	inline CAttr_planarInput():CROAttribute<signals::etypBoolean>(NAME, "Accepts complex vectors with split real and imaginary parts", 1) { }
+	static const char* NAME;
+};
+
+class CPlanarSink
+{	// tracks whether whatever an outgoing endpoint writes into has declared CAttr_planarInput
+public:
+	inline CPlanarSink():m_lastSink(NULL),m_accepts(false) { }
+	bool accepts(COutEndpointBase& ep);
+	inline EVectorLayout layout(COutEndpointBase& ep) { return accepts(ep) ? layoutPlanar : layoutInterleaved; }
+
+private:
+	signals::IAttributes* m_lastSink;
+	bool m_accepts;
+};
@@ -31,6 +31,42 @@ struct assign : public std::unary_function<PARM,RET>
 };
 #pragma warning(pop)
 
+// complex-short samples are fixed-point fractions, full scale is +/-1.0 in the floating-point types
+static const double CPX_SHORT_SCALE = 32768.0;
+
+template<class BASE>
+struct from_cpx_short : public std::unary_function<std::complex<short>,std::complex<BASE> >
+{
+	typedef std::complex<short> argument_type;
+	typedef std::complex<BASE> result_type;
+
+	inline std::complex<BASE> operator()(const std::complex<short>& parm)
+	{
+		return std::complex<BASE>(BASE(parm.real() / CPX_SHORT_SCALE), BASE(parm.imag() / CPX_SHORT_SCALE));
+	}
+};
+
+template<class BASE>
+struct to_cpx_short : public std::unary_function<std::complex<BASE>,std::complex<short> >
+{
+	typedef std::complex<BASE> argument_type;
+	typedef std::complex<short> result_type;
+
+	inline std::complex<short> operator()(const std::complex<BASE>& parm)
+	{
+		return std::complex<short>(toFixed(parm.real()), toFixed(parm.imag()));
+	}
+
+	static inline short toFixed(double val)
+	{
+		// saturate rather than wrap, a clipped peak is far less damaging than a sign flip
+		val *= CPX_SHORT_SCALE;
+		if(val >= 32767.0) return 32767;
+		if(val <= -32768.0) return -32768;
+		return short(floor(val + 0.5));
+	}
+};
+
 // lossless assignments
 static Function<signals::etypByte,signals::etypShort,assign<unsigned char, short> > assignBS("=","byte -> short");
 static Function<signals::etypByte,signals::etypLong,assign<unsigned char,long> > assignBL("=","byte -> long");
@@ -53,6 +89,8 @@ static Function<signals::etypSingle,signals::etypComplex,assign<float,std::compl
 static Function<signals::etypSingle,signals::etypCmplDbl,assign<float,std::complex<double> > > assignFE("=","single -> complex-double");
 static Function<signals::etypDouble,signals::etypCmplDbl,assign<double,std::complex<double> > > assignDE("=","double -> complex-double");
 static Function<signals::etypComplex,signals::etypCmplDbl,assign<std::complex<float>, std::complex<double> > > assignCE("=","complex-single -> complex-double");
+static Function<signals::etypComplexShort,signals::etypComplex,from_cpx_short<float> > assignKC("=","complex-short -> complex-single");
+static Function<signals::etypComplexShort,signals::etypCmplDbl,from_cpx_short<double> > assignKE("=","complex-short -> complex-double");
 
 static VectorElementFunction<signals::etypVecByte,signals::etypVecShort,assign<unsigned char, short> > assignVBS("=","byte -> short");
 static VectorElementFunction<signals::etypVecByte,signals::etypVecLong,assign<unsigned char,long> > assignVBL("=","byte -> long");
@@ -75,6 +113,8 @@ static VectorElementFunction<signals::etypVecSingle,signals::etypVecComplex,assi
 static VectorElementFunction<signals::etypVecSingle,signals::etypVecCmplDbl,assign<float,std::complex<double> > > assignVFE("=","single -> complex-double");
 static VectorElementFunction<signals::etypVecDouble,signals::etypVecCmplDbl,assign<double,std::complex<double> > > assignVDE("=","double -> complex-double");
 static VectorElementFunction<signals::etypVecComplex,signals::etypVecCmplDbl,assign<std::complex<float>, std::complex<double> > > assignVCE("=","complex-single -> complex-double");
+static VectorElementFunction<signals::etypVecComplexShort,signals::etypVecComplex,from_cpx_short<float> > assignVKC("=","complex-short -> complex-single");
+static VectorElementFunction<signals::etypVecComplexShort,signals::etypVecCmplDbl,from_cpx_short<double> > assignVKE("=","complex-short -> complex-double");
 
 // lossy assignments
 static Function<signals::etypShort,signals::etypByte,assign<short, unsigned char> > assignSB("~","short -> byte");
@@ -96,6 +136,8 @@ static Function<signals::etypDouble,signals::etypLong,assign<double, long> > ass
 static Function<signals::etypDouble,signals::etypSingle,assign<double, float> > assignDF("~","double -> single");
 static Function<signals::etypDouble,signals::etypComplex,assign<double, std::complex<float> > > assignCD("~","double -> complex-single");
 static Function<signals::etypCmplDbl,signals::etypComplex,assign<std::complex<double>, std::complex<float> > > assignEC("~","complex-single -> complex-double");
+static Function<signals::etypComplex,signals::etypComplexShort,to_cpx_short<float> > assignCK("~","complex-single -> complex-short");
+static Function<signals::etypCmplDbl,signals::etypComplexShort,to_cpx_short<double> > assignEK("~","complex-double -> complex-short");
 
 static VectorElementFunction<signals::etypVecShort,signals::etypVecByte,assign<short, unsigned char> > assignVSB("~","short -> byte");
 static VectorElementFunction<signals::etypVecLong,signals::etypVecByte,assign<long, unsigned char> > assignVLB("~","long -> byte");
@@ -116,6 +158,8 @@ static VectorElementFunction<signals::etypVecDouble,signals::etypVecLong,assign<
 static VectorElementFunction<signals::etypVecDouble,signals::etypVecSingle,assign<double, float> > assignVDF("~","double -> single");
 static VectorElementFunction<signals::etypVecDouble,signals::etypVecComplex,assign<double, std::complex<float> > > assignVCD("~","double -> complex-single");
 static VectorElementFunction<signals::etypVecCmplDbl,signals::etypVecComplex,assign<std::complex<double>, std::complex<float> > > assignVEC("~","complex-single -> complex-double");
+static VectorElementFunction<signals::etypVecComplex,signals::etypVecComplexShort,to_cpx_short<float> > assignVCK("~","complex-single -> complex-short");
+static VectorElementFunction<signals::etypVecCmplDbl,signals::etypVecComplexShort,to_cpx_short<double> > assignVEK("~","complex-double -> complex-short");
 
 template<class BASE>
 struct mag2 : public std::unary_function<std::complex<BASE>,double>
@@ -218,20 +262,20 @@ signals::IFunctionSpec* FUNCTIONS[] = {
 	// lossless assignments
 	&assignBS, &assignBL, &assignB6, &assignBF, &assignBD, &assignBC, &assignBE, &assignSL, &assignS6,
 	&assignSF, &assignSD, &assignSC, &assignSE, &assignL6, &assignLD, &assignLE, &assignFD, &assignFC,
-	&assignFE, &assignDE, &assignCE,
+	&assignFE, &assignDE, &assignCE, &assignKC, &assignKE,
 	
 	&assignVBS, &assignVBL, &assignVB6, &assignVBF, &assignVBD, &assignVBC, &assignVBE, &assignVSL, &assignVS6,
 	&assignVSF, &assignVSD, &assignVSC, &assignVSE, &assignVL6, &assignVLD, &assignVLE, &assignVFD, &assignVFC,
-	&assignVFE, &assignVDE, &assignVCE,
+	&assignVFE, &assignVDE, &assignVCE, &assignVKC, &assignVKE,
 
 	// lossy assignments
 	&assignSB, &assignLB, &assignLS, &assignLF, &assignLC, &assign6B, &assign6S, &assign6L, &assign6F,
 	&assign6C, &assign6E, &assignFB, &assignFS, &assignDB, &assignDS, &assignDL, &assignDF, &assignCD,
-	&assignEC,
+	&assignEC, &assignCK, &assignEK,
 
 	&assignVSB, &assignVLB, &assignVLS, &assignVLF, &assignVLC, &assignV6B, &assignV6S, &assignV6L, &assignV6F,
 	&assignV6C, &assignV6E, &assignVFB, &assignVFS, &assignVDB, &assignVDS, &assignVDL, &assignVDF, &assignVCD,
-	&assignVEC,
+	&assignVEC, &assignVCK, &assignVEK,
 
 	// complex transforms
 	&mag2S, &mag2D, &magS, &magD, &prS, &prD, &piS, &piD,
@@ -41,7 +41,7 @@ void CIdentityBase::COutgoing::buildAttrs(const CIdentityBase& parent)
 
 signals::IEPBuffer* CIdentityBase::CIncoming::CreateBuffer()
 {
-	ReadLocker lock(m_connRecvLock);
-	if(!m_connRecv) return NULL;
-	return m_connRecv->CreateBuffer();
+	TConnSlot::ref conn(m_connRecv);
+	if(!conn) return NULL;
+	return conn->CreateBuffer();
 }
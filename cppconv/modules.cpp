@@ -26,6 +26,7 @@ CSplitterDriver<signals::etypSingle> split_float;
 CSplitterDriver<signals::etypDouble> split_double;
 CSplitterDriver<signals::etypComplex> split_cpx;
 CSplitterDriver<signals::etypCmplDbl> split_cpxdbl;
+CSplitterDriver<signals::etypComplexShort> split_cpxshort;
 CSplitterDriver<signals::etypLRSingle> split_lr;
 CSplitterDriver<signals::etypVecBoolean> split_vec_bool;
 CSplitterDriver<signals::etypVecByte> split_vec_byte;
@@ -36,6 +37,7 @@ CSplitterDriver<signals::etypVecSingle> split_vec_float;
 CSplitterDriver<signals::etypVecDouble> split_vec_double;
 CSplitterDriver<signals::etypVecComplex> split_vec_cpx;
 CSplitterDriver<signals::etypVecCmplDbl> split_vec_cpxdbl;
+CSplitterDriver<signals::etypVecComplexShort> split_vec_cpxshort;
 CSplitterDriver<signals::etypVecLRSingle> split_vec_lr;
 
 CIdentityDriver<signals::etypBoolean> ident_bool;
@@ -47,6 +49,7 @@ CIdentityDriver<signals::etypSingle> ident_float;
 CIdentityDriver<signals::etypDouble> ident_double;
 CIdentityDriver<signals::etypComplex> ident_cpx;
 CIdentityDriver<signals::etypCmplDbl> ident_cpxdbl;
+CIdentityDriver<signals::etypComplexShort> ident_cpxshort;
 CIdentityDriver<signals::etypLRSingle> ident_lr;
 CIdentityDriver<signals::etypVecBoolean> ident_vec_bool;
 CIdentityDriver<signals::etypVecByte> ident_vec_byte;
@@ -57,21 +60,22 @@ CIdentityDriver<signals::etypVecSingle> ident_vec_float;
 CIdentityDriver<signals::etypVecDouble> ident_vec_double;
 CIdentityDriver<signals::etypVecComplex> ident_vec_cpx;
 CIdentityDriver<signals::etypVecCmplDbl> ident_vec_cpxdbl;
+CIdentityDriver<signals::etypVecComplexShort> ident_vec_cpxshort;
 CIdentityDriver<signals::etypVecLRSingle> ident_vec_lr;
 
 signals::IBlockDriver* BLOCKS[] =
 {
 	// stream split
 	&split_bool, &split_byte, &split_short, &split_long, &split_int64, &split_float, &split_double,
-	&split_cpx, &split_cpxdbl, &split_lr,
+	&split_cpx, &split_cpxdbl, &split_cpxshort, &split_lr,
 	&split_vec_bool, &split_vec_byte, &split_vec_short, &split_vec_long, &split_vec_int64, &split_vec_float, &split_vec_double,
-	&split_vec_cpx, &split_vec_cpxdbl, &split_vec_lr,
+	&split_vec_cpx, &split_vec_cpxdbl, &split_vec_cpxshort, &split_vec_lr,
 
 	// identity
 	&ident_bool, &ident_byte, &ident_short, &ident_long, &ident_int64, &ident_float, &ident_double,
-	&ident_cpx, &ident_cpxdbl, &ident_lr,
+	&ident_cpx, &ident_cpxdbl, &ident_cpxshort, &ident_lr,
 	&ident_vec_bool, &ident_vec_byte, &ident_vec_short, &ident_vec_long, &ident_vec_int64, &ident_vec_float, &ident_vec_double,
-	&ident_vec_cpx, &ident_vec_cpxdbl, &ident_vec_lr
+	&ident_vec_cpx, &ident_vec_cpxdbl, &ident_vec_cpxshort, &ident_vec_lr
 };
 
 extern "C" unsigned QueryDrivers(signals::IBlockDriver** drivers, unsigned availDrivers)
@@ -26,27 +26,33 @@ const char* CSplitterBase::COutgoing::EP_DESCR = "\"splitter\" outgoing endpoint
 
 #pragma warning(push)
 #pragma warning(disable: 4355)
-CSplitterBase::CSplitterBase(signals::EType type, signals::IBlockDriver* driver)
+CSplitterBase::CSplitterBase(signals::EType type, signals::IBlockDriver* driver, unsigned numOutputs)
 	:CThreadBlockBase(driver),m_type(type),m_incoming(this),
-	 m_outgoing(std::vector<COutgoing>(NUM_EP, COutgoing(this)))
+	 m_outgoing(std::vector<COutgoing>(MAX_OUTPUTS, COutgoing(this))),m_numOutputs(numOutputs)
 {
-	buildAttrs();
-	startThread();
+	// the thread is started by CSplitter once the ring it writes to exists
+	buildAttrs(numOutputs);
 }
 #pragma warning(pop)
 
-void CSplitterBase::buildAttrs()
+void CSplitterBase::buildAttrs(unsigned numOutputs)
 {
 	unsigned numEp = m_outgoing.size();
 	for(unsigned idx = 0; idx < numEp; idx++)
 	{
 		m_outgoing[idx].buildAttrs(*this);
 	}
+	attrs.outputs = addLocalAttr(true, new CAttr_outputs(*this, numOutputs));
+}
+
+void CSplitterBase::setOutputs(const long& outputs)
+{
+	InterlockedExchange(&m_numOutputs, outputs < 1 ? 1 : outputs > MAX_OUTPUTS ? MAX_OUTPUTS : outputs);
 }
 
 unsigned CSplitterBase::Outgoing(signals::IOutEndpoint** ep, unsigned availEP)
 {
-	unsigned numEp = m_outgoing.size();
+	unsigned numEp = m_numOutputs;
 	unsigned numToCopy = min(availEP, numEp);
 	if(numToCopy)
 	{
@@ -61,11 +67,28 @@ unsigned CSplitterBase::Outgoing(signals::IOutEndpoint** ep, unsigned availEP)
 void CSplitterBase::COutgoing::buildAttrs(const CSplitterBase& parent)
 {
 	attrs.sync_fault = addLocalAttr(true, new CEventAttribute("syncFault", "Fires when a sync fault happens in a receive stream"));
+	attrs.drop_on_overrun = addLocalAttr(true, new CAttr_callback<signals::etypBoolean,COutgoing>
+		(*this, "dropOnOverrun", "Let this output fall behind and lose data rather than hold up the other outputs", &COutgoing::setDropOnOverrun, 0));
+}
+
+void CSplitterBase::COutgoing::setDropOnOverrun(const unsigned char& drop)
+{
+	InterlockedExchange(&m_dropOnOverrun, drop ? 1 : 0);
+	Locker lock(m_readerLock);
+	if(m_reader) m_reader->setDropOnOverrun(!!drop);
+}
+
+void CSplitterBase::COutgoing::OnConnection(signals::IEPSendTo* send)
+{
+	// a buffer from our own CreateBuffer is read straight out of the ring, anything else is written to separately
+	Locker lock(m_readerLock);
+	m_reader = send ? m_parent->findReader(send) : NULL;
+	if(m_reader) m_reader->setDropOnOverrun(!!m_dropOnOverrun);
 }
 
 signals::IEPBuffer* CSplitterBase::CIncoming::CreateBuffer()
 {
-	ReadLocker lock(m_connRecvLock);
-	if(!m_connRecv) return NULL;
-	return m_connRecv->CreateBuffer();
+	TConnSlot::ref conn(m_connRecv);
+	if(!conn) return NULL;
+	return conn->CreateBuffer();
 }
@@ -15,16 +15,22 @@
 */
 #pragma once
 #include <blockImpl.h>
+#include <broadcast.h>
 
 class CSplitterBase : public CThreadBlockBase
 {
 public:
-	CSplitterBase(signals::EType type, signals::IBlockDriver* driver);
+	enum
+	{
+		DEFAULT_OUTPUTS = 4,
+		MAX_OUTPUTS = 32,
+	};
+
+	CSplitterBase(signals::EType type, signals::IBlockDriver* driver, unsigned numOutputs);
 
 private:
 	CSplitterBase(const CSplitterBase& other);
 	CSplitterBase& operator=(const CSplitterBase& other);
-	enum { NUM_EP = 4 };
 
 public: // IBlock implementation
 	virtual const char* Name()				{ return NAME; }
@@ -32,22 +38,42 @@ public: // IBlock implementation
 	virtual unsigned Outgoing(signals::IOutEndpoint** ep, unsigned availEP);
 
 public:
+	struct
+	{
+		CAttributeBase* outputs;
+	} attrs;
+
+	void setOutputs(const long& outputs);
+
 	class COutgoing : public COutEndpointBase, public CCascadedAttributesBase<CInEndpointBase>
 	{	// This class is assumed to be a static (non-dynamic) member of its parent
 	public:
-		inline COutgoing(CSplitterBase* parent):CCascadedAttributesBase(parent->m_incoming),m_parent(parent) { }
-		inline COutgoing(const COutgoing& other):CCascadedAttributesBase(other.m_parent->m_incoming),m_parent(other.m_parent) { }
+		inline COutgoing(CSplitterBase* parent):CCascadedAttributesBase(parent->m_incoming),m_parent(parent),
+			m_reader(NULL),m_dropOnOverrun(0) { }
+		inline COutgoing(const COutgoing& other):CCascadedAttributesBase(other.m_parent->m_incoming),m_parent(other.m_parent),
+			m_reader(NULL),m_dropOnOverrun(0) { }
 		void buildAttrs(const CSplitterBase& parent);
 
+		inline bool isBroadcast() const		{ return !!m_reader; }	// reading straight from the parent's ring
+		inline bool dropsOnOverrun() const	{ return !!m_dropOnOverrun; }
+
 	protected:
 		CSplitterBase* m_parent;
+		CBroadcastReaderBase* m_reader;
+		Lock m_readerLock;
+		volatile long m_dropOnOverrun;
+
+		virtual void OnConnection(signals::IEPSendTo* send);
 
 	public:
 		struct
 		{
 			CEventAttribute* sync_fault;
+			CAttributeBase* drop_on_overrun;
 		} attrs;
 
+		void setDropOnOverrun(const unsigned char& drop);
+
 	private:
 		const static char* EP_NAME;
 		const static char* EP_DESCR;
@@ -85,12 +111,34 @@ public:
 	};
 
 private:
+	// every endpoint up to MAX_OUTPUTS exists for the life of the block so none is ever moved or destroyed under a
+	// connection, "outputs" only decides how many are offered.  Outputs still connected cannot be taken away.
+	class CAttr_outputs : public CAttr_callback<signals::etypLong,CSplitterBase>
+	{
+	public:
+		inline CAttr_outputs(CSplitterBase& parent, long deflt)
+			:CAttr_callback<signals::etypLong,CSplitterBase>(parent, "outputs", "Number of outgoing endpoints",
+				&CSplitterBase::setOutputs, deflt) { }
+
+		virtual bool isValidValue(const long& newVal) const
+		{
+			if(newVal < 1 || newVal > MAX_OUTPUTS) return false;
+			for(unsigned idx = (unsigned)newVal; idx < m_parent.m_outgoing.size(); idx++)
+			{
+				if(m_parent.m_outgoing[idx].isConnected()) return false;
+			}
+			return true;
+		}
+	};
+
 	static const char* NAME;
 	const signals::EType m_type;
-	void buildAttrs();
+	volatile long m_numOutputs;
+	void buildAttrs(unsigned numOutputs);
 
 protected:
 	virtual signals::IEPBuffer* CreateBuffer() = 0;
+	virtual CBroadcastReaderBase* findReader(signals::IEPSendTo* send) = 0;
 	CIncoming m_incoming;
 	std::vector<COutgoing> m_outgoing;
 
@@ -105,7 +153,11 @@ template<signals::EType ET, int DEFAULT_BUFSIZE = 4096>
 class CSplitter : public CSplitterBase
 {
 public:
-	inline CSplitter(signals::IBlockDriver* driver):CSplitterBase(ET,driver) {}
+	inline CSplitter(signals::IBlockDriver* driver, unsigned numOutputs):CSplitterBase(ET,driver,numOutputs),m_ring(NULL)
+	{
+		startThread();
+	}
+	virtual ~CSplitter();
 
 private:
 	CSplitter(const CSplitter& other);
@@ -113,18 +165,20 @@ private:
 
 protected:
 	enum { is_vector = StoreType<ET>::is_vector };
+	typedef CBroadcastRing<ET> ring_type;
+
+	// created with the first buffer asked of an output, then kept for the life of the splitter
+	ring_type* m_ring;
+	Lock m_ringLock;
 
-	virtual signals::IEPBuffer* CreateBuffer()
+	inline ring_type* currentRing()
 	{
-		signals::IEPBuffer* buffer = m_incoming.CreateBuffer();
-		if(!buffer)
-		{
-			buffer = new CEPBuffer<ET>(DEFAULT_BUFSIZE);
-			buffer->AddRef(NULL);
-		}
-		return buffer;
+		Locker lock(m_ringLock);
+		return m_ring;
 	}
 
+	virtual signals::IEPBuffer* CreateBuffer();
+	virtual CBroadcastReaderBase* findReader(signals::IEPSendTo* send);
 	virtual void thread_run();
 };
 
@@ -132,7 +186,7 @@ template<signals::EType ET, int DEFAULT_BUFSIZE = 4096>
 class CSplitterDriver : public signals::IBlockDriver
 {
 public:
-	inline CSplitterDriver() {}
+	CSplitterDriver();
 	virtual ~CSplitterDriver() {}
 
 private:
@@ -151,7 +205,7 @@ public:
 protected:
 	static const char* NAME;
 	static const char* DESCR;
-	static const unsigned char FINGERPRINT[];
+	static unsigned char FINGERPRINT[3 + CSplitterBase::DEFAULT_OUTPUTS];	// as created, "outputs" can change it
 };
 
 // ------------------------------------------------------------------------------------------------
@@ -163,22 +217,65 @@ template<signals::EType ET, int DEFAULT_BUFSIZE>
 const char* CSplitterDriver<ET,DEFAULT_BUFSIZE>::DESCR = "Send a stream to multiple destinations";
 
 template<signals::EType ET, int DEFAULT_BUFSIZE>
-const unsigned char CSplitterDriver<ET,DEFAULT_BUFSIZE>::FINGERPRINT[]
-	= { 1, (unsigned char)ET, 4, (unsigned char)ET, (unsigned char)ET, (unsigned char)ET, (unsigned char)ET };
+unsigned char CSplitterDriver<ET,DEFAULT_BUFSIZE>::FINGERPRINT[3 + CSplitterBase::DEFAULT_OUTPUTS];
 
+// ------------------------------------------------------------------ class CSplitterDriver
 
-// ------------------------------------------------------------------ class CFrameBuilderDriver
+template<signals::EType ET, int DEFAULT_BUFSIZE>
+CSplitterDriver<ET,DEFAULT_BUFSIZE>::CSplitterDriver()
+{
+	// { 1, ET, DEFAULT_OUTPUTS, ET, ET, ... }
+	FINGERPRINT[0] = 1;
+	FINGERPRINT[1] = (unsigned char)ET;
+	FINGERPRINT[2] = (unsigned char)CSplitterBase::DEFAULT_OUTPUTS;
+	for(unsigned idx = 0; idx < CSplitterBase::DEFAULT_OUTPUTS; idx++) FINGERPRINT[3 + idx] = (unsigned char)ET;
+}
 
 template<signals::EType ET, int DEFAULT_BUFSIZE>
 signals::IBlock * CSplitterDriver<ET,DEFAULT_BUFSIZE>::Create()
 {
-	signals::IBlock* blk = new CSplitter<ET,DEFAULT_BUFSIZE>(this);
+	signals::IBlock* blk = new CSplitter<ET,DEFAULT_BUFSIZE>(this, CSplitterBase::DEFAULT_OUTPUTS);
 	blk->AddRef();
 	return blk;
 }
 
 // ------------------------------------------------------------------ class CSplitter
 
+template<signals::EType ET, int DEFAULT_BUFSIZE>
+CSplitter<ET,DEFAULT_BUFSIZE>::~CSplitter()
+{
+	// readers still connected keep the ring alive on their own
+	stopThread();
+	if(m_ring) m_ring->Release();
+}
+
+template<signals::EType ET, int DEFAULT_BUFSIZE>
+signals::IEPBuffer* CSplitter<ET,DEFAULT_BUFSIZE>::CreateBuffer()
+{
+	Locker lock(m_ringLock);
+	if(!m_ring)
+	{
+		// sized like the buffer the upstream would have given each output
+		unsigned capacity = DEFAULT_BUFSIZE;
+		signals::IEPBuffer* upstream = m_incoming.CreateBuffer();
+		if(upstream)
+		{
+			capacity = upstream->Capacity();
+			upstream->Release(NULL);
+		}
+		m_ring = new ring_type(capacity);
+		m_ring->AddRef();
+	}
+	return m_ring->CreateReader();
+}
+
+template<signals::EType ET, int DEFAULT_BUFSIZE>
+CBroadcastReaderBase* CSplitter<ET,DEFAULT_BUFSIZE>::findReader(signals::IEPSendTo* send)
+{
+	ring_type* ring = currentRing();
+	return ring ? ring->findReader(send) : NULL;
+}
+
 template<signals::EType ET, int DEFAULT_BUFSIZE>
 void CSplitter<ET,DEFAULT_BUFSIZE>::thread_run()
 {
@@ -187,21 +284,38 @@ void CSplitter<ET,DEFAULT_BUFSIZE>::thread_run()
 	typedef StoreType<ET>::type store_type;
 	unsigned numEp = m_outgoing.size();
 	std::vector<store_type> buffer(DEFAULT_BUFSIZE);
+	std::vector<signals::IOutEndpoint*> faulted(numEp);
 	while(threadRunning())
 	{
 		unsigned recvCount = m_incoming.Read(ET, buffer.data(), buffer.size(), FALSE, IN_BUFFER_TIMEOUT);
 		if(recvCount)
 		{
+			// every output reading from the ring shares this one write
+			ring_type* ring = currentRing();
+			if(ring && ring->hasReaders())
+			{
+				ring->Write(buffer.data(), recvCount, OUT_BUFFER_TIMEOUT);
+				unsigned numFaulted = min(ring->takeFaults(faulted.data(), numEp), numEp);
+				for(unsigned fault = 0; fault < numFaulted; fault++)
+				{
+					for(unsigned idx = 0; idx < numEp; idx++)
+					{
+						if(faulted[fault] == &m_outgoing[idx]) m_outgoing[idx].attrs.sync_fault->fire();
+					}
+				}
+			}
+
+			// anything else (an output function, a buffer from elsewhere) still gets its own copy
 			for(unsigned idx = 0; idx < numEp; idx++)
 			{
 				COutgoing& here = m_outgoing[idx];
-				if(here.isConnected())
+				if(here.isConnected() && !here.isBroadcast())
 				{
 					if(is_vector)
 					{
 						for(unsigned elm=0; elm < recvCount; elm++) (*(signals::IVector**)&buffer[elm])->AddRef();
 					}
-					unsigned outSent = here.Write(ET, buffer.data(), recvCount, OUT_BUFFER_TIMEOUT);
+					unsigned outSent = here.Write(ET, buffer.data(), recvCount, here.dropsOnOverrun() ? 0 : OUT_BUFFER_TIMEOUT);
 					if(outSent != recvCount)
 					{
 						here.attrs.sync_fault->fire();
@@ -0,0 +1,178 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#include "stdafx.h"
+#include "cic.h"
+#include "resample.h"
+#include <emmintrin.h>
+
+static const double PI = std::atan(1.0)*4;
+
+// ------------------------------------------------------------------ class CCicFilter
+
+CCicFilter::CCicFilter(unsigned channels)
+	:m_channels(channels),m_order(1),m_decim(1),m_phase(0),m_gain(1.0f)
+{
+	ASSERT(channels == 1 || channels == 2);
+	reset();
+}
+
+unsigned CCicFilter::maxDecim(unsigned order)
+{
+	// the integrators wrap harmlessly as long as the final output fits in the state
+	return (unsigned)min(std::floor(std::pow(2.0, double(GROWTH_BITS) / order)), double(MAX_DECIM));
+}
+
+void CCicFilter::design(unsigned order, unsigned decim, unsigned compTaps, float passband)
+{
+	// the block refuses a decimation past maxDecim(), the limit here only keeps a direct caller from overflowing
+	m_order = order < 1 ? 1 : order > MAX_ORDER ? MAX_ORDER : order;
+	ASSERT(decim <= maxDecim(m_order));
+	m_decim = decim < 1 ? 1 : min(decim, maxDecim(m_order));
+	m_gain = (float)(1.0 / (std::pow(double(m_decim), double(m_order)) * (1 << (INPUT_BITS - 1))));
+
+	m_comp.clear();
+	if(compTaps > 1 && m_decim > 1)
+	{
+		// frequency-sampled inverse of the CIC droop up to the passband edge, Kaiser windowed
+		static const unsigned GRID = 512;
+		static const double BETA = 5.0;
+		compTaps |= 1;
+		const double edge = passband * 0.5;
+		const double center = (compTaps - 1) / 2.0;
+		const double norm = CPolyphaseResampler::besselI0(BETA);
+		std::vector<double> taps(compTaps, 0.0);
+		for(unsigned step = 0; step < GRID; step++)
+		{
+			const double freq = (step + 0.5) * edge / GRID;
+			const double droop = std::pow(std::fabs(std::sin(PI * freq) / (m_decim * std::sin(PI * freq / m_decim))), double(m_order));
+			const double weight = 2.0 * edge / GRID / droop;
+			for(unsigned n = 0; n < compTaps; n++) taps[n] += weight * std::cos(2.0 * PI * freq * (n - center));
+		}
+		double sum = 0.0;
+		for(unsigned n = 0; n < compTaps; n++)
+		{
+			const double x = 2.0 * (n - center) / (compTaps - 1);
+			taps[n] *= CPolyphaseResampler::besselI0(BETA * std::sqrt(max(0.0, 1.0 - x * x))) / norm;
+			sum += taps[n];
+		}
+		m_comp.resize(compTaps);
+		for(unsigned n = 0; n < compTaps; n++) m_comp[n] = (float)(taps[n] / sum);
+	}
+	reset();
+}
+
+void CCicFilter::reset()
+{
+	memset(m_integ, 0, sizeof(m_integ));
+	memset(m_comb, 0, sizeof(m_comb));
+	m_phase = 0;
+	m_compHist.assign(m_comp.empty() ? 0 : (m_comp.size() - 1) * m_channels, 0.0f);
+}
+
+unsigned CCicFilter::maxOutput(unsigned inCount) const
+{
+	return (m_phase + inCount) / m_decim;
+}
+
+unsigned CCicFilter::process(const float* in, unsigned inCount, float* out)
+{
+	// every channel sits in its own 64-bit lane, so one complex sample moves through each stage at once
+	const unsigned order = m_order;
+	__m128i integ[MAX_ORDER], comb[MAX_ORDER];
+	for(unsigned stage = 0; stage < order; stage++)
+	{
+		integ[stage] = _mm_loadu_si128((const __m128i*)(m_integ + stage * 2));
+		comb[stage] = _mm_loadu_si128((const __m128i*)(m_comb + stage * 2));
+	}
+	const __m128 scale = _mm_set1_ps(float(1 << (INPUT_BITS - 1)));
+	const unsigned decim = m_decim;
+	unsigned phase = m_phase;
+	unsigned outCount = 0;
+
+	for(unsigned samp = 0; samp < inCount; samp++)
+	{
+		__m128 value = m_channels == 2
+			? _mm_castpd_ps(_mm_load_sd((const double*)(in + samp * 2)))
+			: _mm_load_ss(in + samp);
+		__m128i quant = _mm_cvtps_epi32(_mm_mul_ps(value, scale));
+		__m128i wide = _mm_unpacklo_epi32(quant, _mm_srai_epi32(quant, 31));
+
+		integ[0] = _mm_add_epi64(integ[0], wide);
+		for(unsigned stage = 1; stage < order; stage++) integ[stage] = _mm_add_epi64(integ[stage], integ[stage-1]);
+
+		if(++phase == decim)
+		{
+			phase = 0;
+			__m128i diff = integ[order-1];
+			for(unsigned stage = 0; stage < order; stage++)
+			{
+				__m128i prev = comb[stage];
+				comb[stage] = diff;
+				diff = _mm_sub_epi64(diff, prev);
+			}
+
+			__int64 lanes[2];
+			_mm_storeu_si128((__m128i*)lanes, diff);
+			float* dest = out + outCount * m_channels;
+			dest[0] = float(lanes[0]) * m_gain;
+			if(m_channels == 2) dest[1] = float(lanes[1]) * m_gain;
+			outCount++;
+		}
+	}
+
+	for(unsigned stage = 0; stage < order; stage++)
+	{
+		_mm_storeu_si128((__m128i*)(m_integ + stage * 2), integ[stage]);
+		_mm_storeu_si128((__m128i*)(m_comb + stage * 2), comb[stage]);
+	}
+	m_phase = phase;
+
+	if(outCount && !m_comp.empty()) compensate(out, outCount);
+	return outCount;
+}
+
+void CCicFilter::compensate(float* out, unsigned outCount)
+{
+	const unsigned chans = m_channels;
+	const unsigned numTaps = (unsigned)m_comp.size();
+	const unsigned histLen = (numTaps - 1) * chans;
+	m_compHist.resize(histLen + outCount * chans);
+	float* hist = m_compHist.data();
+	memcpy(hist + histLen, out, outCount * chans * sizeof(float));
+
+	// output value idx (either channel) is the sum of taps[tap] * hist[idx + tap*chans], so four outputs are built at
+	// once with each tap broadcast against an unaligned load of the history
+	const float* taps = m_comp.data();
+	const unsigned total = outCount * chans;
+	unsigned idx = 0;
+	for(; idx + 4 <= total; idx += 4)
+	{
+		__m128 acc = _mm_setzero_ps();
+		for(unsigned tap = 0; tap < numTaps; tap++)
+		{
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(taps[tap]), _mm_loadu_ps(hist + idx + tap * chans)));
+		}
+		_mm_storeu_ps(out + idx, acc);
+	}
+	for(; idx < total; idx++)
+	{
+		float acc = 0.0f;
+		for(unsigned tap = 0; tap < numTaps; tap++) acc += taps[tap] * hist[idx + tap * chans];
+		out[idx] = acc;
+	}
+	memmove(hist, hist + outCount * chans, histLen * sizeof(float));
+	m_compHist.resize(histLen);
+}
@@ -0,0 +1,415 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+#include <blockImpl.h>
+#include <vector>
+
+class CCicFilter
+{	// integer cascaded integrator-comb decimator over interleaved float channels, with an optional droop-compensating FIR
+public:
+	enum
+	{
+		MAX_ORDER = 6,
+		INPUT_BITS = 18,		// samples are quantized to this many bits before integrating
+		GROWTH_BITS = 45,		// bits left in the 64-bit state for order * log2(decim)
+		MAX_DECIM = 65536,
+	};
+
+	CCicFilter(unsigned channels);
+
+	void design(unsigned order, unsigned decim, unsigned compTaps, float passband);
+	void reset();
+	unsigned maxOutput(unsigned inCount) const;
+	unsigned process(const float* in, unsigned inCount, float* out);
+
+	inline unsigned order() const			{ return m_order; }
+	inline unsigned decim() const			{ return m_decim; }
+	inline unsigned compTaps() const		{ return (unsigned)m_comp.size(); }
+	inline const float* compCoeffs() const	{ return m_comp.empty() ? NULL : m_comp.data(); }
+
+	static unsigned maxDecim(unsigned order);
+
+private:
+	CCicFilter(const CCicFilter& other);
+	CCicFilter& operator=(const CCicFilter& other);
+
+	const unsigned m_channels;
+	unsigned m_order;
+	unsigned m_decim;
+	unsigned m_phase;						// input samples since the last output
+	float m_gain;							// removes the input scaling and the decim^order gain
+	__int64 m_integ[MAX_ORDER * 2];			// integrator state, two lanes per stage
+	__int64 m_comb[MAX_ORDER * 2];			// previous comb inputs, two lanes per stage
+	std::vector<float> m_comp;				// compensating FIR, symmetric
+	std::vector<float> m_compHist;			// compTaps-1 samples of history followed by the current outputs
+
+	void compensate(float* out, unsigned outCount);
+};
+
+template<signals::EType ET, int IS_VECTOR = StoreType<ET>::is_vector>
+struct CicSample
+{	// streams carry samples directly
+	typedef typename StoreType<ET>::type type;
+	enum { is_vector = 0, base_enum = ET };
+};
+
+template<signals::EType ET>
+struct CicSample<ET, 1>
+{	// frames are independent bursts, each one is decimated on its own
+	typedef typename StoreType<ET>::base_type type;
+	enum { is_vector = 1, base_enum = StoreType<ET>::base_enum };
+};
+
+template<signals::EType ET>
+class CCicDecimator : public CThreadBlockBase
+{
+public:
+	CCicDecimator(signals::IBlockDriver* driver);
+	virtual ~CCicDecimator();
+
+private:
+	CCicDecimator(const CCicDecimator& other);
+	CCicDecimator& operator=(const CCicDecimator& other);
+
+public: // IBlock implementation
+	virtual const char* Name()				{ return NAME; }
+	virtual unsigned Incoming(signals::IInEndpoint** ep, unsigned availEP) { return singleIncoming(&m_incoming, ep, availEP); }
+	virtual unsigned Outgoing(signals::IOutEndpoint** ep, unsigned availEP) { return singleOutgoing(&m_outgoing, ep, availEP); }
+
+public:
+	struct
+	{
+		CAttributeBase* order;
+		CAttributeBase* decim;
+		CAttributeBase* compTaps;
+		CAttributeBase* passband;
+	} attrs;
+
+	void setOrder(const long& order);
+	void setDecim(const long& decim);
+	void setCompTaps(const long& taps);
+	void setPassband(const float& passband);
+
+private:
+	enum
+	{
+		IN_BUFFER_TIMEOUT = 1000,
+		OUT_BUFFER_TIMEOUT = 1000,
+		IN_BLOCK_SIZE = 4096,
+		DEFAULT_ORDER = 4,
+		DEFAULT_DECIM = 16,
+		DEFAULT_COMP_TAPS = 21,
+		is_vector = CicSample<ET>::is_vector,
+		CHANNELS = sizeof(typename CicSample<ET>::type) / sizeof(float)
+	};
+
+	typedef typename CicSample<ET>::type sample_type;
+	typedef Vector<(signals::EType)CicSample<ET>::base_enum> VectorType;
+	static const char* NAME;
+
+	// the order and decimation are checked against each other, bit growth past the integrators' state is refused
+	// rather than quietly decimating by less than was asked for
+	class CAttr_order : public CAttr_callback<signals::etypLong,CCicDecimator>
+	{
+	private:
+		typedef CAttr_callback<signals::etypLong,CCicDecimator> base;
+	public:
+		inline CAttr_order(CCicDecimator& parent)
+			:base(parent, "order", "Number of integrator and comb stages", &CCicDecimator::setOrder, DEFAULT_ORDER) { }
+
+		virtual bool isValidValue(const long& newVal) const
+		{
+			return newVal >= 1 && newVal <= CCicFilter::MAX_ORDER && this->m_parent.m_decim <= (long)CCicFilter::maxDecim(newVal);
+		}
+	};
+
+	class CAttr_decim : public CAttr_callback<signals::etypLong,CCicDecimator>
+	{
+	private:
+		typedef CAttr_callback<signals::etypLong,CCicDecimator> base;
+	public:
+		inline CAttr_decim(CCicDecimator& parent)
+			:base(parent, "decimate", "Downsampling factor, no more than the bit growth of the chosen order allows",
+				&CCicDecimator::setDecim, DEFAULT_DECIM) { }
+
+		virtual bool isValidValue(const long& newVal) const
+		{
+			return newVal >= 1 && newVal <= (long)CCicFilter::maxDecim(this->m_parent.m_order);
+		}
+	};
+
+public:
+	class COutgoing : public CSimpleCascadeOutgoingChild<ET>
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline COutgoing(CCicDecimator* parent):CSimpleCascadeOutgoingChild(parent->m_incoming),m_parent(parent) { }
+		void buildAttrs(const CCicDecimator& parent);
+
+	protected:
+		CCicDecimator* m_parent;
+
+	public:
+		struct
+		{
+			CEventAttribute* sync_fault;
+		} attrs;
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		COutgoing(const COutgoing& other);
+		COutgoing& operator=(const COutgoing& other);
+
+	public: // COutEndpointBase interface
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+	};
+
+	class CIncoming : public CSimpleCascadeIncomingChild
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline CIncoming(CCicDecimator* parent):CSimpleCascadeIncomingChild(ET, parent, parent->m_outgoing) { }
+		virtual const char* EPName()	{ return EP_NAME; }
+		virtual const char* EPDescr()	{ return EP_DESCR; }
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		CIncoming(const CIncoming& other);
+		CIncoming& operator=(const CIncoming& other);
+	};
+
+private:
+	CIncoming m_incoming;
+	COutgoing m_outgoing;
+	CCicFilter m_engine;
+
+	volatile long m_order;
+	volatile long m_decim;
+	volatile long m_compTaps;
+	volatile float m_passband;
+	volatile long m_redesign;
+
+	void buildAttrs();
+	void runStream();
+	void runFrames();
+
+protected:
+	virtual void thread_run();
+};
+
+template<signals::EType ET>
+class CCicDecimatorDriver : public signals::IBlockDriver
+{
+public:
+	inline CCicDecimatorDriver() {}
+	virtual ~CCicDecimatorDriver() {}
+
+private:
+	CCicDecimatorDriver(const CCicDecimatorDriver& other);
+	CCicDecimatorDriver operator=(const CCicDecimatorDriver& other);
+
+public:
+	virtual const char* Name()			{ return NAME; }
+	virtual const char* Description()	{ return DESCR; }
+	virtual BOOL canCreate()			{ return true; }
+	virtual BOOL canDiscover()			{ return false; }
+	virtual unsigned Discover(signals::IBlock** blocks, unsigned availBlocks) { return 0; }
+	virtual signals::IBlock* Create();
+	const unsigned char* Fingerprint()	{ return FINGERPRINT; }
+
+protected:
+	static const char* NAME;
+	static const char* DESCR;
+	static const unsigned char FINGERPRINT[];
+};
+
+// ------------------------------------------------------------------------------------------------
+
+template<signals::EType ET>
+const char* CCicDecimatorDriver<ET>::NAME = "cic";
+
+template<signals::EType ET>
+const char* CCicDecimatorDriver<ET>::DESCR = "Decimate a stream or a burst with an integer CIC filter";
+
+template<signals::EType ET>
+const unsigned char CCicDecimatorDriver<ET>::FINGERPRINT[] = { 1, (unsigned char)ET, 1, (unsigned char)ET };
+
+template<signals::EType ET>
+const char* CCicDecimator<ET>::NAME = "CIC decimator";
+
+template<signals::EType ET>
+const char* CCicDecimator<ET>::CIncoming::EP_NAME = "in";
+
+template<signals::EType ET>
+const char* CCicDecimator<ET>::CIncoming::EP_DESCR = "CIC decimator incoming endpoint";
+
+template<signals::EType ET>
+const char* CCicDecimator<ET>::COutgoing::EP_NAME = "out";
+
+template<signals::EType ET>
+const char* CCicDecimator<ET>::COutgoing::EP_DESCR = "CIC decimator outgoing endpoint";
+
+// ------------------------------------------------------------------ class CCicDecimatorDriver
+
+template<signals::EType ET>
+signals::IBlock * CCicDecimatorDriver<ET>::Create()
+{
+	signals::IBlock* blk = new CCicDecimator<ET>(this);
+	blk->AddRef();
+	return blk;
+}
+
+// ------------------------------------------------------------------ class CCicDecimator
+
+#pragma warning(push)
+#pragma warning(disable: 4355)
+template<signals::EType ET>
+CCicDecimator<ET>::CCicDecimator(signals::IBlockDriver* driver)
+	:CThreadBlockBase(driver),m_incoming(this),m_outgoing(this),m_engine(CHANNELS),m_order(DEFAULT_ORDER),
+	 m_decim(DEFAULT_DECIM),m_compTaps(DEFAULT_COMP_TAPS),m_passband(0.8f),m_redesign(1)
+{
+	buildAttrs();
+	startThread();
+}
+#pragma warning(pop)
+
+template<signals::EType ET>
+CCicDecimator<ET>::~CCicDecimator()
+{
+	stopThread();
+}
+
+template<signals::EType ET>
+void CCicDecimator<ET>::buildAttrs()
+{
+	attrs.order = addLocalAttr(true, new CAttr_order(*this));
+	attrs.decim = addLocalAttr(true, new CAttr_decim(*this));
+	attrs.compTaps = addLocalAttr(true, new CAttr_callback<signals::etypLong,CCicDecimator>
+		(*this, "compTaps", "Length of the droop-compensating FIR, zero to disable it", &CCicDecimator::setCompTaps, DEFAULT_COMP_TAPS));
+	attrs.passband = addLocalAttr(true, new CAttr_callback<signals::etypSingle,CCicDecimator>
+		(*this, "passband", "Fraction of the output bandwidth the compensating FIR flattens", &CCicDecimator::setPassband, 0.8f));
+	m_outgoing.buildAttrs(*this);
+}
+
+template<signals::EType ET>
+void CCicDecimator<ET>::setOrder(const long& order)
+{
+	InterlockedExchange(&m_order, order < 1 ? 1 : order > CCicFilter::MAX_ORDER ? CCicFilter::MAX_ORDER : order);
+	InterlockedExchange(&m_redesign, 1);
+}
+
+template<signals::EType ET>
+void CCicDecimator<ET>::setDecim(const long& decim)
+{
+	InterlockedExchange(&m_decim, decim < 1 ? 1 : decim);
+	InterlockedExchange(&m_redesign, 1);
+}
+
+template<signals::EType ET>
+void CCicDecimator<ET>::setCompTaps(const long& taps)
+{
+	InterlockedExchange(&m_compTaps, taps < 0 ? 0 : taps);
+	InterlockedExchange(&m_redesign, 1);
+}
+
+template<signals::EType ET>
+void CCicDecimator<ET>::setPassband(const float& passband)
+{
+	m_passband = passband < 0.1f ? 0.1f : passband > 0.95f ? 0.95f : passband;
+	InterlockedExchange(&m_redesign, 1);
+}
+
+template<signals::EType ET>
+void CCicDecimator<ET>::COutgoing::buildAttrs(const CCicDecimator& parent)
+{
+	attrs.sync_fault = addLocalAttr(true, new CEventAttribute("syncFault", "Fires when a sync fault happens in a receive stream"));
+}
+
+template<signals::EType ET>
+void CCicDecimator<ET>::thread_run()
+{
+	ThreadBase::SetThreadName("CIC Decimator Thread");
+	if(is_vector)
+	{
+		runFrames();
+	}
+	else
+	{
+		runStream();
+	}
+}
+
+template<signals::EType ET>
+void CCicDecimator<ET>::runStream()
+{
+	std::vector<sample_type> inBuffer(IN_BLOCK_SIZE);
+	std::vector<sample_type> outBuffer;
+	while(threadRunning())
+	{
+		if(InterlockedExchange(&m_redesign, 0))
+		{
+			m_engine.design(m_order, m_decim, m_compTaps, m_passband);
+			outBuffer.resize(m_engine.maxOutput(IN_BLOCK_SIZE));
+		}
+
+		unsigned recvCount = m_incoming.Read(ET, inBuffer.data(), IN_BLOCK_SIZE, FALSE, IN_BUFFER_TIMEOUT);
+		if(!recvCount) continue;
+
+		unsigned outCount = m_engine.process((const float*)inBuffer.data(), recvCount, (float*)outBuffer.data());
+		if(outCount && m_outgoing.isConnected())
+		{
+			unsigned sentCount = m_outgoing.Write(ET, outBuffer.data(), outCount, OUT_BUFFER_TIMEOUT);
+			if(sentCount < outCount) m_outgoing.attrs.sync_fault->fire();
+		}
+	}
+}
+
+template<signals::EType ET>
+void CCicDecimator<ET>::runFrames()
+{
+	while(threadRunning())
+	{
+		signals::IVector* inVector = NULL;
+		BOOL recvFrame = m_incoming.ReadOne(ET, &inVector, IN_BUFFER_TIMEOUT);
+		if(!recvFrame) continue;
+
+		if(InterlockedExchange(&m_redesign, 0))
+		{
+			m_engine.design(m_order, m_decim, m_compTaps, m_passband);
+		}
+		m_engine.reset();
+
+		unsigned inCount = inVector->Size();
+		unsigned outCount = m_engine.maxOutput(inCount);
+		if(!outCount)
+		{
+			inVector->Release();
+			continue;
+		}
+
+		VectorType* outVector = VectorType::retrieve(outCount);
+		m_engine.process((const float*)inVector->Data(), inCount, (float*)outVector->data);
+		inVector->Release();
+
+		BOOL outFrame = m_outgoing.WriteOne(ET, &outVector, INFINITE);
+		if(!outFrame)
+		{
+			if(m_outgoing.isConnected()) m_outgoing.attrs.sync_fault->fire();
+			outVector->Release();
+		}
+	}
+}
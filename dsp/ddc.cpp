@@ -0,0 +1,359 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#include "stdafx.h"
+#include "ddc.h"
+#include <xmmintrin.h>
+
+static const double PI = std::atan(1.0)*4;
+
+const char* CDownConverter::NAME = "Digital down-converter";
+const char* CDownConverter::CIncoming::EP_NAME = "in";
+const char* CDownConverter::CIncoming::EP_DESCR = "Down-converter incoming endpoint";
+const char* CDownConverter::COutgoing::EP_NAME = "out";
+const char* CDownConverter::COutgoing::EP_DESCR = "Down-converter outgoing endpoint";
+
+const char* CDownConverterDriver::NAME = "ddc";
+const char* CDownConverterDriver::DESCR = "Tune and decimate a channel out of a wider stream";
+const unsigned char CDownConverterDriver::FINGERPRINT[] = { 1, (unsigned char)signals::etypComplex, 1, (unsigned char)signals::etypComplex };
+
+// ------------------------------------------------------------------ class CNco
+
+CNco::CNco():m_freq(0.0),m_step(1.0, 0.0)
+{
+	for(unsigned lane = 0; lane < LANES; lane++)
+	{
+		m_phasor[lane] = m_rotate[lane] = TComplexDbl(1.0, 0.0);
+	}
+}
+
+void CNco::setFrequency(double cyclesPerSample)
+{
+	if(cyclesPerSample == m_freq) return;
+	m_freq = cyclesPerSample;
+
+	// keep the phase of the next sample, only the rate of rotation changes
+	const TComplexDbl next = m_phasor[0];
+	for(unsigned lane = 0; lane < LANES; lane++)
+	{
+		m_rotate[lane] = std::polar(1.0, -2.0 * PI * cyclesPerSample * lane);
+		m_phasor[lane] = next * m_rotate[lane];
+	}
+	m_step = std::polar(1.0, -2.0 * PI * cyclesPerSample * LANES);
+}
+
+void CNco::mix(TComplex* data, unsigned count)
+{
+	if(!count) return;
+	if(m_osc.size() < count + LANES) m_osc.resize(count + LANES);
+
+	// the lanes are independent recursions, so this loop isn't bound by the multiply latency
+	TComplex* osc = m_osc.data();
+	TComplexDbl next;
+	for(unsigned base = 0; base <= count; base += LANES)
+	{
+		if(base + LANES > count) next = m_phasor[count - base];
+		for(unsigned lane = 0; lane < LANES; lane++)
+		{
+			osc[base + lane] = TComplex(m_phasor[lane]);
+			m_phasor[lane] *= m_step;
+		}
+	}
+
+	// restart the lanes from the sample after this block, renormalizing away accumulated rounding
+	next /= std::abs(next);
+	for(unsigned lane = 0; lane < LANES; lane++)
+	{
+		m_phasor[lane] = next * m_rotate[lane];
+	}
+
+	// complex multiply, two samples per vector
+	static const __m128 SIGN = _mm_set_ps(0.0f, -0.0f, 0.0f, -0.0f);
+	float* dataF = (float*)data;
+	const float* oscF = (const float*)osc;
+	unsigned idx = 0;
+	for(; idx + 2 <= count; idx += 2)
+	{
+		__m128 a = _mm_loadu_ps(dataF + idx * 2);
+		__m128 b = _mm_loadu_ps(oscF + idx * 2);
+		__m128 bRe = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0));
+		__m128 bIm = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1));
+		__m128 aSwap = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 prod = _mm_add_ps(_mm_mul_ps(a, bRe), _mm_xor_ps(_mm_mul_ps(aSwap, bIm), SIGN));
+		_mm_storeu_ps(dataF + idx * 2, prod);
+	}
+	if(idx < count)
+	{
+		data[idx] *= osc[idx];
+	}
+}
+
+// ------------------------------------------------------------------ class CHalfbandDecimator
+
+CHalfbandDecimator::CHalfbandDecimator(double transition)
+{
+	// Kaiser-windowed sinc at a quarter of the input rate, every even offset from the center is zero
+	const double beta = 0.1102 * (ATTENUATION_DB - 8.7);
+	const unsigned estTaps = (unsigned)std::ceil((ATTENUATION_DB - 8) / (2.285 * 2 * PI * transition)) + 1;
+	const unsigned numFold = max(1u, min((estTaps + 1 + 3) / 4, (unsigned)MAX_FOLDED_TAPS));
+	m_numTaps = 4 * numFold - 1;
+	m_fold.resize(numFold);
+
+	double foldSum = 0.0;
+	const double norm = CPolyphaseResampler::besselI0(beta);
+	const double halfLen = (m_numTaps - 1) / 2.0;
+	for(unsigned j = 0; j < numFold; j++)
+	{
+		const double t = 2.0 * j + 1.0;
+		const double x = t / halfLen;
+		const double window = CPolyphaseResampler::besselI0(beta * std::sqrt(max(0.0, 1.0 - x * x)));
+		const double coeff = std::sin(PI * t / 2.0) / (PI * t) * window / norm;
+		m_fold[j] = (float)coeff;
+		foldSum += coeff;
+	}
+
+	// unity gain at DC: 0.5 + 2 * sum(fold) == 1
+	for(unsigned j = 0; j < numFold; j++)
+	{
+		m_fold[j] = float(m_fold[j] * (0.25 / foldSum));
+	}
+
+	m_histLen = m_numTaps - 1;
+	m_hist.assign(m_histLen, TComplex(0.0f, 0.0f));
+}
+
+unsigned CHalfbandDecimator::process(const TComplex* in, unsigned count, TComplex* out)
+{
+	// input is copied into the history first, so "out" may alias "in"
+	const unsigned avail = m_histLen + count;
+	if(m_hist.size() < avail) m_hist.resize(avail);
+	TComplex* hist = m_hist.data();
+	memcpy(hist + m_histLen, in, count * sizeof(TComplex));
+
+	const unsigned numFold = (unsigned)m_fold.size();
+	const unsigned center = (m_numTaps - 1) / 2;
+	const float* fold = m_fold.data();
+	unsigned pos = m_numTaps - 1;
+	unsigned outCount = 0;
+	for(; pos < avail; pos += 2)
+	{
+		const TComplex* mid = hist + pos - center;
+		float accRe = 0.5f * mid[0].real();
+		float accIm = 0.5f * mid[0].imag();
+		for(unsigned j = 0; j < numFold; j++)
+		{
+			const unsigned off = 2 * j + 1;
+			accRe += fold[j] * (mid[off].real() + mid[-(int)off].real());
+			accIm += fold[j] * (mid[off].imag() + mid[-(int)off].imag());
+		}
+		out[outCount++] = TComplex(accRe, accIm);
+	}
+
+	const unsigned base = pos + 1 - m_numTaps;
+	m_histLen = avail - base;
+	memmove(hist, hist + base, m_histLen * sizeof(TComplex));
+	return outCount;
+}
+
+// ------------------------------------------------------------------ class CDownConverter
+
+#pragma warning(push)
+#pragma warning(disable: 4355)
+CDownConverter::CDownConverter(signals::IBlockDriver* driver)
+	:CThreadBlockBase(driver),m_incoming(this),m_outgoing(this),m_inRate(0),m_offset(0),m_decim(1),m_passband(0.8f),
+	 m_rebuild(1),m_final(2)
+{
+	buildAttrs();
+	startThread();
+}
+#pragma warning(pop)
+
+CDownConverter::~CDownConverter()
+{
+	stopThread();
+	clearChain();
+}
+
+void CDownConverter::buildAttrs()
+{
+	m_outgoing.buildAttrs(*this);
+	attrs.offset = addLocalAttr(true, new CAttr_callback<signals::etypLong,CDownConverter>
+		(*this, "offset", "Frequency (Hz relative to the incoming stream) moved to the center of the output", &CDownConverter::setOffset, 0));
+	attrs.decim = addLocalAttr(true, new CAttr_callback<signals::etypLong,CDownConverter>
+		(*this, "decimate", "Downsampling factor", &CDownConverter::setDecim, 1));
+	attrs.passband = addLocalAttr(true, new CAttr_callback<signals::etypSingle,CDownConverter>
+		(*this, "passband", "Fraction of the output bandwidth passed without attenuation", &CDownConverter::setPassband, 0.8f));
+}
+
+void CDownConverter::COutgoing::buildAttrs(const CDownConverter& parent)
+{
+	attrs.sync_fault = addLocalAttr(true, new CEventAttribute("syncFault", "Fires when a sync fault happens in a receive stream"));
+	attrs.rate = addLocalAttr(true, new CAttr_outRate());
+}
+
+void CDownConverter::setOffset(const long& offset)
+{
+	InterlockedExchange(&m_offset, offset);
+}
+
+void CDownConverter::setDecim(const long& decim)
+{
+	InterlockedExchange(&m_decim, decim < 1 ? 1 : decim);
+	InterlockedExchange(&m_rebuild, 1);
+	updateOutputRate();
+}
+
+void CDownConverter::setPassband(const float& passband)
+{
+	m_passband = passband < 0.1f ? 0.1f : passband > 0.98f ? 0.98f : passband;
+	InterlockedExchange(&m_rebuild, 1);
+}
+
+void CDownConverter::setInputRate(long rate)
+{
+	InterlockedExchange(&m_inRate, rate);
+	updateOutputRate();
+}
+
+void CDownConverter::updateOutputRate()
+{
+	m_outgoing.attrs.rate->update(m_inRate / m_decim);
+}
+
+void CDownConverter::clearChain()
+{
+	for(TStageList::iterator trans = m_stages.begin(); trans != m_stages.end(); trans++)
+	{
+		delete *trans;
+	}
+	m_stages.clear();
+}
+
+void CDownConverter::rebuildChain()
+{
+	const unsigned decim = m_decim;
+	const double passband = m_passband;
+	clearChain();
+
+	// half-band stages take out the factors of two, the polyphase filter the rest and sets the final shape
+	unsigned remain = decim;
+	unsigned numHalves = 0;
+	while(!(remain & 1))
+	{
+		remain >>= 1;
+		numHalves++;
+	}
+	for(unsigned stage = 0; stage < numHalves; stage++)
+	{
+		// this stage need only keep aliases out of the final passband
+		const double edge = passband * (1u << stage) / (2.0 * decim);
+		m_stages.push_back(new CHalfbandDecimator(0.5 - 2.0 * edge));
+	}
+	m_final.design(1, remain, (float)passband);
+}
+
+void CDownConverter::thread_run()
+{
+	ThreadBase::SetThreadName("Down-converter Thread");
+
+	std::vector<TComplex> buffer(IN_BLOCK_SIZE);
+	while(threadRunning())
+	{
+		if(InterlockedExchange(&m_rebuild, 0)) rebuildChain();
+
+		unsigned count = m_incoming.Read(signals::etypComplex, buffer.data(), IN_BLOCK_SIZE, FALSE, IN_BUFFER_TIMEOUT);
+		if(!count) continue;
+
+		// retuning takes effect at the start of the next block read
+		const long inRate = m_inRate;
+		m_nco.setFrequency(inRate ? double(m_offset) / inRate : 0.0);
+		m_nco.mix(buffer.data(), count);
+
+		for(TStageList::const_iterator trans = m_stages.begin(); trans != m_stages.end() && count; trans++)
+		{
+			count = (*trans)->process(buffer.data(), count, buffer.data());
+		}
+		if(count) count = m_final.process((const float*)buffer.data(), count, (float*)buffer.data());
+
+		if(count && m_outgoing.isConnected())
+		{
+			unsigned sentCount = m_outgoing.Write(signals::etypComplex, buffer.data(), count, OUT_BUFFER_TIMEOUT);
+			if(sentCount < count) m_outgoing.attrs.sync_fault->fire();
+		}
+	}
+}
+
+// ------------------------------------------------------------------ class CDownConverter::CIncoming
+
+CDownConverter::CIncoming::~CIncoming()
+{
+	if(m_lastRateAttr)
+	{
+		m_lastRateAttr->Unobserve(this);
+		m_lastRateAttr = NULL;
+	}
+}
+
+void CDownConverter::CIncoming::OnConnection(signals::IEPRecvFrom *conn)
+{
+	if(m_lastRateAttr)
+	{
+		m_lastRateAttr->Unobserve(this);
+		m_lastRateAttr = NULL;
+	}
+	if(!conn) return;
+	signals::IAttributes* attrs = conn->OutputAttributes();
+	if(!attrs) return;
+	signals::IAttribute* attr = attrs->GetByName("rate");
+	if(attr && (attr->Type() == signals::etypLong || attr->Type() == signals::etypInt64))
+	{
+		m_lastRateAttr = attr;
+		m_lastRateAttr->Observe(this);
+		OnChanged(attr, attr->getValue());
+	}
+}
+
+void CDownConverter::CIncoming::OnChanged(signals::IAttribute* attr, const void* value)
+{
+	if(attr == m_lastRateAttr)
+	{
+		CDownConverter* base = static_cast<CDownConverter*>(m_parent);
+		if(attr->Type() == signals::etypLong)
+		{
+			base->setInputRate(*(long*)value);
+		} else {
+			base->setInputRate(long(*(__int64*)value));
+		}
+	}
+	else ASSERT(FALSE);
+}
+
+void CDownConverter::CIncoming::OnDetached(signals::IAttribute* attr)
+{
+	if(attr == m_lastRateAttr)
+	{
+		m_lastRateAttr = NULL;
+	}
+	else ASSERT(FALSE);
+}
+
+// ------------------------------------------------------------------ class CDownConverterDriver
+
+signals::IBlock * CDownConverterDriver::Create()
+{
+	signals::IBlock* blk = new CDownConverter(this);
+	blk->AddRef();
+	return blk;
+}
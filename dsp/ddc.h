@@ -0,0 +1,200 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+#include <blockImpl.h>
+#include <vector>
+#include "resample.h"
+
+class CNco
+{	// recursive complex oscillator, the phase is continuous across calls and retunes
+public:
+	typedef std::complex<float> TComplex;
+	typedef std::complex<double> TComplexDbl;
+
+	CNco();
+	void setFrequency(double cyclesPerSample);
+	inline double frequency() const		{ return m_freq; }
+	void mix(TComplex* data, unsigned count);
+
+private:
+	enum { LANES = 4 };
+
+	double m_freq;
+	TComplexDbl m_phasor[LANES];	// oscillator value for each of the next LANES samples
+	TComplexDbl m_rotate[LANES];	// single-sample step raised to 0..LANES-1
+	TComplexDbl m_step;				// rotation applied to each lane per LANES samples
+	std::vector<TComplex> m_osc;
+};
+
+class CHalfbandDecimator
+{	// decimate-by-two FIR exploiting the zero taps and symmetry of a half-band response
+public:
+	typedef std::complex<float> TComplex;
+
+	CHalfbandDecimator(double transition);
+	unsigned process(const TComplex* in, unsigned count, TComplex* out);
+	inline unsigned numTaps() const		{ return m_numTaps; }
+
+private:
+	enum { ATTENUATION_DB = 80, MAX_FOLDED_TAPS = 64 };
+
+	unsigned m_numTaps;				// 4 * m_fold.size() - 1
+	std::vector<float> m_fold;		// coefficients at odd offsets 1, 3, 5... from the center
+	std::vector<TComplex> m_hist;	// numTaps-1 samples of history followed by unconsumed input
+	unsigned m_histLen;
+};
+
+class CDownConverter : public CThreadBlockBase
+{
+public:
+	CDownConverter(signals::IBlockDriver* driver);
+	virtual ~CDownConverter();
+
+private:
+	CDownConverter(const CDownConverter& other);
+	CDownConverter& operator=(const CDownConverter& other);
+
+public: // IBlock implementation
+	virtual const char* Name()				{ return NAME; }
+	virtual unsigned Incoming(signals::IInEndpoint** ep, unsigned availEP) { return singleIncoming(&m_incoming, ep, availEP); }
+	virtual unsigned Outgoing(signals::IOutEndpoint** ep, unsigned availEP) { return singleOutgoing(&m_outgoing, ep, availEP); }
+
+public:
+	struct
+	{
+		CAttributeBase* offset;
+		CAttributeBase* decim;
+		CAttributeBase* passband;
+	} attrs;
+
+	void setOffset(const long& offset);
+	void setDecim(const long& decim);
+	void setPassband(const float& passband);
+
+private:
+	enum
+	{
+		IN_BUFFER_TIMEOUT = 1000,
+		OUT_BUFFER_TIMEOUT = 1000,
+		IN_BLOCK_SIZE = 1024,
+	};
+
+	typedef std::complex<float> TComplex;
+	typedef std::vector<CHalfbandDecimator*> TStageList;
+	static const char* NAME;
+
+	class CAttr_outRate : public CROAttribute<signals::etypLong>
+	{
+	public:
+		inline CAttr_outRate():CROAttribute<signals::etypLong>("rate", "Data rate", 0) { }
+		inline void update(long newVal) { privateSetValue(newVal); }
+	};
+
+public:
+	class COutgoing : public CSimpleCascadeOutgoingChild<signals::etypComplex>
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline COutgoing(CDownConverter* parent):CSimpleCascadeOutgoingChild(parent->m_incoming),m_parent(parent) { }
+		void buildAttrs(const CDownConverter& parent);
+
+	protected:
+		CDownConverter* m_parent;
+
+	public:
+		struct
+		{
+			CEventAttribute* sync_fault;
+			CAttr_outRate* rate;
+		} attrs;
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		COutgoing(const COutgoing& other);
+		COutgoing& operator=(const COutgoing& other);
+
+	public: // COutEndpointBase interface
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+	};
+
+	class CIncoming : public CSimpleCascadeIncomingChild, public signals::IAttributeObserver
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline CIncoming(CDownConverter* parent)
+			:CSimpleCascadeIncomingChild(signals::etypComplex, parent, parent->m_outgoing),m_lastRateAttr(NULL) { }
+		virtual ~CIncoming();
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+		virtual void OnChanged(signals::IAttribute* attr, const void* value);
+		virtual void OnDetached(signals::IAttribute* attr);
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		signals::IAttribute* m_lastRateAttr;
+
+		CIncoming(const CIncoming& other);
+		CIncoming& operator=(const CIncoming& other);
+		virtual void OnConnection(signals::IEPRecvFrom* recv);
+	};
+
+private:
+	CIncoming m_incoming;
+	COutgoing m_outgoing;
+
+	volatile long m_inRate;
+	volatile long m_offset;
+	volatile long m_decim;
+	volatile float m_passband;
+	volatile long m_rebuild;
+
+	CNco m_nco;
+	TStageList m_stages;
+	CPolyphaseResampler m_final;
+
+	void buildAttrs();
+	void setInputRate(long rate);
+	void updateOutputRate();
+	void rebuildChain();
+	void clearChain();
+	virtual void thread_run();
+};
+
+class CDownConverterDriver : public signals::IBlockDriver
+{
+public:
+	inline CDownConverterDriver() {}
+	virtual ~CDownConverterDriver() {}
+
+private:
+	CDownConverterDriver(const CDownConverterDriver& other);
+	CDownConverterDriver operator=(const CDownConverterDriver& other);
+
+public:
+	virtual const char* Name()			{ return NAME; }
+	virtual const char* Description()	{ return DESCR; }
+	virtual BOOL canCreate()			{ return true; }
+	virtual BOOL canDiscover()			{ return false; }
+	virtual unsigned Discover(signals::IBlock** blocks, unsigned availBlocks) { return 0; }
+	virtual signals::IBlock* Create();
+	const unsigned char* Fingerprint()	{ return FINGERPRINT; }
+
+protected:
+	static const char* NAME;
+	static const char* DESCR;
+	static const unsigned char FINGERPRINT[];
+};
@@ -0,0 +1,238 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#include "stdafx.h"
+#include "demod.h"
+#include <xmmintrin.h>
+
+static const double PI = std::atan(1.0)*4;
+
+// ------------------------------------------------------------------ class CAudioDemodulator
+
+CAudioDemodulator::CAudioDemodulator()
+	:m_mode(MODE_AM),m_decimator(2),m_dcAlpha(0.0f),m_dcLevel(0.0f),m_fmScale(1.0f),m_sbTaps(0),m_sbStride(0)
+{
+	m_re.assign(1, 0.0f);
+	m_im.assign(1, 0.0f);
+}
+
+void CAudioDemodulator::configure(EMode mode, long inRate, unsigned decim, float deviation, float lowCut, float highCut)
+{
+	// without a rate from upstream assume the usual audio rate
+	static const double DEFAULT_AUDIO_RATE = 48000.0;
+	if(decim < 1) decim = 1;
+	const double outRate = inRate > 0 ? double(inRate) / decim : DEFAULT_AUDIO_RATE;
+
+	m_mode = mode;
+	m_decimator.design(1, decim, 0.8f);
+
+	m_dcAlpha = (float)(1.0 - std::exp(-2.0 * PI * DC_CORNER_HZ / outRate));
+	m_dcLevel = 0.0f;
+
+	m_fmScale = (float)(outRate / (2.0 * PI * deviation));
+	m_re.assign(1, 0.0f);
+	m_im.assign(1, 0.0f);
+
+	// Weaver: move the center of the sideband to zero, low-pass to half its width, then move it up to the center of the audio band
+	if(highCut < lowCut + 1.0f) highCut = lowCut + 1.0f;
+	const double center = (lowCut + highCut) / 2.0;
+	const double sign = mode == MODE_LSB ? -1.0 : 1.0;
+	m_shiftDown = CNco();
+	m_shiftUp = CNco();
+	m_shiftDown.setFrequency(sign * center / outRate);
+	m_shiftUp.setFrequency(-sign * center / outRate);
+
+	// the transition band ends where the opposite sideband starts to fold in
+	const double cutoff = (highCut - lowCut) / 2.0 / outRate;
+	const double transition = max((double)lowCut, 50.0) / outRate;
+	const double beta = 0.1102 * (ATTENUATION_DB - 8.7);
+	unsigned numTaps = (unsigned)std::ceil((ATTENUATION_DB - 8) / (2.285 * 2 * PI * transition)) + 1;
+	numTaps = min(numTaps | 1, (unsigned)MAX_SIDEBAND_TAPS);
+	m_sbTaps = numTaps;
+	m_sbStride = (numTaps * 2 + 3) & ~3;
+	m_sbFilter.assign(m_sbStride, 0.0f);
+
+	const double edge = cutoff + transition / 2.0;
+	const double mid = (numTaps - 1) / 2.0;
+	const double norm = CPolyphaseResampler::besselI0(beta);
+	for(unsigned n = 0; n < numTaps; n++)
+	{
+		const double t = n - mid;
+		const double x = numTaps > 1 ? 2.0 * t / (numTaps - 1) : 0.0;
+		const double window = CPolyphaseResampler::besselI0(beta * std::sqrt(max(0.0, 1.0 - x * x))) / norm;
+		const double sinc = t == 0.0 ? 2.0 * edge : std::sin(2.0 * PI * edge * t) / (PI * t);
+		m_sbFilter[n * 2] = m_sbFilter[n * 2 + 1] = (float)(sinc * window);
+	}
+	m_sbHist.assign((numTaps - 1) * 2, 0.0f);
+}
+
+unsigned CAudioDemodulator::process(TComplex* iq, unsigned count, float* audio)
+{
+	count = m_decimator.process((const float*)iq, count, (float*)iq);
+	if(!count) return 0;
+
+	switch(m_mode)
+	{
+	case MODE_AM:
+		demodAM(iq, count, audio);
+		break;
+	case MODE_FM:
+		demodFM(iq, count, audio);
+		break;
+	default:
+		demodSSB(iq, count, audio);
+		break;
+	}
+	return count;
+}
+
+void CAudioDemodulator::demodAM(const TComplex* iq, unsigned count, float* audio)
+{
+	// envelope, four samples per vector
+	const float* src = (const float*)iq;
+	unsigned idx = 0;
+	for(; idx + 4 <= count; idx += 4)
+	{
+		__m128 a = _mm_loadu_ps(src + idx * 2);
+		__m128 b = _mm_loadu_ps(src + idx * 2 + 4);
+		__m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(audio + idx, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im))));
+	}
+	for(; idx < count; idx++)
+	{
+		audio[idx] = std::abs(iq[idx]);
+	}
+
+	// remove the carrier level
+	float level = m_dcLevel;
+	const float alpha = m_dcAlpha;
+	for(idx = 0; idx < count; idx++)
+	{
+		level += alpha * (audio[idx] - level);
+		audio[idx] -= level;
+	}
+	m_dcLevel = level;
+}
+
+void CAudioDemodulator::demodFM(const TComplex* iq, unsigned count, float* audio)
+{
+	// split into planar arrays behind the last sample of the previous block
+	m_re.resize(count + 1);
+	m_im.resize(count + 1);
+	float* re = m_re.data();
+	float* im = m_im.data();
+	for(unsigned idx = 0; idx < count; idx++)
+	{
+		re[idx + 1] = iq[idx].real();
+		im[idx + 1] = iq[idx].imag();
+	}
+
+	// polar discriminator: the angle of x[n] * conj(x[n-1]) through a rational arctangent, good to about
+	// 0.005 radians for angles up to pi/4.  Larger phase steps are folded into that range (cross and dot
+	// swapped past pi/4, reflected about pi/2 when dot turns negative) so wide deviation doesn't fold over
+	static const float ATAN_K = 0.28125f;
+	static const float TINY = 1e-20f;
+	const __m128 k = _mm_set1_ps(ATAN_K);
+	const __m128 tiny = _mm_set1_ps(TINY);
+	const __m128 halfPi = _mm_set1_ps(float(PI / 2));
+	const __m128 pi = _mm_set1_ps(float(PI));
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 scale = _mm_set1_ps(m_fmScale);
+	unsigned idx = 0;
+	for(; idx + 4 <= count; idx += 4)
+	{
+		__m128 prevRe = _mm_loadu_ps(re + idx);
+		__m128 prevIm = _mm_loadu_ps(im + idx);
+		__m128 curRe = _mm_loadu_ps(re + idx + 1);
+		__m128 curIm = _mm_loadu_ps(im + idx + 1);
+		__m128 cross = _mm_sub_ps(_mm_mul_ps(curIm, prevRe), _mm_mul_ps(curRe, prevIm));
+		__m128 dot = _mm_add_ps(_mm_mul_ps(curRe, prevRe), _mm_mul_ps(curIm, prevIm));
+
+		// the first octant angle of |cross|, |dot|
+		__m128 absCross = _mm_andnot_ps(signMask, cross);
+		__m128 absDot = _mm_andnot_ps(signMask, dot);
+		__m128 big = _mm_max_ps(absCross, absDot);
+		__m128 small = _mm_min_ps(absCross, absDot);
+		__m128 den = _mm_add_ps(_mm_add_ps(_mm_mul_ps(big, big), _mm_mul_ps(k, _mm_mul_ps(small, small))), tiny);
+		__m128 angle = _mm_div_ps(_mm_mul_ps(absCross, absDot), den);
+
+		// then out to the quadrant and sign they came from
+		__m128 steep = _mm_cmpgt_ps(absCross, absDot);
+		angle = _mm_or_ps(_mm_and_ps(steep, _mm_sub_ps(halfPi, angle)), _mm_andnot_ps(steep, angle));
+		__m128 behind = _mm_cmplt_ps(dot, zero);
+		angle = _mm_or_ps(_mm_and_ps(behind, _mm_sub_ps(pi, angle)), _mm_andnot_ps(behind, angle));
+		angle = _mm_or_ps(angle, _mm_and_ps(signMask, cross));
+		_mm_storeu_ps(audio + idx, _mm_mul_ps(angle, scale));
+	}
+	for(; idx < count; idx++)
+	{
+		const float cross = im[idx + 1] * re[idx] - re[idx + 1] * im[idx];
+		const float dot = re[idx + 1] * re[idx] + im[idx + 1] * im[idx];
+		const float absCross = fabs(cross);
+		const float absDot = fabs(dot);
+		const float big = max(absCross, absDot);
+		const float small = min(absCross, absDot);
+		float angle = absCross * absDot / (big * big + ATAN_K * small * small + TINY);
+		if(absCross > absDot) angle = float(PI / 2) - angle;
+		if(dot < 0.0f) angle = float(PI) - angle;
+		audio[idx] = (cross < 0.0f ? -angle : angle) * m_fmScale;
+	}
+
+	re[0] = re[count];
+	im[0] = im[count];
+}
+
+void CAudioDemodulator::demodSSB(TComplex* iq, unsigned count, float* audio)
+{
+	m_shiftDown.mix(iq, count);
+
+	// low-pass the real and imaginary parts together, two lanes each
+	const unsigned histLen = (m_sbTaps - 1) * 2;
+	if(m_sbHist.size() < histLen + count * 2 + m_sbStride) m_sbHist.resize(histLen + count * 2 + m_sbStride);
+	float* hist = m_sbHist.data();
+	memcpy(hist + histLen, iq, count * sizeof(TComplex));
+	memset(hist + histLen + count * 2, 0, m_sbStride * sizeof(float));
+
+	const float* taps = m_sbFilter.data();
+	const unsigned stride = m_sbStride;
+	for(unsigned samp = 0; samp < count; samp++)
+	{
+		const float* src = hist + samp * 2;
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		unsigned idx = 0;
+		for(; idx + 8 <= stride; idx += 8)
+		{
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(taps + idx), _mm_loadu_ps(src + idx)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(taps + idx + 4), _mm_loadu_ps(src + idx + 4)));
+		}
+		if(idx < stride)
+		{
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(taps + idx), _mm_loadu_ps(src + idx)));
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+		iq[samp] = TComplex(lanes[0] + lanes[2], lanes[1] + lanes[3]);
+	}
+	memmove(hist, hist + count * 2, histLen * sizeof(float));
+
+	m_shiftUp.mix(iq, count);
+	for(unsigned samp = 0; samp < count; samp++)
+	{
+		audio[samp] = iq[samp].real();
+	}
+}
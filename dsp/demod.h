@@ -0,0 +1,475 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+#include <blockImpl.h>
+#include <vector>
+#include "resample.h"
+#include "ddc.h"
+
+class CAudioDemodulator
+{	// decimates complex IQ to the audio rate and recovers the audio of one AM, FM or SSB signal centered on zero
+public:
+	typedef std::complex<float> TComplex;
+
+	enum EMode
+	{
+		MODE_AM,
+		MODE_FM,
+		MODE_USB,
+		MODE_LSB,
+		NUM_MODES
+	};
+
+	CAudioDemodulator();
+
+	void configure(EMode mode, long inRate, unsigned decim, float deviation, float lowCut, float highCut);
+	inline unsigned maxOutput(unsigned inCount) const	{ return m_decimator.maxOutput(inCount); }
+	unsigned process(TComplex* iq, unsigned count, float* audio);	// iq is used as scratch space
+
+private:
+	CAudioDemodulator(const CAudioDemodulator& other);
+	CAudioDemodulator& operator=(const CAudioDemodulator& other);
+
+	enum { ATTENUATION_DB = 70, MAX_SIDEBAND_TAPS = 1023, DC_CORNER_HZ = 20 };
+
+	EMode m_mode;
+	CPolyphaseResampler m_decimator;
+
+	// AM
+	float m_dcAlpha;
+	float m_dcLevel;
+
+	// FM
+	float m_fmScale;					// audio-rate radians to output units
+	std::vector<float> m_re;			// previous sample followed by the deinterleaved block
+	std::vector<float> m_im;
+
+	// SSB, Weaver method
+	CNco m_shiftDown;
+	CNco m_shiftUp;
+	unsigned m_sbTaps;
+	unsigned m_sbStride;				// floats in m_sbFilter, padded to a multiple of 4
+	std::vector<float> m_sbFilter;		// low-pass taps, each duplicated for the real and imaginary lanes
+	std::vector<float> m_sbHist;		// sbTaps-1 samples of history followed by the current block
+
+	void demodAM(const TComplex* iq, unsigned count, float* audio);
+	void demodFM(const TComplex* iq, unsigned count, float* audio);
+	void demodSSB(TComplex* iq, unsigned count, float* audio);
+};
+
+template<signals::EType ET>
+class CDemodulator : public CThreadBlockBase
+{
+public:
+	CDemodulator(signals::IBlockDriver* driver);
+	virtual ~CDemodulator();
+
+private:
+	CDemodulator(const CDemodulator& other);
+	CDemodulator& operator=(const CDemodulator& other);
+
+public: // IBlock implementation
+	virtual const char* Name()				{ return NAME; }
+	virtual unsigned Incoming(signals::IInEndpoint** ep, unsigned availEP) { return singleIncoming(&m_incoming, ep, availEP); }
+	virtual unsigned Outgoing(signals::IOutEndpoint** ep, unsigned availEP) { return singleOutgoing(&m_outgoing, ep, availEP); }
+
+public:
+	void setMode(const long& mode);
+	void setDecim(const long& decim);
+	void setDeviation(const float& deviation);
+	void setLowCut(const float& freq);
+	void setHighCut(const float& freq);
+
+private:
+	enum
+	{
+		IN_BUFFER_TIMEOUT = 1000,
+		OUT_BUFFER_TIMEOUT = 1000,
+		IN_BLOCK_SIZE = 1024,
+		DEFAULT_DECIM = 8,
+		CHANNELS = sizeof(typename StoreType<ET>::type) / sizeof(float)
+	};
+
+	typedef std::complex<float> TComplex;
+	typedef typename StoreType<ET>::type store_type;
+	static const char* NAME;
+	static const char* MODE_NAMES[CAudioDemodulator::NUM_MODES];
+
+	class CAttr_mode : public CAttr_callback<signals::etypLong,CDemodulator>
+	{
+	private:
+		typedef CAttr_callback<signals::etypLong,CDemodulator> base;
+	public:
+		inline CAttr_mode(CDemodulator& parent)
+			:base(parent, "mode", "Demodulation mode", &CDemodulator::setMode, CAudioDemodulator::MODE_AM) { }
+
+		virtual unsigned options(const void* vals, const char** opts, unsigned availElem)
+		{
+			if((vals||opts) && availElem)
+			{
+				unsigned numCopy = min(availElem, (unsigned)CAudioDemodulator::NUM_MODES);
+				for(unsigned idx=0; idx < numCopy; idx++)
+				{
+					if(vals) ((long*)vals)[idx] = (long)idx;
+					if(opts) opts[idx] = MODE_NAMES[idx];
+				}
+			}
+			return CAudioDemodulator::NUM_MODES;
+		}
+
+		virtual bool isValidValue(const long& newVal) const
+		{
+			return newVal >= 0 && newVal < CAudioDemodulator::NUM_MODES;
+		}
+	};
+
+	class CAttr_outRate : public CROAttribute<signals::etypLong>
+	{
+	public:
+		inline CAttr_outRate():CROAttribute<signals::etypLong>("rate", "Data rate", 0) { }
+		inline void update(long newVal) { privateSetValue(newVal); }
+	};
+
+	struct
+	{
+		CAttr_mode* mode;
+		CAttributeBase* decim;
+		CAttributeBase* deviation;
+		CAttributeBase* lowCut;
+		CAttributeBase* highCut;
+	} attrs;
+
+public:
+	class COutgoing : public CSimpleCascadeOutgoingChild<ET>
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline COutgoing(CDemodulator* parent):CSimpleCascadeOutgoingChild(parent->m_incoming),m_parent(parent) { }
+		void buildAttrs(const CDemodulator& parent);
+
+	protected:
+		CDemodulator* m_parent;
+
+	public:
+		struct
+		{
+			CEventAttribute* sync_fault;
+			CAttr_outRate* rate;
+		} attrs;
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		COutgoing(const COutgoing& other);
+		COutgoing& operator=(const COutgoing& other);
+
+	public: // COutEndpointBase interface
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+	};
+
+	class CIncoming : public CSimpleCascadeIncomingChild, public signals::IAttributeObserver
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline CIncoming(CDemodulator* parent)
+			:CSimpleCascadeIncomingChild(signals::etypComplex, parent, parent->m_outgoing),m_lastRateAttr(NULL) { }
+		virtual ~CIncoming();
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+		virtual void OnChanged(signals::IAttribute* attr, const void* value);
+		virtual void OnDetached(signals::IAttribute* attr);
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		signals::IAttribute* m_lastRateAttr;
+
+		CIncoming(const CIncoming& other);
+		CIncoming& operator=(const CIncoming& other);
+		virtual void OnConnection(signals::IEPRecvFrom* recv);
+	};
+
+private:
+	CIncoming m_incoming;
+	COutgoing m_outgoing;
+	CAudioDemodulator m_engine;
+
+	volatile long m_inRate;
+	volatile long m_mode;
+	volatile long m_decim;
+	volatile float m_deviation;
+	volatile float m_lowCut;
+	volatile float m_highCut;
+	volatile long m_reconfigure;
+
+	void buildAttrs();
+	void setInputRate(long rate);
+	void updateOutputRate();
+
+protected:
+	virtual void thread_run();
+};
+
+template<signals::EType ET>
+class CDemodulatorDriver : public signals::IBlockDriver
+{
+public:
+	inline CDemodulatorDriver() {}
+	virtual ~CDemodulatorDriver() {}
+
+private:
+	CDemodulatorDriver(const CDemodulatorDriver& other);
+	CDemodulatorDriver operator=(const CDemodulatorDriver& other);
+
+public:
+	virtual const char* Name()			{ return NAME; }
+	virtual const char* Description()	{ return DESCR; }
+	virtual BOOL canCreate()			{ return true; }
+	virtual BOOL canDiscover()			{ return false; }
+	virtual unsigned Discover(signals::IBlock** blocks, unsigned availBlocks) { return 0; }
+	virtual signals::IBlock* Create();
+	const unsigned char* Fingerprint()	{ return FINGERPRINT; }
+
+protected:
+	static const char* NAME;
+	static const char* DESCR;
+	static const unsigned char FINGERPRINT[];
+};
+
+// ------------------------------------------------------------------------------------------------
+
+template<signals::EType ET>
+const char* CDemodulatorDriver<ET>::NAME = "demod";
+
+template<signals::EType ET>
+const char* CDemodulatorDriver<ET>::DESCR = "Recover audio from an AM, FM or single-sideband signal";
+
+template<signals::EType ET>
+const unsigned char CDemodulatorDriver<ET>::FINGERPRINT[] = { 1, (unsigned char)signals::etypComplex, 1, (unsigned char)ET };
+
+template<signals::EType ET>
+const char* CDemodulator<ET>::NAME = "Audio demodulator";
+
+template<signals::EType ET>
+const char* CDemodulator<ET>::MODE_NAMES[CAudioDemodulator::NUM_MODES] = { "AM", "FM", "USB", "LSB" };
+
+template<signals::EType ET>
+const char* CDemodulator<ET>::CIncoming::EP_NAME = "in";
+
+template<signals::EType ET>
+const char* CDemodulator<ET>::CIncoming::EP_DESCR = "Demodulator incoming endpoint";
+
+template<signals::EType ET>
+const char* CDemodulator<ET>::COutgoing::EP_NAME = "out";
+
+template<signals::EType ET>
+const char* CDemodulator<ET>::COutgoing::EP_DESCR = "Demodulator outgoing endpoint";
+
+// ------------------------------------------------------------------ class CDemodulatorDriver
+
+template<signals::EType ET>
+signals::IBlock * CDemodulatorDriver<ET>::Create()
+{
+	signals::IBlock* blk = new CDemodulator<ET>(this);
+	blk->AddRef();
+	return blk;
+}
+
+// ------------------------------------------------------------------ class CDemodulator
+
+#pragma warning(push)
+#pragma warning(disable: 4355)
+template<signals::EType ET>
+CDemodulator<ET>::CDemodulator(signals::IBlockDriver* driver)
+	:CThreadBlockBase(driver),m_incoming(this),m_outgoing(this),m_inRate(0),m_mode(CAudioDemodulator::MODE_AM),
+	 m_decim(DEFAULT_DECIM),m_deviation(5000.0f),m_lowCut(300.0f),m_highCut(2700.0f),m_reconfigure(1)
+{
+	buildAttrs();
+	startThread();
+}
+#pragma warning(pop)
+
+template<signals::EType ET>
+CDemodulator<ET>::~CDemodulator()
+{
+	stopThread();
+}
+
+template<signals::EType ET>
+void CDemodulator<ET>::buildAttrs()
+{
+	m_outgoing.buildAttrs(*this);
+	attrs.mode = addLocalAttr(true, new CAttr_mode(*this));
+	attrs.decim = addLocalAttr(true, new CAttr_callback<signals::etypLong,CDemodulator>
+		(*this, "decimate", "Ratio of the incoming IQ rate to the audio rate", &CDemodulator::setDecim, DEFAULT_DECIM));
+	attrs.deviation = addLocalAttr(true, new CAttr_callback<signals::etypSingle,CDemodulator>
+		(*this, "deviation", "FM deviation (Hz) producing full-scale audio", &CDemodulator::setDeviation, 5000.0f));
+	attrs.lowCut = addLocalAttr(true, new CAttr_callback<signals::etypSingle,CDemodulator>
+		(*this, "lowCut", "Lowest audio frequency (Hz) passed in SSB", &CDemodulator::setLowCut, 300.0f));
+	attrs.highCut = addLocalAttr(true, new CAttr_callback<signals::etypSingle,CDemodulator>
+		(*this, "highCut", "Highest audio frequency (Hz) passed in SSB", &CDemodulator::setHighCut, 2700.0f));
+}
+
+template<signals::EType ET>
+void CDemodulator<ET>::COutgoing::buildAttrs(const CDemodulator& parent)
+{
+	attrs.sync_fault = addLocalAttr(true, new CEventAttribute("syncFault", "Fires when a sync fault happens in a receive stream"));
+	attrs.rate = addLocalAttr(true, new CAttr_outRate());
+}
+
+template<signals::EType ET>
+void CDemodulator<ET>::setMode(const long& mode)
+{
+	InterlockedExchange(&m_mode, mode);
+	InterlockedExchange(&m_reconfigure, 1);
+}
+
+template<signals::EType ET>
+void CDemodulator<ET>::setDecim(const long& decim)
+{
+	InterlockedExchange(&m_decim, decim < 1 ? 1 : decim);
+	InterlockedExchange(&m_reconfigure, 1);
+	updateOutputRate();
+}
+
+template<signals::EType ET>
+void CDemodulator<ET>::setDeviation(const float& deviation)
+{
+	m_deviation = deviation < 1.0f ? 1.0f : deviation;
+	InterlockedExchange(&m_reconfigure, 1);
+}
+
+template<signals::EType ET>
+void CDemodulator<ET>::setLowCut(const float& freq)
+{
+	m_lowCut = freq < 0.0f ? 0.0f : freq;
+	InterlockedExchange(&m_reconfigure, 1);
+}
+
+template<signals::EType ET>
+void CDemodulator<ET>::setHighCut(const float& freq)
+{
+	m_highCut = freq < 1.0f ? 1.0f : freq;
+	InterlockedExchange(&m_reconfigure, 1);
+}
+
+template<signals::EType ET>
+void CDemodulator<ET>::setInputRate(long rate)
+{
+	InterlockedExchange(&m_inRate, rate);
+	InterlockedExchange(&m_reconfigure, 1);
+	updateOutputRate();
+}
+
+template<signals::EType ET>
+void CDemodulator<ET>::updateOutputRate()
+{
+	m_outgoing.attrs.rate->update(m_inRate / m_decim);
+}
+
+template<signals::EType ET>
+void CDemodulator<ET>::thread_run()
+{
+	ThreadBase::SetThreadName("Demodulator Thread");
+
+	std::vector<TComplex> buffer(IN_BLOCK_SIZE);
+	std::vector<float> audio;
+	std::vector<store_type> outBuffer;
+	while(threadRunning())
+	{
+		if(InterlockedExchange(&m_reconfigure, 0))
+		{
+			m_engine.configure((CAudioDemodulator::EMode)m_mode, m_inRate, m_decim, m_deviation, m_lowCut, m_highCut);
+			audio.resize(m_engine.maxOutput(IN_BLOCK_SIZE));
+			outBuffer.resize(audio.size());
+		}
+
+		unsigned count = m_incoming.Read(signals::etypComplex, buffer.data(), IN_BLOCK_SIZE, FALSE, IN_BUFFER_TIMEOUT);
+		if(!count) continue;
+
+		count = m_engine.process(buffer.data(), count, audio.data());
+		if(!count) continue;
+
+		// stereo outputs carry the same audio on both sides
+		float* dest = (float*)outBuffer.data();
+		for(unsigned idx = 0; idx < count; idx++)
+		{
+			for(unsigned chan = 0; chan < CHANNELS; chan++) *dest++ = audio[idx];
+		}
+		if(m_outgoing.isConnected())
+		{
+			unsigned sentCount = m_outgoing.Write(ET, outBuffer.data(), count, OUT_BUFFER_TIMEOUT);
+			if(sentCount < count) m_outgoing.attrs.sync_fault->fire();
+		}
+	}
+}
+
+// ------------------------------------------------------------------ class CDemodulator::CIncoming
+
+template<signals::EType ET>
+CDemodulator<ET>::CIncoming::~CIncoming()
+{
+	if(m_lastRateAttr)
+	{
+		m_lastRateAttr->Unobserve(this);
+		m_lastRateAttr = NULL;
+	}
+}
+
+template<signals::EType ET>
+void CDemodulator<ET>::CIncoming::OnConnection(signals::IEPRecvFrom *conn)
+{
+	if(m_lastRateAttr)
+	{
+		m_lastRateAttr->Unobserve(this);
+		m_lastRateAttr = NULL;
+	}
+	if(!conn) return;
+	signals::IAttributes* attrs = conn->OutputAttributes();
+	if(!attrs) return;
+	signals::IAttribute* attr = attrs->GetByName("rate");
+	if(attr && (attr->Type() == signals::etypLong || attr->Type() == signals::etypInt64))
+	{
+		m_lastRateAttr = attr;
+		m_lastRateAttr->Observe(this);
+		OnChanged(attr, attr->getValue());
+	}
+}
+
+template<signals::EType ET>
+void CDemodulator<ET>::CIncoming::OnChanged(signals::IAttribute* attr, const void* value)
+{
+	if(attr == m_lastRateAttr)
+	{
+		CDemodulator* base = static_cast<CDemodulator*>(m_parent);
+		if(attr->Type() == signals::etypLong)
+		{
+			base->setInputRate(*(long*)value);
+		} else {
+			base->setInputRate(long(*(__int64*)value));
+		}
+	}
+	else ASSERT(FALSE);
+}
+
+template<signals::EType ET>
+void CDemodulator<ET>::CIncoming::OnDetached(signals::IAttribute* attr)
+{
+	if(attr == m_lastRateAttr)
+	{
+		m_lastRateAttr = NULL;
+	}
+	else ASSERT(FALSE);
+}
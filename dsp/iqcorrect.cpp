@@ -0,0 +1,277 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#include "stdafx.h"
+#include "iqcorrect.h"
+#include <xmmintrin.h>
+
+static const double PI = std::atan(1.0)*4;
+
+const char* CIqCorrection::NAME = "DC and IQ imbalance correction";
+const char* CIqCorrection::CIncoming::EP_NAME = "in";
+const char* CIqCorrection::CIncoming::EP_DESCR = "IQ correction incoming endpoint";
+const char* CIqCorrection::COutgoing::EP_NAME = "out";
+const char* CIqCorrection::COutgoing::EP_DESCR = "IQ correction outgoing endpoint";
+
+const char* CIqCorrectionDriver::NAME = "iq correct";
+const char* CIqCorrectionDriver::DESCR = "Remove the DC offset and I/Q gain and phase imbalance from a complex stream";
+const unsigned char CIqCorrectionDriver::FINGERPRINT[] = { 1, (unsigned char)signals::etypComplex, 1, (unsigned char)signals::etypComplex };
+
+// ------------------------------------------------------------------ class CIqCorrector
+
+CIqCorrector::CIqCorrector()
+	:m_tau(65536.0),m_correctDc(true),m_correctIq(true)
+{
+	reset();
+}
+
+void CIqCorrector::configure(unsigned timeConstant, bool correctDc, bool correctIq)
+{
+	m_tau = timeConstant < 1 ? 1.0 : double(timeConstant);
+	m_correctDc = correctDc;
+	m_correctIq = correctIq;
+	updateCoefficients();
+}
+
+void CIqCorrector::reset()
+{
+	m_primed = false;
+	m_dcRe = m_dcIm = 0.0;
+	m_powerI = m_powerQ = m_cross = 0.0;
+	m_coefA = 0.0f;
+	m_coefB = 1.0f;
+}
+
+double CIqCorrector::gainError() const
+{
+	if(m_powerI <= 0.0 || m_powerQ <= 0.0) return 0.0;
+	return 10.0 * std::log10(m_powerQ / m_powerI);
+}
+
+double CIqCorrector::phaseError() const
+{
+	const double norm = std::sqrt(m_powerI * m_powerQ);
+	if(norm <= 0.0) return 0.0;
+	const double sine = m_cross / norm;
+	return std::asin(sine < -1.0 ? -1.0 : sine > 1.0 ? 1.0 : sine) * 180.0 / PI;
+}
+
+void CIqCorrector::updateCoefficients()
+{
+	// Q is decorrelated from I by removing its projection onto I, then scaled to the power of I:
+	//   Q' = g * (Q - p*I),  p = E[IQ]/E[I^2],  g = sqrt(E[I^2] / (E[Q^2] - p*E[IQ]))
+	static const double MAX_PROJECTION = 0.5;	// 30 degrees
+	static const double MAX_GAIN = 2.0;			// 6 dB
+	m_coefA = 0.0f;
+	m_coefB = 1.0f;
+	if(!m_correctIq || m_powerI <= 0.0) return;
+
+	double proj = m_cross / m_powerI;
+	const double residual = m_powerQ - proj * m_cross;
+	if(residual <= 0.0) return;
+	double gain = std::sqrt(m_powerI / residual);
+
+	// anything beyond these limits is the signal itself (a tone sitting near DC, or silence) rather than the hardware
+	proj = proj < -MAX_PROJECTION ? -MAX_PROJECTION : proj > MAX_PROJECTION ? MAX_PROJECTION : proj;
+	gain = gain < 1.0 / MAX_GAIN ? 1.0 / MAX_GAIN : gain > MAX_GAIN ? MAX_GAIN : gain;
+	m_coefA = (float)(-gain * proj);
+	m_coefB = (float)gain;
+}
+
+void CIqCorrector::process(TComplex* data, unsigned count)
+{
+	if(!count) return;
+	float* samples = (float*)data;
+
+	if(!m_primed)
+	{
+		// start from the mean of the first block so its statistics aren't swamped by the offset
+		double sumRe = 0.0, sumIm = 0.0;
+		for(unsigned idx = 0; idx < count; idx++)
+		{
+			sumRe += data[idx].real();
+			sumIm += data[idx].imag();
+		}
+		m_dcRe = sumRe / count;
+		m_dcIm = sumIm / count;
+	}
+
+	// a single pass measures the block against the current estimates and applies the current correction,
+	// the estimates then move for the next block
+	const __m128 dc = _mm_setr_ps((float)m_dcRe, (float)m_dcIm, (float)m_dcRe, (float)m_dcIm);
+	const __m128 remove = m_correctDc ? dc : _mm_setzero_ps();
+	const __m128 coefA = _mm_setr_ps(0.0f, m_coefA, 0.0f, m_coefA);
+	const __m128 coefB = _mm_setr_ps(1.0f, m_coefB, 1.0f, m_coefB);
+	__m128 sum = _mm_setzero_ps();
+	__m128 power = _mm_setzero_ps();
+	__m128 cross = _mm_setzero_ps();
+
+	unsigned idx = 0;
+	for(; idx + 2 <= count; idx += 2)
+	{
+		__m128 val = _mm_loadu_ps(samples + idx * 2);
+		sum = _mm_add_ps(sum, val);
+		__m128 centered = _mm_sub_ps(val, dc);
+		power = _mm_add_ps(power, _mm_mul_ps(centered, centered));
+		cross = _mm_add_ps(cross, _mm_mul_ps(centered, _mm_shuffle_ps(centered, centered, _MM_SHUFFLE(2, 3, 0, 1))));
+
+		__m128 out = _mm_sub_ps(val, remove);
+		__m128 real = _mm_shuffle_ps(out, out, _MM_SHUFFLE(2, 2, 0, 0));
+		_mm_storeu_ps(samples + idx * 2, _mm_add_ps(_mm_mul_ps(out, coefB), _mm_mul_ps(real, coefA)));
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, sum);
+	double sumRe = lanes[0] + lanes[2], sumIm = lanes[1] + lanes[3];
+	_mm_storeu_ps(lanes, power);
+	double sumI2 = lanes[0] + lanes[2], sumQ2 = lanes[1] + lanes[3];
+	_mm_storeu_ps(lanes, cross);
+	double sumIQ = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) / 2.0;
+
+	for(; idx < count; idx++)
+	{
+		const float re = data[idx].real();
+		const float im = data[idx].imag();
+		sumRe += re;
+		sumIm += im;
+		const double cRe = re - m_dcRe;
+		const double cIm = im - m_dcIm;
+		sumI2 += cRe * cRe;
+		sumQ2 += cIm * cIm;
+		sumIQ += cRe * cIm;
+
+		const float oRe = m_correctDc ? float(cRe) : re;
+		const float oIm = m_correctDc ? float(cIm) : im;
+		data[idx] = TComplex(oRe, m_coefA * oRe + m_coefB * oIm);
+	}
+
+	// one-pole averages advanced by a whole block at once
+	const double alpha = m_primed ? 1.0 - std::exp(-double(count) / m_tau) : 1.0;
+	m_dcRe += alpha * (sumRe / count - m_dcRe);
+	m_dcIm += alpha * (sumIm / count - m_dcIm);
+	m_powerI += alpha * (sumI2 / count - m_powerI);
+	m_powerQ += alpha * (sumQ2 / count - m_powerQ);
+	m_cross += alpha * (sumIQ / count - m_cross);
+	m_primed = true;
+	updateCoefficients();
+}
+
+// ------------------------------------------------------------------ class CIqCorrection
+
+#pragma warning(push)
+#pragma warning(disable: 4355)
+CIqCorrection::CIqCorrection(signals::IBlockDriver* driver)
+	:CThreadBlockBase(driver),m_incoming(this),m_outgoing(this),m_timeConstant(DEFAULT_TIME_CONSTANT),m_correctDc(1),
+	 m_correctIq(1),m_reconfigure(1)
+{
+	buildAttrs();
+	startThread();
+}
+#pragma warning(pop)
+
+CIqCorrection::~CIqCorrection()
+{
+	stopThread();
+}
+
+void CIqCorrection::buildAttrs()
+{
+	m_outgoing.buildAttrs(*this);
+	attrs.timeConstant = addLocalAttr(true, new CAttr_callback<signals::etypLong,CIqCorrection>
+		(*this, "timeConstant", "Samples over which the offset and imbalance are averaged", &CIqCorrection::setTimeConstant, DEFAULT_TIME_CONSTANT));
+	attrs.correctDc = addLocalAttr(true, new CAttr_callback<signals::etypBoolean,CIqCorrection>
+		(*this, "correctDc", "Subtract the DC offset", &CIqCorrection::setCorrectDc, 1));
+	attrs.correctIq = addLocalAttr(true, new CAttr_callback<signals::etypBoolean,CIqCorrection>
+		(*this, "correctIq", "Correct the gain and phase of Q against I", &CIqCorrection::setCorrectIq, 1));
+	attrs.dcReal = addLocalAttr(true, new CAttr_estimate("dcReal", "Estimated DC offset of I"));
+	attrs.dcImag = addLocalAttr(true, new CAttr_estimate("dcImag", "Estimated DC offset of Q"));
+	attrs.gainError = addLocalAttr(true, new CAttr_estimate("gainError", "Estimated gain (dB) of Q relative to I"));
+	attrs.phaseError = addLocalAttr(true, new CAttr_estimate("phaseError", "Estimated phase error (degrees) of Q from quadrature"));
+}
+
+void CIqCorrection::COutgoing::buildAttrs(const CIqCorrection& parent)
+{
+	attrs.sync_fault = addLocalAttr(true, new CEventAttribute("syncFault", "Fires when a sync fault happens in a receive stream"));
+}
+
+void CIqCorrection::setTimeConstant(const long& samples)
+{
+	InterlockedExchange(&m_timeConstant, samples < 1 ? 1 : samples);
+	InterlockedExchange(&m_reconfigure, 1);
+}
+
+void CIqCorrection::setCorrectDc(const unsigned char& enable)
+{
+	InterlockedExchange(&m_correctDc, enable ? 1 : 0);
+	InterlockedExchange(&m_reconfigure, 1);
+}
+
+void CIqCorrection::setCorrectIq(const unsigned char& enable)
+{
+	InterlockedExchange(&m_correctIq, enable ? 1 : 0);
+	InterlockedExchange(&m_reconfigure, 1);
+}
+
+void CIqCorrection::publishEstimates()
+{
+	const TComplex dc = m_engine.dcOffset();
+	attrs.dcReal->update(dc.real());
+	attrs.dcImag->update(dc.imag());
+	attrs.gainError->update((float)m_engine.gainError());
+	attrs.phaseError->update((float)m_engine.phaseError());
+}
+
+void CIqCorrection::thread_run()
+{
+	ThreadBase::SetThreadName("IQ Correction Thread");
+
+	std::vector<TComplex> buffer(IN_BLOCK_SIZE);
+	unsigned sincePublish = 0;
+	while(threadRunning())
+	{
+		if(InterlockedExchange(&m_reconfigure, 0))
+		{
+			// the estimates carry over, only how they are tracked and applied changes
+			m_engine.configure(m_timeConstant, !!m_correctDc, !!m_correctIq);
+		}
+
+		unsigned count = m_incoming.Read(signals::etypComplex, buffer.data(), IN_BLOCK_SIZE, FALSE, IN_BUFFER_TIMEOUT);
+		if(!count) continue;
+
+		m_engine.process(buffer.data(), count);
+		sincePublish += count;
+		if(sincePublish >= PUBLISH_INTERVAL)
+		{
+			// observers don't need every block, and each update is a round of callbacks on this thread
+			publishEstimates();
+			sincePublish = 0;
+		}
+
+		if(m_outgoing.isConnected())
+		{
+			unsigned sentCount = m_outgoing.Write(signals::etypComplex, buffer.data(), count, OUT_BUFFER_TIMEOUT);
+			if(sentCount < count) m_outgoing.attrs.sync_fault->fire();
+		}
+	}
+}
+
+// ------------------------------------------------------------------ class CIqCorrectionDriver
+
+signals::IBlock * CIqCorrectionDriver::Create()
+{
+	signals::IBlock* blk = new CIqCorrection(this);
+	blk->AddRef();
+	return blk;
+}
@@ -0,0 +1,185 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+#include <blockImpl.h>
+
+class CIqCorrector
+{	// removes the DC offset and the gain/phase mismatch between I and Q, tracking both with recursive averages
+public:
+	typedef std::complex<float> TComplex;
+
+	CIqCorrector();
+
+	void configure(unsigned timeConstant, bool correctDc, bool correctIq);
+	void reset();
+	void process(TComplex* data, unsigned count);	// corrects in place
+
+	inline TComplex dcOffset() const		{ return TComplex((float)m_dcRe, (float)m_dcIm); }
+	double gainError() const;				// dB of Q relative to I
+	double phaseError() const;				// degrees Q is away from quadrature with I
+
+private:
+	double m_tau;							// time constant in samples
+	bool m_correctDc;
+	bool m_correctIq;
+	bool m_primed;							// the estimates have seen at least one block
+
+	// running estimates, kept in double so long time constants don't stall on rounding
+	double m_dcRe;
+	double m_dcIm;
+	double m_powerI;						// E[I^2]
+	double m_powerQ;						// E[Q^2]
+	double m_cross;							// E[IQ]
+
+	// correction applied to Q as a*I + b*Q, derived from the estimates after each block
+	float m_coefA;
+	float m_coefB;
+
+	void updateCoefficients();
+};
+
+class CIqCorrection : public CThreadBlockBase
+{
+public:
+	CIqCorrection(signals::IBlockDriver* driver);
+	virtual ~CIqCorrection();
+
+private:
+	CIqCorrection(const CIqCorrection& other);
+	CIqCorrection& operator=(const CIqCorrection& other);
+
+public: // IBlock implementation
+	virtual const char* Name()				{ return NAME; }
+	virtual unsigned Incoming(signals::IInEndpoint** ep, unsigned availEP) { return singleIncoming(&m_incoming, ep, availEP); }
+	virtual unsigned Outgoing(signals::IOutEndpoint** ep, unsigned availEP) { return singleOutgoing(&m_outgoing, ep, availEP); }
+
+private:
+	class CAttr_estimate : public CROAttribute<signals::etypSingle>
+	{
+	public:
+		inline CAttr_estimate(const char* name, const char* descr):CROAttribute<signals::etypSingle>(name, descr, 0.0f) { }
+		inline void update(float newVal) { privateSetValue(newVal); }
+	};
+
+public:
+	struct
+	{
+		CAttributeBase* timeConstant;
+		CAttributeBase* correctDc;
+		CAttributeBase* correctIq;
+		CAttr_estimate* dcReal;
+		CAttr_estimate* dcImag;
+		CAttr_estimate* gainError;
+		CAttr_estimate* phaseError;
+	} attrs;
+
+	void setTimeConstant(const long& samples);
+	void setCorrectDc(const unsigned char& enable);
+	void setCorrectIq(const unsigned char& enable);
+
+private:
+	enum
+	{
+		IN_BUFFER_TIMEOUT = 1000,
+		OUT_BUFFER_TIMEOUT = 1000,
+		IN_BLOCK_SIZE = 1024,
+		DEFAULT_TIME_CONSTANT = 65536,
+		PUBLISH_INTERVAL = 65536,			// samples between updates of the read-only estimates
+	};
+
+	typedef std::complex<float> TComplex;
+	static const char* NAME;
+
+public:
+	class COutgoing : public CSimpleCascadeOutgoingChild<signals::etypComplex>
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline COutgoing(CIqCorrection* parent):CSimpleCascadeOutgoingChild(parent->m_incoming),m_parent(parent) { }
+		void buildAttrs(const CIqCorrection& parent);
+
+	protected:
+		CIqCorrection* m_parent;
+
+	public:
+		struct
+		{
+			CEventAttribute* sync_fault;
+		} attrs;
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		COutgoing(const COutgoing& other);
+		COutgoing& operator=(const COutgoing& other);
+
+	public: // COutEndpointBase interface
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+	};
+
+	class CIncoming : public CSimpleCascadeIncomingChild
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline CIncoming(CIqCorrection* parent):CSimpleCascadeIncomingChild(signals::etypComplex, parent, parent->m_outgoing) { }
+		virtual const char* EPName()	{ return EP_NAME; }
+		virtual const char* EPDescr()	{ return EP_DESCR; }
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		CIncoming(const CIncoming& other);
+		CIncoming& operator=(const CIncoming& other);
+	};
+
+private:
+	CIncoming m_incoming;
+	COutgoing m_outgoing;
+	CIqCorrector m_engine;
+
+	volatile long m_timeConstant;
+	volatile long m_correctDc;
+	volatile long m_correctIq;
+	volatile long m_reconfigure;
+
+	void buildAttrs();
+	void publishEstimates();
+	virtual void thread_run();
+};
+
+class CIqCorrectionDriver : public signals::IBlockDriver
+{
+public:
+	inline CIqCorrectionDriver() {}
+	virtual ~CIqCorrectionDriver() {}
+
+private:
+	CIqCorrectionDriver(const CIqCorrectionDriver& other);
+	CIqCorrectionDriver operator=(const CIqCorrectionDriver& other);
+
+public:
+	virtual const char* Name()			{ return NAME; }
+	virtual const char* Description()	{ return DESCR; }
+	virtual BOOL canCreate()			{ return true; }
+	virtual BOOL canDiscover()			{ return false; }
+	virtual unsigned Discover(signals::IBlock** blocks, unsigned availBlocks) { return 0; }
+	virtual signals::IBlock* Create();
+	const unsigned char* Fingerprint()	{ return FINGERPRINT; }
+
+protected:
+	static const char* NAME;
+	static const char* DESCR;
+	static const unsigned char FINGERPRINT[];
+};
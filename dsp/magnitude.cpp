@@ -0,0 +1,127 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#include "stdafx.h"
+#include "magnitude.h"
+
+const char* CFrameMagnitude::NAME = "Magnitude of each value in a complex frame";
+const char* CFrameMagnitude::CIncoming::EP_NAME = "in";
+const char* CFrameMagnitude::CIncoming::EP_DESCR = "Frame magnitude incoming endpoint";
+const char* CFrameMagnitude::COutgoing::EP_NAME = "out";
+const char* CFrameMagnitude::COutgoing::EP_DESCR = "Frame magnitude outgoing endpoint";
+
+const char* CFrameMagnitudeDriver::NAME = "frame magnitude";
+const char* CFrameMagnitudeDriver::DESCR = "Magnitude or power of each value in a complex frame";
+const unsigned char CFrameMagnitudeDriver::FINGERPRINT[] = { 1, (unsigned char)signals::etypVecComplex, 1, (unsigned char)signals::etypVecSingle };
+
+// ------------------------------------------------------------------ class CFrameMagnitude
+
+#pragma warning(push)
+#pragma warning(disable: 4355)
+CFrameMagnitude::CFrameMagnitude(signals::IBlockDriver* driver)
+	:CThreadBlockBase(driver),m_incoming(this),m_outgoing(this),m_power(0)
+{
+	buildAttrs();
+	startThread();
+}
+#pragma warning(pop)
+
+CFrameMagnitude::~CFrameMagnitude()
+{
+	stopThread();
+}
+
+void CFrameMagnitude::buildAttrs()
+{
+	m_outgoing.buildAttrs(*this);
+	attrs.power = addLocalAttr(true, new CAttr_callback<signals::etypBoolean,CFrameMagnitude>
+		(*this, "power", "Send the squared magnitude rather than the magnitude", &CFrameMagnitude::setPower, 0));
+	attrs.planarFrames = addLocalAttr(true, new CAttr_count("planarFrames", "Frames received with split real and imaginary parts"));
+}
+
+void CFrameMagnitude::COutgoing::buildAttrs(const CFrameMagnitude& parent)
+{
+	attrs.sync_fault = addLocalAttr(true, new CEventAttribute("syncFault", "Fires when a sync fault happens in a receive stream"));
+}
+
+void CFrameMagnitude::setPower(const unsigned char& power)
+{
+	InterlockedExchange(&m_power, power ? 1 : 0);
+}
+
+void CFrameMagnitude::thread_run()
+{
+	ThreadBase::SetThreadName("Frame Magnitude Thread");
+
+	typedef Vector<signals::etypComplex> TInVector;
+	typedef Vector<signals::etypSingle> TOutVector;
+	std::vector<float> parts;			// interleaved frames are split here first
+	long numPlanar = 0;
+	while(threadRunning())
+	{
+		signals::IVector* inVector = NULL;
+		BOOL recvFrame = m_incoming.ReadOne(signals::etypVecComplex, &inVector, IN_BUFFER_TIMEOUT);
+		if(!recvFrame) continue;
+
+		const unsigned size = inVector->Size();
+		const float* re;
+		const float* im;
+		TInVector* native = TInVector::native(inVector);
+		if(native && native->layout == layoutPlanar)
+		{
+			re = (const float*)native->data;
+			im = re + size;
+			attrs.planarFrames->update(++numPlanar);
+		}
+		else
+		{
+			if(parts.size() < 2 * size) parts.resize(2 * size);
+			deinterleave((const float*)inVector->Data(), size, parts.data(), parts.data() + size);
+			re = parts.data();
+			im = re + size;
+		}
+
+		if(!m_outgoing.isConnected())
+		{
+			inVector->Release();
+			continue;
+		}
+
+		TOutVector* outVector = TOutVector::retrieve(size);
+		if(m_power)
+		{
+			planarPower(re, im, size, outVector->data);
+		} else {
+			planarMagnitude(re, im, size, outVector->data);
+		}
+		inVector->Release();
+
+		BOOL outFrame = m_outgoing.WriteOne(signals::etypVecSingle, &outVector, OUT_BUFFER_TIMEOUT);
+		if(!outFrame)
+		{
+			m_outgoing.attrs.sync_fault->fire();
+			outVector->Release();
+		}
+	}
+}
+
+// ------------------------------------------------------------------ class CFrameMagnitudeDriver
+
+signals::IBlock * CFrameMagnitudeDriver::Create()
+{
+	signals::IBlock* blk = new CFrameMagnitude(this);
+	blk->AddRef();
+	return blk;
+}
@@ -0,0 +1,139 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+#include <blockImpl.h>
+#include <planar.h>
+
+class CFrameMagnitude : public CThreadBlockBase
+{	// magnitude (or power) of each value in a complex frame, reading planar frames when its source offers them
+public:
+	CFrameMagnitude(signals::IBlockDriver* driver);
+	virtual ~CFrameMagnitude();
+
+private:
+	CFrameMagnitude(const CFrameMagnitude& other);
+	CFrameMagnitude& operator=(const CFrameMagnitude& other);
+
+public: // IBlock implementation
+	virtual const char* Name()				{ return NAME; }
+	virtual unsigned Incoming(signals::IInEndpoint** ep, unsigned availEP) { return singleIncoming(&m_incoming, ep, availEP); }
+	virtual unsigned Outgoing(signals::IOutEndpoint** ep, unsigned availEP) { return singleOutgoing(&m_outgoing, ep, availEP); }
+
+private:
+	class CAttr_count : public CROAttribute<signals::etypLong>
+	{
+	public:
+		inline CAttr_count(const char* name, const char* descr):CROAttribute<signals::etypLong>(name, descr, 0) { }
+		inline void update(long newVal) { privateSetValue(newVal); }
+	};
+
+public:
+	struct
+	{
+		CAttributeBase* power;
+		CAttr_count* planarFrames;
+	} attrs;
+
+	void setPower(const unsigned char& power);
+
+private:
+	enum
+	{
+		IN_BUFFER_TIMEOUT = 1000,
+		OUT_BUFFER_TIMEOUT = 1000,
+	};
+
+	static const char* NAME;
+
+public:
+	class COutgoing : public CSimpleCascadeOutgoingChild<signals::etypVecSingle>
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline COutgoing(CFrameMagnitude* parent):CSimpleCascadeOutgoingChild(parent->m_incoming),m_parent(parent) { }
+		void buildAttrs(const CFrameMagnitude& parent);
+
+	protected:
+		CFrameMagnitude* m_parent;
+
+	public:
+		struct
+		{
+			CEventAttribute* sync_fault;
+		} attrs;
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		COutgoing(const COutgoing& other);
+		COutgoing& operator=(const COutgoing& other);
+
+	public: // COutEndpointBase interface
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+	};
+
+	class CIncoming : public CSimpleCascadeIncomingChild
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline CIncoming(CFrameMagnitude* parent):CSimpleCascadeIncomingChild(signals::etypVecComplex, parent, parent->m_outgoing)
+		{
+			// the magnitude kernels run straight down the real and imaginary arrays
+			addLocalAttr(false, new CAttr_planarInput());
+		}
+		virtual const char* EPName()	{ return EP_NAME; }
+		virtual const char* EPDescr()	{ return EP_DESCR; }
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		CIncoming(const CIncoming& other);
+		CIncoming& operator=(const CIncoming& other);
+	};
+
+private:
+	CIncoming m_incoming;
+	COutgoing m_outgoing;
+
+	volatile long m_power;
+
+	void buildAttrs();
+	virtual void thread_run();
+};
+
+class CFrameMagnitudeDriver : public signals::IBlockDriver
+{
+public:
+	inline CFrameMagnitudeDriver() {}
+	virtual ~CFrameMagnitudeDriver() {}
+
+private:
+	CFrameMagnitudeDriver(const CFrameMagnitudeDriver& other);
+	CFrameMagnitudeDriver operator=(const CFrameMagnitudeDriver& other);
+
+public:
+	virtual const char* Name()			{ return NAME; }
+	virtual const char* Description()	{ return DESCR; }
+	virtual BOOL canCreate()			{ return true; }
+	virtual BOOL canDiscover()			{ return false; }
+	virtual unsigned Discover(signals::IBlock** blocks, unsigned availBlocks) { return 0; }
+	virtual signals::IBlock* Create();
+	const unsigned char* Fingerprint()	{ return FINGERPRINT; }
+
+protected:
+	static const char* NAME;
+	static const char* DESCR;
+	static const unsigned char FINGERPRINT[];
+};
@@ -0,0 +1,76 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#include "stdafx.h"
+#include "resample.h"
+#include "ddc.h"
+#include "cic.h"
+#include "demod.h"
+#include "squelch.h"
+#include "iqcorrect.h"
+#include "magnitude.h"
+
+CResamplerDriver<signals::etypSingle> resample_float;
+CResamplerDriver<signals::etypComplex> resample_cpx;
+CDownConverterDriver ddc;
+CCicDecimatorDriver<signals::etypSingle> cic_float;
+CCicDecimatorDriver<signals::etypComplex> cic_cpx;
+CCicDecimatorDriver<signals::etypVecSingle> cic_burst_float;
+CCicDecimatorDriver<signals::etypVecComplex> cic_burst_cpx;
+CDemodulatorDriver<signals::etypSingle> demod_float;
+CDemodulatorDriver<signals::etypLRSingle> demod_lr;
+CSquelchDriver<signals::etypSingle> squelch_float;
+CSquelchDriver<signals::etypComplex> squelch_cpx;
+CSquelchDriver<signals::etypVecSingle> squelch_frame_float;
+CSquelchDriver<signals::etypVecComplex> squelch_frame_cpx;
+CIqCorrectionDriver iq_correct;
+CFrameMagnitudeDriver frame_mag;
+
+signals::IBlockDriver* BLOCKS[] =
+{
+	// resample
+	&resample_float, &resample_cpx,
+
+	// digital down-converter
+	&ddc,
+
+	// CIC decimator
+	&cic_float, &cic_cpx, &cic_burst_float, &cic_burst_cpx,
+
+	// audio demodulators
+	&demod_float, &demod_lr,
+
+	// squelch
+	&squelch_float, &squelch_cpx, &squelch_frame_float, &squelch_frame_cpx,
+
+	// DC offset and IQ imbalance correction
+	&iq_correct,
+
+	// magnitude of complex frames
+	&frame_mag,
+};
+
+extern "C" unsigned QueryDrivers(signals::IBlockDriver** drivers, unsigned availDrivers)
+{
+	if(drivers && availDrivers)
+	{
+		unsigned xfer = min(availDrivers, _countof(BLOCKS));
+		for(unsigned idx=0; idx < xfer; idx++)
+		{
+			drivers[idx] = BLOCKS[idx];
+		}
+	}
+	return _countof(BLOCKS);
+}
@@ -0,0 +1,205 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#include "stdafx.h"
+#include "resample.h"
+#include <xmmintrin.h>
+
+static const double PI = std::atan(1.0)*4;
+
+// ------------------------------------------------------------------ class CPolyphaseResampler
+
+CPolyphaseResampler::CPolyphaseResampler(unsigned channels)
+	:m_channels(channels),m_interp(1),m_decim(1),m_numTaps(1),m_rowStride(0),m_bank(NULL),m_histLen(0),
+	 m_phase(0),m_drop(0)
+{
+	ASSERT(channels == 1 || channels == 2);
+}
+
+CPolyphaseResampler::~CPolyphaseResampler()
+{
+	if(m_bank) _aligned_free(m_bank);
+}
+
+double CPolyphaseResampler::besselI0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	const double halfX = x / 2.0;
+	for(unsigned k = 1; k < 64; k++)
+	{
+		term *= (halfX / k) * (halfX / k);
+		sum += term;
+		if(term < sum * 1e-12) break;
+	}
+	return sum;
+}
+
+void CPolyphaseResampler::design(unsigned interp, unsigned decim, float passband)
+{
+	// reduce L/M to lowest terms
+	unsigned gcd = interp, rem = decim;
+	while(rem)
+	{
+		unsigned next = gcd % rem;
+		gcd = rem;
+		rem = next;
+	}
+	interp /= gcd;
+	decim /= gcd;
+
+	if(m_bank)
+	{
+		_aligned_free(m_bank);
+		m_bank = NULL;
+	}
+	m_interp = interp;
+	m_decim = decim;
+	if(interp == decim)
+	{
+		// unity ratio, process() is a copy
+		m_numTaps = 1;
+		m_rowStride = 0;
+		reset();
+		return;
+	}
+
+	// Kaiser-windowed sinc at the upsampled rate, with the transition band ending at the narrower Nyquist
+	const unsigned ratio = max(interp, decim);
+	const double transition = (1.0 - passband) * 0.5 / ratio;
+	const double cutoff = (1.0 + passband) * 0.25 / ratio;
+	const double beta = 0.1102 * (ATTENUATION_DB - 8.7);
+	unsigned numTotal = (unsigned)std::ceil((ATTENUATION_DB - 8) / (2.285 * 2 * PI * transition)) + 1;
+
+	m_numTaps = min((numTotal + interp - 1) / interp, (unsigned)MAX_TAPS_PER_PHASE);
+	numTotal = m_numTaps * interp;
+	m_rowStride = (m_numTaps * m_channels + 3) & ~3;
+	m_bank = (float*)_aligned_malloc(interp * m_rowStride * sizeof(float), 16);
+	memset(m_bank, 0, interp * m_rowStride * sizeof(float));
+
+	const double center = (numTotal - 1) / 2.0;
+	const double norm = besselI0(beta);
+	for(unsigned n = 0; n < numTotal; n++)
+	{
+		const double t = n - center;
+		const double x = 2.0 * t / (numTotal - 1);
+		const double window = besselI0(beta * std::sqrt(max(0.0, 1.0 - x * x))) / norm;
+		const double sinc = t == 0.0 ? 2.0 * cutoff : std::sin(2.0 * PI * cutoff * t) / (PI * t);
+		const float coeff = (float)(sinc * window * interp);
+
+		// branch p holds h[p + k*L], stored newest-sample-last so it lines up with the history buffer
+		float* row = m_bank + (n % interp) * m_rowStride + (m_numTaps - 1 - n / interp) * m_channels;
+		for(unsigned chan = 0; chan < m_channels; chan++) row[chan] = coeff;
+	}
+	reset();
+}
+
+void CPolyphaseResampler::reset()
+{
+	m_histLen = m_numTaps - 1;
+	m_hist.assign(m_histLen * m_channels + m_rowStride, 0.0f);
+	m_phase = 0;
+	m_drop = 0;
+}
+
+unsigned CPolyphaseResampler::maxOutput(unsigned inCount) const
+{
+	if(!m_bank) return inCount;
+	return (unsigned)(((unsigned __int64)inCount * m_interp) / m_decim) + 2;
+}
+
+inline void CPolyphaseResampler::dot(const float* coeff, const float* data, float* out) const
+{
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+	unsigned idx = 0;
+	for(; idx + 8 <= m_rowStride; idx += 8)
+	{
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(coeff + idx), _mm_loadu_ps(data + idx)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_load_ps(coeff + idx + 4), _mm_loadu_ps(data + idx + 4)));
+	}
+	if(idx < m_rowStride)
+	{
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_load_ps(coeff + idx), _mm_loadu_ps(data + idx)));
+	}
+	acc0 = _mm_add_ps(acc0, acc1);
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, acc0);
+	if(m_channels == 1)
+	{
+		out[0] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	}
+	else
+	{
+		// complex samples are interleaved, so the even lanes are real and the odd lanes imaginary
+		out[0] = lanes[0] + lanes[2];
+		out[1] = lanes[1] + lanes[3];
+	}
+}
+
+unsigned CPolyphaseResampler::process(const float* in, unsigned inCount, float* out)
+{
+	const unsigned chans = m_channels;
+	if(!m_bank)
+	{
+		memmove(out, in, inCount * chans * sizeof(float));
+		return inCount;
+	}
+	if(m_drop)
+	{
+		unsigned skip = min(m_drop, inCount);
+		in += skip * chans;
+		inCount -= skip;
+		m_drop -= skip;
+		if(!inCount) return 0;
+	}
+
+	// append the new samples to the history, leaving zeroed padding for the last partial vector load
+	const unsigned avail = m_histLen + inCount;
+	if(m_hist.size() < avail * chans + m_rowStride) m_hist.resize(avail * chans + m_rowStride);
+	float* hist = m_hist.data();
+	memcpy(hist + m_histLen * chans, in, inCount * chans * sizeof(float));
+	memset(hist + avail * chans, 0, m_rowStride * sizeof(float));
+
+	// the history always starts numTaps-1 samples before the next output's newest sample
+	const unsigned numTaps = m_numTaps;
+	unsigned pos = numTaps - 1;
+	unsigned phase = m_phase;
+	unsigned outCount = 0;
+	while(pos < avail)
+	{
+		dot(m_bank + phase * m_rowStride, hist + (pos + 1 - numTaps) * chans, out + outCount * chans);
+		outCount++;
+		phase += m_decim;
+		pos += phase / m_interp;
+		phase %= m_interp;
+	}
+	m_phase = phase;
+
+	const unsigned base = pos + 1 - numTaps;
+	if(base < avail)
+	{
+		m_histLen = avail - base;
+		memmove(hist, hist + base * chans, m_histLen * chans * sizeof(float));
+	}
+	else
+	{
+		// decimating past the end of this block, skip ahead in the next one
+		m_drop = base - avail;
+		m_histLen = 0;
+	}
+	return outCount;
+}
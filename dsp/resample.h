@@ -0,0 +1,300 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+#include <blockImpl.h>
+#include <vector>
+
+class CPolyphaseResampler
+{	// rational L/M resampler over interleaved float channels, state is carried between process() calls
+public:
+	CPolyphaseResampler(unsigned channels);
+	~CPolyphaseResampler();
+
+	void design(unsigned interp, unsigned decim, float passband);
+	void reset();
+	unsigned maxOutput(unsigned inCount) const;
+	unsigned process(const float* in, unsigned inCount, float* out);
+
+	inline unsigned interp() const			{ return m_interp; }
+	inline unsigned decim() const			{ return m_decim; }
+	inline unsigned tapsPerPhase() const	{ return m_numTaps; }
+
+	static double besselI0(double x);
+
+private:
+	CPolyphaseResampler(const CPolyphaseResampler& other);
+	CPolyphaseResampler& operator=(const CPolyphaseResampler& other);
+
+	enum { ATTENUATION_DB = 80, MAX_TAPS_PER_PHASE = 2048 };
+
+	const unsigned m_channels;
+	unsigned m_interp;
+	unsigned m_decim;
+	unsigned m_numTaps;			// taps in each polyphase branch
+	unsigned m_rowStride;		// floats in each branch, padded to a multiple of 4
+	float* m_bank;				// m_interp branches, each reversed and duplicated per channel
+	std::vector<float> m_hist;	// numTaps-1 samples of history followed by unconsumed input
+	unsigned m_histLen;			// samples currently in m_hist
+	unsigned m_phase;			// branch used for the next output
+	unsigned m_drop;			// input samples to discard before the next output
+
+	inline void dot(const float* coeff, const float* data, float* out) const;
+};
+
+template<signals::EType ET>
+class CResampler : public CThreadBlockBase
+{
+public:
+	CResampler(signals::IBlockDriver* driver);
+	virtual ~CResampler();
+
+private:
+	CResampler(const CResampler& other);
+	CResampler& operator=(const CResampler& other);
+
+public: // IBlock implementation
+	virtual const char* Name()				{ return NAME; }
+	virtual unsigned Incoming(signals::IInEndpoint** ep, unsigned availEP) { return singleIncoming(&m_incoming, ep, availEP); }
+	virtual unsigned Outgoing(signals::IOutEndpoint** ep, unsigned availEP) { return singleOutgoing(&m_outgoing, ep, availEP); }
+
+public:
+	struct
+	{
+		CAttributeBase* interp;
+		CAttributeBase* decim;
+		CAttributeBase* passband;
+	} attrs;
+
+	void setInterp(const long& interp);
+	void setDecim(const long& decim);
+	void setPassband(const float& passband);
+
+private:
+	enum
+	{
+		IN_BUFFER_TIMEOUT = 1000,
+		OUT_BUFFER_TIMEOUT = 1000,
+		IN_BLOCK_SIZE = 1024,
+		CHANNELS = sizeof(typename StoreType<ET>::type) / sizeof(float)
+	};
+
+	typedef typename StoreType<ET>::type store_type;
+	static const char* NAME;
+
+public:
+	class COutgoing : public CSimpleCascadeOutgoingChild<ET>
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline COutgoing(CResampler* parent):CSimpleCascadeOutgoingChild(parent->m_incoming),m_parent(parent) { }
+		void buildAttrs(const CResampler& parent);
+
+	protected:
+		CResampler* m_parent;
+
+	public:
+		struct
+		{
+			CEventAttribute* sync_fault;
+		} attrs;
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		COutgoing(const COutgoing& other);
+		COutgoing& operator=(const COutgoing& other);
+
+	public: // COutEndpointBase interface
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+	};
+
+	class CIncoming : public CSimpleCascadeIncomingChild
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline CIncoming(CResampler* parent):CSimpleCascadeIncomingChild(ET, parent, parent->m_outgoing) { }
+		virtual const char* EPName()	{ return EP_NAME; }
+		virtual const char* EPDescr()	{ return EP_DESCR; }
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		CIncoming(const CIncoming& other);
+		CIncoming& operator=(const CIncoming& other);
+	};
+
+private:
+	CIncoming m_incoming;
+	COutgoing m_outgoing;
+	CPolyphaseResampler m_engine;
+
+	volatile long m_interp;
+	volatile long m_decim;
+	volatile float m_passband;
+	volatile long m_redesign;
+
+	void buildAttrs();
+
+protected:
+	virtual void thread_run();
+};
+
+template<signals::EType ET>
+class CResamplerDriver : public signals::IBlockDriver
+{
+public:
+	inline CResamplerDriver() {}
+	virtual ~CResamplerDriver() {}
+
+private:
+	CResamplerDriver(const CResamplerDriver& other);
+	CResamplerDriver operator=(const CResamplerDriver& other);
+
+public:
+	virtual const char* Name()			{ return NAME; }
+	virtual const char* Description()	{ return DESCR; }
+	virtual BOOL canCreate()			{ return true; }
+	virtual BOOL canDiscover()			{ return false; }
+	virtual unsigned Discover(signals::IBlock** blocks, unsigned availBlocks) { return 0; }
+	virtual signals::IBlock* Create();
+	const unsigned char* Fingerprint()	{ return FINGERPRINT; }
+
+protected:
+	static const char* NAME;
+	static const char* DESCR;
+	static const unsigned char FINGERPRINT[];
+};
+
+// ------------------------------------------------------------------------------------------------
+
+template<signals::EType ET>
+const char* CResamplerDriver<ET>::NAME = "resample";
+
+template<signals::EType ET>
+const char* CResamplerDriver<ET>::DESCR = "Change the sample rate of a stream by a rational factor";
+
+template<signals::EType ET>
+const unsigned char CResamplerDriver<ET>::FINGERPRINT[] = { 1, (unsigned char)ET, 1, (unsigned char)ET };
+
+template<signals::EType ET>
+const char* CResampler<ET>::NAME = "Polyphase rational resampler";
+
+template<signals::EType ET>
+const char* CResampler<ET>::CIncoming::EP_NAME = "in";
+
+template<signals::EType ET>
+const char* CResampler<ET>::CIncoming::EP_DESCR = "Resampler incoming endpoint";
+
+template<signals::EType ET>
+const char* CResampler<ET>::COutgoing::EP_NAME = "out";
+
+template<signals::EType ET>
+const char* CResampler<ET>::COutgoing::EP_DESCR = "Resampler outgoing endpoint";
+
+// ------------------------------------------------------------------ class CResamplerDriver
+
+template<signals::EType ET>
+signals::IBlock * CResamplerDriver<ET>::Create()
+{
+	signals::IBlock* blk = new CResampler<ET>(this);
+	blk->AddRef();
+	return blk;
+}
+
+// ------------------------------------------------------------------ class CResampler
+
+#pragma warning(push)
+#pragma warning(disable: 4355)
+template<signals::EType ET>
+CResampler<ET>::CResampler(signals::IBlockDriver* driver)
+	:CThreadBlockBase(driver),m_incoming(this),m_outgoing(this),m_engine(CHANNELS),m_interp(1),m_decim(1),
+	 m_passband(0.8f),m_redesign(1)
+{
+	buildAttrs();
+	startThread();
+}
+#pragma warning(pop)
+
+template<signals::EType ET>
+CResampler<ET>::~CResampler()
+{
+	stopThread();
+}
+
+template<signals::EType ET>
+void CResampler<ET>::buildAttrs()
+{
+	attrs.interp = addLocalAttr(true, new CAttr_callback<signals::etypLong,CResampler>
+		(*this, "interpolate", "Upsampling factor (L)", &CResampler::setInterp, 1));
+	attrs.decim = addLocalAttr(true, new CAttr_callback<signals::etypLong,CResampler>
+		(*this, "decimate", "Downsampling factor (M)", &CResampler::setDecim, 1));
+	attrs.passband = addLocalAttr(true, new CAttr_callback<signals::etypSingle,CResampler>
+		(*this, "passband", "Fraction of the output bandwidth passed without attenuation", &CResampler::setPassband, 0.8f));
+	m_outgoing.buildAttrs(*this);
+}
+
+template<signals::EType ET>
+void CResampler<ET>::setInterp(const long& interp)
+{
+	InterlockedExchange(&m_interp, interp < 1 ? 1 : interp);
+	InterlockedExchange(&m_redesign, 1);
+}
+
+template<signals::EType ET>
+void CResampler<ET>::setDecim(const long& decim)
+{
+	InterlockedExchange(&m_decim, decim < 1 ? 1 : decim);
+	InterlockedExchange(&m_redesign, 1);
+}
+
+template<signals::EType ET>
+void CResampler<ET>::setPassband(const float& passband)
+{
+	m_passband = passband < 0.1f ? 0.1f : passband > 0.98f ? 0.98f : passband;
+	InterlockedExchange(&m_redesign, 1);
+}
+
+template<signals::EType ET>
+void CResampler<ET>::COutgoing::buildAttrs(const CResampler& parent)
+{
+	attrs.sync_fault = addLocalAttr(true, new CEventAttribute("syncFault", "Fires when a sync fault happens in a receive stream"));
+}
+
+template<signals::EType ET>
+void CResampler<ET>::thread_run()
+{
+	ThreadBase::SetThreadName("Resampler Thread");
+
+	std::vector<store_type> inBuffer(IN_BLOCK_SIZE);
+	std::vector<store_type> outBuffer;
+	while(threadRunning())
+	{
+		if(InterlockedExchange(&m_redesign, 0))
+		{
+			m_engine.design(m_interp, m_decim, m_passband);
+			outBuffer.resize(m_engine.maxOutput(IN_BLOCK_SIZE));
+		}
+
+		unsigned recvCount = m_incoming.Read(ET, inBuffer.data(), IN_BLOCK_SIZE, FALSE, IN_BUFFER_TIMEOUT);
+		if(!recvCount) continue;
+
+		unsigned outCount = m_engine.process((const float*)inBuffer.data(), recvCount, (float*)outBuffer.data());
+		if(outCount && m_outgoing.isConnected())
+		{
+			unsigned sentCount = m_outgoing.Write(ET, outBuffer.data(), outCount, OUT_BUFFER_TIMEOUT);
+			if(sentCount < outCount) m_outgoing.attrs.sync_fault->fire();
+		}
+	}
+}
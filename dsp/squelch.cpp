@@ -0,0 +1,78 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#include "stdafx.h"
+#include "squelch.h"
+#include <xmmintrin.h>
+
+// ------------------------------------------------------------------ class CEnergyGate
+
+CEnergyGate::CEnergyGate()
+	:m_openPower(1e-6f),m_closePower(1e-6f),m_attack(1),m_release(1),m_count(0),m_open(false)
+{
+}
+
+void CEnergyGate::configure(float openDb, float closeDb, unsigned attack, unsigned release)
+{
+	// a close level above the open level would make the gate chatter, so it is held at or below it
+	if(closeDb > openDb) closeDb = openDb;
+	m_openPower = (float)std::pow(10.0, openDb / 10.0);
+	m_closePower = (float)std::pow(10.0, closeDb / 10.0);
+	m_attack = attack < 1 ? 1 : attack;
+	m_release = release < 1 ? 1 : release;
+	m_count = 0;
+}
+
+void CEnergyGate::reset()
+{
+	m_count = 0;
+	m_open = false;
+}
+
+bool CEnergyGate::update(float power)
+{
+	const bool wantChange = m_open ? power < m_closePower : power >= m_openPower;
+	if(!wantChange)
+	{
+		m_count = 0;
+	}
+	else if(++m_count >= (m_open ? m_release : m_attack))
+	{
+		m_open = !m_open;
+		m_count = 0;
+	}
+	return m_open;
+}
+
+float CEnergyGate::framePower(const float* data, unsigned numFloats, unsigned numSamples)
+{
+	if(!numSamples) return 0.0f;
+
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+	unsigned idx = 0;
+	for(; idx + 8 <= numFloats; idx += 8)
+	{
+		__m128 a = _mm_loadu_ps(data + idx);
+		__m128 b = _mm_loadu_ps(data + idx + 4);
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(a, a));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(b, b));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+	float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	for(; idx < numFloats; idx++) sum += data[idx] * data[idx];
+	return sum / numSamples;
+}
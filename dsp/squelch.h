@@ -0,0 +1,463 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+#include <blockImpl.h>
+#include <deque>
+
+class CEnergyGate
+{	// open/close decision on per-frame power with separate thresholds and frame counts for each direction
+public:
+	CEnergyGate();
+
+	void configure(float openDb, float closeDb, unsigned attack, unsigned release);
+	void reset();
+	bool update(float power);				// returns true while the gate is open
+	inline bool isOpen() const				{ return m_open; }
+
+	static float framePower(const float* data, unsigned numFloats, unsigned numSamples);
+
+private:
+	float m_openPower;
+	float m_closePower;
+	unsigned m_attack;
+	unsigned m_release;
+	unsigned m_count;						// consecutive frames arguing for a change of state
+	bool m_open;
+};
+
+template<signals::EType ET, int IS_VECTOR = StoreType<ET>::is_vector>
+struct SquelchSample
+{	// streams are gated in windows of a fixed number of samples
+	typedef typename StoreType<ET>::type type;
+	enum { is_vector = 0, base_enum = ET };
+};
+
+template<signals::EType ET>
+struct SquelchSample<ET, 1>
+{	// frames are gated whole
+	typedef typename StoreType<ET>::base_type type;
+	enum { is_vector = 1, base_enum = StoreType<ET>::base_enum };
+};
+
+template<signals::EType ET>
+class CSquelch : public CThreadBlockBase
+{
+public:
+	CSquelch(signals::IBlockDriver* driver);
+	virtual ~CSquelch();
+
+private:
+	CSquelch(const CSquelch& other);
+	CSquelch& operator=(const CSquelch& other);
+
+public: // IBlock implementation
+	virtual const char* Name()				{ return NAME; }
+	virtual unsigned Incoming(signals::IInEndpoint** ep, unsigned availEP) { return singleIncoming(&m_incoming, ep, availEP); }
+	virtual unsigned Outgoing(signals::IOutEndpoint** ep, unsigned availEP) { return singleOutgoing(&m_outgoing, ep, availEP); }
+
+public:
+	struct
+	{
+		CAttributeBase* openLevel;
+		CAttributeBase* closeLevel;
+		CAttributeBase* attack;
+		CAttributeBase* release;
+		CAttributeBase* preTrigger;
+		CAttributeBase* window;
+		CAttributeBase* idleMarker;
+	} attrs;
+
+	void setOpenLevel(const float& level);
+	void setCloseLevel(const float& level);
+	void setAttack(const long& frames);
+	void setRelease(const long& frames);
+	void setPreTrigger(const long& frames);
+	void setWindow(const long& samples);
+	void setIdleMarker(const unsigned char& enable);
+
+private:
+	enum
+	{
+		IN_BUFFER_TIMEOUT = 1000,
+		OUT_BUFFER_TIMEOUT = 1000,
+		DEFAULT_WINDOW = 1024,
+		is_vector = SquelchSample<ET>::is_vector,
+		FLOATS_PER_SAMPLE = sizeof(typename SquelchSample<ET>::type) / sizeof(float)
+	};
+
+	typedef typename SquelchSample<ET>::type sample_type;
+	typedef Vector<(signals::EType)SquelchSample<ET>::base_enum> VectorType;
+	typedef std::deque<VectorType*> THistory;
+	static const char* NAME;
+
+	class CAttr_open : public CROAttribute<signals::etypBoolean>
+	{
+	public:
+		inline CAttr_open():CROAttribute<signals::etypBoolean>("open", "Whether data is currently passing", 0) { }
+		inline void update(bool newVal) { privateSetValue(newVal ? 1 : 0); }
+	};
+
+public:
+	class COutgoing : public CSimpleCascadeOutgoingChild<ET>
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline COutgoing(CSquelch* parent):CSimpleCascadeOutgoingChild(parent->m_incoming),m_parent(parent) { }
+		void buildAttrs(const CSquelch& parent);
+
+	protected:
+		CSquelch* m_parent;
+
+	public:
+		struct
+		{
+			CEventAttribute* sync_fault;
+			CEventAttribute* idle;
+			CAttr_open* open;
+		} attrs;
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		COutgoing(const COutgoing& other);
+		COutgoing& operator=(const COutgoing& other);
+
+	public: // COutEndpointBase interface
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+	};
+
+	class CIncoming : public CSimpleCascadeIncomingChild
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline CIncoming(CSquelch* parent):CSimpleCascadeIncomingChild(ET, parent, parent->m_outgoing) { }
+		virtual const char* EPName()	{ return EP_NAME; }
+		virtual const char* EPDescr()	{ return EP_DESCR; }
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		CIncoming(const CIncoming& other);
+		CIncoming& operator=(const CIncoming& other);
+	};
+
+private:
+	CIncoming m_incoming;
+	COutgoing m_outgoing;
+	CEnergyGate m_gate;
+
+	volatile float m_openLevel;
+	volatile float m_closeLevel;
+	volatile long m_attack;
+	volatile long m_release;
+	volatile long m_preTrigger;
+	volatile long m_window;
+	volatile long m_idleMarker;
+	volatile long m_reconfigure;
+
+	void buildAttrs();
+	VectorType* readFrame();
+	bool send(VectorType* frame);
+	void sendIdle();
+
+protected:
+	virtual void thread_run();
+};
+
+template<signals::EType ET>
+class CSquelchDriver : public signals::IBlockDriver
+{
+public:
+	inline CSquelchDriver() {}
+	virtual ~CSquelchDriver() {}
+
+private:
+	CSquelchDriver(const CSquelchDriver& other);
+	CSquelchDriver operator=(const CSquelchDriver& other);
+
+public:
+	virtual const char* Name()			{ return NAME; }
+	virtual const char* Description()	{ return DESCR; }
+	virtual BOOL canCreate()			{ return true; }
+	virtual BOOL canDiscover()			{ return false; }
+	virtual unsigned Discover(signals::IBlock** blocks, unsigned availBlocks) { return 0; }
+	virtual signals::IBlock* Create();
+	const unsigned char* Fingerprint()	{ return FINGERPRINT; }
+
+protected:
+	static const char* NAME;
+	static const char* DESCR;
+	static const unsigned char FINGERPRINT[];
+};
+
+// ------------------------------------------------------------------------------------------------
+
+template<signals::EType ET>
+const char* CSquelchDriver<ET>::NAME = "squelch";
+
+template<signals::EType ET>
+const char* CSquelchDriver<ET>::DESCR = "Pass data downstream only while its power says the channel is active";
+
+template<signals::EType ET>
+const unsigned char CSquelchDriver<ET>::FINGERPRINT[] = { 1, (unsigned char)ET, 1, (unsigned char)ET };
+
+template<signals::EType ET>
+const char* CSquelch<ET>::NAME = "Squelch";
+
+template<signals::EType ET>
+const char* CSquelch<ET>::CIncoming::EP_NAME = "in";
+
+template<signals::EType ET>
+const char* CSquelch<ET>::CIncoming::EP_DESCR = "Squelch incoming endpoint";
+
+template<signals::EType ET>
+const char* CSquelch<ET>::COutgoing::EP_NAME = "out";
+
+template<signals::EType ET>
+const char* CSquelch<ET>::COutgoing::EP_DESCR = "Squelch outgoing endpoint, idle markers are empty frames, a stream fires the idle event instead";
+
+// ------------------------------------------------------------------ class CSquelchDriver
+
+template<signals::EType ET>
+signals::IBlock * CSquelchDriver<ET>::Create()
+{
+	signals::IBlock* blk = new CSquelch<ET>(this);
+	blk->AddRef();
+	return blk;
+}
+
+// ------------------------------------------------------------------ class CSquelch
+
+#pragma warning(push)
+#pragma warning(disable: 4355)
+template<signals::EType ET>
+CSquelch<ET>::CSquelch(signals::IBlockDriver* driver)
+	:CThreadBlockBase(driver),m_incoming(this),m_outgoing(this),m_openLevel(-60.0f),m_closeLevel(-66.0f),m_attack(1),
+	 m_release(10),m_preTrigger(2),m_window(DEFAULT_WINDOW),m_idleMarker(0),m_reconfigure(1)
+{
+	buildAttrs();
+	startThread();
+}
+#pragma warning(pop)
+
+template<signals::EType ET>
+CSquelch<ET>::~CSquelch()
+{
+	stopThread();
+}
+
+template<signals::EType ET>
+void CSquelch<ET>::buildAttrs()
+{
+	m_outgoing.buildAttrs(*this);
+	attrs.openLevel = addLocalAttr(true, new CAttr_callback<signals::etypSingle,CSquelch>
+		(*this, "openLevel", "Frame power (dB full scale) that opens the gate", &CSquelch::setOpenLevel, -60.0f));
+	attrs.closeLevel = addLocalAttr(true, new CAttr_callback<signals::etypSingle,CSquelch>
+		(*this, "closeLevel", "Frame power (dB full scale) below which the gate closes", &CSquelch::setCloseLevel, -66.0f));
+	attrs.attack = addLocalAttr(true, new CAttr_callback<signals::etypLong,CSquelch>
+		(*this, "attack", "Consecutive loud frames needed to open", &CSquelch::setAttack, 1));
+	attrs.release = addLocalAttr(true, new CAttr_callback<signals::etypLong,CSquelch>
+		(*this, "release", "Consecutive quiet frames needed to close", &CSquelch::setRelease, 10));
+	attrs.preTrigger = addLocalAttr(true, new CAttr_callback<signals::etypLong,CSquelch>
+		(*this, "preTrigger", "Frames from before the gate opened that are sent when it does", &CSquelch::setPreTrigger, 2));
+	attrs.window = addLocalAttr(true, new CAttr_callback<signals::etypLong,CSquelch>
+		(*this, "window", "Samples in each measured frame of a stream", &CSquelch::setWindow, DEFAULT_WINDOW));
+	attrs.idleMarker = addLocalAttr(true, new CAttr_callback<signals::etypBoolean,CSquelch>
+		(*this, "idleMarker", "Send a marker in place of each frame held back while closed", &CSquelch::setIdleMarker, 0));
+}
+
+template<signals::EType ET>
+void CSquelch<ET>::COutgoing::buildAttrs(const CSquelch& parent)
+{
+	attrs.sync_fault = addLocalAttr(true, new CEventAttribute("syncFault", "Fires when a sync fault happens in a receive stream"));
+	attrs.idle = addLocalAttr(true, new CEventAttribute("idle", "Fires in place of each stream window held back while closed, with idleMarker set"));
+	attrs.open = addLocalAttr(true, new CAttr_open());
+}
+
+template<signals::EType ET>
+void CSquelch<ET>::setOpenLevel(const float& level)
+{
+	m_openLevel = level;
+	InterlockedExchange(&m_reconfigure, 1);
+}
+
+template<signals::EType ET>
+void CSquelch<ET>::setCloseLevel(const float& level)
+{
+	m_closeLevel = level;
+	InterlockedExchange(&m_reconfigure, 1);
+}
+
+template<signals::EType ET>
+void CSquelch<ET>::setAttack(const long& frames)
+{
+	InterlockedExchange(&m_attack, frames < 1 ? 1 : frames);
+	InterlockedExchange(&m_reconfigure, 1);
+}
+
+template<signals::EType ET>
+void CSquelch<ET>::setRelease(const long& frames)
+{
+	InterlockedExchange(&m_release, frames < 1 ? 1 : frames);
+	InterlockedExchange(&m_reconfigure, 1);
+}
+
+template<signals::EType ET>
+void CSquelch<ET>::setPreTrigger(const long& frames)
+{
+	InterlockedExchange(&m_preTrigger, frames < 0 ? 0 : frames);
+}
+
+template<signals::EType ET>
+void CSquelch<ET>::setWindow(const long& samples)
+{
+	InterlockedExchange(&m_window, samples < 1 ? 1 : samples);
+}
+
+template<signals::EType ET>
+void CSquelch<ET>::setIdleMarker(const unsigned char& enable)
+{
+	InterlockedExchange(&m_idleMarker, enable ? 1 : 0);
+}
+
+template<signals::EType ET>
+typename CSquelch<ET>::VectorType* CSquelch<ET>::readFrame()
+{
+	if(is_vector)
+	{
+		signals::IVector* frame = NULL;
+		if(!m_incoming.ReadOne(ET, &frame, IN_BUFFER_TIMEOUT)) return NULL;
+		VectorType* ours = VectorType::native(frame);
+		if(ours) return ours;
+
+		// a frame from elsewhere is copied, the history and send() need one of our own vectors
+		const unsigned size = frame->Size();
+		ours = VectorType::retrieve(size);
+		memcpy(ours->data, frame->Data(), size * sizeof(sample_type));
+		frame->Release();
+		return ours;
+	}
+	else
+	{
+		// streams are cut into windows so they can be measured and held like frames
+		const unsigned window = m_window;
+		VectorType* frame = VectorType::retrieve(window);
+		unsigned recvCount = m_incoming.Read(ET, frame->data, window, TRUE, IN_BUFFER_TIMEOUT);
+		if(recvCount < window)
+		{
+			// a partial window is measured on its own rather than delaying the data
+			if(!recvCount)
+			{
+				frame->Release();
+				return NULL;
+			}
+			VectorType* partial = VectorType::retrieve(recvCount);
+			memcpy(partial->data, frame->data, recvCount * sizeof(sample_type));
+			frame->Release();
+			frame = partial;
+		}
+		return frame;
+	}
+}
+
+template<signals::EType ET>
+bool CSquelch<ET>::send(VectorType* frame)
+{
+	// consumes the reference to frame
+	if(is_vector)
+	{
+		if(m_outgoing.WriteOne(ET, &frame, INFINITE)) return true;
+		frame->Release();
+		return false;
+	}
+	else
+	{
+		bool complete = false;
+		if(m_outgoing.isConnected())
+		{
+			unsigned sentCount = m_outgoing.Write(ET, frame->data, frame->size, OUT_BUFFER_TIMEOUT);
+			complete = sentCount == frame->size;
+		}
+		frame->Release();
+		return complete;
+	}
+}
+
+template<signals::EType ET>
+void CSquelch<ET>::sendIdle()
+{
+	// a stream has no empty frame to send, anything written would be taken as signal
+	if(is_vector)
+	{
+		if(!send(VectorType::retrieve(0)) && m_outgoing.isConnected()) m_outgoing.attrs.sync_fault->fire();
+	}
+	else
+	{
+		m_outgoing.attrs.idle->fire();
+	}
+}
+
+template<signals::EType ET>
+void CSquelch<ET>::thread_run()
+{
+	ThreadBase::SetThreadName("Squelch Thread");
+
+	THistory history;
+	while(threadRunning())
+	{
+		if(InterlockedExchange(&m_reconfigure, 0))
+		{
+			m_gate.configure(m_openLevel, m_closeLevel, m_attack, m_release);
+		}
+
+		VectorType* frame = readFrame();
+		if(!frame) continue;
+
+		const bool wasOpen = m_gate.isOpen();
+		const bool open = m_gate.update(CEnergyGate::framePower((const float*)frame->data,
+			frame->size * FLOATS_PER_SAMPLE, frame->size));
+		if(open != wasOpen) m_outgoing.attrs.open->update(open);
+
+		if(open)
+		{
+			// the held frames go out first, oldest to newest
+			bool sent = true;
+			while(!history.empty())
+			{
+				if(!send(history.front())) sent = false;
+				history.pop_front();
+			}
+			if(!send(frame)) sent = false;
+			if(!sent && m_outgoing.isConnected()) m_outgoing.attrs.sync_fault->fire();
+		}
+		else
+		{
+			// frames still being judged by the attack count are kept along with the pre-trigger frames
+			history.push_back(frame);
+			const unsigned keep = (unsigned)m_preTrigger + (unsigned)m_attack - 1;
+			while(history.size() > keep)
+			{
+				history.front()->Release();
+				history.pop_front();
+			}
+			if(m_idleMarker) sendIdle();
+		}
+	}
+	while(!history.empty())
+	{
+		history.front()->Release();
+		history.pop_front();
+	}
+}
@@ -0,0 +1,41 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+// stdafx.h : include file for standard system include files,
+// or project specific include files that are used frequently, but
+// are changed infrequently
+//
+
+#pragma once
+
+#include "targetver.h"
+
+#define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
+// Windows Header Files:
+#include <windows.h>
+
+#include <tchar.h>
+
+#ifdef _DEBUG
+  #define ASSERT(x) { if(!(x)) DebugBreak(); }
+  #define VERIFY(x)  { if(!(x)) DebugBreak(); }
+  #define UNUSED(x)
+  #define UNUSED_ALWAYS(x) (x)
+#else
+  #define ASSERT(x)
+  #define VERIFY(x) (x)
+  #define UNUSED(x) (x)
+  #define UNUSED_ALWAYS(x) (x)
+#endif
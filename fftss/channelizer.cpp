@@ -0,0 +1,353 @@
+/*
+	Copyright 2012-2013 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#include "stdafx.h"
+#include "channelizer.h"
+#include <emmintrin.h>
+
+namespace fftss {
+
+static const double PI = std::atan(1.0)*4;
+
+const char* CChannelizer::NAME = "Polyphase filter-bank channelizer";
+const char* CChannelizer::CIncoming::EP_NAME = "in";
+const char* CChannelizer::CIncoming::EP_DESCR = "Channelizer incoming endpoint";
+const char* CChannelizer::COutgoing::EP_NAME = "out";
+const char* CChannelizer::COutgoing::EP_DESCR = "Channelizer outgoing endpoint, one frame holds frameLength samples of channel 0, then channel 1...";
+
+const unsigned char CChannelizerDriver::FINGERPRINT[] = { 1, (unsigned char)signals::etypComplex, 1, (unsigned char)signals::etypVecComplex };
+const char* CChannelizerDriver::NAME = "channelize";
+const char* CChannelizerDriver::DESCR = "Split a stream into evenly spaced channels using a polyphase filter bank";
+
+static double besselI0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	for(unsigned k = 1; k < 64 && term > sum * 1e-12; k++)
+	{
+		term *= (x / 2 / k) * (x / 2 / k);
+		sum += term;
+	}
+	return sum;
+}
+
+// ------------------------------------------------------------------ class CPolyphaseChannelizer
+
+CPolyphaseChannelizer::CPolyphaseChannelizer()
+	:m_channels(0),m_decim(0),m_protoLen(0),m_histStart(0),m_histLen(0),m_rotate(0),m_fold(NULL),m_spec(NULL),m_plan(NULL)
+{
+}
+
+CPolyphaseChannelizer::~CPolyphaseChannelizer()
+{
+	clear();
+}
+
+void CPolyphaseChannelizer::clear()
+{
+	if(m_plan) ::fftss_destroy_plan(m_plan);
+	if(m_fold) ::fftss_free(m_fold);
+	if(m_spec) ::fftss_free(m_spec);
+	m_plan = NULL;
+	m_fold = m_spec = NULL;
+	m_channels = m_decim = m_protoLen = 0;
+}
+
+void CPolyphaseChannelizer::designPrototype(unsigned channels, unsigned tapsPerChannel, std::vector<double>& proto)
+{
+	// Kaiser-windowed sinc with its -6dB point on the channel edge
+	static const double BETA = 7.0;
+	const unsigned len = channels * tapsPerChannel;
+	const double cutoff = 0.5 / channels;
+	const double center = (len - 1) / 2.0;
+	const double norm = besselI0(BETA);
+	proto.resize(len);
+
+	double sum = 0.0;
+	for(unsigned n = 0; n < len; n++)
+	{
+		const double t = n - center;
+		const double x = len > 1 ? 2.0 * t / (len - 1) : 0.0;
+		const double window = besselI0(BETA * std::sqrt(max(0.0, 1.0 - x * x))) / norm;
+		proto[n] = (t == 0.0 ? 2.0 * cutoff : std::sin(2.0 * PI * cutoff * t) / (PI * t)) * window;
+		sum += proto[n];
+	}
+	for(unsigned n = 0; n < len; n++) proto[n] /= sum;
+}
+
+bool CPolyphaseChannelizer::configure(unsigned channels, unsigned decim, const double* proto, unsigned protoLen)
+{
+	clear();
+	if(channels < 2 || !decim || decim > channels || !proto || !protoLen) return false;
+
+	m_fold = (TComplexDbl*)::fftss_malloc(sizeof(TComplexDbl) * channels);
+	m_spec = (TComplexDbl*)::fftss_malloc(sizeof(TComplexDbl) * channels);
+	m_plan = ::fftss_plan_dft_1d(channels, (double*)m_fold, (double*)m_spec, FFTSS_BACKWARD, FFTSS_MEASURE);
+	if(!m_plan)
+	{
+		clear();
+		return false;
+	}
+	m_channels = channels;
+	m_decim = decim;
+
+	// pad the prototype to whole branches and reverse it so it multiplies the history oldest-first
+	m_protoLen = (protoLen + channels - 1) / channels * channels;
+	m_proto.assign(m_protoLen, 0.0);
+	for(unsigned idx = 0; idx < protoLen; idx++)
+	{
+		m_proto[m_protoLen - 1 - idx] = proto[idx];
+	}
+
+	// the first output is available after the first input sample
+	m_hist.assign(m_protoLen - 1, TComplex(0.0f, 0.0f));
+	m_histStart = 0;
+	m_histLen = m_protoLen - 1;
+	m_rotate = 0;
+	return true;
+}
+
+void CPolyphaseChannelizer::write(const TComplex* in, unsigned count)
+{
+	if(m_histStart)
+	{
+		m_histLen -= m_histStart;
+		memmove(m_hist.data(), m_hist.data() + m_histStart, m_histLen * sizeof(TComplex));
+		m_histStart = 0;
+	}
+	if(m_hist.size() < m_histLen + count) m_hist.resize(m_histLen + count);
+	memcpy(m_hist.data() + m_histLen, in, count * sizeof(TComplex));
+	m_histLen += count;
+}
+
+bool CPolyphaseChannelizer::next(TComplex* out)
+{
+	if(!m_channels || m_histLen - m_histStart < m_protoLen) return false;
+	const unsigned channels = m_channels;
+
+	// weight the window and fold it into one sum per branch, most recent branch last.  Each row of the window holds
+	// one tap of every branch, so rows are added in whole: two samples at a time widened to doubles, each with its own tap
+	const TComplex* window = m_hist.data() + m_histStart;
+	const double* proto = m_proto.data();
+	double* branch = (double*)m_spec;
+	for(unsigned r = 0; r < channels; r++) _mm_store_pd(branch + r * 2, _mm_setzero_pd());
+	for(unsigned row = 0; row < m_protoLen; row += channels)
+	{
+		const float* src = (const float*)(window + row);
+		const double* taps = proto + row;
+		unsigned r = 0;
+		for(; r + 2 <= channels; r += 2)
+		{
+			const __m128 samples = _mm_loadu_ps(src + r * 2);
+			const __m128d tap = _mm_loadu_pd(taps + r);
+			double* dest = branch + r * 2;
+			_mm_store_pd(dest, _mm_add_pd(_mm_load_pd(dest), _mm_mul_pd(_mm_unpacklo_pd(tap, tap), _mm_cvtps_pd(samples))));
+			_mm_store_pd(dest + 2, _mm_add_pd(_mm_load_pd(dest + 2),
+				_mm_mul_pd(_mm_unpackhi_pd(tap, tap), _mm_cvtps_pd(_mm_movehl_ps(samples, samples)))));
+		}
+		if(r < channels)
+		{
+			const __m128 sample = _mm_castpd_ps(_mm_load_sd((const double*)(src + r * 2)));
+			double* dest = branch + r * 2;
+			_mm_store_pd(dest, _mm_add_pd(_mm_load_pd(dest), _mm_mul_pd(_mm_load1_pd(taps + r), _mm_cvtps_pd(sample))));
+		}
+	}
+
+	// reorder so the transform input starts at the newest sample, rotated to keep each channel's phase
+	// continuous when decim is less than the channel count: two reversed runs either side of the rotation point
+	const unsigned rotate = m_rotate;
+	const double* from = branch;
+	double* to = (double*)m_fold;
+	for(unsigned m = 0; m < channels - rotate; m++)
+	{
+		_mm_store_pd(to + m * 2, _mm_load_pd(from + (channels - 1 - rotate - m) * 2));
+	}
+	for(unsigned m = channels - rotate; m < channels; m++)
+	{
+		_mm_store_pd(to + m * 2, _mm_load_pd(from + (2 * channels - 1 - rotate - m) * 2));
+	}
+	::fftss_execute_dft(m_plan, (double*)m_fold, (double*)m_spec);
+
+	const double* spec = (const double*)m_spec;
+	float* dest = (float*)out;
+	unsigned k = 0;
+	for(; k + 2 <= channels; k += 2)
+	{
+		_mm_storeu_ps(dest + k * 2, _mm_movelh_ps(_mm_cvtpd_ps(_mm_load_pd(spec + k * 2)), _mm_cvtpd_ps(_mm_load_pd(spec + k * 2 + 2))));
+	}
+	if(k < channels) out[k] = TComplex(m_spec[k]);
+
+	m_histStart += m_decim;
+	m_rotate = (m_rotate + m_decim) % channels;
+	return true;
+}
+
+// ------------------------------------------------------------------ class CChannelizer
+
+#pragma warning(push)
+#pragma warning(disable: 4355)
+CChannelizer::CChannelizer(signals::IBlockDriver* driver)
+	:CThreadBlockBase(driver),m_incoming(this),m_outgoing(this),m_channels(DEFAULT_CHANNELS),m_oversample(0),
+	 m_tapsPerChannel(DEFAULT_TAPS_PER_CHANNEL),m_frameLength(DEFAULT_FRAME_LENGTH),m_rebuild(1)
+{
+	buildAttrs();
+	startThread();
+}
+#pragma warning(pop)
+
+CChannelizer::~CChannelizer()
+{
+	stopThread();
+}
+
+void CChannelizer::buildAttrs()
+{
+	attrs.channels = addLocalAttr(true, new CAttr_channels(*this));
+	attrs.oversample = addLocalAttr(true, new CAttr_oversample(*this));
+	attrs.tapsPerChannel = addLocalAttr(true, new CAttr_callback<signals::etypLong,CChannelizer>
+		(*this, "tapsPerChannel", "Length of the designed prototype filter, in multiples of the channel count", &CChannelizer::setTapsPerChannel, DEFAULT_TAPS_PER_CHANNEL));
+	attrs.frameLength = addLocalAttr(true, new CAttr_callback<signals::etypLong,CChannelizer>
+		(*this, "frameLength", "Number of samples of each channel in an outgoing frame", &CChannelizer::setFrameLength, DEFAULT_FRAME_LENGTH));
+	attrs.prototype = addLocalAttr(true, new CAttr_prototype(*this));
+	m_outgoing.buildAttrs(*this);
+}
+
+void CChannelizer::COutgoing::buildAttrs(const CChannelizer& parent)
+{
+	attrs.sync_fault = addLocalAttr(true, new CEventAttribute("syncFault", "Fires when a sync fault happens in a receive stream"));
+}
+
+void CChannelizer::setChannels(const long& channels)
+{
+	InterlockedExchange(&m_channels, channels);
+	InterlockedExchange(&m_rebuild, 1);
+}
+
+void CChannelizer::setOversample(const unsigned char& oversample)
+{
+	InterlockedExchange(&m_oversample, oversample ? 1 : 0);
+	InterlockedExchange(&m_rebuild, 1);
+}
+
+void CChannelizer::setTapsPerChannel(const long& taps)
+{
+	InterlockedExchange(&m_tapsPerChannel, taps < 1 ? 1 : taps);
+	InterlockedExchange(&m_rebuild, 1);
+}
+
+void CChannelizer::setFrameLength(const long& length)
+{
+	InterlockedExchange(&m_frameLength, length < 1 ? 1 : length);
+	InterlockedExchange(&m_rebuild, 1);
+}
+
+void CChannelizer::setPrototype(signals::IVector* proto)
+{
+	// the attribute holds the taps, the processing thread picks them up at its next rebuild
+	UNUSED_ALWAYS(proto);
+	InterlockedExchange(&m_rebuild, 1);
+}
+
+bool CChannelizer::rebuild()
+{
+	const unsigned channels = m_channels;
+	if(channels < 2) return false;
+	ASSERT(!m_oversample || !(channels & 1));
+	const unsigned decim = m_oversample ? channels / 2 : channels;
+
+	bool result;
+	signals::IVector* proto = attrs.prototype->nativeGetValue();
+	if(proto && proto->Size())
+	{
+		result = m_engine.configure(channels, decim, (const double*)proto->Data(), proto->Size());
+	}
+	else
+	{
+		std::vector<double> designed;
+		CPolyphaseChannelizer::designPrototype(channels, m_tapsPerChannel, designed);
+		result = m_engine.configure(channels, decim, designed.data(), (unsigned)designed.size());
+	}
+	if(proto) proto->Release();
+	return result;
+}
+
+void CChannelizer::thread_run()
+{
+	ThreadBase::SetThreadName("Channelizer Thread");
+
+	std::vector<TComplex> inBuffer(IN_BLOCK_SIZE);
+	std::vector<TComplex> step;
+	VectorType* frame = NULL;
+	unsigned frameLength = 0;
+	unsigned column = 0;
+	bool configured = false;
+	while(threadRunning())
+	{
+		if(InterlockedExchange(&m_rebuild, 0))
+		{
+			if(frame)
+			{
+				frame->Release();
+				frame = NULL;
+			}
+			column = 0;
+			configured = rebuild();
+			frameLength = m_frameLength;
+			step.resize(m_engine.channels());
+		}
+		if(!configured)
+		{
+			Sleep(IN_BUFFER_TIMEOUT);		// no plan!
+			continue;
+		}
+
+		unsigned recvCount = m_incoming.Read(signals::etypComplex, inBuffer.data(), IN_BLOCK_SIZE, FALSE, IN_BUFFER_TIMEOUT);
+		if(!recvCount) continue;
+		m_engine.write(inBuffer.data(), recvCount);
+
+		const unsigned channels = m_engine.channels();
+		while(m_engine.next(step.data()))
+		{
+			if(!frame) frame = VectorType::retrieve(channels * frameLength);
+			for(unsigned chan = 0; chan < channels; chan++)
+			{
+				frame->data[chan * frameLength + column] = step[chan];
+			}
+			if(++column == frameLength)
+			{
+				BOOL outFrame = m_outgoing.WriteOne(signals::etypVecComplex, &frame, INFINITE);
+				if(!outFrame)
+				{
+					if(m_outgoing.isConnected()) m_outgoing.attrs.sync_fault->fire();
+					frame->Release();
+				}
+				frame = NULL;
+				column = 0;
+			}
+		}
+	}
+	if(frame) frame->Release();
+}
+
+// ------------------------------------------------------------------ class CChannelizerDriver
+
+signals::IBlock * CChannelizerDriver::Create()
+{
+	signals::IBlock* blk = new CChannelizer(this);
+	blk->AddRef();
+	return blk;
+}
+
+}
@@ -0,0 +1,232 @@
+/*
+	Copyright 2012-2013 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+
+#include <blockImpl.h>
+#include <vector>
+#include "fftss/include/fftss.h"
+
+namespace fftss {
+
+class CPolyphaseChannelizer
+{	// analysis filter bank: every "decim" input samples produces one sample for each of "channels" channels
+public:
+	typedef std::complex<float> TComplex;
+	typedef std::complex<double> TComplexDbl;
+
+	CPolyphaseChannelizer();
+	~CPolyphaseChannelizer();
+
+	bool configure(unsigned channels, unsigned decim, const double* proto, unsigned protoLen);
+	static void designPrototype(unsigned channels, unsigned tapsPerChannel, std::vector<double>& proto);
+
+	void write(const TComplex* in, unsigned count);
+	bool next(TComplex* out);
+
+	inline unsigned channels() const		{ return m_channels; }
+	inline unsigned decim() const			{ return m_decim; }
+
+private:
+	CPolyphaseChannelizer(const CPolyphaseChannelizer& other);
+	CPolyphaseChannelizer& operator=(const CPolyphaseChannelizer& other);
+
+	unsigned m_channels;
+	unsigned m_decim;
+	unsigned m_protoLen;			// a multiple of m_channels
+	std::vector<double> m_proto;	// prototype filter, time-reversed to line up with the history
+	std::vector<TComplex> m_hist;	// input samples, the oldest protoLen of them are the current window
+	unsigned m_histStart;
+	unsigned m_histLen;
+	unsigned m_rotate;				// circular shift that aligns each channel's phase, (n * decim) mod channels
+	TComplexDbl* m_fold;
+	TComplexDbl* m_spec;
+	fftss_plan m_plan;
+
+	void clear();
+};
+
+class CChannelizer : public CThreadBlockBase
+{
+public:
+	CChannelizer(signals::IBlockDriver* driver);
+	virtual ~CChannelizer();
+
+private:
+	CChannelizer(const CChannelizer& other);
+	CChannelizer& operator=(const CChannelizer& other);
+
+public: // IBlock implementation
+	virtual const char* Name()				{ return NAME; }
+	virtual unsigned Incoming(signals::IInEndpoint** ep, unsigned availEP) { return singleIncoming(&m_incoming, ep, availEP); }
+	virtual unsigned Outgoing(signals::IOutEndpoint** ep, unsigned availEP) { return singleOutgoing(&m_outgoing, ep, availEP); }
+
+public:
+	void setChannels(const long& channels);
+	void setOversample(const unsigned char& oversample);
+	void setTapsPerChannel(const long& taps);
+	void setFrameLength(const long& length);
+	void setPrototype(signals::IVector* proto);
+
+private:
+	enum
+	{
+		IN_BUFFER_TIMEOUT = 1000,
+		IN_BLOCK_SIZE = 4096,
+		DEFAULT_CHANNELS = 16,
+		DEFAULT_TAPS_PER_CHANNEL = 8,
+		DEFAULT_FRAME_LENGTH = 256,
+	};
+
+	typedef std::complex<float> TComplex;
+	typedef StoreType<signals::etypVecComplex>::buffer_templ VectorType;
+	static const char* NAME;
+
+	// oversampling steps by half the channel count, so it cannot be combined with an odd number of channels
+	class CAttr_channels : public CAttr_callback<signals::etypLong,CChannelizer>
+	{
+	public:
+		inline CAttr_channels(CChannelizer& parent)
+			:CAttr_callback<signals::etypLong,CChannelizer>(parent, "channels", "Number of channels the input is divided into, even when oversampling",
+				&CChannelizer::setChannels, DEFAULT_CHANNELS) { }
+
+		virtual bool isValidValue(const long& newVal) const
+		{
+			return newVal >= 2 && (!m_parent.m_oversample || !(newVal & 1));
+		}
+	};
+
+	class CAttr_oversample : public CAttr_callback<signals::etypBoolean,CChannelizer>
+	{
+	public:
+		inline CAttr_oversample(CChannelizer& parent)
+			:CAttr_callback<signals::etypBoolean,CChannelizer>(parent, "oversample",
+				"Produce channels at twice their bandwidth so they overlap without aliasing, needs an even channel count",
+				&CChannelizer::setOversample, 0) { }
+
+		virtual bool isValidValue(const unsigned char& newVal) const
+		{
+			return !newVal || !(m_parent.m_channels & 1);
+		}
+	};
+
+	class CAttr_prototype : public CRWVectorAttribute<signals::etypVecDouble>
+	{
+	public:
+		inline CAttr_prototype(CChannelizer& parent)
+			:CRWVectorAttribute<signals::etypVecDouble>("prototype", "Prototype low-pass filter, empty to use a Kaiser design"),m_parent(parent) { }
+
+	protected:
+		CChannelizer& m_parent;
+		virtual void onSetValue(signals::IVector* value)
+		{
+			m_parent.setPrototype(value);
+			CRWVectorAttribute<signals::etypVecDouble>::onSetValue(value);
+		}
+	};
+
+	struct
+	{
+		CAttributeBase* channels;
+		CAttributeBase* oversample;
+		CAttributeBase* tapsPerChannel;
+		CAttributeBase* frameLength;
+		CAttr_prototype* prototype;
+	} attrs;
+
+public:
+	class COutgoing : public CSimpleCascadeOutgoingChild<signals::etypVecComplex>
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline COutgoing(CChannelizer* parent):CSimpleCascadeOutgoingChild(parent->m_incoming),m_parent(parent) { }
+		void buildAttrs(const CChannelizer& parent);
+
+	protected:
+		CChannelizer* m_parent;
+
+	public:
+		struct
+		{
+			CEventAttribute* sync_fault;
+		} attrs;
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		COutgoing(const COutgoing& other);
+		COutgoing& operator=(const COutgoing& other);
+
+	public: // COutEndpointBase interface
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+	};
+
+	class CIncoming : public CSimpleCascadeIncomingChild
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline CIncoming(CChannelizer* parent)
+			:CSimpleCascadeIncomingChild(signals::etypComplex, parent, parent->m_outgoing) { }
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		CIncoming(const CIncoming& other);
+		CIncoming& operator=(const CIncoming& other);
+	};
+
+private:
+	CIncoming m_incoming;
+	COutgoing m_outgoing;
+	CPolyphaseChannelizer m_engine;
+
+	volatile long m_channels;
+	volatile long m_oversample;
+	volatile long m_tapsPerChannel;
+	volatile long m_frameLength;
+	volatile long m_rebuild;
+
+	void buildAttrs();
+	bool rebuild();
+	virtual void thread_run();
+};
+
+class CChannelizerDriver : public signals::IBlockDriver
+{
+public:
+	inline CChannelizerDriver() {}
+	virtual ~CChannelizerDriver() {}
+
+private:
+	CChannelizerDriver(const CChannelizerDriver& other);
+	CChannelizerDriver operator=(const CChannelizerDriver& other);
+
+public:
+	virtual const char* Name()			{ return NAME; }
+	virtual const char* Description()	{ return DESCR; }
+	virtual BOOL canCreate()			{ return true; }
+	virtual BOOL canDiscover()			{ return false; }
+	virtual unsigned Discover(signals::IBlock** blocks, unsigned availBlocks) { return 0; }
+	virtual signals::IBlock* Create();
+	const unsigned char* Fingerprint()	{ return FINGERPRINT; }
+
+protected:
+	static const char* NAME;
+	static const char* DESCR;
+	static const unsigned char FINGERPRINT[];
+};
+
+}
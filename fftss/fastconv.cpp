@@ -0,0 +1,314 @@
+/*
+	Copyright 2012-2013 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#include "stdafx.h"
+#include "fastconv.h"
+
+namespace fftss {
+
+const char* CFastConvolver::NAME = "FIR filter using overlap-save fast convolution";
+const char* CFastConvolver::CIncoming::EP_NAME = "in";
+const char* CFastConvolver::CIncoming::EP_DESCR = "FIR filter incoming endpoint";
+const char* CFastConvolver::COutgoing::EP_NAME = "out";
+const char* CFastConvolver::COutgoing::EP_DESCR = "FIR filter outgoing endpoint";
+
+const unsigned char CFastConvolverDriver::FINGERPRINT[] = { 1, (unsigned char)signals::etypComplex, 1, (unsigned char)signals::etypComplex };
+const char* CFastConvolverDriver::NAME = "fir";
+const char* CFastConvolverDriver::DESCR = "FIR filter using overlap-save fast convolution";
+
+// ------------------------------------------------------------------ class COverlapSave::Kernel
+
+COverlapSave::Kernel::Kernel(unsigned fftSize, unsigned numTaps)
+	:fftSize(fftSize),numTaps(numTaps),m_refCount(0)
+{
+	resp = (TComplexDbl*)::fftss_malloc(sizeof(TComplexDbl) * fftSize);
+}
+
+COverlapSave::Kernel::~Kernel()
+{
+	::fftss_free(resp);
+}
+
+unsigned COverlapSave::Kernel::Release()
+{
+	unsigned newref = _InterlockedDecrement(&m_refCount);
+	if(!newref) delete this;
+	return newref;
+}
+
+COverlapSave::Kernel* COverlapSave::Kernel::build(const TComplexDbl* taps, unsigned numTaps, unsigned minTaps)
+{
+	// an empty tap set is a unit impulse, so clearing the taps passes the stream through rather than
+	// leaving the previous filter in place
+	static const TComplexDbl UNIT_IMPULSE(1.0);
+	if(!numTaps)
+	{
+		taps = &UNIT_IMPULSE;
+		numTaps = 1;
+	}
+
+	// shorter tap sets are zero-padded to the current length so they can be swapped in without a glitch
+	unsigned kernTaps = max(numTaps, minTaps);
+
+	// a transform of at least four times the filter length keeps the per-sample cost near its minimum
+	unsigned fftSize = 64;
+	while(fftSize < 4 * kernTaps) fftSize <<= 1;
+
+	Kernel* kern = new Kernel(fftSize, kernTaps);
+	TComplexDbl* temp = (TComplexDbl*)::fftss_malloc(sizeof(TComplexDbl) * fftSize);
+	const double scale = 1.0 / fftSize;
+	for(unsigned idx = 0; idx < numTaps; idx++) temp[idx] = taps[idx] * scale;
+	for(unsigned idx = numTaps; idx < fftSize; idx++) temp[idx] = 0.0;
+
+	fftss_plan plan = ::fftss_plan_dft_1d(fftSize, (double*)temp, (double*)kern->resp, FFTSS_FORWARD, FFTSS_ESTIMATE);
+	::fftss_execute(plan);
+	::fftss_destroy_plan(plan);
+	::fftss_free(temp);
+
+	kern->AddRef();
+	return kern;
+}
+
+// ------------------------------------------------------------------ class COverlapSave
+
+COverlapSave::COverlapSave()
+	:m_active(NULL),m_fadeFrom(NULL),m_pending(NULL),m_capacity(0),m_fftSize(0),m_numTaps(0),
+	 m_time(NULL),m_freq(NULL),m_spec(NULL),m_out(NULL),m_fadeOut(NULL),m_fwd(NULL),m_bwd(NULL)
+{
+}
+
+COverlapSave::~COverlapSave()
+{
+	if(m_pending) m_pending->Release();
+	if(m_active) m_active->Release();
+	if(m_fadeFrom) m_fadeFrom->Release();
+	clearBuffers();
+}
+
+void COverlapSave::clearBuffers()
+{
+	if(m_fwd) ::fftss_destroy_plan(m_fwd);
+	if(m_bwd) ::fftss_destroy_plan(m_bwd);
+	m_fwd = m_bwd = NULL;
+	if(m_time) ::fftss_free(m_time);
+	if(m_freq) ::fftss_free(m_freq);
+	if(m_spec) ::fftss_free(m_spec);
+	if(m_out) ::fftss_free(m_out);
+	if(m_fadeOut) ::fftss_free(m_fadeOut);
+	m_time = m_freq = m_spec = m_out = m_fadeOut = NULL;
+	m_fftSize = m_numTaps = 0;
+}
+
+void COverlapSave::setKernel(Kernel* kern)
+{
+	// the new kernel is picked up by the processing thread at its next block boundary
+	ASSERT(kern);
+	kern->AddRef();
+	if(kern->numTaps > m_capacity) m_capacity = kern->numTaps;
+	Kernel* oldKern = (Kernel*)InterlockedExchangePointer((PVOID volatile*)&m_pending, kern);
+	if(oldKern) oldKern->Release();
+}
+
+void COverlapSave::configure(const Kernel* kern)
+{
+	// keep as much input history as the new geometry can use
+	TComplexDbl* oldTime = m_time;
+	unsigned oldHist = m_numTaps ? m_numTaps - 1 : 0;
+	m_time = NULL;
+	clearBuffers();
+
+	m_fftSize = kern->fftSize;
+	m_numTaps = kern->numTaps;
+	m_time = (TComplexDbl*)::fftss_malloc(sizeof(TComplexDbl) * m_fftSize);
+	m_freq = (TComplexDbl*)::fftss_malloc(sizeof(TComplexDbl) * m_fftSize);
+	m_spec = (TComplexDbl*)::fftss_malloc(sizeof(TComplexDbl) * m_fftSize);
+	m_out = (TComplexDbl*)::fftss_malloc(sizeof(TComplexDbl) * m_fftSize);
+	m_fadeOut = (TComplexDbl*)::fftss_malloc(sizeof(TComplexDbl) * m_fftSize);
+	m_fwd = ::fftss_plan_dft_1d(m_fftSize, (double*)m_time, (double*)m_freq, FFTSS_FORWARD, FFTSS_ESTIMATE | FFTSS_PRESERVE_INPUT);
+	m_bwd = ::fftss_plan_dft_1d(m_fftSize, (double*)m_spec, (double*)m_out, FFTSS_BACKWARD, FFTSS_ESTIMATE);
+
+	unsigned newHist = m_numTaps - 1;
+	unsigned keep = min(oldHist, newHist);
+	for(unsigned idx = 0; idx < newHist - keep; idx++) m_time[idx] = 0.0;
+	if(keep) memcpy(m_time + newHist - keep, oldTime + oldHist - keep, keep * sizeof(TComplexDbl));
+	if(oldTime) ::fftss_free(oldTime);
+}
+
+unsigned COverlapSave::beginBlock()
+{
+	if(m_fadeFrom)
+	{
+		m_fadeFrom->Release();
+		m_fadeFrom = NULL;
+	}
+	if(m_pending)
+	{
+		Kernel* newKern = (Kernel*)InterlockedExchangePointer((PVOID volatile*)&m_pending, NULL);
+		if(newKern)
+		{
+			if(m_active && newKern->fftSize == m_fftSize && newKern->numTaps == m_numTaps)
+			{
+				// same geometry: crossfade the old and new responses across the next block
+				m_fadeFrom = m_active;
+			}
+			else
+			{
+				if(m_active) m_active->Release();
+				configure(newKern);
+			}
+			m_active = newKern;
+		}
+	}
+	return m_active ? m_active->step() : 0;
+}
+
+void COverlapSave::applyKernel(const Kernel* kern, TComplexDbl* out)
+{
+	const double* x = (const double*)m_freq;
+	const double* h = (const double*)kern->resp;
+	double* y = (double*)m_spec;
+	for(unsigned idx = 0; idx < 2 * m_fftSize; idx += 2)
+	{
+		y[idx] = x[idx] * h[idx] - x[idx+1] * h[idx+1];
+		y[idx+1] = x[idx] * h[idx+1] + x[idx+1] * h[idx];
+	}
+	::fftss_execute_dft(m_bwd, (double*)m_spec, (double*)out);
+}
+
+void COverlapSave::process(const TComplex* in, TComplex* out)
+{
+	ASSERT(m_active && m_fftSize == m_active->fftSize);
+	const unsigned hist = m_numTaps - 1;
+	const unsigned step = m_fftSize - hist;
+
+	double* t = (double*)(m_time + hist);
+	const float* src = (const float*)in;
+	for(unsigned idx = 0; idx < 2 * step; idx++) t[idx] = src[idx];
+
+	::fftss_execute_dft(m_fwd, (double*)m_time, (double*)m_freq);
+	applyKernel(m_active, m_out);
+
+	const TComplexDbl* y = m_out + hist;
+	if(m_fadeFrom)
+	{
+		applyKernel(m_fadeFrom, m_fadeOut);
+		const TComplexDbl* yOld = m_fadeOut + hist;
+		const double ramp = 1.0 / step;
+		for(unsigned idx = 0; idx < step; idx++)
+		{
+			const double mix = idx * ramp;
+			out[idx] = TComplex(yOld[idx] + (y[idx] - yOld[idx]) * mix);
+		}
+	}
+	else
+	{
+		const double* yd = (const double*)y;
+		float* dst = (float*)out;
+		for(unsigned idx = 0; idx < 2 * step; idx++) dst[idx] = (float)yd[idx];
+	}
+
+	if(hist) memmove(m_time, m_time + step, hist * sizeof(TComplexDbl));
+}
+
+// ------------------------------------------------------------------ class CFastConvolver
+
+#pragma warning(push)
+#pragma warning(disable: 4355)
+CFastConvolver::CFastConvolver(signals::IBlockDriver* driver)
+	:CThreadBlockBase(driver),m_incoming(this),m_outgoing(this)
+{
+	buildAttrs();
+	startThread();
+}
+#pragma warning(pop)
+
+CFastConvolver::~CFastConvolver()
+{
+	stopThread();
+}
+
+void CFastConvolver::buildAttrs()
+{
+	attrs.taps = addLocalAttr(true, new CAttr_taps(*this));
+	m_outgoing.buildAttrs(*this);
+}
+
+void CFastConvolver::COutgoing::buildAttrs(const CFastConvolver& parent)
+{
+	attrs.sync_fault = addLocalAttr(true, new CEventAttribute("syncFault", "Fires when a sync fault happens in a receive stream"));
+}
+
+void CFastConvolver::setTaps(signals::IVector* taps)
+{
+	// the transform of the new taps is built here rather than on the processing thread
+	Locker lock(m_tapsLock);
+	const unsigned numTaps = taps ? taps->Size() : 0;
+	COverlapSave::Kernel* kern = COverlapSave::Kernel::build(numTaps ? (const std::complex<double>*)taps->Data() : NULL,
+		numTaps, m_engine.capacity());
+	m_engine.setKernel(kern);
+	kern->Release();
+}
+
+void CFastConvolver::thread_run()
+{
+	ThreadBase::SetThreadName("FIR Filter Thread");
+
+	std::vector<TComplex> inBuffer(PASSTHRU_BLOCK);
+	std::vector<TComplex> outBuffer(PASSTHRU_BLOCK);
+	unsigned inOffset = 0;
+	unsigned step = 0;
+	while(threadRunning())
+	{
+		if(!inOffset) step = m_engine.beginBlock();
+		if(!step)
+		{
+			// no taps yet, pass the stream through unchanged
+			unsigned recvCount = m_incoming.Read(signals::etypComplex, inBuffer.data(), PASSTHRU_BLOCK, FALSE, IN_BUFFER_TIMEOUT);
+			if(recvCount && m_outgoing.isConnected())
+			{
+				unsigned sentCount = m_outgoing.Write(signals::etypComplex, inBuffer.data(), recvCount, OUT_BUFFER_TIMEOUT);
+				if(sentCount < recvCount) m_outgoing.attrs.sync_fault->fire();
+			}
+			continue;
+		}
+		if(inBuffer.size() < step)
+		{
+			inBuffer.resize(step);
+			outBuffer.resize(step);
+		}
+
+		inOffset += m_incoming.Read(signals::etypComplex, inBuffer.data() + inOffset, step - inOffset, TRUE, IN_BUFFER_TIMEOUT);
+		if(inOffset < step) continue;
+		inOffset = 0;
+
+		m_engine.process(inBuffer.data(), outBuffer.data());
+		if(m_outgoing.isConnected())
+		{
+			unsigned sentCount = m_outgoing.Write(signals::etypComplex, outBuffer.data(), step, OUT_BUFFER_TIMEOUT);
+			if(sentCount < step) m_outgoing.attrs.sync_fault->fire();
+		}
+	}
+}
+
+// ------------------------------------------------------------------ class CFastConvolverDriver
+
+signals::IBlock * CFastConvolverDriver::Create()
+{
+	signals::IBlock* blk = new CFastConvolver(this);
+	blk->AddRef();
+	return blk;
+}
+
+}
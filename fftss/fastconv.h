@@ -0,0 +1,208 @@
+/*
+	Copyright 2012-2013 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+
+#include <blockImpl.h>
+#include "fftss/include/fftss.h"
+
+namespace fftss {
+
+class COverlapSave
+{	// overlap-save FIR filter, consumes and produces step() samples per block
+public:
+	typedef std::complex<float> TComplex;
+	typedef std::complex<double> TComplexDbl;
+
+	class Kernel
+	{	// frequency response of a tap set, immutable once built
+	public:
+		static Kernel* build(const TComplexDbl* taps, unsigned numTaps, unsigned minTaps = 0);	// no taps is a unit impulse
+		inline unsigned AddRef()		{ return _InterlockedIncrement(&m_refCount); }
+		unsigned Release();
+
+		const unsigned fftSize;
+		const unsigned numTaps;
+		inline unsigned step() const	{ return fftSize - numTaps + 1; }
+		TComplexDbl* resp;				// fftSize entries, scaled by 1/fftSize
+
+	private:
+		Kernel(unsigned fftSize, unsigned numTaps);
+		~Kernel();
+		Kernel(const Kernel& other);
+		Kernel& operator=(const Kernel& other);
+
+		volatile long m_refCount;
+	};
+
+	COverlapSave();
+	~COverlapSave();
+
+	void setKernel(Kernel* kern);
+	unsigned beginBlock();
+	void process(const TComplex* in, TComplex* out);
+	inline unsigned capacity() const	{ return m_capacity; }
+
+private:
+	COverlapSave(const COverlapSave& other);
+	COverlapSave& operator=(const COverlapSave& other);
+
+	Kernel* m_active;
+	Kernel* m_fadeFrom;
+	Kernel* volatile m_pending;
+	volatile unsigned m_capacity;
+
+	unsigned m_fftSize;
+	unsigned m_numTaps;
+	TComplexDbl* m_time;
+	TComplexDbl* m_freq;
+	TComplexDbl* m_spec;
+	TComplexDbl* m_out;
+	TComplexDbl* m_fadeOut;
+	fftss_plan m_fwd;
+	fftss_plan m_bwd;
+
+	void configure(const Kernel* kern);
+	void clearBuffers();
+	void applyKernel(const Kernel* kern, TComplexDbl* out);
+};
+
+class CFastConvolver : public CThreadBlockBase
+{
+public:
+	CFastConvolver(signals::IBlockDriver* driver);
+	virtual ~CFastConvolver();
+
+private:
+	CFastConvolver(const CFastConvolver& other);
+	CFastConvolver& operator=(const CFastConvolver& other);
+
+public: // IBlock implementation
+	virtual const char* Name()				{ return NAME; }
+	virtual unsigned Incoming(signals::IInEndpoint** ep, unsigned availEP) { return singleIncoming(&m_incoming, ep, availEP); }
+	virtual unsigned Outgoing(signals::IOutEndpoint** ep, unsigned availEP) { return singleOutgoing(&m_outgoing, ep, availEP); }
+
+public:
+	void setTaps(signals::IVector* taps);
+
+private:
+	enum
+	{
+		IN_BUFFER_TIMEOUT = 1000,
+		OUT_BUFFER_TIMEOUT = 1000,
+		PASSTHRU_BLOCK = 1024,
+	};
+
+	typedef std::complex<float> TComplex;
+	static const char* NAME;
+
+	class CAttr_taps : public CRWVectorAttribute<signals::etypVecCmplDbl>
+	{
+	public:
+		inline CAttr_taps(CFastConvolver& parent)
+			:CRWVectorAttribute<signals::etypVecCmplDbl>("taps", "Complex filter coefficients"),m_parent(parent) { }
+
+	protected:
+		CFastConvolver& m_parent;
+		virtual void onSetValue(signals::IVector* value)
+		{
+			m_parent.setTaps(value);
+			CRWVectorAttribute<signals::etypVecCmplDbl>::onSetValue(value);
+		}
+	};
+
+	struct
+	{
+		CAttr_taps* taps;
+	} attrs;
+
+public:
+	class COutgoing : public CSimpleCascadeOutgoingChild<signals::etypComplex>
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline COutgoing(CFastConvolver* parent):CSimpleCascadeOutgoingChild(parent->m_incoming),m_parent(parent) { }
+		void buildAttrs(const CFastConvolver& parent);
+
+	protected:
+		CFastConvolver* m_parent;
+
+	public:
+		struct
+		{
+			CEventAttribute* sync_fault;
+		} attrs;
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		COutgoing(const COutgoing& other);
+		COutgoing& operator=(const COutgoing& other);
+
+	public: // COutEndpointBase interface
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+	};
+
+	class CIncoming : public CSimpleCascadeIncomingChild
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline CIncoming(CFastConvolver* parent)
+			:CSimpleCascadeIncomingChild(signals::etypComplex, parent, parent->m_outgoing) { }
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		CIncoming(const CIncoming& other);
+		CIncoming& operator=(const CIncoming& other);
+	};
+
+private:
+	CIncoming m_incoming;
+	COutgoing m_outgoing;
+	COverlapSave m_engine;
+	Lock m_tapsLock;
+
+	void buildAttrs();
+	virtual void thread_run();
+};
+
+class CFastConvolverDriver : public signals::IBlockDriver
+{
+public:
+	inline CFastConvolverDriver() {}
+	virtual ~CFastConvolverDriver() {}
+
+private:
+	CFastConvolverDriver(const CFastConvolverDriver& other);
+	CFastConvolverDriver operator=(const CFastConvolverDriver& other);
+
+public:
+	virtual const char* Name()			{ return NAME; }
+	virtual const char* Description()	{ return DESCR; }
+	virtual BOOL canCreate()			{ return true; }
+	virtual BOOL canDiscover()			{ return false; }
+	virtual unsigned Discover(signals::IBlock** blocks, unsigned availBlocks) { return 0; }
+	virtual signals::IBlock* Create();
+	const unsigned char* Fingerprint()	{ return FINGERPRINT; }
+
+protected:
+	static const char* NAME;
+	static const char* DESCR;
+	static const unsigned char FINGERPRINT[];
+};
+
+}
@@ -55,6 +55,7 @@ typedef struct _fftss_plan_1d_s {
   long map_id, table_type, kset_id;
   double fastest;
   fftss_kern *k;
+  struct _fftss_mixed_s *mx;
 } fftss_plan_1d_s;
 
 typedef fftss_plan_1d_s *fftss_plan_1d;
@@ -106,6 +107,9 @@ extern int fftss_version(char *);
 extern void fftss_execute(fftss_plan);
 extern void fftss_execute_dft_1d(fftss_plan_1d, double *, double *);
 extern void fftss_execute_inplace_dft_1d(fftss_plan_1d, double *, double *);
+extern void fftss_execute_mixed_1d(fftss_plan_1d, double *, double *);
+extern int fftss_plan_mixed_1d(fftss_plan_1d);
+extern void fftss_destroy_mixed_1d(fftss_plan_1d);
 extern void *fftss_malloc(long);
 extern void fftss_free(void *);
 extern fftss_plan fftss_plan_dft_1d(long, double *, double *, long, long);
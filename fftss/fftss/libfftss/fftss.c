@@ -277,13 +277,22 @@ fftss_plan fftss_plan_dft_1d(long n, double *in, double *out,
 
   logn2 = 0;
   for (k = n; k > 1; k >>= 1, logn2 ++);
-  if (n != 1 << logn2) {
-    printf("n=%ld: not supported.\n", n);
-    return NULL;
-  }
   p->logn2 = logn2;
   p->k = NULL;
   p->work = NULL;
+  p->mx = NULL;
+  if (n != 1 << logn2) {
+    p->logn2 = 0;
+    p->w = NULL;
+    p->table_type = -1;
+    if (n < 1 || fftss_plan_mixed_1d(p) < 0) {
+      printf("n=%ld: not supported.\n", n);
+      free(p);
+      free(pp);
+      return NULL;
+    }
+    return pp;
+  }
   if (logn2 < 2) return pp;
   p->stages = 0;
   p->k = malloc(sizeof(fftss_kern) * p->logn2);
@@ -39,7 +39,8 @@ void fftss_destroy_plan_1d(fftss_plan_1d p)
 #else
     fftss_free(p->work);
 #endif
-  fftss_table_free(p->n, p->table_type);
+  if (p->mx) fftss_destroy_mixed_1d(p);
+  else fftss_table_free(p->n, p->table_type);
   if (p->k) free(p->k);
   free(p);
 }
@@ -0,0 +1,326 @@
+/*
+	Copyright 2012-2013 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+/*
+ * Non power-of-two transforms.  Lengths that factor into 2, 3, 4, 5 and
+ * small odd primes run as a Stockham autosort sequence of radix stages;
+ * anything with a larger prime factor goes through Bluestein's chirp-z
+ * algorithm on top of a pair of power-of-two fftss plans.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "libfftss.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define FFTSS_MIXED_MAX_RADIX   31
+#define FFTSS_MIXED_MAX_STAGES  64
+
+typedef struct _fftss_mixed_s {
+  long stages;
+  long radix[FFTSS_MIXED_MAX_STAGES];
+  double *tw;              /* exp(sign * 2 pi i k / n), k = 0..n-1 */
+  double *work;
+  /* Bluestein */
+  long m;
+  double *chirp;           /* exp(sign * pi i k^2 / n), k = 0..n-1 */
+  double *kern;            /* FFT of the conjugate chirp, scaled by 1/m */
+  double *b0, *b1;
+  fftss_plan fwd, bwd;
+} fftss_mixed;
+
+static long fftss_mixed_factor(long n, long *radix)
+{
+  long stages = 0;
+  long p;
+
+  while ((n & 3) == 0) { radix[stages++] = 4; n >>= 2; }
+  if ((n & 1) == 0) { radix[stages++] = 2; n >>= 1; }
+  for (p = 3; p <= FFTSS_MIXED_MAX_RADIX && n > 1; p += 2)
+    while (n % p == 0) { radix[stages++] = p; n /= p; }
+
+  return n == 1 ? stages : -1;
+}
+
+static void fftss_mixed_butterfly(long r, long sign, const double *a,
+				  double *y, const double *tw, long step)
+{
+  long j, k, e;
+
+  switch (r) {
+  case 2:
+    y[0] = a[0] + a[2];  y[1] = a[1] + a[3];
+    y[2] = a[0] - a[2];  y[3] = a[1] - a[3];
+    break;
+  case 3:
+    {
+      const double s = sign * 0.86602540378443864676;
+      double tr, ti, dr, di;
+
+      tr = a[2] + a[4];  ti = a[3] + a[5];
+      dr = -s * (a[3] - a[5]);  di = s * (a[2] - a[4]);
+      y[0] = a[0] + tr;  y[1] = a[1] + ti;
+      tr = a[0] - 0.5 * tr;  ti = a[1] - 0.5 * ti;
+      y[2] = tr + dr;  y[3] = ti + di;
+      y[4] = tr - dr;  y[5] = ti - di;
+    }
+    break;
+  case 4:
+    {
+      double t0r, t0i, t1r, t1i, t2r, t2i, t3r, t3i;
+
+      t0r = a[0] + a[4];  t0i = a[1] + a[5];
+      t1r = a[0] - a[4];  t1i = a[1] - a[5];
+      t2r = a[2] + a[6];  t2i = a[3] + a[7];
+      t3r = -sign * (a[3] - a[7]);  t3i = sign * (a[2] - a[6]);
+      y[0] = t0r + t2r;  y[1] = t0i + t2i;
+      y[2] = t1r + t3r;  y[3] = t1i + t3i;
+      y[4] = t0r - t2r;  y[5] = t0i - t2i;
+      y[6] = t1r - t3r;  y[7] = t1i - t3i;
+    }
+    break;
+  case 5:
+    {
+      const double c1 = 0.30901699437494742410, c2 = -0.80901699437494742410;
+      const double s1 = sign * 0.95105651629515357212;
+      const double s2 = sign * 0.58778525229247312917;
+      double t1r, t1i, t2r, t2i, t3r, t3i, t4r, t4i;
+      double b1r, b1i, b2r, b2i, d1r, d1i, d2r, d2i;
+
+      t1r = a[2] + a[8];  t1i = a[3] + a[9];
+      t2r = a[4] + a[6];  t2i = a[5] + a[7];
+      t3r = a[2] - a[8];  t3i = a[3] - a[9];
+      t4r = a[4] - a[6];  t4i = a[5] - a[7];
+      b1r = a[0] + c1 * t1r + c2 * t2r;  b1i = a[1] + c1 * t1i + c2 * t2i;
+      b2r = a[0] + c2 * t1r + c1 * t2r;  b2i = a[1] + c2 * t1i + c1 * t2i;
+      d1r = -(s1 * t3i + s2 * t4i);  d1i = s1 * t3r + s2 * t4r;
+      d2r = -(s2 * t3i - s1 * t4i);  d2i = s2 * t3r - s1 * t4r;
+      y[0] = a[0] + t1r + t2r;  y[1] = a[1] + t1i + t2i;
+      y[2] = b1r + d1r;  y[3] = b1i + d1i;
+      y[4] = b2r + d2r;  y[5] = b2i + d2i;
+      y[6] = b2r - d2r;  y[7] = b2i - d2i;
+      y[8] = b1r - d1r;  y[9] = b1i - d1i;
+    }
+    break;
+  default:
+    /* small odd prime: plain DFT, roots taken from the n-point table */
+    for (j = 0; j < r; j++) {
+      double sr = 0.0, si = 0.0;
+      for (k = 0, e = 0; k < r; k++) {
+	const double *w = tw + 2 * e * step;
+	sr += a[2 * k] * w[0] - a[2 * k + 1] * w[1];
+	si += a[2 * k] * w[1] + a[2 * k + 1] * w[0];
+	e += j;
+	if (e >= r) e -= r;
+      }
+      y[2 * j] = sr;  y[2 * j + 1] = si;
+    }
+    break;
+  }
+}
+
+/*
+ * One decimation-in-frequency Stockham stage.  len is the length of the
+ * sub-transforms at this stage, s the product of the radices already done.
+ */
+static void fftss_mixed_stage(const fftss_mixed *mx, long n, long sign,
+			      long r, long len, long s,
+			      const double *x, double *y)
+{
+  double a[2 * FFTSS_MIXED_MAX_RADIX], b[2 * FFTSS_MIXED_MAX_RADIX];
+  long m = len / r;
+  long p, q, j, k;
+
+  for (p = 0; p < m; p++) {
+    for (q = 0; q < s; q++) {
+      const double *xp = x + 2 * (q + s * p);
+      double *yp = y + 2 * (q + s * r * p);
+
+      for (k = 0; k < r; k++) {
+	a[2 * k] = xp[2 * s * m * k];
+	a[2 * k + 1] = xp[2 * s * m * k + 1];
+      }
+      fftss_mixed_butterfly(r, sign, a, b, mx->tw, n / r);
+
+      yp[0] = b[0];
+      yp[1] = b[1];
+      for (j = 1; j < r; j++) {
+	const double *w = mx->tw + 2 * j * p * s;
+	yp[2 * s * j] = b[2 * j] * w[0] - b[2 * j + 1] * w[1];
+	yp[2 * s * j + 1] = b[2 * j] * w[1] + b[2 * j + 1] * w[0];
+      }
+    }
+  }
+}
+
+static void fftss_mixed_bluestein(fftss_plan_1d p, double *in, double *out)
+{
+  fftss_mixed *mx = p->mx;
+  const double *c = mx->chirp;
+  double *b0 = mx->b0, *b1 = mx->b1;
+  long i;
+
+  for (i = 0; i < p->n; i++) {
+    b0[2 * i] = in[2 * i] * c[2 * i] - in[2 * i + 1] * c[2 * i + 1];
+    b0[2 * i + 1] = in[2 * i] * c[2 * i + 1] + in[2 * i + 1] * c[2 * i];
+  }
+  for (i = p->n * 2; i < mx->m * 2; i++) b0[i] = 0.0;
+
+  fftss_execute(mx->fwd);
+  for (i = 0; i < mx->m; i++) {
+    double xr = b1[2 * i], xi = b1[2 * i + 1];
+    b1[2 * i] = xr * mx->kern[2 * i] - xi * mx->kern[2 * i + 1];
+    b1[2 * i + 1] = xr * mx->kern[2 * i + 1] + xi * mx->kern[2 * i];
+  }
+  fftss_execute(mx->bwd);
+
+  for (i = 0; i < p->n; i++) {
+    out[2 * i] = b0[2 * i] * c[2 * i] - b0[2 * i + 1] * c[2 * i + 1];
+    out[2 * i + 1] = b0[2 * i] * c[2 * i + 1] + b0[2 * i + 1] * c[2 * i];
+  }
+}
+
+void fftss_execute_mixed_1d(fftss_plan_1d p, double *in, double *out)
+{
+  fftss_mixed *mx = p->mx;
+  double *dst = (p->flags & FFTSS_INOUT) ? in : out;
+  const double *src = in;
+  double *buf;
+  long i, len, s;
+
+  if (mx->fwd) {
+    fftss_mixed_bluestein(p, in, dst);
+    return;
+  }
+  if (mx->stages == 0) {
+    if (dst != in) memcpy(dst, in, sizeof(double) * 2 * p->n);
+    return;
+  }
+
+  /* ping-pong so the last stage lands in dst where possible */
+  len = p->n; s = 1;
+  for (i = 0; i < mx->stages; i++) {
+    if (dst == in)
+      buf = (i & 1) ? dst : mx->work;
+    else
+      buf = ((mx->stages - 1 - i) & 1) ? mx->work : dst;
+    fftss_mixed_stage(mx, p->n, p->sign, mx->radix[i], len, s, src, buf);
+    len /= mx->radix[i];
+    s *= mx->radix[i];
+    src = buf;
+  }
+  if (src != dst) memcpy(dst, src, sizeof(double) * 2 * p->n);
+}
+
+static int fftss_mixed_bluestein_plan(fftss_plan_1d p, fftss_mixed *mx)
+{
+  long n = p->n, m, i, kk;
+  long flags = p->flags & (FFTSS_NO_SIMD | FFTSS_ESTIMATE | FFTSS_VERBOSE);
+  double *b;
+
+  for (m = 4; m < 2 * n - 1; m <<= 1);
+  mx->m = m;
+  mx->chirp = fftss_malloc(sizeof(double) * 2 * n);
+  mx->kern = fftss_malloc(sizeof(double) * 2 * m);
+  mx->b0 = fftss_malloc(sizeof(double) * 2 * m);
+  mx->b1 = fftss_malloc(sizeof(double) * 2 * m);
+  mx->fwd = fftss_plan_dft_1d(m, mx->b0, mx->b1, FFTSS_FORWARD, flags);
+  mx->bwd = fftss_plan_dft_1d(m, mx->b1, mx->b0, FFTSS_BACKWARD, flags);
+  if (mx->fwd == NULL || mx->bwd == NULL) return -1;
+
+  /* k^2 mod 2n keeps the chirp argument small for long transforms */
+  for (i = 0, kk = 0; i < n; i++) {
+    double t = M_PI * (double)kk / (double)n;
+    mx->chirp[2 * i] = cos(t);
+    mx->chirp[2 * i + 1] = p->sign * sin(t);
+    kk += 2 * i + 1;
+    if (kk >= 2 * n) kk -= 2 * n;
+  }
+
+  b = mx->b0;
+  for (i = 0; i < 2 * m; i++) b[i] = 0.0;
+  for (i = 0; i < n; i++) {
+    b[2 * i] = mx->chirp[2 * i] / (double)m;
+    b[2 * i + 1] = -mx->chirp[2 * i + 1] / (double)m;
+    if (i > 0) {
+      b[2 * (m - i)] = b[2 * i];
+      b[2 * (m - i) + 1] = b[2 * i + 1];
+    }
+  }
+  fftss_execute(mx->fwd);
+  memcpy(mx->kern, mx->b1, sizeof(double) * 2 * m);
+
+  return 0;
+}
+
+void fftss_destroy_mixed_1d(fftss_plan_1d p)
+{
+  fftss_mixed *mx = p->mx;
+
+  if (mx == NULL) return;
+  if (mx->tw) fftss_free(mx->tw);
+  if (mx->work) fftss_free(mx->work);
+  if (mx->chirp) fftss_free(mx->chirp);
+  if (mx->kern) fftss_free(mx->kern);
+  if (mx->b0) fftss_free(mx->b0);
+  if (mx->b1) fftss_free(mx->b1);
+  if (mx->fwd) fftss_destroy_plan(mx->fwd);
+  if (mx->bwd) fftss_destroy_plan(mx->bwd);
+  free(mx);
+  p->mx = NULL;
+}
+
+int fftss_plan_mixed_1d(fftss_plan_1d p)
+{
+  fftss_mixed *mx;
+  long n = p->n, i;
+
+  mx = malloc(sizeof(fftss_mixed));
+  memset(mx, 0, sizeof(fftss_mixed));
+  p->mx = mx;
+  p->fp = fftss_execute_mixed_1d;
+
+  mx->stages = fftss_mixed_factor(n, mx->radix);
+  if (mx->stages < 0) {
+    mx->stages = 0;
+    if (fftss_verbose)
+      printf("n=%ld: large prime factor, using Bluestein.\n", n);
+    if (fftss_mixed_bluestein_plan(p, mx) < 0) {
+      fftss_destroy_mixed_1d(p);
+      return -1;
+    }
+    return 0;
+  }
+
+  if (fftss_verbose) {
+    printf("mixed radix:");
+    for (i = 0; i < mx->stages; i++) printf(" %ld", mx->radix[i]);
+    printf("\n");
+  }
+
+  mx->tw = fftss_malloc(sizeof(double) * 2 * n);
+  for (i = 0; i < n; i++) {
+    double t = 2.0 * M_PI * (double)i / (double)n;
+    mx->tw[2 * i] = cos(t);
+    mx->tw[2 * i + 1] = p->sign * sin(t);
+  }
+  mx->work = fftss_malloc(sizeof(double) * 2 * n);
+
+  return 0;
+}
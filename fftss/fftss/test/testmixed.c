@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "fftss.h"
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* mixed-radix and Bluestein lengths, compared against a direct DFT */
+static long sizes[] = {
+  3, 5, 6, 7, 9, 10, 12, 15, 17, 25, 45, 49, 60, 96, 97, 100, 120,
+  243, 360, 384, 480, 625, 1000, 1009, 1536, 3000, 6000, 7919, 10007,
+  48000, 0
+};
+
+static double check(long n, long sign, int inplace)
+{
+  double *b0, *b1, *x, *o;
+  fftss_plan p;
+  long i, j, k, chk;
+  double max_err = 0.0;
+
+  b0 = (double *)fftss_malloc(sizeof(double) * 2 * n);
+  b1 = (double *)fftss_malloc(sizeof(double) * 2 * n);
+  x = (double *)malloc(sizeof(double) * 2 * n);
+  for (i = 0; i < 2 * n; i++)
+    x[i] = b0[i] = (double)rand() / (double)RAND_MAX - 0.5;
+
+  p = fftss_plan_dft_1d(n, b0, inplace ? b0 : b1, sign, FFTSS_ESTIMATE);
+  if (p == NULL) return 1.0;
+  fftss_execute(p);
+  o = inplace ? b0 : b1;
+
+  /* spot-check long transforms */
+  chk = n > 2000 ? 64 : n;
+  for (i = 0; i < chk; i++) {
+    double sr = 0.0, si = 0.0;
+
+    j = n > 2000 ? (i * 7919) % n : i;
+    for (k = 0; k < n; k++) {
+      double t = sign * 2.0 * M_PI * (double)((j * k) % n) / (double)n;
+      sr += x[2 * k] * cos(t) - x[2 * k + 1] * sin(t);
+      si += x[2 * k] * sin(t) + x[2 * k + 1] * cos(t);
+    }
+    sr = hypot(sr - o[2 * j], si - o[2 * j + 1]);
+    if (sr > max_err) max_err = sr;
+  }
+
+  fftss_destroy_plan(p);
+  fftss_free(b0);
+  fftss_free(b1);
+  free(x);
+
+  return max_err;
+}
+
+int testall()
+{
+  int status = 0;
+  long i, n;
+  double err, err2;
+
+  for (i = 0; sizes[i]; i++) {
+    n = sizes[i];
+    err = check(n, FFTSS_FORWARD, 0);
+    err2 = check(n, FFTSS_BACKWARD, 1);
+    if (err2 > err) err = err2;
+    printf("[%5ld] max err=%le %s\n", n, err,
+	   err > (double)n * 1e-13 ? "FAILED" : "ok");
+    if (err > (double)n * 1e-13) status++;
+  }
+
+  if (status)
+    printf("\nTotal %d test(s) failed.\n", status);
+  else
+    printf("\nAll tests passed.\n");
+
+  return status;
+}
+
+static double bench(long n)
+{
+  double *b0, *b1;
+  fftss_plan p0, p1;
+  long i, j, tries;
+  double t0, t1, best = -1.0;
+
+  tries = 2000000 / n + 1;
+  b0 = (double *)fftss_malloc(sizeof(double) * 2 * n);
+  b1 = (double *)fftss_malloc(sizeof(double) * 2 * n);
+  p0 = fftss_plan_dft_1d(n, b0, b1, FFTSS_BACKWARD, FFTSS_MEASURE);
+  p1 = fftss_plan_dft_1d(n, b1, b0, FFTSS_FORWARD, FFTSS_MEASURE);
+
+  for (j = 0; j < 5; j++) {
+    for (i = 0; i < 2 * n; i++) b0[i] = (double)(i & 7);
+    t0 = fftss_get_wtime();
+    for (i = 0; i < tries; i++) {
+      fftss_execute(p0);
+      fftss_execute(p1);
+    }
+    t1 = (fftss_get_wtime() - t0) / (double)(tries * 2);
+    if (best < 0 || t1 < best) best = t1;
+  }
+
+  fftss_destroy_plan(p0);
+  fftss_destroy_plan(p1);
+  fftss_free(b0);
+  fftss_free(b1);
+  return best;
+}
+
+int main(int argc, char **argv)
+{
+  long i, n, m;
+  double t, tp;
+
+  if (argc == 2 && strcmp("-t", argv[1]) == 0)
+    return testall();
+
+  if (argc == 2 && atol(argv[1]) == 0) {
+    printf("usage:\n\ttestmixed -t\t\trun all tests.\n"
+	   "\ttestmixed [N]\t\tbenchmark N against the next power of two\n");
+    return 0;
+  }
+
+  for (i = 0; sizes[i]; i++) {
+    n = argc == 2 ? atol(argv[1]) : sizes[i];
+    for (m = 1; m < n; m <<= 1);
+    t = bench(n);
+    tp = bench(m);
+    printf("[%5ld] %le sec. padded [%5ld] %le sec. (%.2lfx)\n",
+	   n, t, m, tp, t / tp);
+    if (argc == 2) break;
+  }
+
+  return 0;
+}
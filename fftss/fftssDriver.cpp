@@ -15,35 +15,31 @@
 */
 #include "stdafx.h"
 #include "fftssDriver.h"
-
-extern "C" unsigned QueryDrivers(signals::IBlockDriver** drivers, unsigned availDrivers)
-{
-	static fftss::CFFTransformDriver fft_dd;
-	if(drivers && availDrivers)
-	{
-		if(availDrivers > 0) drivers[0] = &fft_dd;
-	}
-	return 1;
-}
+#include "fastconv.h"
+#include "channelizer.h"
 
 namespace fftss {
 
 const char* CFFTransform::NAME = "FFT Transform using fftss";
+const char* CFFTransform::INV_NAME = "Inverse FFT Transform using fftss";
 const char* CFFTransform::CIncoming::EP_NAME = "in";
 const char* CFFTransform::CIncoming::EP_DESCR = "FFT Transform incoming endpoint";
 const char* CFFTransform::COutgoing::EP_NAME = "out";
 const char* CFFTransform::COutgoing::EP_DESCR = "FFT Transform outgoing endpoint";
 
-const unsigned char CFFTransformDriver::FINGERPRINT[] = { 1, (unsigned char)signals::etypVecCmplDbl, 1, (unsigned char)signals::etypVecCmplDbl };
-const char* CFFTransformDriver::NAME = "fft";
-const char* CFFTransformDriver::DESCR = "FFT Transform using fftss";
+template<long SIGN>
+const unsigned char CFFTransformDriver<SIGN>::FINGERPRINT[] = { 1, (unsigned char)signals::etypVecCmplDbl, 1, (unsigned char)signals::etypVecCmplDbl };
+template<> const char* CFFTransformDriver<FFTSS_FORWARD>::NAME = "fft";
+template<> const char* CFFTransformDriver<FFTSS_FORWARD>::DESCR = "FFT Transform using fftss";
+template<> const char* CFFTransformDriver<FFTSS_BACKWARD>::NAME = "ifft";
+template<> const char* CFFTransformDriver<FFTSS_BACKWARD>::DESCR = "Inverse FFT Transform using fftss";
 
 // ------------------------------------------------------------------ class CFFTransform
 
 #pragma warning(push)
 #pragma warning(disable: 4355)
-CFFTransform::CFFTransform(signals::IBlockDriver* driver)
-	:CThreadBlockBase(driver),m_currPlan(NULL),m_requestSize(0),m_inBuffer(NULL),m_outBuffer(NULL),m_bufSize(0),
+CFFTransform::CFFTransform(signals::IBlockDriver* driver, long sign)
+	:CThreadBlockBase(driver),m_currPlan(NULL),m_requestSize(0),m_sign(sign),m_inBuffer(NULL),m_outBuffer(NULL),m_bufSize(0),
 	 m_incoming(this),m_outgoing(this)
 {
 	buildAttrs();
@@ -99,7 +95,14 @@ bool CFFTransform::startPlan()
 	TComplexDbl* tempIn = (TComplexDbl*)::fftss_malloc(sizeof(TComplexDbl)*reqSize);
 	TComplexDbl* tempOut = (TComplexDbl*)::fftss_malloc(sizeof(TComplexDbl)*reqSize);
 
-	fftss_plan newPlan = ::fftss_plan_dft_1d(reqSize, (double*)tempIn, (double*)tempOut, FFTSS_FORWARD, FFTSS_MEASURE);
+	// non power-of-two sizes are planned as mixed-radix (or Bluestein for large prime factors)
+	fftss_plan newPlan = ::fftss_plan_dft_1d(reqSize, (double*)tempIn, (double*)tempOut, m_sign, FFTSS_MEASURE);
+	if(!newPlan)
+	{
+		::fftss_free(tempIn);
+		::fftss_free(tempOut);
+		return false;
+	}
 
 	if(m_bufSize != reqSize && reqSize == m_requestSize)
 	{
@@ -163,7 +166,16 @@ void CFFTransform::thread_run()
 
 			typedef StoreType<signals::etypVecCmplDbl>::buffer_templ VectorType;
 			VectorType* outVector = VectorType::retrieve(m_bufSize);
-			memcpy(outVector->data, m_outBuffer, m_bufSize * sizeof(TComplexDbl));
+			if(m_sign == FFTSS_BACKWARD)
+			{
+				// the backward transform is unscaled
+				const double scale = 1.0 / m_bufSize;
+				for(unsigned idx = 0; idx < m_bufSize; idx++)
+				{
+					outVector->data[idx] = m_outBuffer[idx] * scale;
+				}
+			}
+			else memcpy(outVector->data, m_outBuffer, m_bufSize * sizeof(TComplexDbl));
 
 			BOOL outFrame = m_outgoing.WriteOne(signals::etypVecCmplDbl, &outVector, INFINITE);
 			if(!outFrame)
@@ -233,11 +245,28 @@ void CFFTransform::CIncoming::OnDetached(signals::IAttribute* attr)
 
 // ------------------------------------------------------------------ class CFFTransformDriver
 
-signals::IBlock * CFFTransformDriver::Create()
+template<long SIGN>
+signals::IBlock * CFFTransformDriver<SIGN>::Create()
 {
-	signals::IBlock* blk = new CFFTransform(this);
+	signals::IBlock* blk = new CFFTransform(this, SIGN);
 	blk->AddRef();
 	return blk;
 }
 
 }
+
+extern "C" unsigned QueryDrivers(signals::IBlockDriver** drivers, unsigned availDrivers)
+{
+	static fftss::CFFTransformDriver<FFTSS_FORWARD> fft_dd;
+	static fftss::CFFTransformDriver<FFTSS_BACKWARD> ifft_dd;
+	static fftss::CFastConvolverDriver fir_cc;
+	static fftss::CChannelizerDriver chan_cv;
+	if(drivers && availDrivers)
+	{
+		if(availDrivers > 0) drivers[0] = &fft_dd;
+		if(availDrivers > 1) drivers[1] = &ifft_dd;
+		if(availDrivers > 2) drivers[2] = &fir_cc;
+		if(availDrivers > 3) drivers[3] = &chan_cv;
+	}
+	return 4;
+}
@@ -24,6 +24,7 @@ typedef void *fftss_plan;
 
 namespace fftss {
 
+template<long SIGN>
 class CFFTransformDriver : public signals::IBlockDriver
 {
 public:
@@ -52,7 +53,7 @@ protected:
 class CFFTransform : public CThreadBlockBase
 {
 public:
-	CFFTransform(signals::IBlockDriver* driver);
+	CFFTransform(signals::IBlockDriver* driver, long sign);
 	virtual ~CFFTransform();
 
 private:
@@ -60,7 +61,7 @@ private:
 	CFFTransform& operator=(const CFFTransform& other);
 
 public: // IBlock implementation
-	virtual const char* Name()				{ return NAME; }
+	virtual const char* Name()				{ return m_sign == FFTSS_BACKWARD ? INV_NAME : NAME; }
 	virtual unsigned Incoming(signals::IInEndpoint** ep, unsigned availEP) { return singleIncoming(&m_incoming, ep, availEP); }
 	virtual unsigned Outgoing(signals::IOutEndpoint** ep, unsigned availEP) { return singleOutgoing(&m_outgoing, ep, availEP); }
 
@@ -72,8 +73,10 @@ private:
 
 	typedef std::complex<double> TComplexDbl;
 	static const char* NAME;
+	static const char* INV_NAME;
 
 	volatile long m_requestSize;
+	const long m_sign;
 
 	void clearPlan();
 	void refreshPlan();
@@ -14,62 +14,154 @@
 	limitations under the License.
 */
 
-// tesing.cpp : Defines the entry point for the console application.
+// testing.cpp : benchmarks the overlap-save FIR engine against a direct-form FIR, and checks and benchmarks the polyphase channelizer
 //
 
 #include "stdafx.h"
 #include "fftssDriver.h"
+#include "fastconv.h"
+#include "channelizer.h"
+#include <stdio.h>
 
-static fftss::CFFTransformDriver<signals::etypCmplDbl,signals::etypVecCmplDbl> fft_dd;
-static fftss::CFFTransformDriver<signals::etypCmplDbl,signals::etypVecComplex> fft_ds;
-static fftss::CFFTransformDriver<signals::etypComplex,signals::etypVecCmplDbl> fft_sd;
-static fftss::CFFTransformDriver<signals::etypComplex,signals::etypVecComplex> fft_ss;
+static double elapsed(const LARGE_INTEGER& start)
+{
+	LARGE_INTEGER now, freq;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	return double(now.QuadPart - start.QuadPart) / freq.QuadPart;
+}
 
-int _tmain(int argc, _TCHAR* argv[])
+static bool checkChannelizer(unsigned numChannels, bool oversample)
 {
-	_CrtSetDbgFlag ( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
+	// a tone a quarter channel above the center of one channel has to come out of that channel alone, scaled and
+	// turned by the prototype's response at that offset and stepping in phase by its offset times the decimation
+	typedef std::complex<float> TComplex;
+	typedef std::complex<double> TComplexDbl;
+	static const unsigned TAPS_PER_CHANNEL = 8;
+	static const unsigned NUM_STEPS = 200;
+	static const double TOLERANCE = 1e-5;
+	static const double REJECT = 1e-3;				// 60 dB, the prototype stopband is deeper than that two channels out
+	const double PI = std::atan(1.0)*4;
+	const unsigned target = numChannels / 3;
+	const unsigned decim = oversample ? numChannels / 2 : numChannels;
+	const double offset = 0.25 / numChannels;
+	const double freq = double(target) / numChannels + offset;		// cycles per input sample
 
-	signals::IBlock* fft = fft_dd.Create();
-	ASSERT(fft != NULL);
-/*
-	typedef std::list<CAttrObserver*> TObservList;
-	TObservList obsList;
-	signals::IAttributes* attrs = hpsdr->Attributes();
+	std::vector<double> proto;
+	fftss::CPolyphaseChannelizer::designPrototype(numChannels, TAPS_PER_CHANNEL, proto);
+	TComplexDbl response;
+	for(unsigned n = 0; n < proto.size(); n++) response += proto[n] * std::polar(1.0, -2.0 * PI * offset * n);
+
+	fftss::CPolyphaseChannelizer engine;
+	bool good = engine.configure(numChannels, decim, proto.data(), (unsigned)proto.size());
+	std::vector<TComplex> in(NUM_STEPS * decim), out(numChannels);
+	for(unsigned idx = 0; idx < in.size(); idx++) in[idx] = TComplex(std::polar(1.0, 2.0 * PI * freq * idx));
+	engine.write(in.data(), (unsigned)in.size());
+
+	// output m has input m * decim as its newest sample
+	double worstErr = 0.0, worstLeak = 0.0;
+	const unsigned settle = (unsigned)proto.size() / decim + 1;
+	unsigned numSteps = 0;
+	for(; engine.next(out.data()); numSteps++)
 	{
-		unsigned count = attrs->Itemize(NULL, 0);
-		signals::IAttribute** attrList = new signals::IAttribute*[count];
-		VERIFY(attrs->Itemize(attrList, count) == count);
-		for(unsigned i = 0; i < count; i++)
+		if(numSteps < settle) continue;
+		const TComplexDbl expect = response * std::polar(1.0, 2.0 * PI * offset * double(numSteps * decim));
+		worstErr = max(worstErr, std::abs(TComplexDbl(out[target]) - expect));
+		for(unsigned chan = 0; chan < numChannels; chan++)
 		{
-			obsList.push_back(new CAttrObserver("", attrList[i]));
+			if(chan + 1 < target || chan > target + 1) worstLeak = max(worstLeak, double(std::abs(out[chan])));
 		}
-		delete [] attrList;
 	}
+	good = good && numSteps == NUM_STEPS && worstErr < TOLERANCE && worstLeak < REJECT;
 
-	unsigned numOut = fft->Outgoing(NULL, 0);
-	signals::IOutEndpoint** outEPs = new signals::IOutEndpoint*[numOut];
-	VERIFY(hpsdr->Outgoing(outEPs, numOut) == numOut);
-	signals::IOutEndpoint* recv1 = outEPs[2];
-	signals::IEPBuffer* buff = recv1->CreateBuffer();
-	recv1->Connect(buff);
+	printf("%s: %4u channels %s tone off by %.2e, %.2e leaked into other channels\n", good ? "pass" : "FAIL",
+		numChannels, oversample ? "2x oversampled" : "critical      ", worstErr, worstLeak);
+	return good;
+}
 
+int _tmain(int argc, _TCHAR* argv[])
+{
+	_CrtSetDbgFlag ( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
+
+	typedef std::complex<float> TComplex;
+	typedef std::complex<double> TComplexDbl;
+	static const unsigned TAP_COUNTS[] = { 64, 256, 1024, 4096, 16384, 65536 };
+	static const unsigned SAMPLE_RATE = 384000;
+	static const unsigned DIRECT_SAMPLES = 4096;
+
+	for(unsigned test = 0; test < _countof(TAP_COUNTS); test++)
 	{
-		CStreamObserver<signals::etypComplex> strm(buff);
-*/
-//		fft->Start();
-		Sleep(30000);
-/*		hpsdr->Stop();
+		const unsigned numTaps = TAP_COUNTS[test];
+		std::vector<TComplexDbl> taps(numTaps);
+		for(unsigned idx = 0; idx < numTaps; idx++) taps[idx] = TComplexDbl(cos(idx * 0.01), sin(idx * 0.01)) / double(numTaps);
+
+		// overlap-save, one second of samples at 384 kHz
+		fftss::COverlapSave engine;
+		fftss::COverlapSave::Kernel* kern = fftss::COverlapSave::Kernel::build(taps.data(), numTaps);
+		engine.setKernel(kern);
+		kern->Release();
+		unsigned step = engine.beginBlock();
+		std::vector<TComplex> in(step, TComplex(0.5f, 0.25f)), out(step);
+		unsigned numBlocks = SAMPLE_RATE / step + 1;
+
+		LARGE_INTEGER start;
+		QueryPerformanceCounter(&start);
+		for(unsigned blk = 0; blk < numBlocks; blk++)
+		{
+			engine.beginBlock();
+			engine.process(in.data(), out.data());
+		}
+		double fastPerSample = elapsed(start) / (double(numBlocks) * step);
+
+		// direct form, timed over a shorter run
+		std::vector<TComplex> hist(numTaps + DIRECT_SAMPLES, TComplex(0.5f, 0.25f));
+		std::vector<TComplex> ftaps(taps.begin(), taps.end());
+		volatile float sink = 0.0f;
+		QueryPerformanceCounter(&start);
+		for(unsigned samp = 0; samp < DIRECT_SAMPLES; samp++)
+		{
+			TComplex acc = 0.0f;
+			const TComplex* src = &hist[samp + numTaps - 1];
+			for(unsigned idx = 0; idx < numTaps; idx++) acc += ftaps[idx] * src[-(int)idx];
+			sink += acc.real();
+		}
+		double directPerSample = elapsed(start) / DIRECT_SAMPLES;
+
+		printf("%6u taps: overlap-save %8.1f ns/sample (%6.1fx realtime at 384 kHz), direct %10.1f ns/sample (%6.2fx realtime)\n",
+			numTaps, fastPerSample * 1e9, 1.0 / (fastPerSample * SAMPLE_RATE),
+			directPerSample * 1e9, 1.0 / (directPerSample * SAMPLE_RATE));
 	}
 
-	for(TObservList::iterator trans = obsList.begin(); trans != obsList.end(); trans++)
+	static const unsigned CHANNEL_COUNTS[] = { 16, 64, 256 };
+	static const unsigned TAPS_PER_CHANNEL = 8;
+	bool failed = false;
+	for(unsigned test = 0; test < _countof(CHANNEL_COUNTS); test++)
 	{
-		delete *trans;
-	}
-	buff->Release();
-	delete [] outEPs;*/
-	VERIFY(!fft->Release());
+		const unsigned numChannels = CHANNEL_COUNTS[test];
+		if(!checkChannelizer(numChannels, false) || !checkChannelizer(numChannels, true)) failed = true;
+		std::vector<double> proto;
+		fftss::CPolyphaseChannelizer::designPrototype(numChannels, TAPS_PER_CHANNEL, proto);
+		std::vector<TComplex> in(SAMPLE_RATE), out(numChannels);
+		for(unsigned idx = 0; idx < SAMPLE_RATE; idx++) in[idx] = TComplex((float)cos(idx * 0.3), (float)sin(idx * 0.3));
+
+		for(unsigned oversample = 0; oversample < 2; oversample++)
+		{
+			// one second of samples at 384 kHz
+			fftss::CPolyphaseChannelizer engine;
+			engine.configure(numChannels, oversample ? numChannels / 2 : numChannels, proto.data(), (unsigned)proto.size());
 
-//	std::cout << numPackets << " entries received" << std::endl;
-//	Sleep(30000);
-	return 0;
+			LARGE_INTEGER start;
+			QueryPerformanceCounter(&start);
+			engine.write(in.data(), SAMPLE_RATE);
+			unsigned numSteps = 0;
+			while(engine.next(out.data())) numSteps++;
+			double secs = elapsed(start);
+
+			printf("%4u channels %s: %8.1f ns/input sample, %6.1f ns/channel output (%6.1fx realtime at 384 kHz)\n",
+				numChannels, oversample ? "2x oversampled" : "critical      ", secs / SAMPLE_RATE * 1e9,
+				secs / (double(numSteps) * numChannels) * 1e9, 1.0 / secs);
+		}
+	}
+	if(!checkChannelizer(15, false)) failed = true;		// odd count, the single-branch tails
+	return failed ? 1 : 0;
 }
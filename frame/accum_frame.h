@@ -0,0 +1,435 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+#include <blockImpl.h>
+
+// Smooths a stream of frames (typically FFT magnitudes) into a persistent accumulator, emitting
+// a copy of the accumulator once every "decimation" input frames
+template<signals::EType ET>
+class CFrameAccumulator : public CThreadBlockBase
+{
+public:
+	CFrameAccumulator(signals::IBlockDriver* driver);
+	virtual ~CFrameAccumulator();
+
+private:
+	CFrameAccumulator(const CFrameAccumulator& other);
+	CFrameAccumulator& operator=(const CFrameAccumulator& other);
+
+public: // IBlock implementation
+	virtual const char* Name()				{ return NAME; }
+	virtual unsigned Incoming(signals::IInEndpoint** ep, unsigned availEP) { return singleIncoming(&m_incoming, ep, availEP); }
+	virtual unsigned Outgoing(signals::IOutEndpoint** ep, unsigned availEP) { return singleOutgoing(&m_outgoing, ep, availEP); }
+
+public:
+	enum EMode
+	{
+		MODE_EXPONENTIAL,		// acc += alpha * (in - acc)
+		MODE_LINEAR,			// mean of the last "count" frames
+		MODE_MAX_HOLD,			// acc = max(in, acc + decay * (in - acc))
+		MODE_MIN_HOLD,			// acc = min(in, acc + decay * (in - acc))
+		NUM_MODES
+	};
+
+	struct
+	{
+		CAttributeBase* mode;
+		CAttributeBase* alpha;
+		CAttributeBase* count;
+		CAttributeBase* decay;
+		CAttributeBase* decimation;
+	} attrs;
+
+	void setMode(const long& mode);
+	void setAlpha(const float& alpha);
+	void setCount(const long& count);
+	void setDecay(const float& decay);
+	void setDecimation(const long& decimation);
+
+private:
+	enum
+	{
+		IN_BUFFER_TIMEOUT = 1000,
+		DEFAULT_COUNT = 8,
+	};
+
+	typedef typename StoreType<ET>::buffer_templ VectorType;
+	typedef typename StoreType<ET>::base_type base_type;
+	static const char* NAME;
+	static const char* MODE_NAMES[NUM_MODES];
+
+	class CAttr_mode : public CAttr_callback<signals::etypLong,CFrameAccumulator>
+	{
+	private:
+		typedef CAttr_callback<signals::etypLong,CFrameAccumulator> base;
+	public:
+		inline CAttr_mode(CFrameAccumulator& parent)
+			:base(parent, "mode", "Accumulation mode", &CFrameAccumulator::setMode, MODE_EXPONENTIAL) { }
+
+		virtual unsigned options(const void* vals, const char** opts, unsigned availElem)
+		{
+			if((vals||opts) && availElem)
+			{
+				unsigned numCopy = min(availElem, (unsigned)NUM_MODES);
+				for(unsigned idx=0; idx < numCopy; idx++)
+				{
+					if(vals) ((long*)vals)[idx] = (long)idx;
+					if(opts) opts[idx] = MODE_NAMES[idx];
+				}
+			}
+			return NUM_MODES;
+		}
+
+		virtual bool isValidValue(const long& newVal) const
+		{
+			return newVal >= 0 && newVal < NUM_MODES;
+		}
+	};
+
+public:
+	class COutgoing : public CSimpleCascadeOutgoingChild<ET>
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline COutgoing(CFrameAccumulator* parent):CSimpleCascadeOutgoingChild(parent->m_incoming),m_parent(parent) { }
+		void buildAttrs(const CFrameAccumulator& parent);
+
+	protected:
+		CFrameAccumulator* m_parent;
+
+	public:
+		struct
+		{
+			CEventAttribute* sync_fault;
+		} attrs;
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		COutgoing(const COutgoing& other);
+		COutgoing& operator=(const COutgoing& other);
+
+	public: // COutEndpointBase interface
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+	};
+
+	class CIncoming : public CSimpleCascadeIncomingChild
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline CIncoming(CFrameAccumulator* parent):CSimpleCascadeIncomingChild(ET, parent, parent->m_outgoing) { }
+		virtual const char* EPName()	{ return EP_NAME; }
+		virtual const char* EPDescr()	{ return EP_DESCR; }
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		CIncoming(const CIncoming& other);
+		CIncoming& operator=(const CIncoming& other);
+	};
+
+private:
+	CIncoming m_incoming;
+	COutgoing m_outgoing;
+
+	volatile long m_mode;
+	volatile float m_alpha;
+	volatile long m_count;
+	volatile float m_decay;
+	volatile long m_decimation;
+	volatile long m_resetRequested;
+
+	void buildAttrs();
+	static void accumulate(EMode mode, base_type* acc, const base_type* in, unsigned size, base_type weight);
+
+protected:
+	virtual void thread_run();
+};
+
+template<signals::EType ET>
+class CFrameAccumulatorDriver : public signals::IBlockDriver
+{
+public:
+	inline CFrameAccumulatorDriver() {}
+	virtual ~CFrameAccumulatorDriver() {}
+
+private:
+	CFrameAccumulatorDriver(const CFrameAccumulatorDriver& other);
+	CFrameAccumulatorDriver operator=(const CFrameAccumulatorDriver& other);
+
+public:
+	virtual const char* Name()			{ return NAME; }
+	virtual const char* Description()	{ return DESCR; }
+	virtual BOOL canCreate()			{ return true; }
+	virtual BOOL canDiscover()			{ return false; }
+	virtual unsigned Discover(signals::IBlock** blocks, unsigned availBlocks) { return 0; }
+	virtual signals::IBlock* Create();
+	const unsigned char* Fingerprint()	{ return FINGERPRINT; }
+
+protected:
+	static const char* NAME;
+	static const char* DESCR;
+	static const unsigned char FINGERPRINT[];
+};
+
+// ------------------------------------------------------------------------------------------------
+
+template<signals::EType ET>
+const char* CFrameAccumulatorDriver<ET>::NAME = "accumulate frame";
+
+template<signals::EType ET>
+const char* CFrameAccumulatorDriver<ET>::DESCR = "Average or peak-hold a stream of frames";
+
+template<signals::EType ET>
+const unsigned char CFrameAccumulatorDriver<ET>::FINGERPRINT[] = { 1, (unsigned char)ET, 1, (unsigned char)ET };
+
+template<signals::EType ET>
+const char* CFrameAccumulator<ET>::NAME = "Average or peak-hold a stream of frames";
+
+template<signals::EType ET>
+const char* CFrameAccumulator<ET>::MODE_NAMES[NUM_MODES] = { "exponential", "linear", "max hold", "min hold" };
+
+template<signals::EType ET>
+const char* CFrameAccumulator<ET>::CIncoming::EP_NAME = "in";
+
+template<signals::EType ET>
+const char* CFrameAccumulator<ET>::CIncoming::EP_DESCR = "\"Accumulate Frame\" incoming endpoint";
+
+template<signals::EType ET>
+const char* CFrameAccumulator<ET>::COutgoing::EP_NAME = "out";
+
+template<signals::EType ET>
+const char* CFrameAccumulator<ET>::COutgoing::EP_DESCR = "\"Accumulate Frame\" outgoing endpoint";
+
+// ------------------------------------------------------------------ class CFrameAccumulatorDriver
+
+template<signals::EType ET>
+signals::IBlock * CFrameAccumulatorDriver<ET>::Create()
+{
+	signals::IBlock* blk = new CFrameAccumulator<ET>(this);
+	blk->AddRef();
+	return blk;
+}
+
+// ------------------------------------------------------------------ class CFrameAccumulator
+
+#pragma warning(push)
+#pragma warning(disable: 4355)
+template<signals::EType ET>
+CFrameAccumulator<ET>::CFrameAccumulator(signals::IBlockDriver* driver)
+	:CThreadBlockBase(driver),m_incoming(this),m_outgoing(this),m_mode(MODE_EXPONENTIAL),m_alpha(0.2f),
+	 m_count(DEFAULT_COUNT),m_decay(0.0f),m_decimation(1),m_resetRequested(0)
+{
+	buildAttrs();
+	startThread();
+}
+#pragma warning(pop)
+
+template<signals::EType ET>
+CFrameAccumulator<ET>::~CFrameAccumulator()
+{
+	stopThread();
+}
+
+template<signals::EType ET>
+void CFrameAccumulator<ET>::buildAttrs()
+{
+	attrs.mode = addLocalAttr(true, new CAttr_mode(*this));
+	attrs.alpha = addLocalAttr(true, new CAttr_callback<signals::etypSingle,CFrameAccumulator>
+		(*this, "alpha", "Weight given to each new frame in exponential mode", &CFrameAccumulator::setAlpha, 0.2f));
+	attrs.count = addLocalAttr(true, new CAttr_callback<signals::etypLong,CFrameAccumulator>
+		(*this, "count", "Number of frames averaged together in linear mode", &CFrameAccumulator::setCount, DEFAULT_COUNT));
+	attrs.decay = addLocalAttr(true, new CAttr_callback<signals::etypSingle,CFrameAccumulator>
+		(*this, "decay", "Rate a held peak relaxes toward new frames in hold modes (0 = hold forever)", &CFrameAccumulator::setDecay, 0.0f));
+	attrs.decimation = addLocalAttr(true, new CAttr_callback<signals::etypLong,CFrameAccumulator>
+		(*this, "decimation", "Number of incoming frames for each outgoing frame", &CFrameAccumulator::setDecimation, 1));
+	m_outgoing.buildAttrs(*this);
+}
+
+template<signals::EType ET>
+void CFrameAccumulator<ET>::setMode(const long& mode)
+{
+	InterlockedExchange(&m_mode, mode);
+	InterlockedExchange(&m_resetRequested, 1);
+}
+
+template<signals::EType ET>
+void CFrameAccumulator<ET>::setAlpha(const float& alpha)
+{
+	m_alpha = alpha < 0.0f ? 0.0f : alpha > 1.0f ? 1.0f : alpha;
+}
+
+template<signals::EType ET>
+void CFrameAccumulator<ET>::setCount(const long& count)
+{
+	InterlockedExchange(&m_count, count < 1 ? 1 : count);
+	InterlockedExchange(&m_resetRequested, 1);
+}
+
+template<signals::EType ET>
+void CFrameAccumulator<ET>::setDecay(const float& decay)
+{
+	m_decay = decay < 0.0f ? 0.0f : decay > 1.0f ? 1.0f : decay;
+}
+
+template<signals::EType ET>
+void CFrameAccumulator<ET>::setDecimation(const long& decimation)
+{
+	InterlockedExchange(&m_decimation, decimation < 1 ? 1 : decimation);
+}
+
+template<signals::EType ET>
+void CFrameAccumulator<ET>::COutgoing::buildAttrs(const CFrameAccumulator& parent)
+{
+	attrs.sync_fault = addLocalAttr(true, new CEventAttribute("syncFault", "Fires when a sync fault happens in a receive stream"));
+}
+
+template<signals::EType ET>
+void CFrameAccumulator<ET>::accumulate(EMode mode, base_type* acc, const base_type* in, unsigned size, base_type weight)
+{
+	// kept as simple branch-free loops over raw arrays so the compiler can vectorize them
+	switch(mode)
+	{
+	case MODE_EXPONENTIAL:
+		for(unsigned idx = 0; idx < size; idx++)
+		{
+			acc[idx] += weight * (in[idx] - acc[idx]);
+		}
+		break;
+	case MODE_MAX_HOLD:
+		for(unsigned idx = 0; idx < size; idx++)
+		{
+			base_type held = acc[idx] + weight * (in[idx] - acc[idx]);
+			acc[idx] = in[idx] > held ? in[idx] : held;
+		}
+		break;
+	case MODE_MIN_HOLD:
+		for(unsigned idx = 0; idx < size; idx++)
+		{
+			base_type held = acc[idx] + weight * (in[idx] - acc[idx]);
+			acc[idx] = in[idx] < held ? in[idx] : held;
+		}
+		break;
+	}
+}
+
+template<signals::EType ET>
+void CFrameAccumulator<ET>::thread_run()
+{
+	ThreadBase::SetThreadName("Frame Accumulator Thread");
+
+	base_type* acc = NULL;
+	unsigned accSize = 0;
+	unsigned numAccum = 0;			// frames currently held in the accumulator
+	unsigned numSinceOut = 0;		// frames received since the last output
+	std::vector<base_type> window;	// linear mode: the last "count" frames, oldest at windowNext
+	std::vector<base_type> windowSum;
+	unsigned windowNext = 0;
+	while(threadRunning())
+	{
+		signals::IVector* inVector = NULL;
+		BOOL recvFrame = m_incoming.ReadOne(ET, &inVector, IN_BUFFER_TIMEOUT);
+		if(!recvFrame) continue;
+
+		unsigned size = inVector->Size();
+		if(!size)
+		{
+			inVector->Release();
+			continue;
+		}
+		if(size != accSize)
+		{
+			delete [] acc;
+			acc = new base_type[size];
+			accSize = size;
+			numAccum = 0;
+			numSinceOut = 0;
+		}
+		if(InterlockedExchange(&m_resetRequested, 0)) numAccum = 0;
+
+		EMode mode = (EMode)m_mode;
+		const base_type* inData = (const base_type*)inVector->Data();
+		if(mode == MODE_LINEAR)
+		{
+			// a sliding window, so every output is a full average however the decimation lines up with the count
+			const unsigned count = (unsigned)m_count;
+			if(!numAccum || window.size() != count * size)
+			{
+				window.assign(count * size, base_type(0));
+				windowSum.assign(size, base_type(0));
+				windowNext = 0;
+				numAccum = 0;
+			}
+			base_type* slot = &window[windowNext * size];
+			base_type* sum = windowSum.data();
+			if(numAccum == count)
+			{
+				for(unsigned idx = 0; idx < size; idx++) sum[idx] -= slot[idx];
+			}
+			else numAccum++;
+			memcpy(slot, inData, size * sizeof(base_type));
+			for(unsigned idx = 0; idx < size; idx++) sum[idx] += slot[idx];
+
+			if(++windowNext == count)
+			{
+				// rebuild the sum once per pass so the rounding of the running subtraction can't build up
+				windowNext = 0;
+				memcpy(sum, window.data(), size * sizeof(base_type));
+				for(unsigned frame = 1; frame < count; frame++)
+				{
+					const base_type* prev = &window[frame * size];
+					for(unsigned idx = 0; idx < size; idx++) sum[idx] += prev[idx];
+				}
+			}
+
+			const base_type scale = base_type(1) / base_type(numAccum);
+			for(unsigned idx = 0; idx < size; idx++) acc[idx] = sum[idx] * scale;
+		}
+		else if(!numAccum)
+		{
+			memcpy(acc, inData, size * sizeof(base_type));
+		}
+		else
+		{
+			base_type weight;
+			switch(mode)
+			{
+			case MODE_EXPONENTIAL:
+				weight = (base_type)m_alpha;
+				break;
+			default:
+				weight = (base_type)m_decay;
+				break;
+			}
+			accumulate(mode, acc, inData, size, weight);
+		}
+		if(mode != MODE_LINEAR) numAccum++;
+		inVector->Release();
+
+		if(++numSinceOut >= (unsigned)m_decimation)
+		{
+			numSinceOut = 0;
+			VectorType* outVector = VectorType::retrieve(size);
+			memcpy(outVector->data, acc, size * sizeof(base_type));
+			BOOL outFrame = m_outgoing.WriteOne(ET, &outVector, INFINITE);
+			if(!outFrame)
+			{
+				if(m_outgoing.isConnected()) m_outgoing.attrs.sync_fault->fire();
+				outVector->Release();
+			}
+		}
+	}
+	delete [] acc;
+}
@@ -0,0 +1,545 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+#include <blockImpl.h>
+#include <vector>
+#include <algorithm>
+#include <emmintrin.h>
+
+// Finds the peaks in spectrum frames (power or dB) that stand out from their neighbours by a constant
+// false-alarm-rate test, emitting one frame per input holding (bin, power, width) for each detection
+template<signals::EType ET>
+class CCfarDetector : public CThreadBlockBase
+{
+public:
+	CCfarDetector(signals::IBlockDriver* driver);
+	virtual ~CCfarDetector();
+
+private:
+	CCfarDetector(const CCfarDetector& other);
+	CCfarDetector& operator=(const CCfarDetector& other);
+
+public: // IBlock implementation
+	virtual const char* Name()				{ return NAME; }
+	virtual unsigned Incoming(signals::IInEndpoint** ep, unsigned availEP) { return singleIncoming(&m_incoming, ep, availEP); }
+	virtual unsigned Outgoing(signals::IOutEndpoint** ep, unsigned availEP) { return singleOutgoing(&m_outgoing, ep, availEP); }
+
+public:
+	enum EMethod
+	{
+		METHOD_CELL_AVERAGE,	// noise is the mean of the reference cells
+		METHOD_ORDER_STATISTIC,	// noise is the reference cell at "rank" when sorted, robust to nearby signals
+		NUM_METHODS
+	};
+
+	enum EScale
+	{
+		SCALE_LINEAR,			// frames hold power, the threshold multiplies the noise
+		SCALE_DB,				// frames hold decibels, the threshold is added to the noise
+		NUM_SCALES
+	};
+
+	struct
+	{
+		CAttributeBase* method;
+		CAttributeBase* scale;
+		CAttributeBase* threshold;
+		CAttributeBase* guard;
+		CAttributeBase* reference;
+		CAttributeBase* rank;
+		CAttributeBase* maxPeaks;
+	} attrs;
+
+	void setMethod(const long& method);
+	void setScale(const long& scale);
+	void setThreshold(const float& threshold);
+	void setGuard(const long& cells);
+	void setReference(const long& cells);
+	void setRank(const float& rank);
+	void setMaxPeaks(const long& peaks);
+
+private:
+	enum
+	{
+		IN_BUFFER_TIMEOUT = 1000,
+		DEFAULT_GUARD = 2,
+		DEFAULT_REFERENCE = 16,
+		DEFAULT_MAX_PEAKS = 64,
+		VALUES_PER_PEAK = 3,
+	};
+
+	typedef typename StoreType<ET>::buffer_templ VectorType;
+	typedef typename StoreType<ET>::base_type base_type;
+	static const char* NAME;
+	static const char* METHOD_NAMES[NUM_METHODS];
+	static const char* SCALE_NAMES[NUM_SCALES];
+
+	struct Peak
+	{
+		unsigned bin;
+		double position;		// bin refined from the shape of its neighbours
+		base_type power;
+		unsigned low, high;		// extent of the half-power lobe
+	};
+	struct StrongerPeak { inline bool operator()(const Peak& a, const Peak& b) const { return a.power > b.power; } };
+	struct LowerPeak { inline bool operator()(const Peak& a, const Peak& b) const { return a.bin < b.bin; } };
+
+	struct Settings
+	{
+		EMethod method;
+		EScale scale;
+		double threshold;		// multiplier or offset, depending on the scale
+		unsigned guard;
+		unsigned reference;
+		double rank;
+	};
+
+	template<class OPTS>
+	class CAttr_options : public CAttr_callback<signals::etypLong,CCfarDetector>
+	{
+	private:
+		typedef CAttr_callback<signals::etypLong,CCfarDetector> base;
+	public:
+		inline CAttr_options(CCfarDetector& parent, const char* name, const char* descr,
+				typename base::TCallback setter, long deflt)
+			:base(parent, name, descr, setter, deflt) { }
+
+		virtual unsigned options(const void* vals, const char** opts, unsigned availElem)
+		{
+			if((vals||opts) && availElem)
+			{
+				unsigned numCopy = min(availElem, (unsigned)OPTS::COUNT);
+				for(unsigned idx=0; idx < numCopy; idx++)
+				{
+					if(vals) ((long*)vals)[idx] = (long)idx;
+					if(opts) opts[idx] = OPTS::names()[idx];
+				}
+			}
+			return OPTS::COUNT;
+		}
+
+		virtual bool isValidValue(const long& newVal) const
+		{
+			return newVal >= 0 && newVal < OPTS::COUNT;
+		}
+	};
+	struct MethodOptions { enum { COUNT = NUM_METHODS }; static const char** names() { return METHOD_NAMES; } };
+	struct ScaleOptions { enum { COUNT = NUM_SCALES }; static const char** names() { return SCALE_NAMES; } };
+
+public:
+	class COutgoing : public CSimpleCascadeOutgoingChild<ET>
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline COutgoing(CCfarDetector* parent):CSimpleCascadeOutgoingChild(parent->m_incoming),m_parent(parent) { }
+		void buildAttrs(const CCfarDetector& parent);
+
+	protected:
+		CCfarDetector* m_parent;
+
+	public:
+		struct
+		{
+			CEventAttribute* sync_fault;
+		} attrs;
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		COutgoing(const COutgoing& other);
+		COutgoing& operator=(const COutgoing& other);
+
+	public: // COutEndpointBase interface
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+	};
+
+	class CIncoming : public CSimpleCascadeIncomingChild
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline CIncoming(CCfarDetector* parent):CSimpleCascadeIncomingChild(ET, parent, parent->m_outgoing) { }
+		virtual const char* EPName()	{ return EP_NAME; }
+		virtual const char* EPDescr()	{ return EP_DESCR; }
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		CIncoming(const CIncoming& other);
+		CIncoming& operator=(const CIncoming& other);
+	};
+
+private:
+	CIncoming m_incoming;
+	COutgoing m_outgoing;
+
+	volatile long m_method;
+	volatile long m_scale;
+	volatile float m_threshold;
+	volatile long m_guard;
+	volatile long m_reference;
+	volatile float m_rank;
+	volatile long m_maxPeaks;
+
+	std::vector<double> m_prefix;		// running sums of the frame for the cell-averaging windows
+	std::vector<unsigned> m_candidates;	// local maxima that passed (CA) or still need (OS) the threshold test
+	std::vector<Peak> m_peaks;
+
+	void buildAttrs();
+	void findCandidates(const base_type* in, unsigned size, const Settings& settings);
+	bool isDetection(const base_type* in, unsigned size, unsigned bin, const Settings& settings);
+	void detect(const base_type* in, unsigned size, const Settings& settings, unsigned maxPeaks);
+
+	static inline __m128d load2(const float* src)	{ return _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double*)src))); }
+	static inline __m128d load2(const double* src)	{ return _mm_loadu_pd(src); }
+
+protected:
+	virtual void thread_run();
+};
+
+template<signals::EType ET>
+class CCfarDetectorDriver : public signals::IBlockDriver
+{
+public:
+	inline CCfarDetectorDriver() {}
+	virtual ~CCfarDetectorDriver() {}
+
+private:
+	CCfarDetectorDriver(const CCfarDetectorDriver& other);
+	CCfarDetectorDriver operator=(const CCfarDetectorDriver& other);
+
+public:
+	virtual const char* Name()			{ return NAME; }
+	virtual const char* Description()	{ return DESCR; }
+	virtual BOOL canCreate()			{ return true; }
+	virtual BOOL canDiscover()			{ return false; }
+	virtual unsigned Discover(signals::IBlock** blocks, unsigned availBlocks) { return 0; }
+	virtual signals::IBlock* Create();
+	const unsigned char* Fingerprint()	{ return FINGERPRINT; }
+
+protected:
+	static const char* NAME;
+	static const char* DESCR;
+	static const unsigned char FINGERPRINT[];
+};
+
+// ------------------------------------------------------------------------------------------------
+
+template<signals::EType ET>
+const char* CCfarDetectorDriver<ET>::NAME = "cfar detect";
+
+template<signals::EType ET>
+const char* CCfarDetectorDriver<ET>::DESCR = "Reduce spectrum frames to a list of detected peaks";
+
+template<signals::EType ET>
+const unsigned char CCfarDetectorDriver<ET>::FINGERPRINT[] = { 1, (unsigned char)ET, 1, (unsigned char)ET };
+
+template<signals::EType ET>
+const char* CCfarDetector<ET>::NAME = "CFAR Detect";
+
+template<signals::EType ET>
+const char* CCfarDetector<ET>::METHOD_NAMES[NUM_METHODS] = { "cell average", "order statistic" };
+
+template<signals::EType ET>
+const char* CCfarDetector<ET>::SCALE_NAMES[NUM_SCALES] = { "linear", "dB" };
+
+template<signals::EType ET>
+const char* CCfarDetector<ET>::CIncoming::EP_NAME = "in";
+
+template<signals::EType ET>
+const char* CCfarDetector<ET>::CIncoming::EP_DESCR = "\"CFAR Detect\" incoming endpoint";
+
+template<signals::EType ET>
+const char* CCfarDetector<ET>::COutgoing::EP_NAME = "out";
+
+template<signals::EType ET>
+const char* CCfarDetector<ET>::COutgoing::EP_DESCR = "\"CFAR Detect\" outgoing endpoint, each peak is three values: bin, power, half-power width in bins";
+
+// ------------------------------------------------------------------ class CCfarDetectorDriver
+
+template<signals::EType ET>
+signals::IBlock * CCfarDetectorDriver<ET>::Create()
+{
+	signals::IBlock* blk = new CCfarDetector<ET>(this);
+	blk->AddRef();
+	return blk;
+}
+
+// ------------------------------------------------------------------ class CCfarDetector
+
+#pragma warning(push)
+#pragma warning(disable: 4355)
+template<signals::EType ET>
+CCfarDetector<ET>::CCfarDetector(signals::IBlockDriver* driver)
+	:CThreadBlockBase(driver),m_incoming(this),m_outgoing(this),m_method(METHOD_CELL_AVERAGE),m_scale(SCALE_DB),
+	 m_threshold(10.0f),m_guard(DEFAULT_GUARD),m_reference(DEFAULT_REFERENCE),m_rank(0.75f),m_maxPeaks(DEFAULT_MAX_PEAKS)
+{
+	buildAttrs();
+	startThread();
+}
+#pragma warning(pop)
+
+template<signals::EType ET>
+CCfarDetector<ET>::~CCfarDetector()
+{
+	stopThread();
+}
+
+template<signals::EType ET>
+void CCfarDetector<ET>::buildAttrs()
+{
+	attrs.method = addLocalAttr(true, new CAttr_options<MethodOptions>
+		(*this, "method", "How the noise level around each bin is estimated", &CCfarDetector::setMethod, METHOD_CELL_AVERAGE));
+	attrs.scale = addLocalAttr(true, new CAttr_options<ScaleOptions>
+		(*this, "scale", "Whether incoming frames hold linear power or decibels", &CCfarDetector::setScale, SCALE_DB));
+	attrs.threshold = addLocalAttr(true, new CAttr_callback<signals::etypSingle,CCfarDetector>
+		(*this, "threshold", "Height (dB) above the local noise needed for a detection", &CCfarDetector::setThreshold, 10.0f));
+	attrs.guard = addLocalAttr(true, new CAttr_callback<signals::etypLong,CCfarDetector>
+		(*this, "guard", "Bins on each side of the tested bin left out of the noise estimate", &CCfarDetector::setGuard, DEFAULT_GUARD));
+	attrs.reference = addLocalAttr(true, new CAttr_callback<signals::etypLong,CCfarDetector>
+		(*this, "reference", "Bins on each side, past the guard, used to estimate the noise", &CCfarDetector::setReference, DEFAULT_REFERENCE));
+	attrs.rank = addLocalAttr(true, new CAttr_callback<signals::etypSingle,CCfarDetector>
+		(*this, "rank", "Fraction into the sorted reference bins taken as the noise in order-statistic mode", &CCfarDetector::setRank, 0.75f));
+	attrs.maxPeaks = addLocalAttr(true, new CAttr_callback<signals::etypLong,CCfarDetector>
+		(*this, "maxPeaks", "Most detections reported per frame, strongest first", &CCfarDetector::setMaxPeaks, DEFAULT_MAX_PEAKS));
+	m_outgoing.buildAttrs(*this);
+}
+
+template<signals::EType ET>
+void CCfarDetector<ET>::setMethod(const long& method)
+{
+	InterlockedExchange(&m_method, method);
+}
+
+template<signals::EType ET>
+void CCfarDetector<ET>::setScale(const long& scale)
+{
+	InterlockedExchange(&m_scale, scale);
+}
+
+template<signals::EType ET>
+void CCfarDetector<ET>::setThreshold(const float& threshold)
+{
+	m_threshold = threshold;
+}
+
+template<signals::EType ET>
+void CCfarDetector<ET>::setGuard(const long& cells)
+{
+	InterlockedExchange(&m_guard, cells < 0 ? 0 : cells);
+}
+
+template<signals::EType ET>
+void CCfarDetector<ET>::setReference(const long& cells)
+{
+	InterlockedExchange(&m_reference, cells < 1 ? 1 : cells);
+}
+
+template<signals::EType ET>
+void CCfarDetector<ET>::setRank(const float& rank)
+{
+	m_rank = rank < 0.0f ? 0.0f : rank > 1.0f ? 1.0f : rank;
+}
+
+template<signals::EType ET>
+void CCfarDetector<ET>::setMaxPeaks(const long& peaks)
+{
+	InterlockedExchange(&m_maxPeaks, peaks < 1 ? 1 : peaks);
+}
+
+template<signals::EType ET>
+void CCfarDetector<ET>::COutgoing::buildAttrs(const CCfarDetector& parent)
+{
+	attrs.sync_fault = addLocalAttr(true, new CEventAttribute("syncFault", "Fires when a sync fault happens in a receive stream"));
+}
+
+template<signals::EType ET>
+bool CCfarDetector<ET>::isDetection(const base_type* in, unsigned size, unsigned bin, const Settings& settings)
+{
+	// reference windows are clipped at the frame edges, leaving a one-sided estimate there
+	const unsigned leftEnd = bin > settings.guard ? bin - settings.guard : 0;
+	const unsigned leftStart = leftEnd > settings.reference ? leftEnd - settings.reference : 0;
+	const unsigned rightStart = min(bin + settings.guard + 1, size);
+	const unsigned rightEnd = min(rightStart + settings.reference, size);
+	const unsigned numCells = (leftEnd - leftStart) + (rightEnd - rightStart);
+	if(!numCells) return false;
+	const bool isDb = settings.scale == SCALE_DB;
+
+	if(settings.method == METHOD_CELL_AVERAGE)
+	{
+		const double* prefix = m_prefix.data();
+		const double noise = (prefix[leftEnd] - prefix[leftStart] + prefix[rightEnd] - prefix[rightStart]) / numCells;
+		return in[bin] > (isDb ? noise + settings.threshold : noise * settings.threshold);
+	}
+
+	// the bin exceeds the threshold over the ranked cell exactly when more than "rank" cells sit under
+	// the level the bin implies, which is a count rather than a sort
+	const base_type limit = base_type(isDb ? in[bin] - settings.threshold : in[bin] / settings.threshold);
+	const unsigned rank = min(unsigned(settings.rank * (numCells - 1) + 0.5), numCells - 1);
+	unsigned below = 0;
+	for(unsigned idx = leftStart; idx < leftEnd; idx++) below += in[idx] < limit;
+	for(unsigned idx = rightStart; idx < rightEnd; idx++) below += in[idx] < limit;
+	return below > rank;
+}
+
+template<signals::EType ET>
+void CCfarDetector<ET>::findCandidates(const base_type* in, unsigned size, const Settings& settings)
+{
+	m_candidates.clear();
+	if(size < 3) return;
+
+	m_prefix.resize(size + 1);
+	double* prefix = m_prefix.data();
+	prefix[0] = 0.0;
+	for(unsigned idx = 0; idx < size; idx++) prefix[idx + 1] = prefix[idx] + in[idx];
+
+	// where both reference windows fit, two bins are tested per vector: a local maximum above its threshold
+	// (cell averaging) or any local maximum (order statistic, tested afterward)
+	const bool isAverage = settings.method == METHOD_CELL_AVERAGE;
+	const unsigned span = settings.guard + settings.reference;
+	const unsigned interiorStart = max(span, 1u);
+	const unsigned interiorEnd = size > span + 1 ? size - span - 1 : 0;
+	const __m128d inv = _mm_set1_pd(1.0 / (2 * settings.reference));
+	const __m128d thresh = _mm_set1_pd(settings.threshold);
+	const bool isDb = settings.scale == SCALE_DB;
+
+	for(unsigned bin = 1; bin < min(interiorStart, size - 1); bin++)
+	{
+		if(in[bin] >= in[bin - 1] && in[bin] >= in[bin + 1]) m_candidates.push_back(bin);
+	}
+	unsigned bin = interiorStart;
+	for(; bin + 2 <= interiorEnd; bin += 2)
+	{
+		__m128d value = load2(in + bin);
+		__m128d mask = _mm_and_pd(_mm_cmpge_pd(value, load2(in + bin - 1)), _mm_cmpge_pd(value, load2(in + bin + 1)));
+		if(isAverage)
+		{
+			__m128d sum = _mm_add_pd(
+				_mm_sub_pd(_mm_loadu_pd(prefix + bin + settings.guard + settings.reference + 1), _mm_loadu_pd(prefix + bin + settings.guard + 1)),
+				_mm_sub_pd(_mm_loadu_pd(prefix + bin - settings.guard), _mm_loadu_pd(prefix + bin - span)));
+			__m128d noise = _mm_mul_pd(sum, inv);
+			__m128d limit = isDb ? _mm_add_pd(noise, thresh) : _mm_mul_pd(noise, thresh);
+			mask = _mm_and_pd(mask, _mm_cmpgt_pd(value, limit));
+		}
+		const int bits = _mm_movemask_pd(mask);
+		if(bits & 1) m_candidates.push_back(bin);
+		if(bits & 2) m_candidates.push_back(bin + 1);
+	}
+	for(; bin < size - 1; bin++)
+	{
+		if(!(in[bin] >= in[bin - 1] && in[bin] >= in[bin + 1])) continue;
+		if(isAverage && bin < interiorEnd)
+		{
+			// a leftover interior bin, tested exactly as the vector loop would
+			const double noise = (prefix[bin + span + 1] - prefix[bin + settings.guard + 1] + prefix[bin - settings.guard] - prefix[bin - span])
+				/ (2 * settings.reference);
+			if(!(in[bin] > (isDb ? noise + settings.threshold : noise * settings.threshold))) continue;
+		}
+		m_candidates.push_back(bin);
+	}
+}
+
+template<signals::EType ET>
+void CCfarDetector<ET>::detect(const base_type* in, unsigned size, const Settings& settings, unsigned maxPeaks)
+{
+	m_peaks.clear();
+	findCandidates(in, size, settings);
+	if(m_candidates.empty()) return;
+
+	const bool isDb = settings.scale == SCALE_DB;
+	const unsigned span = settings.guard + settings.reference;
+	const unsigned interiorEnd = size > span + 1 ? size - span - 1 : 0;
+	std::vector<Peak> found;
+	for(std::vector<unsigned>::const_iterator iter = m_candidates.begin(); iter != m_candidates.end(); iter++)
+	{
+		const unsigned bin = *iter;
+		const bool tested = settings.method == METHOD_CELL_AVERAGE && bin >= max(span, 1u) && bin < interiorEnd;
+		if(!tested)
+		{
+			if(!isDetection(in, size, bin, settings)) continue;
+		}
+
+		// the lobe extends while the bins stay within 3 dB of the peak
+		const base_type floor = isDb ? base_type(in[bin] - 3.0103) : base_type(in[bin] * 0.5);
+		Peak peak;
+		peak.bin = bin;
+		peak.position = bin;
+		peak.power = in[bin];
+		const double curve = double(in[bin - 1]) - 2.0 * in[bin] + in[bin + 1];
+		if(curve < 0.0) peak.position += 0.5 * (double(in[bin - 1]) - in[bin + 1]) / curve;
+		peak.low = peak.high = bin;
+		while(peak.low > 0 && in[peak.low - 1] >= floor && in[peak.low - 1] <= in[peak.low]) peak.low--;
+		while(peak.high + 1 < size && in[peak.high + 1] >= floor && in[peak.high + 1] <= in[peak.high]) peak.high++;
+		found.push_back(peak);
+	}
+
+	// keep the strongest, dropping weaker maxima that sit inside an accepted lobe
+	std::sort(found.begin(), found.end(), StrongerPeak());
+	for(typename std::vector<Peak>::const_iterator iter = found.begin(); iter != found.end() && m_peaks.size() < maxPeaks; iter++)
+	{
+		bool covered = false;
+		for(typename std::vector<Peak>::const_iterator prev = m_peaks.begin(); prev != m_peaks.end(); prev++)
+		{
+			if(iter->bin >= prev->low && iter->bin <= prev->high)
+			{
+				covered = true;
+				break;
+			}
+		}
+		if(!covered) m_peaks.push_back(*iter);
+	}
+	std::sort(m_peaks.begin(), m_peaks.end(), LowerPeak());
+}
+
+template<signals::EType ET>
+void CCfarDetector<ET>::thread_run()
+{
+	ThreadBase::SetThreadName("CFAR Detector Thread");
+
+	while(threadRunning())
+	{
+		signals::IVector* inVector = NULL;
+		BOOL recvFrame = m_incoming.ReadOne(ET, &inVector, IN_BUFFER_TIMEOUT);
+		if(!recvFrame) continue;
+
+		Settings settings;
+		settings.method = (EMethod)m_method;
+		settings.scale = (EScale)m_scale;
+		settings.threshold = settings.scale == SCALE_DB ? m_threshold : std::pow(10.0, m_threshold / 10.0);
+		settings.guard = m_guard;
+		settings.reference = m_reference;
+		settings.rank = m_rank;
+
+		detect((const base_type*)inVector->Data(), inVector->Size(), settings, m_maxPeaks);
+		inVector->Release();
+
+		const unsigned numPeaks = (unsigned)m_peaks.size();
+		VectorType* outVector = VectorType::retrieve(numPeaks * VALUES_PER_PEAK);
+		base_type* out = outVector->data;
+		for(unsigned idx = 0; idx < numPeaks; idx++)
+		{
+			const Peak& peak = m_peaks[idx];
+			*out++ = base_type(peak.position);
+			*out++ = peak.power;
+			*out++ = base_type(peak.high - peak.low + 1);
+		}
+
+		BOOL outFrame = m_outgoing.WriteOne(ET, &outVector, INFINITE);
+		if(!outFrame)
+		{
+			if(m_outgoing.isConnected()) m_outgoing.attrs.sync_fault->fire();
+			outVector->Release();
+		}
+	}
+}
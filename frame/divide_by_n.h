@@ -41,6 +41,10 @@ struct DivideByN : public std::unary_function<signals::IVector*,signals::IVector
 		{
 			outData[idx] = inData[idx] / (denomType)width;
 		}
+
+		// scaling doesn't care where the parts are, so a planar vector stays planar
+		buffer_templ* native = buffer_templ::native(parm);
+		if(native) out->layout = native->layout;
 		parm->Release();
 		return out;
 	}
@@ -15,6 +15,7 @@
 */
 #pragma once
 #include <blockImpl.h>
+#include <planar.h>
 
 template<signals::EType IN_TYPE, signals::EType OUT_TYPE = signals::EType(IN_TYPE + 8) >
 class CFrameBuilder : public CThreadBlockBase
@@ -94,6 +95,7 @@ public:
 private:
 	CIncoming m_incoming;
 	COutgoing m_outgoing;
+	CPlanarSink m_planar;
 
 	volatile unsigned m_bufSize;
 
@@ -237,6 +239,7 @@ void CFrameBuilder<IN_TYPE,OUT_TYPE>::thread_run()
 					{
 						newBuff->data[idx] = buffer->data[idx + outOffset];
 					}
+					if(ComplexParts<IN_TYPE>::is_complex) newBuff = toLayout(newBuff, m_planar.layout(m_outgoing));
 					BOOL outFrame = m_outgoing.WriteOne(OUT_TYPE, &newBuff, INFINITE);
 					if(!outFrame && m_outgoing.isConnected()) m_outgoing.attrs.sync_fault->fire();
 
@@ -274,6 +277,7 @@ void CFrameBuilder<IN_TYPE,OUT_TYPE>::thread_run()
 		}
 		if(inOffset >= bufSize)
 		{
+			if(ComplexParts<IN_TYPE>::is_complex) buffer = toLayout(buffer, m_planar.layout(m_outgoing));
 			BOOL outFrame = m_outgoing.WriteOne(OUT_TYPE, &buffer, INFINITE);
 			if(!outFrame && m_outgoing.isConnected()) m_outgoing.attrs.sync_fault->fire();
 			buffer = VectorType::retrieve(bufSize);
@@ -17,6 +17,8 @@
 #include "summ_frame.h"
 #include "divide_by_n.h"
 #include "make_frame.h"
+#include "accum_frame.h"
+#include "cfar_frame.h"
 #include "real_chop.h"
 
 Function<signals::etypVecByte, signals::etypVecByte, DivideByN<signals::etypVecByte> > divideByN_byte;
@@ -49,8 +51,15 @@ CFrameBuilderDriver<signals::etypSingle> frame_float;
 CFrameBuilderDriver<signals::etypDouble> frame_double;
 CFrameBuilderDriver<signals::etypComplex> frame_cpx;
 CFrameBuilderDriver<signals::etypCmplDbl> frame_cpxdbl;
+CFrameBuilderDriver<signals::etypComplexShort> frame_cpxshort;
 CFrameBuilderDriver<signals::etypLRSingle> frame_lr;
 
+CFrameAccumulatorDriver<signals::etypVecSingle> accum_float;
+CFrameAccumulatorDriver<signals::etypVecDouble> accum_double;
+
+CCfarDetectorDriver<signals::etypVecSingle> cfar_float;
+CCfarDetectorDriver<signals::etypVecDouble> cfar_double;
+
 Function<signals::etypVecBoolean, signals::etypBoolean, frame_max<signals::etypVecBoolean> > summ_max_bool;
 Function<signals::etypVecByte, signals::etypByte, frame_max<signals::etypVecByte> > summ_max_byte;
 Function<signals::etypVecShort, signals::etypShort, frame_max<signals::etypVecShort> > summ_max_short;
@@ -87,7 +96,13 @@ signals::IBlockDriver* BLOCKS[] =
 {
 	// make frame
 	&frame_bool, &frame_byte, &frame_short, &frame_long, &frame_int64, &frame_float, &frame_double,
-	&frame_cpx, &frame_cpxdbl, &frame_lr,
+	&frame_cpx, &frame_cpxdbl, &frame_cpxshort, &frame_lr,
+
+	// accumulate frame
+	&accum_float, &accum_double,
+
+	// peak detection
+	&cfar_float, &cfar_double,
 };
 
 signals::IFunctionSpec* FUNCTIONS[] =
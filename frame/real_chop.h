@@ -403,6 +403,7 @@ signals::IVector* ChopRealFrame<ET>::chop_frame(signals::IVector* frame)
 
 	if(!frame) { ASSERT(FALSE); return NULL; }
 	ASSERT(frame->Type() == my_type::base_enum);
+	frame = toInterleaved<(signals::EType)my_type::base_enum>(frame);
 	unsigned copySize = frame->Size() / 2;
 	my_type::buffer_templ* newBuff = my_type::buffer_templ::retrieve(copySize);
 	base_type::type* srcData = (base_type::type*)frame->Data();
@@ -119,7 +119,7 @@ private:
 	typedef CROAttribute<signals::etypBoolean> base;
 public:
 	inline CAttr_inBit(const char* name, const char* descr, bool deflt, byte addr, byte offset, byte mask)
-		:base(name, descr, deflt ? 1 : 0), CAttr_inMonitor(addr), m_offset(offset), m_mask(mask)
+		:base(name, descr, deflt ? 1 : 0), CAttr_inMonitor(addr, watchBits(offset, mask)), m_offset(offset), m_mask(mask)
 	{
 	}
 
@@ -178,7 +178,7 @@ private:
 	typedef CROAttribute<signals::etypByte> base;
 public:
 	inline CAttr_inBits(const char* name, const char* descr, byte deflt, byte addr, byte offset, byte mask, byte shift)
-		:base(name, descr, deflt), CAttr_inMonitor(addr), m_offset(offset), m_mask(mask), m_shift(shift)
+		:base(name, descr, deflt), CAttr_inMonitor(addr, watchBits(offset, mask)), m_offset(offset), m_mask(mask), m_shift(shift)
 	{
 	}
 
@@ -232,7 +232,7 @@ private:
 	typedef CROAttribute<signals::etypShort> base;
 public:
 	inline CAttr_inShort(const char* name, const char* descr, short deflt, byte addr, byte offset)
-		:base(name, descr, deflt), CAttr_inMonitor(addr), m_offset(offset)
+		:base(name, descr, deflt), CAttr_inMonitor(addr, watchBits(offset, 0xFF) | watchBits(offset + 1, 0xFF)), m_offset(offset)
 	{
 	}
 
@@ -377,6 +377,30 @@ private:
 	}
 };
 
+class CAttr_out_batch : public CRWAttribute<signals::etypBoolean>
+{
+private:
+	typedef CRWAttribute<signals::etypBoolean> base;
+public:
+	inline CAttr_out_batch(CHpsdrDevice& parent, const char* name, const char* descr)
+		:base(name, descr, 0),m_parent(parent)
+	{
+	}
+
+	virtual ~CAttr_out_batch() { }
+
+protected:
+	virtual void onSetValue(const store_type& newVal)
+	{
+		// only called when the value changes, so each set is matched by one clear
+		if(newVal) m_parent.beginCC(); else m_parent.commitCC();
+		base::onSetValue(newVal);
+	}
+
+private:
+	CHpsdrDevice& m_parent;
+};
+
 class CAttr_out_mic_src : public CNumOptionedAttribute<signals::etypByte>
 {
 private:
@@ -403,6 +427,7 @@ private:
 
 	inline void setValue(const store_type& newVal)
 	{
+		CHpsdrDevice::CCBatch batch(m_parent);
 		m_parent.setCCbits(0, 0, 0x80, newVal == 0 ? 0 : 0x80);
 		m_parent.setCCbits(9, 1, 0x02, newVal <= 1 ? 0 : 0x02);
 	}
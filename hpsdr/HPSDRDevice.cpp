@@ -18,6 +18,7 @@
 
 #include "error.h"
 #include "HPSDRAttrs.h"
+#include <emmintrin.h>
 
 // ------------------------------------------------------------------ class CHpsdrDevice
 
@@ -28,13 +29,21 @@ const float CHpsdrDevice::SCALE_16 = float(1U << 15);
 #pragma warning(push)
 #pragma warning(disable: 4355)
 CHpsdrDevice::CHpsdrDevice(EBoardId boardId)
-	:m_controllerType(boardId),m_CCoutSet(0),m_CCoutPending(0),m_micSample(0),m_lastCCout(MAX_CC_OUT),m_CC0in(0),
+	:m_controllerType(boardId),m_CCoutSet(0),m_CCoutPending(0),m_CCoutUrgent(0),m_CCoutInFlight(0),m_CCoutBatch(0),m_CCoutStagedMask(0),
+	 m_micSample(0),m_lastCCout(MAX_CC_OUT),m_CC0in(0),
 	 m_receiver1(this, 0),m_receiver2(this, 1),m_receiver3(this, 2),m_receiver4(this, 3),m_wideRecv(this),
 	 m_microphone(this),m_speaker(this),m_transmit(this),m_recvSpeed(0),m_attrThreadEnabled(true),
-	 m_attrThread(Thread<>::delegate_type(this, &CHpsdrDevice::thread_attr)), m_CCinDirty(0)
+	 m_attrThread(Thread<>::delegate_type(this, &CHpsdrDevice::thread_attr)), m_CCinDirty(0),m_CCinSeen(0)
 {
 	memset(m_CCout, 0, sizeof(m_CCout));
+	memset(m_CCoutQueued, 0, sizeof(m_CCoutQueued));
+	memset(m_CCoutStaged, 0, sizeof(m_CCoutStaged));
 	memset(m_CCin, 0, sizeof(m_CCin));
+	memset(m_CCinChanged, 0, sizeof(m_CCinChanged));
+
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	m_latencyScale = 1000.0f / float(freq.QuadPart);
 
 	buildAttrs();
 
@@ -55,6 +64,8 @@ CHpsdrDevice::~CHpsdrDevice()
 		}
 		m_attrThread.close();
 	}
+	CReceiverSet* receivers = m_receivers.exchange(NULL);
+	if(receivers) receivers->Release();
 }
 
 unsigned CHpsdrDevice::receive_frame(byte* frame)
@@ -66,27 +77,47 @@ unsigned CHpsdrDevice::receive_frame(byte* frame)
 	byte CC0 = *frame++;
 	m_CC0in = CC0;
 
-	byte CCframe = ((CC0 & 0xF8) >> 1);
-	byte* recvCC = m_CCin + CCframe;
-	CCframe = CCframe >> 2;
+	// the status words rarely change, so unless they have the monitor thread is left asleep.  This is the only
+	// thread writing m_CCin, so comparing against it doesn't need the lock
+	const byte CCaddr = CC0 >> 3;
+	byte* recvCC = m_CCin + CCaddr*4;
+	const unsigned long newCC = (frame[0] << 24) | (frame[1] << 16) | (frame[2] << 8) | frame[3];
+	unsigned long changed = newCC ^ ((recvCC[0] << 24) | (recvCC[1] << 16) | (recvCC[2] << 8) | recvCC[3]);
+	const unsigned int CCaddrMask = 1UL << CCaddr;
+	if(!(m_CCinSeen & CCaddrMask))
+	{
+		// everything counts as changed the first time, so monitors don't sit on their defaults
+		m_CCinSeen |= CCaddrMask;
+		changed = ~0UL;
+	}
+	if(changed)
 	{
 		Locker lock(m_CCinLock);
-		*recvCC++ = *frame++;
-		*recvCC++ = *frame++;
-		*recvCC++ = *frame++;
-		*recvCC++ = *frame++;
-		m_CCinDirty |= (1UL<<CCframe);
+		*(long*)recvCC = *(long*)frame;
+		m_CCinChanged[CCaddr] |= changed;
+		m_CCinDirty |= CCaddrMask;
 		m_CCinUpdated.wakeAll();
 	}
+	frame += 4;
 
 	int remain = 504; // 512 - 8 bytes
 
-	Locker recvLock(m_recvListLock);
-	const std::vector<Receiver>::size_type numReceiver = max(1, m_receivers.size());
-	const bool hasReceivers = !m_receivers.empty();
+	// attaching or detaching a receiver publishes a new set rather than changing this one, so the frame is
+	// decoded against a single consistent list without holding m_recvListLock
+	CReceiverSet* receivers = m_receivers.acquire();
+	const unsigned numAttached = receivers ? receivers->count : 0;
+	const unsigned numReceiver = max(1, numAttached);
 	const int sample_size = 6 * numReceiver + 2;
 
-	std::complex<float> recvBuff[MAX_RECEIVERS][504 / (6 + 2)];
+	// each attached receiver decodes straight into its staging block, the slot that only sets the layout when
+	// nothing is attached decodes into scratch
+	std::complex<float> unattached[504 / (6 + 2)];
+	std::complex<float>* recvBuff[MAX_RECEIVERS];
+	for (unsigned recv = 0; recv < numAttached; recv++)
+	{
+		recvBuff[recv] = receivers->recv[recv]->stage();
+	}
+	if(!numAttached) recvBuff[0] = unattached;
 	float micBuff[504 / (6 + 2)];
 
 	unsigned numSamples = 0;
@@ -125,17 +156,14 @@ unsigned CHpsdrDevice::receive_frame(byte* frame)
 		remain -= 2;
 		numSamples++;
 	}
-	if(hasReceivers && numSamples)
+	if(numSamples)
 	{
-		for (unsigned recv = 0; recv < numReceiver; recv++)
+		for (unsigned recv = 0; recv < numAttached; recv++)
 		{
-			ASSERT(m_receivers[recv]->isConnected());
-			if(!m_receivers[recv]->Write(signals::etypComplex, recvBuff[recv], numSamples, 0) && m_receivers[recv]->isConnected())
-			{
-				attrs.sync_fault->fire();
-			}
+			if(!receivers->recv[recv]->commit(numSamples, m_recvSpeed)) attrs.sync_fault->fire();
 		}
 	}
+	if(receivers) receivers->Release();
 	if(numMicSamples && !m_microphone.Write(signals::etypSingle, micBuff, numMicSamples, 0) && m_microphone.isConnected())
 	{
 		attrs.sync_mic_fault->fire();
@@ -143,12 +171,27 @@ unsigned CHpsdrDevice::receive_frame(byte* frame)
 	return numSamples;
 }
 
+void CHpsdrDevice::flush_receivers()
+{
+	// called from the decoding thread when the stream has gone quiet, so nothing is left sitting in staging
+	CReceiverSet* receivers = m_receivers.acquire();
+	if(receivers)
+	{
+		for (unsigned recv = 0; recv < receivers->count; recv++)
+		{
+			if(!receivers->recv[recv]->flushStaged()) attrs.sync_fault->fire();
+		}
+		receivers->Release();
+	}
+}
+
 void CHpsdrDevice::thread_attr()
 {
 	ThreadBase::SetThreadName("HPSDR Attribute Monitor Thread");
 
 	byte curAddr = 0;
 	byte CCin[4];
+	unsigned long changed = 0;
 	for(;;)
 	{
 		{
@@ -183,6 +226,8 @@ void CHpsdrDevice::thread_attr()
 				{
 					curAddr = nextAddr;
 					*(long*)&CCin = *(long*)(m_CCin + curAddr*4);
+					changed = m_CCinChanged[curAddr];
+					m_CCinChanged[curAddr] = 0;
 					m_CCinDirty &= ~nextMask;
 					break;
 				}
@@ -190,10 +235,12 @@ void CHpsdrDevice::thread_attr()
 			}
 		}
 
-		for(TInAttrList::const_iterator trans = m_inAttrs.begin(); trans != m_inAttrs.end(); trans++)
+		// only the monitors at this address that read one of the bits that moved
+		const TInAttrList& monitors = m_inAttrs[curAddr];
+		for(TInAttrList::const_iterator trans = monitors.begin(); trans != monitors.end(); trans++)
 		{
 			CAttr_inMonitor* monitor = *trans;
-			if(monitor->m_addr == curAddr)
+			if(monitor->m_watch & changed)
 			{
 				monitor->evaluate(CCin);
 			}
@@ -203,35 +250,23 @@ void CHpsdrDevice::thread_attr()
 
 byte* CHpsdrDevice::chooseCC()
 {	// ASSUMES m_CCoutLock IS HELD
-	unsigned int CCoutMask = 1 << ++m_lastCCout;
-	if(m_CCoutPending)
+	// urgent changes go first, then any other changes, otherwise keep cycling through everything that has been set
+	const unsigned short choices = m_CCoutUrgent ? m_CCoutUrgent : m_CCoutPending ? m_CCoutPending : m_CCoutSet;
+	if(choices)
 	{
-		for(;;)
+		do
 		{
-			CCoutMask = CCoutMask << 1;
-			if(++m_lastCCout > MAX_CC_OUT)
-			{
-				m_lastCCout = 0;
-				CCoutMask = 1;
-			}
-			if(CCoutMask & m_CCoutPending)
-			{
-				m_CCoutPending &= ~CCoutMask;
-				break;
-			}
+			if(++m_lastCCout >= MAX_CC_OUT) m_lastCCout = 0;
 		}
-	}
-	else if(m_CCoutSet)
-	{
-		for(;;)
+		while(!(choices & (1 << m_lastCCout)));
+
+		const unsigned short CCoutMask = 1 << m_lastCCout;
+		if(m_CCoutPending & CCoutMask)
 		{
-			CCoutMask = CCoutMask << 1;
-			if(++m_lastCCout > MAX_CC_OUT)
-			{
-				m_lastCCout = 0;
-				CCoutMask = 1;
-			}
-			if(CCoutMask & m_CCoutSet) break;
+			m_CCoutPending &= ~CCoutMask;
+			m_CCoutUrgent &= ~CCoutMask;
+			const __int64 queued = m_CCoutQueued[m_lastCCout];
+			if(!m_CCoutInFlight || queued < m_CCoutInFlight) m_CCoutInFlight = queued;
 		}
 	}
 	else
@@ -241,34 +276,119 @@ byte* CHpsdrDevice::chooseCC()
 	return &m_CCout[m_lastCCout*4];
 }
 
+bool CHpsdrDevice::queueCC(byte addr, bool urgent)
+{	// ASSUMES m_CCoutLock IS HELD, returns whether the transport should be told about an urgent change
+	// Repeated writes to a register that hasn't gone out yet collapse into the one pending send, which carries
+	// whatever the latest value is; the latency is measured from the first of them.
+	const unsigned short CCoutMask = 1 << addr;
+	m_CCoutSet |= CCoutMask;
+	if(!(m_CCoutPending & CCoutMask))
+	{
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		m_CCoutQueued[addr] = now.QuadPart;
+		m_CCoutPending |= CCoutMask;
+	}
+	if(!(urgent || (URGENT_CC_OUT & CCoutMask)) || (m_CCoutUrgent & CCoutMask)) return false;
+	m_CCoutUrgent |= CCoutMask;
+	return true;
+}
+
+bool CHpsdrDevice::writeCC(byte addr, const byte* newVal)
+{	// ASSUMES m_CCoutLock IS HELD, returns whether the transport should be told about an urgent change
+	if(m_CCoutBatch)
+	{
+		memcpy(m_CCoutStaged + addr*4, newVal, 4);
+		m_CCoutStagedMask |= 1 << addr;
+		return false;
+	}
+	byte* loc = m_CCout + addr*4;
+	if(memcmp(loc, newVal, 4) == 0 && (m_CCoutSet & (1 << addr))) return false;
+	memcpy(loc, newVal, 4);
+	return queueCC(addr, false);
+}
+
 void CHpsdrDevice::setCCbits(byte addr, byte offset, byte mask, byte value)
 {
 	if(addr >= MAX_CC_OUT || offset >= 4) {ASSERT(FALSE);return;}
 
-	Locker outLock(m_CCoutLock);
-	byte* loc = m_CCout + (addr*4) + offset;
-	*loc = (*loc & ~mask) | (value & mask);
-
-	unsigned int CCoutMask = 1 << addr;
-	m_CCoutSet |= CCoutMask;
-	m_CCoutPending |= CCoutMask;
+	bool urgent;
+	{
+		Locker outLock(m_CCoutLock);
+		byte newVal[4];
+		memcpy(newVal, (m_CCoutBatch ? m_CCoutStaged : m_CCout) + addr*4, 4);
+		newVal[offset] = (newVal[offset] & ~mask) | (value & mask);
+		urgent = writeCC(addr, newVal);
+	}
+	if(urgent) onUrgentCC();
 }
 
 void CHpsdrDevice::setCCint(byte addr, unsigned long value)
 {
 	if(addr >= MAX_CC_OUT) {ASSERT(FALSE);return;}
 
+	const byte newVal[4] = { (byte)((value >> 24) & 0xFF), (byte)((value >> 16) & 0xFF), (byte)((value >> 8) & 0xFF), (byte)(value & 0xFF) };
+	bool urgent;
+	{
+		Locker outLock(m_CCoutLock);
+		urgent = writeCC(addr, newVal);
+	}
+	if(urgent) onUrgentCC();
+}
+
+void CHpsdrDevice::beginCC()
+{
 	Locker outLock(m_CCoutLock);
-	byte* loc = m_CCout + (addr*4);
+	if(!m_CCoutBatch++)
+	{
+		memcpy(m_CCoutStaged, m_CCout, sizeof(m_CCoutStaged));
+		m_CCoutStagedMask = 0;
+	}
+}
 
-	*loc++ = (value >> 24) & 0xFF;
-	*loc++ = (value >> 16) & 0xFF;
-	*loc++ = (value >> 8) & 0xFF;
-	*loc++ = value & 0xFF;
+void CHpsdrDevice::commitCC()
+{
+	bool applied = false;
+	bool urgent = false;
+	{
+		Locker outLock(m_CCoutLock);
+		if(!m_CCoutBatch) {ASSERT(FALSE);return;}
+		if(--m_CCoutBatch) return;
 
-	unsigned int CCoutMask = 1 << addr;
-	m_CCoutSet |= CCoutMask;
-	m_CCoutPending |= CCoutMask;
+		// everything in the batch jumps the queue together, so it goes out as one unbroken run of frames
+		for(byte addr = 0; addr < MAX_CC_OUT; addr++)
+		{
+			const unsigned short CCoutMask = 1 << addr;
+			if(!(m_CCoutStagedMask & CCoutMask)) continue;
+			byte* loc = m_CCout + addr*4;
+			const byte* newVal = m_CCoutStaged + addr*4;
+			if(memcmp(loc, newVal, 4) == 0 && (m_CCoutSet & CCoutMask)) continue;
+			memcpy(loc, newVal, 4);
+			if(queueCC(addr, true)) urgent = true;
+			applied = true;
+		}
+		m_CCoutStagedMask = 0;
+	}
+	if(urgent) onUrgentCC();
+	if(applied) attrs.changes_applied->fire();
+}
+
+void CHpsdrDevice::sent_frames(bool measure)
+{
+	// called by the transport once the frames built since the last call are on the wire.  Changes flushed before
+	// streaming starts aren't measured, they would only record how long the device sat idle
+	__int64 queued;
+	{
+		Locker outLock(m_CCoutLock);
+		queued = m_CCoutInFlight;
+		m_CCoutInFlight = 0;
+	}
+	if(queued && measure)
+	{
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		attrs.cc_latency->update((now.QuadPart - queued) * m_latencyScale);
+	}
 }
 
 void CHpsdrDevice::send_frame(byte* frame, bool no_streams)
@@ -294,51 +414,49 @@ void CHpsdrDevice::send_frame(byte* frame, bool no_streams)
 		return;
 	}
 
-	std::complex<float> audSampleArr[63];
-	std::complex<float> iqSampleArr[63];
-	unsigned numAud = m_speaker.Read(signals::etypLRSingle, audSampleArr, _countof(audSampleArr), TRUE, 0);
-	unsigned numIQ = m_transmit.Read(signals::etypComplex, iqSampleArr, _countof(iqSampleArr), TRUE, 0);
-
-	for (unsigned idx = 0; idx < 63; idx++)        // fill out one 512-byte frame
-	{
-		if(idx < numAud)
-		{
-			const std::complex<float>& audSample = audSampleArr[idx];
-
-			// send left & right data to the speakers on the receiver
-			int IntValue = int(SCALE_16 * audSample.real());
-			*frame++ = (byte)(IntValue >> 8);    // left hi
-			*frame++ = (byte)(IntValue & 0xff);  // left lo
-
-			IntValue = int(SCALE_16 * audSample.imag());
-			*frame++ = (byte)(IntValue >> 8);    // right hi
-			*frame++ = (byte)(IntValue & 0xff);  // right lo
-		}
-		else
-		{
-			*((__int32*)frame) = 0;
-			frame += 4;
-		}
-
-		if(idx < numIQ)
-		{
-			const std::complex<float>& iqSample = iqSampleArr[idx];
+	std::complex<float> audSampleArr[FRAME_SAMPLES];
+	std::complex<float> iqSampleArr[FRAME_SAMPLES];
+	unsigned numAud = m_speaker.ReadPaced(audSampleArr, _countof(audSampleArr));
+	unsigned numIQ = m_transmit.ReadPaced(iqSampleArr, _countof(iqSampleArr));
+	encode_samples(audSampleArr, numAud, iqSampleArr, numIQ, frame);
+}
 
-			// send I & Q data to the exciter
-			int IntValue = int(SCALE_16 * iqSample.imag());
-			*frame++ = (byte)(IntValue >> 8);    // right hi
-			*frame++ = (byte)(IntValue & 0xff);  // right lo
+static inline short clip16(float scaled)
+{
+	return scaled >= 32767.0f ? 32767 : scaled <= -32768.0f ? -32768 : (short)scaled;
+}
 
-			IntValue = int(SCALE_16 * iqSample.real());
-			*frame++ = (byte)(IntValue >> 8);    // right hi
-			*frame++ = (byte)(IntValue & 0xff);  // right lo
-		}
-		else
+void CHpsdrDevice::encode_samples(std::complex<float>* aud, unsigned numAud, std::complex<float>* iq, unsigned numIQ, byte* frame)
+{
+	// each sample is left, right, Q, I as big-endian shorts, with silence filling out whatever wasn't available
+	for(unsigned idx = numAud; idx < FRAME_SAMPLES; idx++) aud[idx] = 0.0f;
+	for(unsigned idx = numIQ; idx < FRAME_SAMPLES; idx++) iq[idx] = 0.0f;
+
+	// two samples at a time: swap I and Q, scale, saturate down to 16 bits and swap the bytes around
+	const __m128 scale = _mm_set1_ps(SCALE_16);
+	unsigned idx = 0;
+	for(; idx + 2 <= FRAME_SAMPLES; idx += 2)
+	{
+		__m128 audSamples = _mm_loadu_ps((const float*)(aud + idx));
+		__m128 iqSamples = _mm_loadu_ps((const float*)(iq + idx));
+		iqSamples = _mm_shuffle_ps(iqSamples, iqSamples, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128i first = _mm_cvttps_epi32(_mm_mul_ps(_mm_movelh_ps(audSamples, iqSamples), scale));
+		__m128i second = _mm_cvttps_epi32(_mm_mul_ps(_mm_movehl_ps(iqSamples, audSamples), scale));
+		__m128i packed = _mm_packs_epi32(first, second);
+		packed = _mm_or_si128(_mm_slli_epi16(packed, 8), _mm_srli_epi16(packed, 8));
+		_mm_storeu_si128((__m128i*)(frame + idx * 8), packed);
+	}
+	for(; idx < FRAME_SAMPLES; idx++)
+	{
+		const short values[4] = { clip16(SCALE_16 * aud[idx].real()), clip16(SCALE_16 * aud[idx].imag()),
+			clip16(SCALE_16 * iq[idx].imag()), clip16(SCALE_16 * iq[idx].real()) };
+		byte* out = frame + idx * 8;
+		for(unsigned part = 0; part < _countof(values); part++)
 		{
-			*((__int32*)frame) = 0;
-			frame += 4;
+			*out++ = (byte)(values[part] >> 8);
+			*out++ = (byte)(values[part] & 0xff);
 		}
-	} // end for
+	}
 }
 
 // ------------------------------------------------------------------ class CHpsdrDevice::Receiver
@@ -354,24 +472,63 @@ void CHpsdrDevice::Receiver::buildAttrs(const CHpsdrDevice& parent)
 	attrs.freq = addLocalAttr(true, new CAttr_outProxy<signals::etypLong>("freq", "Frequency", *parent.attrs.recvX_freq[0]));
 	attrs.overflow = addLocalAttr(true, new CAttr_inProxy("overflow", "ADC overloaded?", *parent.attrs.recvX_overflow[0]));
 	attrs.version = addLocalAttr(true, new CAttr_inProxy("version", "Software version", *parent.attrs.recvX_version[0]));
+	attrs.batch_size = addLocalAttr(true, new CAttr_callback<signals::etypLong,Receiver>
+		(*this, "batchSize", "Samples collected before being sent on, fewer means lower latency but more overhead", &Receiver::setBatchSize, DEFAULT_BATCH));
+	attrs.batch_latency = addLocalAttr(true, new CAttr_callback<signals::etypLong,Receiver>
+		(*this, "batchLatency", "Most milliseconds of samples collected before being sent on", &Receiver::setBatchLatency, DEFAULT_BATCH_LATENCY));
 }
 
-BOOL CHpsdrDevice::Receiver::Connect(signals::IEPSendTo* send)
+void CHpsdrDevice::Receiver::setBatchSize(const long& newVal)
 {
-	if(!COutEndpointBase::Connect(send)) return false;
+	InterlockedExchange(&m_batchSize, max(1L, min(newVal, long(MAX_BATCH))));
+}
+
+void CHpsdrDevice::Receiver::setBatchLatency(const long& newVal)
+{
+	InterlockedExchange(&m_batchLatency, max(0L, newVal));
+}
+
+std::complex<float>* CHpsdrDevice::Receiver::stage()
+{
+	if(m_restage)
 	{
-		Locker lock(m_parent->m_recvListLock);
-		if(m_attachedRecv < 0)
-		{
-			m_parent->AttachReceiver(*this);
-			ASSERT(m_attachedRecv < 0);
-		}
+		m_restage = false;
+		m_numStaged = 0;
 	}
-	return true;
+	ASSERT(m_numStaged + MAX_FRAME <= m_staged.size());
+	return &m_staged[m_numStaged];
+}
+
+bool CHpsdrDevice::Receiver::commit(unsigned count, unsigned rateKhz)
+{
+	m_numStaged += count;
+
+	// samples arrive at the sampling rate, so the staged count is also how long the oldest has been waiting
+	const unsigned latencyLimit = max(1U, unsigned(m_batchLatency) * rateKhz);
+	const unsigned limit = min(unsigned(m_batchSize), latencyLimit);
+	return m_numStaged < limit || flushStaged();
 }
 
-BOOL CHpsdrDevice::Receiver::Disconnect()
+bool CHpsdrDevice::Receiver::flushStaged()
 {
+	if(m_restage)
+	{
+		// staged for a connection that has since gone
+		m_restage = false;
+		m_numStaged = 0;
+	}
+	if(!m_numStaged) return true;
+	const unsigned numStaged = m_numStaged;
+	m_numStaged = 0;
+
+	// we may be disconnecting as we write, in which case the samples are just lost
+	return Write(signals::etypComplex, &m_staged[0], numStaged, 0) == numStaged || !isConnected();
+}
+
+BOOL CHpsdrDevice::Receiver::Connect(signals::IEPSendTo* send)
+{
+	// Disconnect() arrives here as Connect(NULL), so attaching and detaching are both decided here
+	if(!send)
 	{
 		Locker lock(m_parent->m_recvListLock);
 		if(m_attachedRecv >= 0)
@@ -380,11 +537,25 @@ BOOL CHpsdrDevice::Receiver::Disconnect()
 			m_attachedRecv = -1;
 		}
 	}
-	return COutEndpointBase::Disconnect();
+	else m_restage = true;		// anything staged before now belongs to the last connection
+
+	if(!COutEndpointBase::Connect(send)) return false;
+	if(send)
+	{
+		Locker lock(m_parent->m_recvListLock);
+		if(m_attachedRecv < 0)
+		{
+			m_parent->AttachReceiver(*this);
+			ASSERT(m_attachedRecv >= 0);
+		}
+	}
+	return true;
 }
 
 void CHpsdrDevice::Receiver::setProxy(CHpsdrDevice& parent, short attachedRecv)
 {
+	// ASSUMES m_recvListLock IS HELD
+	m_attachedRecv = attachedRecv;
 	attrs.preamp->setProxy(*parent.attrs.recvX_preamp[attachedRecv]);
 	attrs.freq->setProxy(*parent.attrs.recvX_freq[attachedRecv]);
 	attrs.overflow->setProxy(*parent.attrs.recvX_overflow[attachedRecv]);
@@ -413,6 +584,7 @@ void CHpsdrDevice::Transmitter::buildAttrs(const CHpsdrDevice& parent)
 {
 	attrs.rate = addLocalAttr(true, new CROAttribute<signals::etypLong>("rate", "Data rate", 48000));
 	attrs.version = addRemoteAttr("version", parent.m_controllerType == Hermes ? parent.attrs.merc_software : parent.attrs.penny_software);
+	buildJitterAttrs();
 }
 
 // ------------------------------------------------------------------ class CHpsdrDevice::Microphone
@@ -436,6 +608,7 @@ void CHpsdrDevice::Speaker::buildAttrs(const CHpsdrDevice& parent)
 {
 	UNUSED_ALWAYS(parent);
 	attrs.rate = addLocalAttr(true, new CROAttribute<signals::etypLong>("rate", "Data rate", 48000));
+	buildJitterAttrs();
 }
 
 // ------------------------------------------------------------------ main attributes
@@ -480,8 +653,13 @@ void CHpsdrDevice::buildAttrs()
 	attrs.sync_fault = addLocalAttr(true, new CEventAttribute("syncFault", "Fires when a sync fault happens in a receive stream"));
 	attrs.wide_sync_fault = addLocalAttr(false, new CEventAttribute("wideSyncFault", "Fires when a sync fault happens in the wideband receive stream"));
 	attrs.sync_mic_fault = addLocalAttr(false, new CEventAttribute("micSyncFault", "Fires when an overrun occurs receiving microphone data"));
+	attrs.changes_applied = addLocalAttr(true, new CEventAttribute("changesApplied", "Fires when a batch of held changes is released to the radio"));
+
+	// diagnostics
+	attrs.cc_latency = addLocalAttr(true, new CAttr_reading("ccLatency", "Milliseconds from the last register change to the packet carrying it"));
 
 	// write-only
+	attrs.batch_changes = addLocalAttr(true, new CAttr_out_batch(*this, "BatchChanges", "Hold back changes until this is cleared?"));
 	attrs.recv_speed = addLocalAttr(true, new CAttr_out_recv_speed(*this, "recvRate", "Rate that receivers send data", 192000, 0, 0, 0x3, 0));
 	if(m_controllerType != Hermes)
 	{
@@ -518,7 +696,7 @@ void CHpsdrDevice::buildAttrs()
 
 	attrs.recv_duplex = addLocalAttr(true, new CAttr_outBit(*this, "Duplex", "Duplex?", true, 0, 3, 0x04));
 	attrs.num_recv = addLocalAttr(false, new CAttr_outBits(*this, "NumRecv", "Number of active receivers - 1",
-		(byte)max(m_receivers.size(),1)-1, 0, 3, 0x7, 3, 0, NULL));
+		(byte)max(numReceivers(),1)-1, 0, 3, 0x7, 3, 0, NULL));
 	attrs.recv_clone = addLocalAttr(true, new CAttr_outBit(*this, "RecvClone", "Common Mercury frequency?", false, 0, 3, 0x80));
 	attrs.send_freq = addLocalAttr(true, new CAttr_outLong(*this, "SendFreq", "Transmit Frequency", 0, 1));
 	attrs.recvX_freq[0] = addLocalAttr(false, new CAttr_outLong(*this, "Recv1Freq", "Receiver 1 Frequency", 0, 2));
@@ -569,18 +747,30 @@ void CHpsdrDevice::buildAttrs()
 	m_transmit.buildAttrs(*this);
 }
 
+void CHpsdrDevice::publishReceivers(CReceiverSet* receivers)
+{
+	// ASSUMES m_recvListLock IS HELD
+	receivers->AddRef();
+	CReceiverSet* oldSet = m_receivers.exchange(receivers);
+	if(oldSet) oldSet->Release();		// the last frame still decoding against it lets go of it instead
+}
+
 short CHpsdrDevice::AttachReceiver(CHpsdrDevice::Receiver& recv)
 {
 	// ASSUMES m_recvListLock IS HELD
-	unsigned numRecv = m_receivers.size();
-	if(numRecv >= 4)
+	const CReceiverSet* current = m_receivers.peek();
+	const unsigned numRecv = current ? current->count : 0;
+	if(numRecv >= MAX_RECEIVERS)
 	{
 		ASSERT(FALSE);
 		return -1;
 	}
-	m_receivers.resize(numRecv+1);
-	m_receivers[numRecv] = &recv;
+	CReceiverSet* receivers = new CReceiverSet;
+	for(unsigned idx = 0; idx < numRecv; idx++) receivers->recv[idx] = current->recv[idx];
+	receivers->recv[numRecv] = &recv;
+	receivers->count = numRecv+1;
 	recv.setProxy(*this, (short)numRecv);
+	publishReceivers(receivers);
 	if(attrs.num_recv) attrs.num_recv->nativeSetValue((byte)numRecv);
 	return (short)numRecv;
 }
@@ -588,18 +778,22 @@ short CHpsdrDevice::AttachReceiver(CHpsdrDevice::Receiver& recv)
 void CHpsdrDevice::DetachReceiver(const CHpsdrDevice::Receiver& recv, unsigned short attachedRecv)
 {
 	// ASSUMES m_recvListLock IS HELD
-	unsigned numRecv = m_receivers.size();
-	if(numRecv <= attachedRecv || m_receivers[attachedRecv] != &recv)
+	const CReceiverSet* current = m_receivers.peek();
+	const unsigned numRecv = current ? current->count : 0;
+	if(numRecv <= attachedRecv || current->recv[attachedRecv] != &recv)
 	{
 		ASSERT(FALSE);
 		return;
 	}
+	CReceiverSet* receivers = new CReceiverSet;
+	for(unsigned idx = 0; idx < numRecv-1; idx++) receivers->recv[idx] = current->recv[idx];
+	receivers->count = numRecv-1;
 	if(numRecv > (unsigned)attachedRecv+1)
 	{
-		Receiver* moved = m_receivers[numRecv-1];
-		m_receivers[attachedRecv] = moved;
+		Receiver* moved = current->recv[numRecv-1];
+		receivers->recv[attachedRecv] = moved;
 		moved->setProxy(*this, attachedRecv);
 	}
-	m_receivers.resize(numRecv-1);
+	publishReceivers(receivers);
 	if(attrs.num_recv) attrs.num_recv->nativeSetValue((byte)max(numRecv-1,1)-1);
 }
@@ -16,6 +16,7 @@
 #pragma once
 #include <blockImpl.h>
 #include <mt.h>
+#include <jitter.h>
 #include <vector>
 typedef unsigned char byte;
 
@@ -32,6 +33,27 @@ public:
 	void setCCbits(byte addr, byte offset, byte mask, byte value);
 	void setCCint(byte addr, unsigned long value);
 
+	// Register changes made between beginCC and commitCC (from any thread) are held back and then released
+	// together, so the radio never runs with half of a band or mode change.  These nest.
+	void beginCC();
+	void commitCC();
+
+	// fills the 504 sample bytes of a transmit frame, both arrays hold FRAME_SAMPLES entries and are cleared past
+	// the samples actually present
+	enum { FRAME_SAMPLES = 63 };
+	static void encode_samples(std::complex<float>* aud, unsigned numAud, std::complex<float>* iq, unsigned numIQ, byte* frame);
+
+	class CCBatch
+	{
+	public:
+		inline explicit CCBatch(CHpsdrDevice& parent):m_parent(parent) { m_parent.beginCC(); }
+		inline ~CCBatch() { m_parent.commitCC(); }
+	private:
+		CHpsdrDevice& m_parent;
+		CCBatch(const CCBatch& other);
+		CCBatch& operator=(const CCBatch& other);
+	};
+
 private:
 	CHpsdrDevice(const CHpsdrDevice& other);
 	CHpsdrDevice& operator=(const CHpsdrDevice& other);
@@ -41,7 +63,20 @@ protected:
 
 	unsigned receive_frame(byte* frame);
 	void send_frame(byte* frame, bool no_streams = false);
+	void sent_frames(bool measure = true);
 	void buildAttrs();
+	void flush_receivers();
+
+	// called without any locks held when a register marked urgent takes a new value, so the transport can
+	// get it onto the wire ahead of its regular schedule
+	virtual void onUrgentCC() { }
+
+	class CAttr_reading : public CROAttribute<signals::etypSingle>
+	{
+	public:
+		inline CAttr_reading(const char* name, const char* descr):CROAttribute<signals::etypSingle>(name, descr, 0.0f) { }
+		inline void update(float newVal) { privateSetValue(newVal); }
+	};
 
 	short AttachReceiver(Receiver& recv);
 	void DetachReceiver(const Receiver& recv, unsigned short attachedRecv);
@@ -52,6 +87,10 @@ protected:
 		CEventAttribute* sync_fault;
 		CEventAttribute* sync_mic_fault;
 		CEventAttribute* wide_sync_fault;
+		CEventAttribute* changes_applied;
+
+		// diagnostics
+		CAttr_reading* cc_latency;
 
 		// high-priority read-only
 		CAttributeBase* PPT;
@@ -76,6 +115,7 @@ protected:
 		CAttributeBase* recvX_version[4];
 
 		// write-only
+		CAttributeBase* batch_changes;
 		CAttributeBase* enable_penny;
 		CAttributeBase* enable_merc;
 		CAttributeBase* recv_speed;
@@ -127,10 +167,17 @@ public:
 	class Receiver : public CSimpleOutgoingChild<signals::etypComplex, 192000>
 	{	// This class is assumed to be a static (non-dynamic) member of its parent
 	public:
-		inline Receiver(CHpsdrDevice* parent, short recvNum):m_parent(parent),m_recvNum(recvNum),m_attachedRecv(-1) { }
+		inline Receiver(CHpsdrDevice* parent, short recvNum):m_parent(parent),m_recvNum(recvNum),m_attachedRecv(-1),
+			m_staged(MAX_BATCH + MAX_FRAME),m_numStaged(0),m_restage(false),m_batchSize(0),m_batchLatency(0) { }
 		void buildAttrs(const CHpsdrDevice& parent);
 		void setProxy(CHpsdrDevice& parent, short attachedRecv);
 
+		// decoded samples are staged here and pushed once batchSize of them are waiting or the oldest has waited
+		// batchLatency (in stream time), only called from the decoding thread
+		std::complex<float>* stage();				// room for a frame's samples after those already staged
+		bool commit(unsigned count, unsigned rateKhz);	// false if the receiving buffer overflowed
+		bool flushStaged();
+
 	public:
 		template<class target_type>
 		class IAttrProxy
@@ -144,6 +191,23 @@ public:
 		const short m_recvNum;
 		short m_attachedRecv;
 
+		enum
+		{
+			MAX_FRAME = 504 / (6 + 2),		// the most samples a single frame carries for one receiver
+			MAX_BATCH = 4096,
+			DEFAULT_BATCH = 256,			// samples
+			DEFAULT_BATCH_LATENCY = 5		// milliseconds
+		};
+
+		void setBatchSize(const long& newVal);
+		void setBatchLatency(const long& newVal);
+
+		std::vector<std::complex<float> > m_staged;		// private to the decoding thread
+		unsigned m_numStaged;
+		volatile bool m_restage;			// set on connection, anything still staged belongs to the last one
+		volatile long m_batchSize;
+		volatile long m_batchLatency;
+
 		struct
 		{
 			CEventAttribute* sync_fault;
@@ -152,6 +216,8 @@ public:
 			IAttrProxy<CRWAttribute<signals::etypLong> >* freq;
 			IAttrProxy<signals::IAttribute>* overflow;
 			IAttrProxy<signals::IAttribute>* version;
+			CAttributeBase* batch_size;
+			CAttributeBase* batch_latency;
 		} attrs;
 
 	private:
@@ -164,7 +230,6 @@ public:
 		virtual const char* EPName()				{ return EP_NAME[m_recvNum]; }
 		virtual const char* EPDescr()				{ return EP_DESCR; }
 		virtual BOOL Connect(signals::IEPSendTo* send);
-		virtual BOOL Disconnect();
 	};
 
 	class Microphone : public CSimpleOutgoingChild<signals::etypSingle, 48000>
@@ -221,10 +286,10 @@ public:
 		virtual const char* EPDescr()				{ return EP_DESCR; }
 	};
 
-	class Transmitter : public CSimpleIncomingChild
+	class Transmitter : public CJitterIncomingChild<signals::etypComplex>
 	{	// This class is assumed to be a static (non-dynamic) member of its parent
 	public:
-		inline Transmitter(signals::IBlock* parent):CSimpleIncomingChild(signals::etypComplex, parent) { }
+		inline Transmitter(signals::IBlock* parent):CJitterIncomingChild(parent, 48000, 50) { }
 		void buildAttrs(const CHpsdrDevice& parent);
 		virtual const char* EPName()	{ return EP_NAME; }
 		virtual const char* EPDescr()	{ return EP_DESCR; }
@@ -243,10 +308,10 @@ public:
 		Transmitter& operator=(const Transmitter& other);
 	};
 
-	class Speaker : public CSimpleIncomingChild
+	class Speaker : public CJitterIncomingChild<signals::etypLRSingle>
 	{	// This class is assumed to be a static (non-dynamic) member of its parent
 	public:
-		inline Speaker(signals::IBlock* parent):CSimpleIncomingChild(signals::etypLRSingle, parent) { }
+		inline Speaker(signals::IBlock* parent):CJitterIncomingChild(parent, 48000, 50) { }
 		void buildAttrs(const CHpsdrDevice& parent);
 		virtual const char* EPName()	{ return EP_NAME; }
 		virtual const char* EPDescr()	{ return EP_DESCR; }
@@ -268,10 +333,14 @@ public:
 	class CAttr_inMonitor
 	{
 	public:
-		inline CAttr_inMonitor(byte addr):m_addr(addr) {}
+		inline CAttr_inMonitor(byte addr, unsigned long watch):m_addr(addr),m_watch(watch) {}
 		virtual void evaluate(byte* inVal) PURE;
 
+		// the bits a monitor reads from the four C&C bytes at its address, with C1 in the top byte
+		static inline unsigned long watchBits(byte offset, byte mask) { return offset < 4 ? (unsigned long)mask << (8 * (3 - offset)) : 0; }
+
 		const byte m_addr;
+		const unsigned long m_watch;		// only evaluated when one of these bits changes
 	private:
 		CAttr_inMonitor(const CAttr_inMonitor&);
 		CAttr_inMonitor& operator=(const CAttr_inMonitor&);
@@ -283,7 +352,9 @@ private:
 	enum
 	{
 		SYNC = 0x7F,
-		MAX_CC_OUT = 10
+		MAX_CC_OUT = 10,
+		MAX_CC_IN = 32,
+		URGENT_CC_OUT = 0x01FE						// C&C addresses 1-8 (the transmit and receiver frequencies)
 	};
 
 	Thread<> m_attrThread;
@@ -294,22 +365,34 @@ private:
 	byte m_CCout[16*4];								// protected by m_CCoutLock
 	unsigned short m_CCoutSet;						// protected by m_CCoutLock
 	unsigned short m_CCoutPending;					// protected by m_CCoutLock
+	unsigned short m_CCoutUrgent;					// protected by m_CCoutLock, pending addresses that go out first
+	__int64 m_CCoutQueued[MAX_CC_OUT];				// protected by m_CCoutLock, when each pending address was first changed
+	__int64 m_CCoutInFlight;						// protected by m_CCoutLock, oldest change chosen since the last sent_frames
+	float m_latencyScale;							// milliseconds per performance counter tick
+	unsigned m_CCoutBatch;							// protected by m_CCoutLock, nesting depth of beginCC
+	byte m_CCoutStaged[MAX_CC_OUT*4];				// protected by m_CCoutLock, registers as they will be when committed
+	unsigned short m_CCoutStagedMask;				// protected by m_CCoutLock, addresses written since beginCC
 	Lock m_CCoutLock;
 
 	byte* chooseCC();
+	bool writeCC(byte addr, const byte* newVal);
+	bool queueCC(byte addr, bool urgent);
 
 	volatile byte m_CC0in;
-	byte m_CCin[32*4];								// protected by m_CCinLock
+	byte m_CCin[MAX_CC_IN*4];						// protected by m_CCinLock, only written by receive_frame
+	unsigned long m_CCinChanged[MAX_CC_IN];			// protected by m_CCinLock, bits changed since last evaluated
 	unsigned int m_CCinDirty;						// protected by m_CCinLock
 	Condition m_CCinUpdated;						// protected by m_CCinLock
 	Lock m_CCinLock;
+	unsigned int m_CCinSeen;						// private to receive_frame, addresses received at least once
 
-	typedef std::list<CAttr_inMonitor*> TInAttrList;
-	TInAttrList m_inAttrs;
+	typedef std::vector<CAttr_inMonitor*> TInAttrList;
+	TInAttrList m_inAttrs[MAX_CC_IN];				// monitors indexed by C&C address
 
 protected:
 	template<class ATTR> ATTR* addLocalInAttr(bool bVisible, ATTR* attr);
 	inline bool outPendingExists() const { return !!m_CCoutPending; }
+	inline bool outUrgentExists() const { return !!m_CCoutUrgent; }
 
 	friend class CAttr_out_recv_speed;
 
@@ -326,8 +409,19 @@ protected:
 	unsigned int m_recvSpeed;
 	const EBoardId m_controllerType;
 
-	std::vector<Receiver*> m_receivers;				// protected by m_recvListLock
-	Lock m_recvListLock;
+	class CReceiverSet : public CRefcountObject
+	{	// the attached receivers in the order the radio sends them, never changed once published
+	public:
+		inline CReceiverSet():count(0) { memset(recv, 0, sizeof(recv)); }
+		unsigned count;
+		Receiver* recv[MAX_RECEIVERS];
+	};
+
+	CSnapshotSlot<CReceiverSet> m_receivers;		// read without locking, replaced under m_recvListLock
+	Lock m_recvListLock;							// serializes AttachReceiver and DetachReceiver
+
+	void publishReceivers(CReceiverSet* receivers);
+	inline unsigned numReceivers() const { CReceiverSet* receivers = m_receivers.peek(); return receivers ? receivers->count : 0; }
 
 	Receiver m_receiver1, m_receiver2, m_receiver3, m_receiver4;
 	WideReceiver m_wideRecv;
@@ -343,7 +437,8 @@ template<class ATTR> ATTR* CHpsdrDevice::addLocalInAttr(bool bVisible, ATTR* att
 	if(attr)
 	{
 		addLocalAttr(bVisible, attr);
-		m_inAttrs.push_back(attr);
+		if(attr->m_addr < MAX_CC_IN) m_inAttrs[attr->m_addr].push_back(attr);
+		else ASSERT(FALSE);
 	}
 	return attr;
 }
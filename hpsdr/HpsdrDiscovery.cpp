@@ -0,0 +1,483 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#include "stdafx.h"
+#include "HpsdrDiscovery.h"
+#include "HpsdrEther2.h"
+
+#include "error.h"
+#include <vector>
+
+#pragma comment(lib, "advapi32.lib")
+
+// ------------------------------------------------------------------ class CHpsdrDiscovery
+
+#pragma warning(push)
+#pragma warning(disable: 4355)
+
+CHpsdrDiscovery::CHpsdrDiscovery(const char* cacheKey)
+	:m_cacheKey(cacheKey),m_retries(DEFAULT_RETRIES),m_retryMs(DEFAULT_RETRY_MS),m_refreshMs(DEFAULT_REFRESH_MS),
+	 m_targetAddr(INADDR_BROADCAST),m_targetPort(CHpsdr2Ethernet::GENERAL_PORT),m_searches(0),m_wantSearches(0),
+	 m_probedAt(0),m_cacheDirty(false),m_threadActive(false),m_threadOkay(false),m_lastFind(0),
+	 m_thread(Thread<>::delegate_type(this, &CHpsdrDiscovery::thread_search))
+{
+}
+
+#pragma warning(pop)
+
+CHpsdrDiscovery::~CHpsdrDiscovery()
+{
+	stop();
+}
+
+void CHpsdrDiscovery::configure(unsigned retries, unsigned retryMs, unsigned refreshMs)
+{
+	Locker lock(m_lock);
+	m_retries = max(retries, 1U);
+	m_retryMs = retryMs;
+	m_refreshMs = refreshMs;
+	m_changed.wakeAll();
+}
+
+void CHpsdrDiscovery::setTarget(unsigned long ipaddr, unsigned short port)
+{
+	Locker lock(m_lock);
+	m_targetAddr = ipaddr;
+	m_targetPort = port;
+}
+
+unsigned CHpsdrDiscovery::numSettled(DWORD& pendingMs) const
+{
+	// ASSUMES m_lock IS HELD
+	// a radio speaking both protocols answers the Metis probe too, so a protocol 1 reply only counts straight away
+	// from a radio known to speak nothing else, otherwise once the protocol 2 probe sent alongside it has had as
+	// long as any probe gets to be answered
+	const DWORD sinceProbe = GetTickCount() - m_probedAt;
+	pendingMs = 0;
+	unsigned count = 0;
+	for(TBoardMap::const_iterator trans = m_boards.begin(); trans != m_boards.end(); trans++)
+	{
+		const CEntry& entry = trans->second;
+		if(!entry.confirmed) continue;
+		if(entry.board.protocol >= 2 || entry.known == 1 || sinceProbe >= m_retryMs) count++;
+		else pendingMs = m_retryMs - sinceProbe;
+	}
+	return count;
+}
+
+void CHpsdrDiscovery::find(TBoardList& boards, unsigned expected, DWORD msTimeout /* = INFINITE */)
+{
+	boards.clear();
+	Locker lock(m_lock);
+	m_lastFind = GetTickCount();
+	if(!m_threadActive)
+	{
+		// a new thread starts over, checking what it remembers before it's reported
+		for(TBoardMap::iterator trans = m_boards.begin(); trans != m_boards.end(); trans++)
+		{
+			trans->second.confirmed = false;
+		}
+		m_wantSearches = m_searches + 1;
+		m_threadOkay = true;
+		m_threadActive = true;
+		m_thread.launch();
+	}
+
+	const DWORD start = GetTickCount();
+	while(m_threadActive && m_searches < m_wantSearches)
+	{
+		DWORD pendingMs;
+		if(expected && numSettled(pendingMs) >= expected) break;
+		const DWORD waited = GetTickCount() - start;
+		if(msTimeout != INFINITE && waited >= msTimeout) break;
+		DWORD sleepMs = msTimeout == INFINITE ? INFINITE : msTimeout - waited;
+		if(expected && pendingMs) sleepMs = min(sleepMs, pendingMs);		// nothing wakes us when a reply settles
+		m_changed.sleep(lock, sleepMs);
+	}
+
+	for(TBoardMap::const_iterator trans = m_boards.begin(); trans != m_boards.end(); trans++)
+	{
+		if(trans->second.confirmed) boards.push_back(trans->second.board);
+	}
+}
+
+void CHpsdrDiscovery::refresh()
+{
+	Locker lock(m_lock);
+	if(m_threadActive)
+	{
+		m_wantSearches = m_searches + 1;
+		m_changed.wakeAll();
+	}
+}
+
+void CHpsdrDiscovery::stop()
+{
+	{
+		Locker lock(m_lock);
+		m_threadOkay = false;
+		m_changed.wakeAll();
+	}
+	m_thread.close();
+}
+
+static SOCKET buildSocket()
+{
+	sockaddr_in iep;
+	memset(&iep, 0, sizeof(iep));
+	iep.sin_family = AF_INET;
+	iep.sin_addr.S_un.S_addr = INADDR_ANY;
+
+	SOCKET sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if(sock == INVALID_SOCKET) ThrowSocketError(WSAGetLastError());
+	try
+	{
+		if(::bind(sock, (sockaddr*)&iep, sizeof(iep)) == SOCKET_ERROR) ThrowSocketError(WSAGetLastError());
+
+		// set socket option so that broadcast is allowed.
+		static const BOOL bBroadcast = TRUE;
+		if(::setsockopt(sock, SOL_SOCKET, SO_BROADCAST, (char*)&bBroadcast, sizeof(bBroadcast)) == SOCKET_ERROR)
+		{
+			ThrowSocketError(WSAGetLastError());
+		}
+	}
+	catch(const std::exception&)
+	{
+		::shutdown(sock, SD_BOTH);
+		::closesocket(sock);
+		throw;
+	}
+	return sock;
+}
+
+void CHpsdrDiscovery::thread_search()
+{
+	ThreadBase::SetThreadName("HPSDR Discovery Thread");
+	SOCKET sock = INVALID_SOCKET;
+	try
+	{
+		sock = buildSocket();
+		loadCache();
+		bool validate = true;
+		Locker lock(m_lock);
+		while(m_threadOkay)
+		{
+			lock.unlock();
+			search(sock, validate);
+			validate = false;
+			lock.lock();
+
+			// wait for the next refresh or for someone to ask for one, ending if nobody's asked for a while
+			const DWORD start = GetTickCount();
+			while(m_threadOkay && m_searches >= m_wantSearches)
+			{
+				const DWORD now = GetTickCount();
+				const DWORD idle = now - m_lastFind;
+				const DWORD waited = now - start;
+				if(idle >= IDLE_MS)
+				{
+					m_threadOkay = false;
+				}
+				else if(waited >= m_refreshMs)
+				{
+					break;
+				}
+				else
+				{
+					m_changed.sleep(lock, min(m_refreshMs - waited, IDLE_MS - idle));
+				}
+			}
+		}
+	}
+	catch(const std::exception&)
+	{
+		// nothing more can be found, what has been stays known
+	}
+	if(sock != INVALID_SOCKET)
+	{
+		::shutdown(sock, SD_BOTH);
+		::closesocket(sock);
+	}
+
+	Locker lock(m_lock);
+	m_threadActive = false;
+	m_changed.wakeAll();
+}
+
+void CHpsdrDiscovery::search(SOCKET sock, bool validate)
+{
+	Locker lock(m_lock);
+	std::vector<unsigned long> remembered;
+	for(TBoardMap::iterator trans = m_boards.begin(); trans != m_boards.end(); trans++)
+	{
+		trans->second.seen = false;
+		if(validate) remembered.push_back(trans->second.board.ipaddr);
+	}
+	const unsigned retries = m_retries;
+	const unsigned retryMs = m_retryMs;
+	const unsigned long targetAddr = m_targetAddr;
+	const unsigned short targetPort = m_targetPort;
+	m_probedAt = GetTickCount();
+	lock.unlock();
+
+	// radios we remember are asked directly first, they answer long before a broadcast search would finish
+	if(!remembered.empty())
+	{
+		for(std::vector<unsigned long>::const_iterator trans = remembered.begin(); trans != remembered.end(); trans++)
+		{
+			probe(sock, *trans, targetPort);
+		}
+		collect(sock, VALIDATE_MS);
+	}
+
+	for(unsigned attempt = 0; attempt < retries; attempt++)
+	{
+		probe(sock, targetAddr, targetPort);
+		collect(sock, retryMs);
+		lock.lock();
+		const bool okay = m_threadOkay;
+		lock.unlock();
+		if(!okay) break;
+	}
+
+	// forget radios that have stopped answering
+	lock.lock();
+	TBoardMap::iterator trans = m_boards.begin();
+	while(trans != m_boards.end())
+	{
+		CEntry& entry = trans->second;
+		if(entry.seen)
+		{
+			entry.known = entry.board.protocol;
+			entry.missed = 0;
+			trans++;
+		}
+		else if(++entry.missed >= STALE_SEARCHES)
+		{
+			m_cacheDirty = true;
+			trans = m_boards.erase(trans);
+		}
+		else trans++;
+	}
+	m_searches++;
+	m_changed.wakeAll();
+
+	if(m_cacheDirty)
+	{
+		m_cacheDirty = false;
+		TBoardList boards;
+		for(trans = m_boards.begin(); trans != m_boards.end(); trans++)
+		{
+			boards.push_back(trans->second.board);
+		}
+		lock.unlock();
+		saveCache(boards);
+	}
+}
+
+void CHpsdrDiscovery::probe(SOCKET sock, unsigned long ipaddr, unsigned short port)
+{
+	sockaddr_in iep;
+	memset(&iep, 0, sizeof(iep));
+	iep.sin_family = AF_INET;
+	iep.sin_addr.S_un.S_addr = ipaddr;
+	iep.sin_port = htons(port);
+
+	// Protocol 2 goes first: a radio speaking both is offered as protocol 2, and its reply to this should beat
+	// its reply to the Metis probe.  A probe that can't be sent is no different from one that goes unanswered.
+	byte message[63];
+	CHpsdr2Ethernet::buildDiscovery(message);
+	::sendto(sock, (char*)message, 60, 0, (sockaddr*)&iep, sizeof(iep));
+
+	// set up HPSDR Metis discovery packet
+	memset(message, 0, sizeof(message));
+	message[0] = 0xEF;
+	message[1] = 0xFE;
+	message[2] = 0x02;
+	::sendto(sock, (char*)message, sizeof(message), 0, (sockaddr*)&iep, sizeof(iep));
+}
+
+void CHpsdrDiscovery::collect(SOCKET sock, DWORD msWait)
+{
+	const DWORD start = GetTickCount();
+	for(;;)
+	{
+		const DWORD waited = GetTickCount() - start;
+		if(waited >= msWait) break;
+
+		fd_set fds;
+		FD_ZERO(&fds) ;
+		FD_SET(sock, &fds);
+
+		struct timeval tv;
+		tv.tv_sec = (msWait - waited) / 1000;
+		tv.tv_usec = ((msWait - waited) % 1000) * 1000;
+
+		int ret = select (1, &fds, NULL, NULL, &tv);
+		if(ret == SOCKET_ERROR) ThrowSocketError(WSAGetLastError());
+		if(ret == 0) break;
+
+		byte message[1500];
+		sockaddr_in iep;
+		int iep_size = sizeof(iep);
+		ret = ::recvfrom(sock, (char*)message, sizeof(message), 0, (sockaddr*)&iep, &iep_size);
+		if(ret == SOCKET_ERROR)
+		{
+			// a probe sent to a remembered address with nobody there comes back as a reset, it's not fatal
+			const int err = WSAGetLastError();
+			if(err == WSAECONNRESET) continue;
+			ThrowSocketError(err);
+		}
+
+		CBoard board;
+		if(!parseReply(message, ret, board)) continue;
+		board.ipaddr = iep.sin_addr.S_un.S_addr;
+
+		Locker lock(m_lock);
+		TBoardMap::iterator found = m_boards.find(board.mac);
+		if(found == m_boards.end())
+		{
+			CEntry entry;
+			entry.board = board;
+			entry.confirmed = entry.seen = true;
+			entry.known = 0;
+			entry.missed = 0;
+			m_boards.insert(TBoardMap::value_type(board.mac, entry));
+			m_cacheDirty = true;
+		}
+		else
+		{
+			// firmware that speaks both protocols answers both probes, and is offered as a protocol 2 radio
+			CEntry& entry = found->second;
+			if(!entry.confirmed || board.protocol >= entry.board.protocol)
+			{
+				if(entry.board.ipaddr != board.ipaddr || entry.board.protocol != board.protocol) m_cacheDirty = true;
+				entry.board = board;
+			}
+			entry.confirmed = entry.seen = true;
+			entry.missed = 0;
+		}
+		m_changed.wakeAll();
+	}
+}
+
+// byte by byte as unsigned, a byte past 0x80 shifted as an int would sign extend into the top of the key
+static __int64 readMac(const byte* src)
+{
+	__int64 mac = 0;
+	for(unsigned idx = 0; idx < 6; idx++) mac = (mac << 8) | src[idx];
+	return mac;
+}
+
+bool CHpsdrDiscovery::parseReply(const byte* message, int size, CBoard& board)
+{
+	if(size == 60 && message[0] == 0xEF && message[1] == 0xFE && (message[2] == 0x02 || message[2] == 0x03))
+	{
+		board.status = message[2];
+		board.mac = readMac(message + 3);
+		board.ver = message[9];
+		board.boardId = message[10];
+		board.protocol = 1;
+		board.numDDC = 0;
+	}
+	else if(CHpsdr2Ethernet::isDiscoveryReply(message, size))
+	{
+		board.status = message[4];
+		board.mac = readMac(message + 5);
+		board.ver = message[13];
+		board.boardId = message[11];
+		board.protocol = 2;
+		board.numDDC = message[20];
+	}
+	else return false;
+
+	return !!board.mac;
+}
+
+// a remembered radio is stored field by field, so the record doesn't depend on how the compiler lays out CBoard
+void CHpsdrDiscovery::packBoard(const CBoard& board, byte* record)
+{
+	for(unsigned idx = 0; idx < 6; idx++) record[idx] = byte(board.mac >> (40 - idx * 8));
+	memcpy(record + 6, &board.ipaddr, 4);		// already in network order
+	record[10] = board.status;
+	record[11] = board.ver;
+	record[12] = board.boardId;
+	record[13] = board.protocol;
+	record[14] = board.numDDC;
+}
+
+bool CHpsdrDiscovery::unpackBoard(const byte* record, CBoard& board)
+{
+	board.mac = readMac(record);
+	memcpy(&board.ipaddr, record + 6, 4);
+	board.status = record[10];
+	board.ver = record[11];
+	board.boardId = record[12];
+	board.protocol = record[13];
+	board.numDDC = record[14];
+	return board.mac && (board.protocol == 1 || board.protocol == 2);
+}
+
+void CHpsdrDiscovery::loadCache()
+{
+	if(!m_cacheKey) return;
+	HKEY key;
+	if(RegOpenKeyExA(HKEY_CURRENT_USER, m_cacheKey, 0, KEY_READ, &key) != ERROR_SUCCESS) return;
+
+	Locker lock(m_lock);
+	for(DWORD idx = 0; ; idx++)
+	{
+		char name[32];
+		DWORD nameSize = sizeof(name);
+		DWORD type;
+		byte record[CACHE_RECORD_SIZE];
+		DWORD size = sizeof(record);
+		const LONG ret = RegEnumValueA(key, idx, name, &nameSize, NULL, &type, record, &size);
+		if(ret == ERROR_NO_MORE_ITEMS) break;
+
+		// anything left by a build with a different idea of a board is ignored
+		CBoard board;
+		if(ret != ERROR_SUCCESS || type != REG_BINARY || size != sizeof(record) || !unpackBoard(record, board)) continue;
+		if(m_boards.find(board.mac) == m_boards.end())
+		{
+			CEntry entry;
+			entry.board = board;
+			entry.confirmed = entry.seen = false;
+			entry.known = board.protocol;
+			entry.missed = 0;
+			m_boards.insert(TBoardMap::value_type(board.mac, entry));
+		}
+	}
+	RegCloseKey(key);
+}
+
+void CHpsdrDiscovery::saveCache(const TBoardList& boards) const
+{
+	if(!m_cacheKey) return;
+
+	// the key is rewritten whole, there are only ever a handful of radios
+	RegDeleteKeyA(HKEY_CURRENT_USER, m_cacheKey);
+	HKEY key;
+	if(RegCreateKeyExA(HKEY_CURRENT_USER, m_cacheKey, 0, NULL, 0, KEY_WRITE, NULL, &key, NULL) != ERROR_SUCCESS) return;
+	for(TBoardList::const_iterator trans = boards.begin(); trans != boards.end(); trans++)
+	{
+		char name[20];
+		sprintf_s(name, _countof(name), "%012I64X", trans->mac);
+		byte record[CACHE_RECORD_SIZE];
+		packBoard(*trans, record);
+		RegSetValueExA(key, name, 0, REG_BINARY, record, sizeof(record));
+	}
+	RegCloseKey(key);
+}
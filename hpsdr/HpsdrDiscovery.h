@@ -0,0 +1,121 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+
+#include <mt.h>
+#include <list>
+#include <map>
+#include <WinSock2.h>
+typedef unsigned char byte;
+
+// Radio discovery
+//
+// Searches for radios from a thread of its own so callers only wait as long as they need to.  A search sends the
+// Metis and protocol 2 probes together, repeating them a few times in case one is lost, and a caller asking for a
+// given number of radios is answered as soon as that many have replied.  Once a search has finished, the radios
+// found are kept fresh by searching again in the background, so later callers are answered immediately.
+//
+// The radios found are remembered (in the registry, keyed by MAC address) and on the next start each is sent a
+// probe directly, which a radio still at that address answers in a millisecond or two, well before a broadcast
+// search would finish.  A remembered radio isn't reported until it has answered, using the protocol it was
+// remembered with; a new radio answering only the Metis probe isn't counted until the protocol 2 probe has had
+// time to be answered too.
+
+class CHpsdrDiscovery
+{
+public:
+	struct CBoard
+	{
+		unsigned long ipaddr;
+		byte status;
+		__int64 mac;
+		byte ver;
+		byte boardId;
+		byte protocol;			// 1 for Metis framing, 2 for the newer separate streams
+		byte numDDC;			// protocol 2 only
+	};
+	typedef std::list<CBoard> TBoardList;
+
+	enum
+	{
+		DEFAULT_RETRIES = 3,			// probes sent per search
+		DEFAULT_RETRY_MS = 250,			// wait for replies after each probe
+		DEFAULT_REFRESH_MS = 30000		// between background searches
+	};
+
+	explicit CHpsdrDiscovery(const char* cacheKey);		// under HKEY_CURRENT_USER, NULL to not remember radios
+	~CHpsdrDiscovery();
+
+	void configure(unsigned retries, unsigned retryMs, unsigned refreshMs);
+	void setTarget(unsigned long ipaddr, unsigned short port);	// network order address, host order port
+
+	// Fills boards with the radios known, waiting at most msTimeout for the first search to finish unless the
+	// expected number of radios (if not zero) have already replied.
+	void find(TBoardList& boards, unsigned expected, DWORD msTimeout = INFINITE);
+	void refresh();				// the next find waits on a new search
+	void stop();				// ends the search thread, the next find starts it again
+
+private:
+	CHpsdrDiscovery(const CHpsdrDiscovery& other);
+	CHpsdrDiscovery& operator=(const CHpsdrDiscovery& other);
+
+	enum
+	{
+		VALIDATE_MS = 100,			// wait for remembered radios to answer before the broadcast search
+		STALE_SEARCHES = 2,			// radios missing from this many searches in a row are forgotten
+		IDLE_MS = 300000,			// the search thread ends after this long without a caller
+		CACHE_RECORD_SIZE = 15		// bytes remembered for each radio, see packBoard
+	};
+
+	struct CEntry
+	{
+		CBoard board;
+		bool confirmed;				// has replied since the search thread started
+		bool seen;					// has replied during the current search
+		byte known;					// protocol it settled on in an earlier search (or the cache), 0 if new
+		unsigned missed;			// searches in a row it hasn't replied to
+	};
+	typedef std::map<__int64, CEntry> TBoardMap;
+
+	const char* m_cacheKey;
+	Lock m_lock;
+	Condition m_changed;			// protected by m_lock, a radio replied or a search ended
+	TBoardMap m_boards;				// protected by m_lock
+	unsigned m_retries;				// protected by m_lock
+	unsigned m_retryMs;				// protected by m_lock
+	unsigned m_refreshMs;			// protected by m_lock
+	unsigned long m_targetAddr;		// protected by m_lock
+	unsigned short m_targetPort;	// protected by m_lock
+	unsigned m_searches;			// protected by m_lock, completed searches
+	unsigned m_wantSearches;		// protected by m_lock, searches find waits for
+	DWORD m_probedAt;				// protected by m_lock, when the current search sent its first probe
+	bool m_cacheDirty;				// protected by m_lock, the registry is out of date
+	bool m_threadActive;			// protected by m_lock
+	bool m_threadOkay;				// protected by m_lock
+	DWORD m_lastFind;				// protected by m_lock
+	Thread<> m_thread;
+
+	unsigned numSettled(DWORD& pendingMs) const;	// confirmed radios that can be reported as they are
+	void thread_search();
+	void search(SOCKET sock, bool validate);
+	void collect(SOCKET sock, DWORD msWait);
+	static void probe(SOCKET sock, unsigned long ipaddr, unsigned short port);
+	static bool parseReply(const byte* message, int size, CBoard& board);
+	static void packBoard(const CBoard& board, byte* record);
+	static bool unpackBoard(const byte* record, CBoard& board);
+	void loadCache();
+	void saveCache(const TBoardList& boards) const;
+};
@@ -15,12 +15,15 @@
 */
 #include "stdafx.h"
 #include "HpsdrEther.h"
+#include "HpsdrEther2.h"
 
 #include "block.h"
 #include "error.h"
-#include <set>
+#include <cmath>
+#include <MMSystem.h>
 
 #pragma comment(lib, "ws2_32.lib")
+#pragma comment(lib, "winmm.lib")
 
 extern "C" unsigned QueryDrivers(signals::IBlockDriver** drivers, unsigned availDrivers)
 {
@@ -38,6 +41,7 @@ const char* CHpsdrEthernetDriver::NAME = "radio";
 const char* CHpsdrEthernetDriver::DESCR = "OpenHPSDR Ethernet Devices";
 
 CHpsdrEthernetDriver::CHpsdrEthernetDriver()
+	:m_discovery("Software\\modHpsdr\\Radios")
 {
 	WSADATA wsaData;
 	m_wsaStartup = WSAStartup(MAKEWORD(2, 2), &wsaData);
@@ -45,6 +49,7 @@ CHpsdrEthernetDriver::CHpsdrEthernetDriver()
 
 CHpsdrEthernetDriver::~CHpsdrEthernetDriver()
 {
+	m_discovery.stop();
 	if(m_wsaStartup == 0)
 	{
 		WSACleanup();
@@ -56,9 +61,10 @@ unsigned CHpsdrEthernetDriver::Discover(signals::IBlock** blocks, unsigned avail
 {
 	if(!driverGood()) return 0;
 
-	typedef std::list<CDiscoveredBoard> TBoardList;
+	// a caller with room for a given number of radios is answered as soon as that many are found
+	typedef CHpsdrDiscovery::TBoardList TBoardList;
 	TBoardList discList;
-	Metis_Discovery(discList);
+	m_discovery.find(discList, blocks ? availBlocks : 0);
 	if(discList.empty()) return 0;
 
 	if(blocks && availBlocks)
@@ -67,8 +73,14 @@ unsigned CHpsdrEthernetDriver::Discover(signals::IBlock** blocks, unsigned avail
 		TBoardList::const_iterator trans;
 		for(i=0, trans=discList.begin(); i < availBlocks && trans != discList.end(); i++, trans++)
 		{
-			const CDiscoveredBoard& disc = *trans;
-			CHpsdrEthernet* block = new CHpsdrEthernet(this, disc.ipaddr, disc.mac, disc.ver, (CHpsdrEthernet::EBoardId)disc.boardId);
+			const CHpsdrDiscovery::CBoard& disc = *trans;
+			signals::IBlock* block;
+			if(disc.protocol == 2)
+			{
+				block = new CHpsdr2Ethernet(this, disc.ipaddr, disc.mac, disc.ver, disc.boardId, disc.numDDC);
+			} else {
+				block = new CHpsdrEthernet(this, disc.ipaddr, disc.mac, disc.ver, (CHpsdrEthernet::EBoardId)disc.boardId);
+			}
 			block->AddRef();
 			blocks[i] = block;
 		}
@@ -76,105 +88,6 @@ unsigned CHpsdrEthernetDriver::Discover(signals::IBlock** blocks, unsigned avail
 	return discList.size();
 }
 
-#pragma warning(push)
-#pragma warning(disable: 4127)
-
-void CHpsdrEthernetDriver::Metis_Discovery(std::list<CDiscoveredBoard>& discList)
-{
-	discList.clear();
-
-	// set up HPSDR Metis discovery packet
-	byte message[63];
-	memset(message, 0, sizeof(message));
-	message[0] = 0xEF;
-	message[1] = 0xFE;
-	message[2] = 0x02;
-
-	sockaddr_in iep;
-	memset(&iep, 0, sizeof(iep));
-	iep.sin_family = AF_INET;
-	iep.sin_addr.S_un.S_addr = INADDR_ANY;
-
-	SOCKET sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-	if(sock == INVALID_SOCKET) ThrowSocketError(WSAGetLastError());
-	try
-	{
-		if(::bind(sock, (sockaddr*)&iep, sizeof(iep)) == SOCKET_ERROR) ThrowSocketError(WSAGetLastError());
-
-		static const int SendBufferSize = 1032;
-		if(::setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char*)&SendBufferSize, sizeof(SendBufferSize)) == SOCKET_ERROR)
-		{
-			ThrowSocketError(WSAGetLastError());
-		}
-
-		// set socket option so that broadcast is allowed.
-		static const BOOL bBroadcast = TRUE;
-		if(::setsockopt(sock, SOL_SOCKET, SO_BROADCAST, (char*)&bBroadcast, sizeof(bBroadcast)) == SOCKET_ERROR)
-		{
-			ThrowSocketError(WSAGetLastError());
-		}
-
-		// need this so we can Broadcast on the socket
-		memset(&iep, 0, sizeof(iep));
-		iep.sin_family = AF_INET;
-		iep.sin_addr.S_un.S_addr = INADDR_BROADCAST;
-		iep.sin_port = htons(CHpsdrEthernet::METIS_PORT);
-
-		// send a broadcast to the port 1024
-		if(::sendto(sock, (char*)message, sizeof(message), 0, (sockaddr*)&iep, sizeof(iep)) == SOCKET_ERROR)
-		{
-			ThrowSocketError(WSAGetLastError());
-		}
-
-		fd_set fds;
-		FD_ZERO(&fds) ;
-		FD_SET(sock, &fds);
-
-		struct timeval tv;
-		tv.tv_sec = 2;
-		tv.tv_usec = 0;
-
-		std::set<__int64> foundDevices;
-		int iep_size = sizeof(iep);
-		for(;;)
-		{
-			int ret = select (1, &fds, NULL, NULL, &tv);
-			if(ret == SOCKET_ERROR) ThrowSocketError(WSAGetLastError());
-			if(ret == 0) break;
-
-			ret = ::recvfrom(sock, (char*)message, sizeof(message), 0, (sockaddr*)&iep, &iep_size);
-			if(ret == SOCKET_ERROR) ThrowSocketError(WSAGetLastError());
-
-			if(ret == 60 && message[0] == 0xEF && message[1] == 0xFE && (message[2] == 0x02 || message[2] == 0x03))
-			{
-				__int64 mac = (__int64(message[3])<<40)|(__int64(message[4])<<32)|(message[5]<<24)
-					|(message[6]<<16)|(message[7]<<8)|message[8];
-				if(mac && foundDevices.find(mac) == foundDevices.end())
-				{
-					CDiscoveredBoard thisBoard;
-					thisBoard.ipaddr = iep.sin_addr.S_un.S_addr;
-					thisBoard.status = message[2];
-					thisBoard.mac = mac;
-					thisBoard.ver = message[9];
-					thisBoard.boardId = message[10];
-					foundDevices.insert(mac);
-					discList.push_back(thisBoard);
-				}
-			}
-		}
-	}
-	catch(const std::exception&)
-	{
-		::shutdown(sock, SD_BOTH);
-		::closesocket(sock);
-		throw;
-	}
-	::shutdown(sock, SD_BOTH);
-	::closesocket(sock);
-}
-
-#pragma warning(pop)
-
 // ------------------------------------------------------------------ class CHpsdrEthernet
 
 const char* CHpsdrEthernet::NAME = "Metis (OpenHPSDR Controller)";
@@ -187,8 +100,10 @@ CHpsdrEthernet::CHpsdrEthernet(signals::IBlockDriver* driver, unsigned long ipad
 	 m_recvThread(Thread<>::delegate_type(this, &CHpsdrEthernet::thread_recv)),
 	 m_sendThread(Thread<>::delegate_type(this, &CHpsdrEthernet::thread_send)),
 	 m_sock(INVALID_SOCKET), m_lastRunStatus(0), m_iqStarting(false),
-	 m_nextSendSeq(0), m_driver(driver)
+	 m_driver(driver), m_urgentState(URGENT_IDLE), m_pacer(MAX_SEND_LAG), m_timerPeriod(false)
 {
+	m_clockDrift = addLocalAttr(true, new CAttr_reading("clockDrift", "Radio sample clock against the host clock, parts per million"));
+	m_pacingError = addLocalAttr(true, new CAttr_reading("pacingError", "Average milliseconds transmit packets leave behind schedule"));
 }
 
 #pragma warning(pop)
@@ -269,10 +184,15 @@ SOCKET CHpsdrEthernet::buildSocket() const
 void CHpsdrEthernet::Start()
 {
 	m_sock = buildSocket();
+	m_sendBatch.attach(m_sock);
+
+	// packets are due every 2.6ms, the default timer resolution would deliver them in bursts
+	if(!m_timerPeriod) m_timerPeriod = timeBeginPeriod(1) == TIMERR_NOERROR;
 
 	// spawn the recv + send threads
 	m_sendThread.launch(THREAD_PRIORITY_TIME_CRITICAL, true);
 	FlushPendingChanges();
+	m_urgentState = URGENT_IDLE;
 	m_sendThreadLock.open(0, MAX_SEND_LAG);
 	m_sendThread.resume();
 
@@ -298,6 +218,12 @@ void CHpsdrEthernet::Stop()
 		closesocket(m_sock);
 		m_sock = INVALID_SOCKET;
 	}
+
+	if(m_timerPeriod)
+	{
+		timeEndPeriod(1);
+		m_timerPeriod = false;
+	}
 }
 
 #pragma warning(push)
@@ -323,8 +249,10 @@ void CHpsdrEthernet::thread_recv()
 
 		int ret = select(1, &fds, NULL, NULL, &tv);
 		if(ret == SOCKET_ERROR) ThrowSocketError(WSAGetLastError());
-		if(ret != 0)
+		if(ret == 0)
 		{
+			flush_receivers();
+		} else {
 			ret = ::recv(this->m_sock, (char*)message, sizeof(message), 0);
 			if(ret == SOCKET_ERROR) ThrowSocketError(WSAGetLastError());
 
@@ -376,13 +304,7 @@ void CHpsdrEthernet::thread_recv()
 								m_iqStarting = false;
 							}
 							m_lastIQSeq = seq;
-							m_recvSamples += numSamples * MIC_RATE;
-							if(m_recvSamples > m_recvSpeed*128)
-							{
-								// release send thread
-								m_recvSamples -= m_recvSpeed*128;
-								m_sendThreadLock.wake();
-							}
+							if(m_recvSpeed) m_pacer.received(seq, double(numSamples) * MIC_RATE / m_recvSpeed);
 						}
 					}
 					break;
@@ -391,6 +313,7 @@ void CHpsdrEthernet::thread_recv()
 		}
 	}
 	if(wideBuff) wideBuff->Release();
+	flush_receivers();
 }
 
 #pragma warning(pop)
@@ -416,14 +339,14 @@ void CHpsdrEthernet::Metis_start_stop(bool runIQ, bool runWide)
 	if(!(m_lastRunStatus&1) && runIQ)
 	{
 		m_iqStarting = true;
-		m_recvSamples = 0;
+		m_pacer.reset();
 		m_lastIQSeq = 0;
 	}
 	if(!(m_lastRunStatus&2) && runWide)
 	{
 		m_lastWideSeq = 0;
 	}
-	m_nextSendSeq = 0;
+	m_sendBatch.restart();
 	if(!m_lastRunStatus && message[3] && !m_recvThread.running())
 	{
 		m_recvThread.launch(THREAD_PRIORITY_TIME_CRITICAL, true);
@@ -448,43 +371,251 @@ void CHpsdrEthernet::Metis_start_stop(bool runIQ, bool runWide)
 void CHpsdrEthernet::thread_send()
 {
 	ThreadBase::SetThreadName("Metis Send Thread");
-	byte message[1032];
-	while(m_sendThreadLock.sleep())
+	unsigned sinceReport = 0;
+	while(m_sendThreadLock.isOpen())
 	{
-		memset(message, 0, sizeof(message));
-		message[0] = 0xEF;
-		message[1] = 0xFE;
-		message[2] = 0x01;
-		message[3] = 0x02;
-		*(u_long*)&message[4] = ::htonl(m_nextSendSeq++);
+		DWORD waitMs;
+		const unsigned numDue = m_pacer.due(waitMs);
+		if(!numDue)
+		{
+			// the semaphore is only released by onUrgentCC (or closed by Stop)
+			if(m_sendThreadLock.sleep(waitMs) && m_urgentState == URGENT_WAKE)
+			{
+				// Once the radio is streaming the next regular packet goes out early, real samples and all, and
+				// the pacer pushes back the one after it.  Only one is allowed between regular packets so the
+				// radio is never more than a packet ahead.
+				m_urgentState = URGENT_SENT;
+				if(outUrgentExists())
+				{
+					send_packet(!m_pacer.sendEarly());
+					m_sendBatch.flush();
+					sent_frames();
+				}
+			}
+			continue;
+		}
 
-		send_frame(message + 8);
-		send_frame(message + 520);
+		// if we've fallen behind schedule then catch up with a single call rather than one per packet
+		for(unsigned idx = 0; idx < numDue; idx++)
+		{
+			send_packet(false);
+		}
+		m_sendBatch.flush();
+		sent_frames();
+		if(m_urgentState == URGENT_SENT) m_urgentState = URGENT_IDLE;
 
-		int ret = ::send(this->m_sock, (char*)message, sizeof(message), 0);
-		if(ret == SOCKET_ERROR) ThrowSocketError(WSAGetLastError());
+		sinceReport += numDue;
+		if(sinceReport >= REPORT_PACKETS)
+		{
+			sinceReport = 0;
+			m_clockDrift->update(m_pacer.drift());
+			m_pacingError->update(m_pacer.lateness());
+		}
+	}
+}
+
+void CHpsdrEthernet::onUrgentCC()
+{
+	// a frequency change shouldn't sit waiting for the next regular packet, wake the send thread to carry it
+	// now unless it's already been asked to (the change will then ride on whatever it sends next)
+	if(_InterlockedCompareExchange(&m_urgentState, URGENT_WAKE, URGENT_IDLE) == URGENT_IDLE)
+	{
+		if(!m_sendThreadLock.wake()) _InterlockedCompareExchange(&m_urgentState, URGENT_IDLE, URGENT_WAKE);
 	}
 }
 
+void CHpsdrEthernet::send_packet(bool no_streams)
+{
+	byte* message = m_sendBatch.next();
+	send_frame(message + 8, no_streams);
+	send_frame(message + 520, no_streams);
+}
+
 void CHpsdrEthernet::FlushPendingChanges()
 {
 	ASSERT(!m_sendThreadLock.isOpen());
 	if(m_sendThreadLock.isOpen()) return;
 
-	byte message[1032];
 	while(outPendingExists())
 	{
-		memset(message, 0, sizeof(message));
+		send_packet(true);
+	}
+	m_sendBatch.flush();
+	sent_frames(false);
+}
+
+// ------------------------------------------------------------------ class CSendPacer
+
+static const double PI = std::atan(1.0)*4;
+
+const double CSendPacer::BANDWIDTH = 0.1;			// Hz, slow enough to average out a few ms of arrival jitter
+const double CSendPacer::LATENESS_WEIGHT = 0.01;
+
+CSendPacer::CSendPacer(unsigned maxLag):m_maxLag(maxLag)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	m_tickPeriod = 1.0 / double(freq.QuadPart);
+	reset();
+}
+
+double CSendPacer::now() const
+{
+	LARGE_INTEGER ticks;
+	QueryPerformanceCounter(&ticks);
+	return ticks.QuadPart * m_tickPeriod;
+}
+
+void CSendPacer::reset()
+{
+	Locker lock(m_lock);
+	m_started = false;
+	m_lastSeq = 0;
+	m_sample = 0.0;
+	m_time = 0.0;
+	m_period = 1.0 / RADIO_RATE;
+	m_sendSample = 0.0;
+	m_lateness = 0.0;
+}
+
+void CSendPacer::received(unsigned seq, double samples)
+{
+	const double arrived = now();
+	Locker lock(m_lock);
+	const unsigned gap = seq - m_lastSeq;
+	m_lastSeq = seq;
+	if(!m_started || !gap || gap > MAX_GAP)
+	{
+		// anchor the timeline on this packet, a restart keeps the schedule and what we know of the period
+		if(m_started) m_sample += samples;
+		m_time = arrived;
+		m_started = true;
+		return;
+	}
+
+	// Lost packets are assumed to have carried as many samples as this one.  The loop gains follow the usual
+	// critically-damped choice for the time between updates, see F. Adriaensen "Using a DLL to filter time"
+	const double span = gap * samples;
+	const double predicted = m_time + span * m_period;
+	const double error = arrived - predicted;
+	const double omega = min(2.0 * PI * BANDWIDTH * span * m_period, 0.5);
+	m_sample += span;
+	m_time = predicted + std::sqrt(2.0) * omega * error;
+	m_period += omega * omega * error / span;
+
+	// nothing real drifts by a tenth of a percent, don't let a burst of late packets drag us there
+	const double nominal = 1.0 / RADIO_RATE;
+	m_period = max(nominal * 0.999, min(m_period, nominal * 1.001));
+}
+
+unsigned CSendPacer::due(DWORD& waitMs)
+{
+	const double current = now();
+	Locker lock(m_lock);
+	if(!m_started)
+	{
+		waitMs = 10;
+		return 0;
+	}
+
+	const double dueAt = m_time + (m_sendSample - m_sample) * m_period;
+	if(current < dueAt)
+	{
+		waitMs = DWORD((dueAt - current) * 1000.0) + 1;
+		return 0;
+	}
+
+	// too far behind and we give up on the packets we've missed rather than flood the radio
+	const double late = current - dueAt;
+	unsigned numDue = unsigned(late / (SEND_SAMPLES * m_period)) + 1;
+	if(numDue > m_maxLag)
+	{
+		m_sendSample += (numDue - m_maxLag) * double(SEND_SAMPLES);
+		numDue = m_maxLag;
+	}
+	m_sendSample += numDue * double(SEND_SAMPLES);
+	m_lateness += LATENESS_WEIGHT * (late - m_lateness);
+	waitMs = 0;
+	return numDue;
+}
+
+bool CSendPacer::sendEarly()
+{
+	Locker lock(m_lock);
+	if(!m_started) return false;
+	m_sendSample += SEND_SAMPLES;
+	return true;
+}
+
+float CSendPacer::drift()
+{
+	Locker lock(m_lock);
+	return float((1.0 / (m_period * RADIO_RATE) - 1.0) * 1e6);
+}
+
+float CSendPacer::lateness()
+{
+	Locker lock(m_lock);
+	return float(m_lateness * 1000.0);
+}
+
+// ------------------------------------------------------------------ class CSendBatch
+
+CSendBatch::CSendBatch():m_sock(INVALID_SOCKET),m_transmitPackets(NULL),m_count(0),m_nextSeq(0)
+{
+	memset(m_packets, 0, sizeof(m_packets));
+	for(unsigned idx = 0; idx < MAX_BATCH; idx++)
+	{
+		byte* message = m_packets[idx];
 		message[0] = 0xEF;
 		message[1] = 0xFE;
 		message[2] = 0x01;
 		message[3] = 0x02;
-		*(u_long*)&message[4] = ::htonl(m_nextSendSeq++);
 
-		send_frame(message + 8, true);
-		send_frame(message + 520, true);
+		TRANSMIT_PACKETS_ELEMENT& elem = m_elements[idx];
+		memset(&elem, 0, sizeof(elem));
+		elem.dwElFlags = TP_ELEMENT_MEMORY | TP_ELEMENT_EOP;
+		elem.cLength = PACKET_SIZE;
+		elem.pBuffer = message;
+	}
+}
 
-		int ret = ::send(this->m_sock, (char*)message, sizeof(message), 0);
-		if(ret == SOCKET_ERROR) ThrowSocketError(WSAGetLastError());
+void CSendBatch::attach(SOCKET sock)
+{
+	// TransmitPackets is the closest Winsock has to sendmmsg, each EOP element leaves as its own datagram
+	m_sock = sock;
+	m_count = 0;
+	m_transmitPackets = NULL;
+	GUID guid = WSAID_TRANSMITPACKETS;
+	DWORD bytes;
+	if(::WSAIoctl(sock, SIO_GET_EXTENSION_FUNCTION_POINTER, &guid, sizeof(guid), &m_transmitPackets,
+		sizeof(m_transmitPackets), &bytes, NULL, NULL) == SOCKET_ERROR)
+	{
+		m_transmitPackets = NULL;
+	}
+}
+
+byte* CSendBatch::next()
+{
+	if(m_count == MAX_BATCH) flush();
+	byte* message = m_packets[m_count++];
+	*(u_long*)&message[4] = ::htonl(m_nextSeq++);
+	return message;
+}
+
+void CSendBatch::flush()
+{
+	if(m_count > 1 && m_transmitPackets)
+	{
+		if(!m_transmitPackets(m_sock, m_elements, m_count, 0, NULL, TF_USE_DEFAULT_WORKER)) ThrowSocketError(WSAGetLastError());
+	}
+	else
+	{
+		for(unsigned idx = 0; idx < m_count; idx++)
+		{
+			int ret = ::send(m_sock, (char*)m_packets[idx], PACKET_SIZE, 0);
+			if(ret == SOCKET_ERROR) ThrowSocketError(WSAGetLastError());
+		}
 	}
+	m_count = 0;
 }
@@ -16,8 +16,10 @@
 #pragma once
 
 #include "HPSDRDevice.h"
+#include "HpsdrDiscovery.h"
 #include <list>
 #include <WinSock2.h>
+#include <MSWSock.h>
 
 class CHpsdrEthernetDriver;
 extern "C" unsigned QueryDrivers(signals::IBlockDriver** drivers, unsigned availDrivers);
@@ -28,6 +30,7 @@ public:
 	CHpsdrEthernetDriver();
 	virtual ~CHpsdrEthernetDriver();
 	inline bool driverGood()		{ return m_wsaStartup == 0; }
+	inline CHpsdrDiscovery& discovery()	{ return m_discovery; }
 
 private:
 	CHpsdrEthernetDriver(const CHpsdrEthernetDriver& other);
@@ -46,17 +49,74 @@ protected:
 	static const char* NAME;
 	static const char* DESCR;
 	int m_wsaStartup;
+	CHpsdrDiscovery m_discovery;
+};
 
-	struct CDiscoveredBoard
+class CSendBatch
+{	// outgoing Metis packets, built over a prepared header and handed to the socket a run at a time
+public:
+	enum
 	{
-		unsigned long ipaddr;
-		byte status;
-		__int64 mac;
-		byte ver;
-		byte boardId;
+		PACKET_SIZE = 1032,
+		MAX_BATCH = 10
 	};
 
-	static void Metis_Discovery(std::list<CDiscoveredBoard>& discList);
+	CSendBatch();
+	void attach(SOCKET sock);
+	byte* next();			// the next packet with its header and sequence number filled in
+	void flush();			// sends everything returned by next since the last flush
+	inline void restart()	{ m_nextSeq = 0; }
+
+private:
+	CSendBatch(const CSendBatch& other);
+	CSendBatch& operator=(const CSendBatch& other);
+
+	SOCKET m_sock;
+	LPFN_TRANSMITPACKETS m_transmitPackets;
+	unsigned m_count;
+	unsigned m_nextSeq;
+	byte m_packets[MAX_BATCH][PACKET_SIZE];
+	TRANSMIT_PACKETS_ELEMENT m_elements[MAX_BATCH];
+};
+
+class CSendPacer
+{	// Recovers the radio's 48k sample clock from when receive packets arrive, using a second-order delay-locked
+	// loop, and schedules transmit packets against that smoothed timeline rather than against the arrivals
+	// themselves.  Fed by the receive thread and polled by the send thread.
+public:
+	explicit CSendPacer(unsigned maxLag);
+	void reset();
+	void received(unsigned seq, double samples);	// samples is how many 48k samples the packet carried
+	unsigned due(DWORD& waitMs);					// packets to send now, or how long until the next one is due
+	bool sendEarly();								// claims the next packet now, false if the radio isn't streaming
+	float drift();									// radio clock against ours, parts per million
+	float lateness();								// average milliseconds packets go out behind schedule
+
+private:
+	CSendPacer(const CSendPacer& other);
+	CSendPacer& operator=(const CSendPacer& other);
+
+	enum
+	{
+		RADIO_RATE = 48000,
+		SEND_SAMPLES = 2 * CHpsdrDevice::FRAME_SAMPLES,	// 48k samples carried by each transmit packet
+		MAX_GAP = 1000									// larger sequence jumps are treated as a restart
+	};
+	static const double BANDWIDTH;
+	static const double LATENESS_WEIGHT;
+
+	double now() const;
+
+	Lock m_lock;
+	const unsigned m_maxLag;
+	double m_tickPeriod;		// seconds per performance counter tick
+	bool m_started;				// protected by m_lock
+	unsigned m_lastSeq;			// protected by m_lock
+	double m_sample;			// protected by m_lock, samples received up to the last packet
+	double m_time;				// protected by m_lock, filtered time the last packet arrived
+	double m_period;			// protected by m_lock, filtered seconds per sample
+	double m_sendSample;		// protected by m_lock, sample position the next transmit packet is due at
+	double m_lateness;			// protected by m_lock, smoothed seconds sends trail their schedule
 };
 
 class CHpsdrEthernet : public CHpsdrDevice, protected CRefcountObject
@@ -86,7 +146,8 @@ private:
 
 	enum
 	{
-		MAX_SEND_LAG = 10		// how many frames behind are we permitting the send thread to catch up with?
+		MAX_SEND_LAG = 10,		// how many frames behind are we permitting the send thread to catch up with?
+		REPORT_PACKETS = 256	// how often the pacing attributes are refreshed
 	};
 
 	SOCKET buildSocket() const;
@@ -94,8 +155,20 @@ private:
 
 	void thread_recv();
 	void thread_send();
+	void send_packet(bool no_streams);
 	void FlushPendingChanges();
 
+protected:
+	virtual void onUrgentCC();
+
+private:
+	enum
+	{
+		URGENT_IDLE,			// no out-of-band packet since the last regular one
+		URGENT_WAKE,			// the send thread has been woken to send one
+		URGENT_SENT				// one has been sent, anything else waits for the next regular packet
+	};
+
 	const unsigned long	m_ipAddress;
 	const __int64		m_macAddress;
 	const byte			m_controllerVersion;
@@ -103,10 +176,15 @@ private:
 
 	Thread<> m_recvThread, m_sendThread;
 	SOCKET   m_sock;
-	unsigned m_lastIQSeq, m_lastWideSeq, m_nextSendSeq;
+	unsigned m_lastIQSeq, m_lastWideSeq;
 	bool     m_iqStarting;
 	volatile byte m_lastRunStatus;
 	Semaphore m_sendThreadLock;
-	unsigned m_recvSamples;		// private to thread_recv
+	volatile long m_urgentState;
+	CSendBatch m_sendBatch;		// private to thread_send (and FlushPendingChanges before it starts)
+	CSendPacer m_pacer;
+	bool m_timerPeriod;			// have we raised the system timer resolution?
+	CAttr_reading* m_clockDrift;
+	CAttr_reading* m_pacingError;
 };
 
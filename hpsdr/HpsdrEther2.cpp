@@ -0,0 +1,668 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#include "stdafx.h"
+#include "HpsdrEther2.h"
+
+#include "error.h"
+#include <complex>
+
+static const float INV_SCALE_32 = 1 / float(1U << 31);
+static const float INV_SCALE_16 = 1 / float(1U << 15);
+
+// protocol 2 is big-endian throughout
+static inline unsigned readBE16(const byte* src)	{ return (src[0]<<8)|src[1]; }
+static inline unsigned readBE32(const byte* src)	{ return (src[0]<<24)|(src[1]<<16)|(src[2]<<8)|src[3]; }
+static inline void writeBE16(byte* dest, unsigned val)
+{
+	dest[0] = (byte)((val>>8)&0xFF);
+	dest[1] = (byte)(val&0xFF);
+}
+static inline void writeBE32(byte* dest, unsigned val)
+{
+	dest[0] = (byte)((val>>24)&0xFF);
+	dest[1] = (byte)((val>>16)&0xFF);
+	dest[2] = (byte)((val>>8)&0xFF);
+	dest[3] = (byte)(val&0xFF);
+}
+
+// ------------------------------------------------------------------ class CAttr_ddcRate
+
+class CAttr_ddcRate : public CAttr_callback<signals::etypLong,CHpsdr2Ethernet::Receiver>
+{	// the rates a protocol 2 DDC can run at
+private:
+	typedef CAttr_callback<signals::etypLong,CHpsdr2Ethernet::Receiver> base;
+	static const long rate_options[6];
+	static const char* rate_names[6];
+
+public:
+	inline CAttr_ddcRate(CHpsdr2Ethernet::Receiver& parent, const char* name, const char* descr, TCallback cb, long deflt)
+		:base(parent, name, descr, cb, deflt) { }
+
+	virtual bool isValidValue(const store_type& newVal) const
+	{
+		for(unsigned idx = 0; idx < _countof(rate_options); idx++)
+		{
+			if(rate_options[idx] == newVal) return true;
+		}
+		return false;
+	}
+
+	virtual unsigned options(const void* vals, const char** opts, unsigned availElem)
+	{
+		if((vals||opts) && availElem)
+		{
+			unsigned numCopy = min(availElem, _countof(rate_options));
+			for(unsigned idx=0; idx < numCopy; idx++)
+			{
+				if(vals) ((store_type*)vals)[idx] = rate_options[idx];
+				if(opts) opts[idx] = rate_names[idx];
+			}
+		}
+		return _countof(rate_options);
+	}
+};
+
+const long CAttr_ddcRate::rate_options[] = { 48000, 96000, 192000, 384000, 768000, 1536000 };
+const char* CAttr_ddcRate::rate_names[] = { "48 kHz", "96 kHz", "192 kHz", "384 kHz", "768 kHz", "1536 kHz" };
+
+// ------------------------------------------------------------------ class CHpsdr2Ethernet
+
+const char* CHpsdr2Ethernet::NAME = "OpenHPSDR Protocol 2 Radio";
+
+#pragma warning(push)
+#pragma warning(disable: 4355)
+
+CHpsdr2Ethernet::CHpsdr2Ethernet(signals::IBlockDriver* driver, unsigned long ipaddr, __int64 mac, byte ver, byte boardId, byte numDDC)
+	:m_ipAddress(ipaddr),m_macAddress(mac),m_controllerVersion(ver),m_boardId(boardId),m_numDDC(numDDC),m_driver(driver),
+	 m_cmdDirty(0),m_cmdThreadEnabled(false),
+	 m_recvThread(Thread<>::delegate_type(this, &CHpsdr2Ethernet::thread_recv)),
+	 m_cmdThread(Thread<>::delegate_type(this, &CHpsdr2Ethernet::thread_cmd)),
+	 m_sock(INVALID_SOCKET),m_running(false),m_micStarting(true),m_lastMicSeq(0),m_lost(0)
+{
+	memset(&m_cmd, 0, sizeof(m_cmd));
+	memset(m_cmdSeq, 0, sizeof(m_cmdSeq));
+	for(unsigned ddc = 0; ddc < MAX_RECEIVERS; ddc++)
+	{
+		m_cmd.ddcRate[ddc] = DEFAULT_RATE;
+	}
+	buildAttrs();
+}
+
+#pragma warning(pop)
+
+CHpsdr2Ethernet::~CHpsdr2Ethernet()
+{
+	Stop();
+}
+
+unsigned CHpsdr2Ethernet::NodeId(char* buff, unsigned availChar)
+{
+	if(availChar >= 17)
+	{
+		sprintf_s(buff, availChar+1, "%02X:%02X:%02X:%02X:%02X:%02X", (int)((m_macAddress>>40)&0xFF), (int)((m_macAddress>>32)&0xFF),
+			(int)((m_macAddress>>24)&0xFF),(int)((m_macAddress>>16)&0xFF),(int)((m_macAddress>>8)&0xFF),(int)(m_macAddress&0xFF));
+	}
+	return 17;
+}
+
+unsigned CHpsdr2Ethernet::Outgoing(signals::IOutEndpoint** ep, unsigned availEP)
+{
+	const unsigned numRecv = min(unsigned(m_numDDC), unsigned(MAX_RECEIVERS));
+	if(ep && availEP > 0) ep[0] = &m_microphone;
+	for(unsigned ddc = 0; ddc < numRecv; ddc++)
+	{
+		if(ep && availEP > ddc+1) ep[ddc+1] = &m_receivers[ddc];
+	}
+	return numRecv + 1;
+}
+
+void CHpsdr2Ethernet::buildDiscovery(byte* message)
+{
+	memset(message, 0, 60);
+	message[4] = 0x02;
+}
+
+bool CHpsdr2Ethernet::isDiscoveryReply(const byte* message, int size)
+{
+	return size == 60 && !message[0] && !message[1] && !message[2] && !message[3]
+		&& (message[4] == 0x02 || message[4] == 0x03);
+}
+
+SOCKET CHpsdr2Ethernet::buildSocket() const
+{
+	sockaddr_in iep;
+	memset(&iep, 0, sizeof(iep));
+	iep.sin_family = AF_INET;
+	iep.sin_addr.S_un.S_addr = INADDR_ANY;
+
+	// the one socket carries every command out and every stream back, so it isn't connected to any one port
+	SOCKET sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if(sock == INVALID_SOCKET) ThrowSocketError(WSAGetLastError());
+	try
+	{
+		if(::bind(sock, (sockaddr*)&iep, sizeof(iep)) == SOCKET_ERROR) ThrowSocketError(WSAGetLastError());
+
+		static const int ReceiveBufferSize = 4 * 1024 * 1024;	// a quarter second of one DDC at 1536kHz
+		if(::setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char*)&ReceiveBufferSize, sizeof(ReceiveBufferSize)) == SOCKET_ERROR)
+		{
+			ThrowSocketError(WSAGetLastError());
+		}
+	}
+	catch(const std::exception&)
+	{
+		::shutdown(sock, SD_BOTH);
+		::closesocket(sock);
+		throw;
+	}
+
+	return sock;
+}
+
+void CHpsdr2Ethernet::Start()
+{
+	if(m_running) return;
+	m_sock = buildSocket();
+	m_micStarting = true;
+	m_lost = 0;
+	attrs.lost_packets->update(0);
+	for(unsigned ddc = 0; ddc < MAX_RECEIVERS; ddc++)
+	{
+		m_receivers[ddc].restart();
+	}
+
+	// listen before the radio is told to run so the first packets aren't lost
+	m_running = true;
+	m_recvThread.launch(THREAD_PRIORITY_TIME_CRITICAL);
+
+	Locker lock(m_cmdLock);
+	m_cmd.run = true;
+	sendCommands(CMD_ALL, lock);
+	m_cmdThreadEnabled = true;
+	lock.unlock();
+	m_cmdThread.launch(THREAD_PRIORITY_ABOVE_NORMAL);
+}
+
+void CHpsdr2Ethernet::Stop()
+{
+	if(!m_running) return;
+
+	// shut down the command thread
+	{
+		Locker lock(m_cmdLock);
+		m_cmdThreadEnabled = false;
+		m_cmdChanged.wakeAll();
+	}
+	m_cmdThread.close();
+
+	// tell the radio to stop
+	{
+		Locker lock(m_cmdLock);
+		m_cmd.run = false;
+		sendCommands(CMD_HIGH_PRI, lock);
+	}
+
+	// shut down the receive thread
+	m_running = false;
+	m_recvThread.close();
+
+	// shut down the socket
+	if(m_sock != INVALID_SOCKET)
+	{
+		shutdown(m_sock, SD_BOTH);
+		closesocket(m_sock);
+		m_sock = INVALID_SOCKET;
+	}
+}
+
+// ------------------------------------------------------------------ command packets
+
+void CHpsdr2Ethernet::changed(unsigned cmd)
+{
+	// ASSUMES m_cmdLock IS HELD
+	m_cmdDirty |= cmd;
+	m_cmdChanged.wake();
+}
+
+void CHpsdr2Ethernet::setPtt(const unsigned char& newVal)
+{
+	Locker lock(m_cmdLock);
+	m_cmd.ptt = !!newVal;
+	changed(CMD_HIGH_PRI);
+}
+
+void CHpsdr2Ethernet::setSendFreq(const long& newVal)
+{
+	Locker lock(m_cmdLock);
+	m_cmd.sendFreq = newVal;
+	changed(CMD_HIGH_PRI);
+}
+
+void CHpsdr2Ethernet::setDriveLevel(const unsigned char& newVal)
+{
+	Locker lock(m_cmdLock);
+	m_cmd.driveLevel = newVal;
+	changed(CMD_HIGH_PRI);
+}
+
+void CHpsdr2Ethernet::setAttenuation(const unsigned char& newVal)
+{
+	Locker lock(m_cmdLock);
+	m_cmd.attenuation = min(newVal, (unsigned char)31);
+	changed(CMD_HIGH_PRI);
+}
+
+void CHpsdr2Ethernet::setDither(const unsigned char& newVal)
+{
+	Locker lock(m_cmdLock);
+	m_cmd.dither = !!newVal;
+	changed(CMD_DDC);
+}
+
+void CHpsdr2Ethernet::setRandom(const unsigned char& newVal)
+{
+	Locker lock(m_cmdLock);
+	m_cmd.random = !!newVal;
+	changed(CMD_DDC);
+}
+
+void CHpsdr2Ethernet::setMicBoost(const unsigned char& newVal)
+{
+	Locker lock(m_cmdLock);
+	m_cmd.micBoost = !!newVal;
+	changed(CMD_DUC);
+}
+
+void CHpsdr2Ethernet::setMicLineIn(const unsigned char& newVal)
+{
+	Locker lock(m_cmdLock);
+	m_cmd.micLineIn = !!newVal;
+	changed(CMD_DUC);
+}
+
+void CHpsdr2Ethernet::setDDCFreq(byte ddc, long freq)
+{
+	Locker lock(m_cmdLock);
+	m_cmd.ddcFreq[ddc] = freq;
+	changed(CMD_HIGH_PRI);
+}
+
+void CHpsdr2Ethernet::setDDCRate(byte ddc, long khz)
+{
+	Locker lock(m_cmdLock);
+	m_cmd.ddcRate[ddc] = khz;
+	changed(CMD_DDC);
+}
+
+void CHpsdr2Ethernet::setDDCAdc(byte ddc, byte adc)
+{
+	Locker lock(m_cmdLock);
+	m_cmd.ddcAdc[ddc] = adc;
+	changed(CMD_DDC);
+}
+
+void CHpsdr2Ethernet::enableDDC(byte ddc, bool enable)
+{
+	Locker lock(m_cmdLock);
+	if(enable) m_cmd.ddcEnabled |= 1U << ddc;
+	else m_cmd.ddcEnabled &= ~(1U << ddc);
+	changed(CMD_DDC);
+}
+
+void CHpsdr2Ethernet::buildGeneral(byte* packet)
+{
+	// ASSUMES m_cmdLock IS HELD
+	memset(packet, 0, GENERAL_SIZE);
+	writeBE32(packet, m_cmdSeq[0]++);
+	packet[4] = 0x00;							// command
+	writeBE16(packet + 5, DDC_CMD_PORT);
+	writeBE16(packet + 7, DUC_CMD_PORT);
+	writeBE16(packet + 9, HIGH_PRI_CMD_PORT);
+	writeBE16(packet + 11, STATUS_PORT);
+	writeBE16(packet + 13, AUDIO_PORT);
+	writeBE16(packet + 15, DUC_IQ_PORT);
+	writeBE16(packet + 17, DDC_IQ_PORT);
+	writeBE16(packet + 19, MIC_PORT);
+	writeBE16(packet + 21, WIDE_PORT);
+	packet[37] = 0x00;							// bit 3 clear: frequencies are sent in Hz rather than as phase words
+}
+
+void CHpsdr2Ethernet::buildDDC(byte* packet)
+{
+	// ASSUMES m_cmdLock IS HELD
+	// Angelia, Orion and Orion MkII have a second ADC
+	const byte numAdc = (m_boardId >= 3 && m_boardId <= 5) ? 2 : 1;
+	const byte adcMask = (byte)((1 << numAdc) - 1);
+
+	memset(packet, 0, DDC_CMD_SIZE);
+	writeBE32(packet, m_cmdSeq[1]++);
+	packet[4] = numAdc;
+	packet[5] = m_cmd.dither ? adcMask : 0;
+	packet[6] = m_cmd.random ? adcMask : 0;
+	for(unsigned ddc = 0; ddc < MAX_RECEIVERS; ddc++)
+	{
+		if(m_cmd.ddcEnabled & (1U << ddc)) packet[7 + ddc / 8] |= (byte)(1 << (ddc % 8));
+		byte* config = packet + 17 + 6 * ddc;
+		config[0] = m_cmd.ddcAdc[ddc];
+		writeBE16(config + 1, (unsigned)m_cmd.ddcRate[ddc]);
+		config[5] = 24;							// bits per sample
+	}
+}
+
+void CHpsdr2Ethernet::buildDUC(byte* packet)
+{
+	// ASSUMES m_cmdLock IS HELD
+	memset(packet, 0, DUC_CMD_SIZE);
+	writeBE32(packet, m_cmdSeq[2]++);
+	packet[4] = 1;								// number of DACs
+	packet[50] = (m_cmd.micLineIn ? 0x01 : 0) | (m_cmd.micBoost ? 0x02 : 0);
+}
+
+void CHpsdr2Ethernet::buildHighPriority(byte* packet)
+{
+	// ASSUMES m_cmdLock IS HELD
+	memset(packet, 0, HIGH_PRI_CMD_SIZE);
+	writeBE32(packet, m_cmdSeq[3]++);
+	packet[4] = (m_cmd.run ? 0x01 : 0) | (m_cmd.ptt ? 0x02 : 0);
+	for(unsigned ddc = 0; ddc < MAX_RECEIVERS; ddc++)
+	{
+		writeBE32(packet + 9 + 4 * ddc, (unsigned)m_cmd.ddcFreq[ddc]);
+	}
+	writeBE32(packet + 329, (unsigned)m_cmd.sendFreq);
+	packet[345] = m_cmd.driveLevel;
+	packet[1442] = m_cmd.attenuation;			// ADC1
+	packet[1443] = m_cmd.attenuation;			// ADC0
+}
+
+void CHpsdr2Ethernet::sendCommands(unsigned cmds, Locker& lock)
+{
+	// ASSUMES m_cmdLock IS HELD, it is released while the packets are sent
+	byte general[GENERAL_SIZE];
+	byte ddc[DDC_CMD_SIZE];
+	byte duc[DUC_CMD_SIZE];
+	byte highPri[HIGH_PRI_CMD_SIZE];
+	m_cmdDirty &= ~cmds;
+	if(cmds & CMD_GENERAL) buildGeneral(general);
+	if(cmds & CMD_DDC) buildDDC(ddc);
+	if(cmds & CMD_DUC) buildDUC(duc);
+	if(cmds & CMD_HIGH_PRI) buildHighPriority(highPri);
+	lock.unlock();
+
+	// the radio is configured before the high-priority packet that may be telling it to run
+	if(cmds & CMD_GENERAL) sendTo(GENERAL_PORT, general, sizeof(general));
+	if(cmds & CMD_DDC) sendTo(DDC_CMD_PORT, ddc, sizeof(ddc));
+	if(cmds & CMD_DUC) sendTo(DUC_CMD_PORT, duc, sizeof(duc));
+	if(cmds & CMD_HIGH_PRI) sendTo(HIGH_PRI_CMD_PORT, highPri, sizeof(highPri));
+	lock.lock();
+}
+
+void CHpsdr2Ethernet::sendTo(unsigned short port, const byte* packet, unsigned size)
+{
+	sockaddr_in iep;
+	memset(&iep, 0, sizeof(iep));
+	iep.sin_family = AF_INET;
+	iep.sin_addr.S_un.S_addr = m_ipAddress;
+	iep.sin_port = htons(port);
+	if(::sendto(m_sock, (const char*)packet, size, 0, (sockaddr*)&iep, sizeof(iep)) == SOCKET_ERROR)
+	{
+		ThrowSocketError(WSAGetLastError());
+	}
+}
+
+void CHpsdr2Ethernet::thread_cmd()
+{
+	ThreadBase::SetThreadName("HPSDR Protocol 2 Command Thread");
+	Locker lock(m_cmdLock);
+	while(m_cmdThreadEnabled)
+	{
+		// changes are sent as they're made, and a quiet spell resends everything
+		if(!m_cmdDirty && !m_cmdChanged.sleep(lock, REFRESH_MS)) m_cmdDirty = CMD_ALL;
+		if(!m_cmdThreadEnabled) break;
+		if(m_cmdDirty) sendCommands(m_cmdDirty, lock);
+	}
+}
+
+// ------------------------------------------------------------------ received streams
+
+#pragma warning(push)
+#pragma warning(disable: 4127)
+
+void CHpsdr2Ethernet::thread_recv()
+{
+	ThreadBase::SetThreadName("HPSDR Protocol 2 Receive Thread");
+	byte message[1500];
+
+	fd_set fds;
+
+	struct timeval tv;
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+
+	while(m_running)
+	{
+		FD_ZERO(&fds) ;
+		FD_SET(this->m_sock, &fds);
+
+		int ret = select(1, &fds, NULL, NULL, &tv);
+		if(ret == SOCKET_ERROR) ThrowSocketError(WSAGetLastError());
+		if(ret == 0) continue;
+
+		sockaddr_in from;
+		int fromSize = sizeof(from);
+		ret = ::recvfrom(this->m_sock, (char*)message, sizeof(message), 0, (sockaddr*)&from, &fromSize);
+		if(ret == SOCKET_ERROR)
+		{
+			// a command that found nobody listening comes back as a reset on the next receive, it's not fatal
+			const int err = WSAGetLastError();
+			if(err == WSAECONNRESET) continue;
+			ThrowSocketError(err);
+		}
+		if(from.sin_addr.S_un.S_addr != m_ipAddress) continue;
+
+		// the streams are told apart by the port the radio sent them from
+		const unsigned short port = ntohs(from.sin_port);
+		if(port >= DDC_IQ_PORT && port < DDC_IQ_PORT + MAX_RECEIVERS)
+		{
+			m_receivers[port - DDC_IQ_PORT].received(message, ret);
+		}
+		else if(port == STATUS_PORT)
+		{
+			receive_status(message, ret);
+		}
+		else if(port == MIC_PORT)
+		{
+			receive_mic(message, ret);
+		}
+	}
+}
+
+#pragma warning(pop)
+
+void CHpsdr2Ethernet::receive_status(const byte* packet, unsigned size)
+{
+	if(size < STATUS_SIZE) return;
+	attrs.ptt_in->update((byte)(packet[4] & 0x01));
+	attrs.recv_overflow->update((byte)(packet[5] ? 1 : 0));
+	attrs.exciter_power->update((short)readBE16(packet + 6));
+	attrs.forward_power->update((short)readBE16(packet + 14));
+	attrs.reverse_power->update((short)readBE16(packet + 22));
+}
+
+void CHpsdr2Ethernet::receive_mic(const byte* packet, unsigned size)
+{
+	if(size < MIC_SIZE) return;
+	const unsigned seq = readBE32(packet);
+	if(!m_micStarting && seq != m_lastMicSeq + 1) attrs.sync_mic_fault->fire();
+	m_micStarting = false;
+	m_lastMicSeq = seq;
+
+	float micBuff[MIC_SAMPLES];
+	const byte* src = packet + 4;
+	for(unsigned idx = 0; idx < MIC_SAMPLES; idx++)
+	{
+		// force the 16bit number to be signed and convert to float
+		micBuff[idx] = short((src[0] << 8) | src[1]) * INV_SCALE_16;
+		src += 2;
+	}
+	if(!m_microphone.Write(signals::etypSingle, micBuff, MIC_SAMPLES, 0) && m_microphone.isConnected())
+	{
+		attrs.sync_mic_fault->fire();
+	}
+}
+
+// ------------------------------------------------------------------ main attributes
+
+void CHpsdr2Ethernet::buildAttrs()
+{
+	// events
+	attrs.sync_fault = addLocalAttr(true, new CEventAttribute("syncFault", "Fires when a sync fault happens in a receive stream"));
+	attrs.sync_mic_fault = addLocalAttr(false, new CEventAttribute("micSyncFault", "Fires when an overrun occurs receiving microphone data"));
+
+	// read-only
+	attrs.version = addLocalAttr(true, new CROAttribute<signals::etypByte>("version", "Firmware version", m_controllerVersion));
+	attrs.num_ddc = addLocalAttr(true, new CROAttribute<signals::etypByte>("numDDC", "Number of receivers the radio has", m_numDDC));
+	attrs.ptt_in = addLocalAttr(true, new CAttr_status<signals::etypBoolean>("PTTIn", "Is the radio's PTT input pressed?", false));
+	attrs.recv_overflow = addLocalAttr(true, new CAttr_status<signals::etypBoolean>("recvOverflow", "Receiver ADC overloaded?", false));
+	attrs.forward_power = addLocalAttr(true, new CAttr_status<signals::etypShort>("AIN1", "Forward power from Alex/Apollo", 0));
+	attrs.reverse_power = addLocalAttr(true, new CAttr_status<signals::etypShort>("AIN2", "Reverse power from Alex/Apollo", 0));
+	attrs.exciter_power = addLocalAttr(true, new CAttr_status<signals::etypShort>("AIN5", "Forward power from the exciter", 0));
+	attrs.lost_packets = addLocalAttr(true, new CAttr_status<signals::etypLong>("lostPackets", "Receive packets lost since the radio was started", 0));
+
+	// write-only
+	attrs.ptt = addLocalAttr(true, new CAttr_callback<signals::etypBoolean,CHpsdr2Ethernet>
+		(*this, "PTT", "Transmit?", &CHpsdr2Ethernet::setPtt, false));
+	attrs.send_freq = addLocalAttr(true, new CAttr_callback<signals::etypLong,CHpsdr2Ethernet>
+		(*this, "SendFreq", "Transmit Frequency", &CHpsdr2Ethernet::setSendFreq, 0));
+	attrs.send_drive_level = addLocalAttr(true, new CAttr_callback<signals::etypByte,CHpsdr2Ethernet>
+		(*this, "SendDriveLevel", "Drive Level", &CHpsdr2Ethernet::setDriveLevel, 0));
+	attrs.recv_adc_dither = addLocalAttr(true, new CAttr_callback<signals::etypBoolean,CHpsdr2Ethernet>
+		(*this, "RecvAdcDither", "Enable receiver ADC dithering?", &CHpsdr2Ethernet::setDither, false));
+	attrs.recv_adc_random = addLocalAttr(true, new CAttr_callback<signals::etypBoolean,CHpsdr2Ethernet>
+		(*this, "RecvAdcRandom", "Enable receiver ADC random?", &CHpsdr2Ethernet::setRandom, false));
+	attrs.adc_attenuation = addLocalAttr(true, new CAttr_callback<signals::etypByte,CHpsdr2Ethernet>
+		(*this, "AdcAttenuation", "Receiver ADC step attenuation in dB (0-31)", &CHpsdr2Ethernet::setAttenuation, 0));
+	attrs.mic_boost = addLocalAttr(true, new CAttr_callback<signals::etypBoolean,CHpsdr2Ethernet>
+		(*this, "MicBoost", "Boost microphone signal by 20dB?", &CHpsdr2Ethernet::setMicBoost, false));
+	attrs.mic_line_in = addLocalAttr(true, new CAttr_callback<signals::etypBoolean,CHpsdr2Ethernet>
+		(*this, "MicLineIn", "Take microphone samples from the line input?", &CHpsdr2Ethernet::setMicLineIn, false));
+
+	for(byte ddc = 0; ddc < MAX_RECEIVERS; ddc++)
+	{
+		m_receivers[ddc].buildAttrs(*this, ddc);
+	}
+	m_microphone.buildAttrs(*this);
+}
+
+// ------------------------------------------------------------------ class CHpsdr2Ethernet::Receiver
+
+const char* CHpsdr2Ethernet::Receiver::EP_NAME[] = {"recv1", "recv2", "recv3", "recv4", "recv5", "recv6", "recv7", "recv8" };
+const char* CHpsdr2Ethernet::Receiver::EP_DESCR = "Received IQ Samples";
+
+void CHpsdr2Ethernet::Receiver::buildAttrs(CHpsdr2Ethernet& parent, byte ddc)
+{
+	m_parent = &parent;
+	m_ddc = ddc;
+	attrs.sync_fault = addRemoteAttr("syncFault", parent.attrs.sync_fault);
+	attrs.rate = addLocalAttr(true, new CAttr_ddcRate(*this, "rate", "Rate that this receiver sends data", &Receiver::setRate, DEFAULT_RATE * 1000));
+	attrs.freq = addLocalAttr(true, new CAttr_callback<signals::etypLong,Receiver>(*this, "freq", "Frequency", &Receiver::setFreq, 0));
+	attrs.adc = addLocalAttr(true, new CAttr_callback<signals::etypByte,Receiver>(*this, "adc", "ADC this receiver takes its samples from", &Receiver::setAdc, 0));
+	attrs.lost_packets = addLocalAttr(true, new CAttr_status<signals::etypLong>("lostPackets", "Packets lost since the receiver was connected", 0));
+}
+
+void CHpsdr2Ethernet::Receiver::setFreq(const long& newVal)
+{
+	m_parent->setDDCFreq(m_ddc, newVal);
+}
+
+void CHpsdr2Ethernet::Receiver::setRate(const long& newVal)
+{
+	m_parent->setDDCRate(m_ddc, (newVal + 500) / 1000);
+}
+
+void CHpsdr2Ethernet::Receiver::setAdc(const byte& newVal)
+{
+	m_parent->setDDCAdc(m_ddc, newVal);
+}
+
+BOOL CHpsdr2Ethernet::Receiver::Connect(signals::IEPSendTo* send)
+{
+	// Disconnect() arrives here as Connect(NULL)
+	if(!COutEndpointBase::Connect(send)) return false;
+	if(send) m_restart = true;
+	m_parent->enableDDC(m_ddc, send != NULL);
+	return true;
+}
+
+void CHpsdr2Ethernet::Receiver::received(const byte* packet, unsigned size)
+{
+	enum
+	{
+		MAX_SAMPLES = (MAX_IQ_SIZE - IQ_HEADER) / 6,
+		MAX_GAP = 1000				// larger sequence jumps are the radio restarting its count, not lost packets
+	};
+	if(!isConnected() || size < IQ_HEADER) return;
+
+	// bytes 4-11 carry a timestamp we don't use
+	const unsigned seq = readBE32(packet);
+	const unsigned bitsPerSample = readBE16(packet + 12);
+	const unsigned numSamples = readBE16(packet + 14);
+	if(bitsPerSample != 24 || numSamples > MAX_SAMPLES || IQ_HEADER + numSamples * 6 > size) return;
+
+	if(m_restart)
+	{
+		m_restart = false;
+		m_lost = 0;
+		attrs.lost_packets->update(0);
+	}
+	else if(seq != m_lastSeq + 1)
+	{
+		const unsigned gap = seq - m_lastSeq - 1;
+		if(gap < MAX_GAP)
+		{
+			m_lost += gap;
+			attrs.lost_packets->update(m_lost);
+			m_parent->m_lost += gap;
+			m_parent->attrs.lost_packets->update(m_parent->m_lost);
+		}
+		m_parent->attrs.sync_fault->fire();
+	}
+	m_lastSeq = seq;
+
+	std::complex<float> recvBuff[MAX_SAMPLES];
+	const byte* src = packet + IQ_HEADER;
+	for(unsigned idx = 0; idx < numSamples; idx++)
+	{
+		// we shift the 24bit sample by 32bits because it is a signed number
+		signed iReal = (signed(src[0])<<24)|(src[1]<<16)|(src[2]<<8);
+		signed iImag = (signed(src[3])<<24)|(src[4]<<16)|(src[5]<<8);
+		src += 6;
+		recvBuff[idx] = std::complex<float>(iReal * INV_SCALE_32, iImag * INV_SCALE_32);
+	}
+	if(numSamples && Write(signals::etypComplex, recvBuff, numSamples, 0) < numSamples && isConnected())
+	{
+		m_parent->attrs.sync_fault->fire();
+	}
+}
+
+// ------------------------------------------------------------------ class CHpsdr2Ethernet::Microphone
+
+const char* CHpsdr2Ethernet::Microphone::EP_NAME = "mic";
+const char* CHpsdr2Ethernet::Microphone::EP_DESCR = "Microphone audio input";
+
+void CHpsdr2Ethernet::Microphone::buildAttrs(const CHpsdr2Ethernet& parent)
+{
+	attrs.sync_fault = addRemoteAttr("syncFault", parent.attrs.sync_mic_fault);
+	attrs.rate = addLocalAttr(true, new CROAttribute<signals::etypLong>("rate", "Data rate", 48000));
+}
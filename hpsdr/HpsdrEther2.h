@@ -0,0 +1,270 @@
+/*
+	Copyright 2013-2014 Erik Anderson
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+#pragma once
+
+#include <blockImpl.h>
+#include <mt.h>
+#include <WinSock2.h>
+typedef unsigned char byte;
+
+// OpenHPSDR protocol 2
+//
+// Newer boards drop the Metis framing for a set of separate UDP streams: the host configures the radio with four
+// kinds of command packet (general, DDC-specific, DUC-specific and high-priority) sent to four different ports,
+// and each DDC (receiver) then streams its IQ samples from a port of its own at up to 1536 kHz, alongside the
+// microphone and a high-priority status stream.  Everything the radio sends arrives on the one socket and is told
+// apart by the port it came from.
+
+class CHpsdr2Ethernet : public CAttributesBase, public signals::IBlock, protected CRefcountObject
+{
+public:
+	CHpsdr2Ethernet(signals::IBlockDriver* driver, unsigned long ipaddr, __int64 mac, byte ver, byte boardId, byte numDDC);
+	virtual ~CHpsdr2Ethernet();
+
+	enum
+	{
+		// ports on the radio
+		GENERAL_PORT = 1024,		// discovery and general commands, to the radio
+		DDC_CMD_PORT = 1025,		// DDC-specific commands, to the radio
+		DUC_CMD_PORT = 1026,		// DUC-specific commands, to the radio
+		HIGH_PRI_CMD_PORT = 1027,	// high-priority commands, to the radio
+		AUDIO_PORT = 1028,			// speaker audio, to the radio (not yet sent)
+		DUC_IQ_PORT = 1029,			// transmit IQ samples, to the radio (not yet sent)
+		STATUS_PORT = 1025,			// high-priority status, from the radio
+		MIC_PORT = 1026,			// microphone samples, from the radio
+		WIDE_PORT = 1027,			// wideband ADC samples, from the radio (not yet enabled)
+		DDC_IQ_PORT = 1035,			// IQ samples from DDC n come from DDC_IQ_PORT + n
+
+		MAX_RECEIVERS = 8,			// DDCs offered as receivers, boards implement anywhere from 2 up
+		GENERAL_SIZE = 60,
+		DDC_CMD_SIZE = 1444,
+		DUC_CMD_SIZE = 60,
+		HIGH_PRI_CMD_SIZE = 1444,
+		STATUS_SIZE = 60,
+		MIC_SIZE = 132,
+		MIC_SAMPLES = 64,
+		IQ_HEADER = 16,
+		MAX_IQ_SIZE = 1444
+	};
+
+	// the reply to a discovery packet is 60 bytes: a zero sequence number, 2 (idle) or 3 (running) in byte 4,
+	// then the MAC, board type, protocol version, firmware version and (in byte 20) the number of DDCs
+	static void buildDiscovery(byte* message);		// 60 bytes
+	static bool isDiscoveryReply(const byte* message, int size);
+
+public: // IBlock implementation
+	virtual unsigned AddRef()				{ return CRefcountObject::AddRef(); }
+	virtual unsigned Release()				{ return CRefcountObject::Release(); }
+	virtual const char* Name()				{ return NAME; }
+	virtual unsigned NodeId(char* buff, unsigned availChar);
+	virtual signals::IBlockDriver* Driver()	{ return m_driver; }
+	virtual signals::IBlock* Parent()		{ return NULL; }
+	virtual signals::IAttributes* Attributes() { return this; }
+	virtual unsigned Children(signals::IBlock** /* blocks */, unsigned /* availBlocks */) { return 0; }
+	virtual unsigned Incoming(signals::IInEndpoint** /* ep */, unsigned /* availEP */) { return 0; }
+	virtual unsigned Outgoing(signals::IOutEndpoint** ep, unsigned availEP);
+	virtual void Start();
+	virtual void Stop();
+
+public:
+	template<signals::EType ET>
+	class CAttr_status : public CROAttribute<ET>
+	{
+	public:
+		inline CAttr_status(const char* name, const char* descr, typename StoreType<ET>::type deflt)
+			:CROAttribute<ET>(name, descr, deflt) { }
+		inline void update(const typename StoreType<ET>::type& newVal) { this->privateSetValue(newVal); }
+	};
+
+	class Receiver : public CSimpleOutgoingChild<signals::etypComplex, 384000>
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline Receiver():m_parent(NULL),m_ddc(0),m_restart(true),m_lastSeq(0),m_lost(0) { }
+		void buildAttrs(CHpsdr2Ethernet& parent, byte ddc);
+		void received(const byte* packet, unsigned size);	// called from the receive thread
+		inline void restart() { m_restart = true; }
+
+	protected:
+		CHpsdr2Ethernet* m_parent;
+		byte m_ddc;
+		volatile bool m_restart;		// set on connection, the next packet starts a new sequence
+		unsigned m_lastSeq;				// private to the receive thread
+		long m_lost;					// private to the receive thread
+
+		void setFreq(const long& newVal);
+		void setRate(const long& newVal);
+		void setAdc(const byte& newVal);
+
+		struct
+		{
+			CEventAttribute* sync_fault;
+			CAttributeBase* rate;
+			CAttributeBase* freq;
+			CAttributeBase* adc;
+			CAttr_status<signals::etypLong>* lost_packets;
+		} attrs;
+
+	private:
+		const static char* EP_NAME[];
+		const static char* EP_DESCR;
+		Receiver(const Receiver& other);
+		Receiver& operator=(const Receiver& other);
+
+	public: // COutEndpointBase interface
+		virtual const char* EPName()				{ return EP_NAME[m_ddc]; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+		virtual BOOL Connect(signals::IEPSendTo* send);
+	};
+
+	class Microphone : public CSimpleOutgoingChild<signals::etypSingle, 48000>
+	{	// This class is assumed to be a static (non-dynamic) member of its parent
+	public:
+		inline Microphone() { }
+		void buildAttrs(const CHpsdr2Ethernet& parent);
+
+	protected:
+		struct
+		{
+			CEventAttribute* sync_fault;
+			CAttributeBase* rate;
+		} attrs;
+
+	private:
+		const static char* EP_NAME;
+		const static char* EP_DESCR;
+		Microphone(const Microphone& other);
+		Microphone& operator=(const Microphone& other);
+
+	public: // COutEndpointBase interface
+		virtual const char* EPName()				{ return EP_NAME; }
+		virtual const char* EPDescr()				{ return EP_DESCR; }
+	};
+
+private:
+	CHpsdr2Ethernet(const CHpsdr2Ethernet& other);
+	CHpsdr2Ethernet& operator=(const CHpsdr2Ethernet& other);
+
+	static const char* NAME;
+
+	enum
+	{
+		// the command packets, as bits of m_cmdDirty
+		CMD_GENERAL = 0x1,
+		CMD_DDC = 0x2,
+		CMD_DUC = 0x4,
+		CMD_HIGH_PRI = 0x8,
+		CMD_ALL = 0xF,
+
+		REFRESH_MS = 1000,			// everything is resent this often, so a lost command packet is soon repaired
+		DEFAULT_RATE = 192			// kHz
+	};
+
+	struct
+	{
+		// events
+		CEventAttribute* sync_fault;
+		CEventAttribute* sync_mic_fault;
+
+		// read-only
+		CAttributeBase* version;
+		CAttributeBase* num_ddc;
+		CAttr_status<signals::etypBoolean>* ptt_in;
+		CAttr_status<signals::etypBoolean>* recv_overflow;
+		CAttr_status<signals::etypShort>* exciter_power;
+		CAttr_status<signals::etypShort>* forward_power;
+		CAttr_status<signals::etypShort>* reverse_power;
+		CAttr_status<signals::etypLong>* lost_packets;
+
+		// write-only
+		CAttributeBase* ptt;
+		CAttributeBase* send_freq;
+		CAttributeBase* send_drive_level;
+		CAttributeBase* recv_adc_dither;
+		CAttributeBase* recv_adc_random;
+		CAttributeBase* adc_attenuation;
+		CAttributeBase* mic_boost;
+		CAttributeBase* mic_line_in;
+	} attrs;
+
+	void buildAttrs();
+
+	// attribute callbacks, each marks the command packet carrying the value as needing to be resent
+	void setPtt(const unsigned char& newVal);
+	void setSendFreq(const long& newVal);
+	void setDriveLevel(const unsigned char& newVal);
+	void setDither(const unsigned char& newVal);
+	void setRandom(const unsigned char& newVal);
+	void setAttenuation(const unsigned char& newVal);
+	void setMicBoost(const unsigned char& newVal);
+	void setMicLineIn(const unsigned char& newVal);
+	void setDDCFreq(byte ddc, long freq);
+	void setDDCRate(byte ddc, long khz);
+	void setDDCAdc(byte ddc, byte adc);
+	void enableDDC(byte ddc, bool enable);
+	void changed(unsigned cmd);
+
+	SOCKET buildSocket() const;
+	void sendCommands(unsigned cmds, Locker& lock);
+	void sendTo(unsigned short port, const byte* packet, unsigned size);
+	void buildGeneral(byte* packet);
+	void buildDDC(byte* packet);
+	void buildDUC(byte* packet);
+	void buildHighPriority(byte* packet);
+
+	void thread_recv();
+	void thread_cmd();
+	void receive_status(const byte* packet, unsigned size);
+	void receive_mic(const byte* packet, unsigned size);
+
+	const unsigned long	m_ipAddress;
+	const __int64		m_macAddress;
+	const byte			m_controllerVersion;
+	const byte			m_boardId;
+	const byte			m_numDDC;
+	signals::IBlockDriver* m_driver;
+
+	struct
+	{	// protected by m_cmdLock, what the command packets tell the radio
+		bool run;
+		bool ptt;
+		long sendFreq;
+		byte driveLevel;
+		bool dither;
+		bool random;
+		byte attenuation;
+		bool micBoost;
+		bool micLineIn;
+		unsigned ddcEnabled;		// bit n streams DDC n
+		long ddcFreq[MAX_RECEIVERS];
+		long ddcRate[MAX_RECEIVERS];	// kHz
+		byte ddcAdc[MAX_RECEIVERS];
+	} m_cmd;
+	unsigned m_cmdSeq[4];			// protected by m_cmdLock, per command port
+	unsigned m_cmdDirty;			// protected by m_cmdLock, CMD_* packets waiting to be sent
+	bool m_cmdThreadEnabled;		// protected by m_cmdLock
+	Condition m_cmdChanged;			// protected by m_cmdLock
+	Lock m_cmdLock;
+
+	Thread<> m_recvThread, m_cmdThread;
+	SOCKET m_sock;
+	volatile bool m_running;
+	bool m_micStarting;				// private to the receive thread
+	unsigned m_lastMicSeq;			// private to the receive thread
+	long m_lost;					// private to the receive thread
+
+	Receiver m_receivers[MAX_RECEIVERS];
+	Microphone m_microphone;
+};
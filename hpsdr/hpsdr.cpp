@@ -18,6 +18,7 @@
 
 #include "stdafx.h"
 #include "HpsdrEther.h"
+#include "HpsdrEther2.h"
 #include <iostream>
 
 static Lock st_screenLock;
@@ -73,6 +74,7 @@ protected:
 		case signals::etypVecInt64:
 		case signals::etypVecSingle:
 		case signals::etypVecDouble:
+		case signals::etypVecComplexShort:
 		case signals::etypVecComplex:
 		case signals::etypVecCmplDbl:
 		case signals::etypVecLRSingle:
@@ -153,6 +155,17 @@ protected:
 					}
 					accum += ']';
 					break;
+				case signals::etypVecComplexShort:
+					accum = "(complex-short)[";
+					for(idx=0; idx < size; idx++)
+					{
+						if(idx) accum += ", ";
+						const std::complex<short>& pComplex = ((std::complex<short>*)dat)[idx];
+						sprintf_s(buffer, _countof(buffer), "<real: %d, imag: %d>", (int)pComplex.real(), (int)pComplex.imag());
+						accum += buffer;
+					}
+					accum += ']';
+					break;
 				case signals::etypVecComplex:
 					accum = "(complex-single)[";
 					for(idx=0; idx < size; idx++)
@@ -216,6 +229,12 @@ protected:
 			break;
 		case signals::etypString:
 			return std::string("(string)") + (char*)value;
+		case signals::etypComplexShort:
+			{
+				std::complex<short>* pComplex = (std::complex<short>*)value;
+				sprintf_s(buffer, _countof(buffer), "(complex-short) <real: %d, imag: %d>", (int)pComplex->real(), (int)pComplex->imag());
+				break;
+			}
 		case signals::etypComplex:
 			{
 				std::complex<float>* pComplex = (std::complex<float>*)value;
@@ -287,10 +306,1343 @@ private:
 
 static CHpsdrEthernetDriver DRIVER_HpsdrEthernet;
 
+// ------------------------------------------------------------------ transmit benchmark
+
+class CLoopbackCounter
+{	// counts the packets arriving on a loopback socket
+public:
+	CLoopbackCounter(SOCKET sock)
+		:m_sock(sock),m_bThreadOkay(true),m_received(0),m_thread(Thread<>::delegate_type(this, &CLoopbackCounter::start))
+	{
+		m_thread.launch(THREAD_PRIORITY_ABOVE_NORMAL);
+	}
+
+	~CLoopbackCounter()
+	{
+		m_bThreadOkay = false;
+		m_thread.close();
+	}
+
+	volatile unsigned m_received;
+
+private:
+	SOCKET m_sock;
+	volatile bool m_bThreadOkay;
+	Thread<> m_thread;
+
+	void start()
+	{
+		char packet[CSendBatch::PACKET_SIZE];
+		while(m_bThreadOkay)
+		{
+			if(::recv(m_sock, packet, sizeof(packet), 0) > 0) m_received++;
+		}
+	}
+};
+
+static double threadSeconds()
+{
+	FILETIME created, exited, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user);
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return (k.QuadPart + u.QuadPart) / 1e7;
+}
+
+static int benchTransmit()
+{
+	enum { NUM_PACKETS = 200000 };
+
+	// a connected pair of sockets on loopback stands in for the radio
+	SOCKET recvSock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.S_un.S_addr = htonl(INADDR_LOOPBACK);
+	int addrLen = sizeof(addr);
+	int rcvBuf = 8 * 1024 * 1024;
+	DWORD timeout = 100;
+	::setsockopt(recvSock, SOL_SOCKET, SO_RCVBUF, (const char*)&rcvBuf, sizeof(rcvBuf));
+	::setsockopt(recvSock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+	if(::bind(recvSock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR
+		|| ::getsockname(recvSock, (sockaddr*)&addr, &addrLen) == SOCKET_ERROR)
+	{
+		std::cout << "could not open loopback socket" << std::endl;
+		closesocket(recvSock);
+		return 1;
+	}
+	SOCKET sendSock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	::connect(sendSock, (sockaddr*)&addr, sizeof(addr));
+
+	// a tone to encode, so the conversion isn't working on zeros
+	std::complex<float> tone[CHpsdrDevice::FRAME_SAMPLES];
+	for(unsigned idx = 0; idx < CHpsdrDevice::FRAME_SAMPLES; idx++)
+	{
+		tone[idx] = std::polar(0.5f, idx * 0.1f);
+	}
+
+	CSendBatch batch;
+	batch.attach(sendSock);
+	static const unsigned batchSizes[] = { 1, 2, 5, CSendBatch::MAX_BATCH };
+	for(unsigned size = 0; size < _countof(batchSizes); size++)
+	{
+		const unsigned batchSize = batchSizes[size];
+		CLoopbackCounter counter(recvSock);
+		LARGE_INTEGER start, now, freq;
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&start);
+		const double startCpu = threadSeconds();
+		for(unsigned sent = 0; sent < NUM_PACKETS; sent += batchSize)
+		{
+			for(unsigned idx = 0; idx < batchSize; idx++)
+			{
+				std::complex<float> aud[CHpsdrDevice::FRAME_SAMPLES], iq[CHpsdrDevice::FRAME_SAMPLES];
+				byte* message = batch.next();
+				memcpy(aud, tone, sizeof(aud));
+				memcpy(iq, tone, sizeof(iq));
+				CHpsdrDevice::encode_samples(aud, _countof(aud), iq, _countof(iq), message + 16);
+				memcpy(aud, tone, sizeof(aud));
+				memcpy(iq, tone, sizeof(iq));
+				CHpsdrDevice::encode_samples(aud, _countof(aud), iq, _countof(iq), message + 528);
+			}
+			batch.flush();
+		}
+		const double cpu = threadSeconds() - startCpu;
+		QueryPerformanceCounter(&now);
+		const double wall = double(now.QuadPart - start.QuadPart) / freq.QuadPart;
+		Sleep(200);
+
+		printf("batch %2u: %9.0f packets/s, %6.2f us cpu/packet, %u of %u received\n", batchSize,
+			NUM_PACKETS / wall, cpu * 1e6 / NUM_PACKETS, (unsigned)counter.m_received, (unsigned)NUM_PACKETS);
+	}
+
+	closesocket(sendSock);
+	closesocket(recvSock);
+	return 0;
+}
+
+// ------------------------------------------------------------------ transmit pacing simulation
+
+class CRadioClock
+{	// delivers receive packets to a pacer as a radio with a fast clock would, late by up to a few ms and some lost
+public:
+	enum { PACKET_SAMPLES = 2 * CHpsdrDevice::FRAME_SAMPLES };	// 48k samples in each receive packet
+
+	CRadioClock(CSendPacer& pacer, double ppm, double jitterMs, double loss)
+		:m_pacer(pacer),m_rate(48000.0 * (1.0 + ppm * 1e-6)),m_jitter(jitterMs / 1000.0),m_loss(loss),
+		 m_bThreadOkay(true),m_packets(0),m_thread(Thread<>::delegate_type(this, &CRadioClock::start))
+	{
+		m_thread.launch(THREAD_PRIORITY_TIME_CRITICAL);
+	}
+
+	~CRadioClock()
+	{
+		m_bThreadOkay = false;
+		m_thread.close();
+	}
+
+	volatile unsigned m_packets;		// sent by the radio, lost or not
+
+private:
+	CSendPacer& m_pacer;
+	const double m_rate;
+	const double m_jitter;
+	const double m_loss;
+	volatile bool m_bThreadOkay;
+	Thread<> m_thread;
+
+	void start()
+	{
+		LARGE_INTEGER freq, begin, now;
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&begin);
+		unsigned seed = 1;
+		for(unsigned seq = 1; m_bThreadOkay; seq++)
+		{
+			seed = seed * 1103515245 + 12345;
+			const double delay = m_jitter * ((seed >> 16) & 0x7FFF) / 32768.0;
+			seed = seed * 1103515245 + 12345;
+			const bool lost = ((seed >> 16) & 0x7FFF) < m_loss * 32768.0;
+
+			// sleep most of the way there and spin the rest, Sleep alone is too coarse to jitter by fractions of ms
+			const double arrival = seq * PACKET_SAMPLES / m_rate + delay;
+			for(;;)
+			{
+				QueryPerformanceCounter(&now);
+				const double remain = arrival - double(now.QuadPart - begin.QuadPart) / freq.QuadPart;
+				if(remain <= 0.0) break;
+				if(remain > 0.002) Sleep(1);
+				else YieldProcessor();
+			}
+			if(!lost) m_pacer.received(seq, PACKET_SAMPLES);
+			m_packets = seq;
+		}
+	}
+};
+
+static int simulatePacing()
+{
+	enum { RUN_SECONDS = 15, MAX_LAG = 10, SEND_SAMPLES = 2 * CHpsdrDevice::FRAME_SAMPLES };
+	static const double DRIFT_PPM = 50.0;
+	static const double JITTER_MS = 3.0;
+	static const double LOSS = 0.01;
+	timeBeginPeriod(1);
+
+	// this thread plays the send thread, sending whatever the pacer says is due
+	CSendPacer pacer(MAX_LAG);
+	unsigned sent = 0, radioPackets;
+	{
+		CRadioClock radio(pacer, DRIFT_PPM, JITTER_MS, LOSS);
+		const DWORD start = GetTickCount();
+		while(GetTickCount() - start < RUN_SECONDS * 1000)
+		{
+			DWORD waitMs;
+			const unsigned numDue = pacer.due(waitMs);
+			sent += numDue;
+			if(!numDue) Sleep(waitMs);
+		}
+		radioPackets = radio.m_packets;
+	}
+	timeEndPeriod(1);
+
+	// the radio's receive and transmit packets both carry 126 samples at 48k, so we should have kept pace packet
+	// for packet, give or take the first packet's jitter and the one in flight at either end
+	const float drift = pacer.drift();
+	const bool driftGood = fabs(drift - DRIFT_PPM) < 10.0;
+	printf("%s: clock drift settled to %.1f ppm against %.0f ppm with %.0f ms jitter and %.0f%% loss\n",
+		driftGood ? "pass" : "FAIL", drift, DRIFT_PPM, JITTER_MS, LOSS * 100);
+	const int behind = int(radioPackets * (unsigned)CRadioClock::PACKET_SAMPLES / SEND_SAMPLES) - int(sent);
+	const bool countGood = behind >= -3 && behind <= 3;
+	printf("%s: %u packets sent for %u received, packets went out %.2f ms behind schedule\n",
+		countGood ? "pass" : "FAIL", sent, radioPackets, pacer.lateness());
+	return driftGood && countGood ? 0 : 1;
+}
+
+// ------------------------------------------------------------------ receiver list stress test
+
+class CStressDevice : public CHpsdrEthernet
+{	// a device that is never started, with frames fed to it directly
+public:
+	inline CStressDevice():CHpsdrEthernet(NULL, 0, 0, 0, Hermes) { }
+	inline unsigned feed(byte* frame) { return receive_frame(frame); }
+	inline void flush() { flush_receivers(); }
+	inline unsigned attached() const { return numReceivers(); }
+};
+
+static void noiseFrame(byte* frame, unsigned size)
+{
+	// a frame of noise behind the sync bytes, with the C&C bytes left at zero
+	unsigned seed = 1;
+	for(unsigned idx = 0; idx < size; idx++)
+	{
+		seed = seed * 1103515245 + 12345;
+		frame[idx] = byte(seed >> 16);
+	}
+	frame[0] = frame[1] = frame[2] = 0x7F;		// sync
+	memset(frame + 3, 0, 5);
+}
+
+class CReceiverToggler
+{	// connects and disconnects receivers in random order as fast as it can, emptying their buffers as it goes
+public:
+	enum { NUM_RECEIVERS = 4 };
+
+	CReceiverToggler(signals::IOutEndpoint** recv, signals::IEPBuffer** buff)
+		:m_recv(recv),m_buff(buff),m_bThreadOkay(true),m_toggles(0),m_thread(Thread<>::delegate_type(this, &CReceiverToggler::start))
+	{
+		memset(m_connected, 0, sizeof(m_connected));
+		m_thread.launch();
+	}
+
+	~CReceiverToggler()
+	{
+		m_bThreadOkay = false;
+		m_thread.close();
+		for(unsigned idx = 0; idx < NUM_RECEIVERS; idx++)
+		{
+			if(m_connected[idx]) m_recv[idx]->Disconnect();
+		}
+	}
+
+	volatile unsigned m_toggles;
+
+private:
+	signals::IOutEndpoint** m_recv;
+	signals::IEPBuffer** m_buff;
+	bool m_connected[NUM_RECEIVERS];
+	volatile bool m_bThreadOkay;
+	Thread<> m_thread;
+
+	void start()
+	{
+		unsigned seed = 12345;
+		std::complex<float> scratch[1000];
+		while(m_bThreadOkay)
+		{
+			seed = seed * 1103515245 + 12345;
+			const unsigned idx = (seed >> 16) % NUM_RECEIVERS;
+			if(m_connected[idx])
+			{
+				m_recv[idx]->Disconnect();
+			} else {
+				m_recv[idx]->Connect(m_buff[idx]);
+			}
+			m_connected[idx] = !m_connected[idx];
+			m_toggles++;
+
+			for(unsigned recv = 0; recv < NUM_RECEIVERS; recv++)
+			{
+				while(m_buff[recv]->Read(signals::etypComplex, scratch, _countof(scratch), FALSE, 0) == _countof(scratch));
+			}
+		}
+	}
+};
+
+static int stressReceivers()
+{
+	enum { RUN_SECONDS = 10, STALL_US = 1000 };
+
+	CStressDevice* dev = new CStressDevice;
+	dev->AddRef();
+	signals::IOutEndpoint* outEPs[6];
+	VERIFY(dev->Outgoing(outEPs, _countof(outEPs)) == _countof(outEPs));
+	signals::IOutEndpoint** recv = outEPs + 2;
+	signals::IEPBuffer* buff[CReceiverToggler::NUM_RECEIVERS];
+	for(unsigned idx = 0; idx < CReceiverToggler::NUM_RECEIVERS; idx++) buff[idx] = recv[idx]->CreateBuffer();
+
+	byte frame[512];
+	noiseFrame(frame, sizeof(frame));
+
+	LARGE_INTEGER freq, start, before, after;
+	QueryPerformanceFrequency(&freq);
+	const LONGLONG stallTicks = freq.QuadPart * STALL_US / 1000000;
+	LONGLONG worst = 0;
+	unsigned numFrames = 0, numSamples = 0, numStalls = 0, numToggles;
+	{
+		CReceiverToggler toggler(recv, buff);
+		QueryPerformanceCounter(&start);
+		after = start;
+		while(after.QuadPart - start.QuadPart < RUN_SECONDS * freq.QuadPart)
+		{
+			QueryPerformanceCounter(&before);
+			numSamples += dev->feed(frame);
+			QueryPerformanceCounter(&after);
+			const LONGLONG elapsed = after.QuadPart - before.QuadPart;
+			worst = max(worst, elapsed);
+			if(elapsed > stallTicks) numStalls++;
+			numFrames++;
+		}
+		numToggles = toggler.m_toggles;
+	}
+
+	printf("%u frames (%u samples) decoded against %u receiver changes\n", numFrames, numSamples, numToggles);
+	printf("slowest frame %.1f us, %u frames over %u us\n", worst * 1e6 / freq.QuadPart, numStalls, (unsigned)STALL_US);
+
+	// every receiver the toggler left connected has been disconnected, and either way of disconnecting detaches
+	bool attachGood = dev->attached() == 0;
+	for(unsigned idx = 0; idx < CReceiverToggler::NUM_RECEIVERS; idx++) recv[idx]->Connect(buff[idx]);
+	attachGood = attachGood && dev->attached() == CReceiverToggler::NUM_RECEIVERS;
+	recv[0]->Connect(NULL);
+	attachGood = attachGood && dev->attached() == CReceiverToggler::NUM_RECEIVERS - 1;
+	for(unsigned idx = 1; idx < CReceiverToggler::NUM_RECEIVERS; idx++) recv[idx]->Disconnect();
+	attachGood = attachGood && dev->attached() == 0;
+	printf("%s: receivers detached on disconnect\n", attachGood ? "pass" : "FAIL");
+
+	for(unsigned idx = 0; idx < CReceiverToggler::NUM_RECEIVERS; idx++) buff[idx]->Release();
+	VERIFY(!dev->Release());
+	return numSamples && attachGood ? 0 : 1;
+}
+
+// ------------------------------------------------------------------ jitter buffer simulation
+
+class CTestJitter : public CJitterIncomingChild<signals::etypComplex>
+{	// a transmitter's jitter buffer, without the radio behind it
+public:
+	inline CTestJitter(signals::IBlock* parent, unsigned rate, long msTarget)
+		:CJitterIncomingChild(parent, rate, msTarget)
+	{
+		buildJitterAttrs();
+	}
+	virtual const char* EPName()	{ return "test"; }
+	virtual const char* EPDescr()	{ return "jitter buffer test input"; }
+
+	inline const void* stat(const char* name) { return GetByName(name)->getValue(); }
+};
+
+static int simulateJitter()
+{
+	// runs in simulated time: the radio asks for a frame's worth every 63 samples, and before each request the
+	// producer delivers every block that would have arrived by then
+	enum { RATE = 48000, TARGET_MS = 50, BLOCK = 1024, RUN_SECONDS = 120, SETTLE_SECONDS = 30 };
+	static const double PRODUCER_PPM = 200.0;
+	static const double JITTER_MS = 10.0;
+	static const double TONE_HZ = 1000.0;
+	static const float AMPLITUDE = 0.5f;
+
+	CStressDevice* dev = new CStressDevice;
+	dev->AddRef();
+	signals::IEPBuffer* buff = new CEPBuffer<signals::etypComplex>(16 * BLOCK);
+	buff->AddRef(NULL);
+
+	bool good;
+	{
+		CTestJitter jitter(dev, RATE, TARGET_MS);
+		jitter.Connect(buff);
+
+		const double producerRate = RATE * (1.0 + PRODUCER_PPM * 1e-6);
+		std::complex<float> block[BLOCK];
+		std::complex<float> frame[CHpsdrDevice::FRAME_SAMPLES];
+		unsigned seed = 1;
+		unsigned numBlocks = 0;
+		double arrival = 0.0;			// of the next block
+		float minLatency = 1e9f, maxLatency = 0.0f;
+		float worstError = 0.0f;
+		unsigned numTicks = 0;
+		for(;;)
+		{
+			const double now = double(numTicks) * CHpsdrDevice::FRAME_SAMPLES / RATE;
+			if(now >= RUN_SECONDS) break;
+			while(arrival <= now)
+			{
+				for(unsigned idx = 0; idx < BLOCK; idx++)
+				{
+					const double cycles = TONE_HZ * (numBlocks * BLOCK + idx) / producerRate;
+					block[idx] = std::polar(AMPLITUDE, float(2.0 * 3.14159265358979 * (cycles - floor(cycles))));
+				}
+				VERIFY(buff->Write(signals::etypComplex, block, BLOCK, 0) == BLOCK);
+				numBlocks++;
+
+				// blocks are sent on the producer's clock and held up by up to JITTER_MS, but never reordered
+				seed = seed * 1103515245 + 12345;
+				const double delay = JITTER_MS / 1000.0 * ((seed >> 16) & 0x7FFF) / 32768.0;
+				arrival = max(arrival, numBlocks * BLOCK / producerRate + delay);
+			}
+
+			const unsigned numReal = jitter.ReadPaced(frame, _countof(frame));
+			numTicks++;
+			if(now < SETTLE_SECONDS) continue;
+			for(unsigned idx = 0; idx < numReal; idx++)
+			{
+				worstError = max(worstError, fabs(std::abs(frame[idx]) - AMPLITUDE));
+			}
+			const float latency = *(const float*)jitter.stat("latency");
+			minLatency = min(minLatency, latency);
+			maxLatency = max(maxLatency, latency);
+		}
+
+		const long underruns = *(const long*)jitter.stat("underruns");
+		const long overruns = *(const long*)jitter.stat("overruns");
+		const bool fillGood = minLatency >= TARGET_MS * 0.95f && maxLatency <= TARGET_MS * 1.05f;
+		printf("%s: fill held at %.1f to %.1f ms against a %u ms target (producer %.0f ppm fast, %.0f ms jitter)\n",
+			fillGood ? "pass" : "FAIL", minLatency, maxLatency, (unsigned)TARGET_MS, PRODUCER_PPM, JITTER_MS);
+		const bool runGood = !underruns && !overruns;
+		printf("%s: %ld underruns, %ld overruns in %u seconds\n", runGood ? "pass" : "FAIL", underruns, overruns,
+			(unsigned)RUN_SECONDS);
+		const bool toneGood = worstError < 1e-3f;
+		printf("%s: tone magnitude within %.2g of %.1f through the interpolator\n", toneGood ? "pass" : "FAIL",
+			worstError, AMPLITUDE);
+		good = fillGood && runGood && toneGood;
+
+		jitter.Disconnect();
+	}
+
+	buff->Release(NULL);
+	VERIFY(!dev->Release());
+	return good ? 0 : 1;
+}
+
+// ------------------------------------------------------------------ reconnection during a blocked read
+
+class CTestIncoming : public CSimpleIncomingChild
+{	// a consumer's input endpoint, without a block of its own
+public:
+	inline CTestIncoming(signals::IBlock* parent):CSimpleIncomingChild(signals::etypComplex, parent) { }
+	virtual const char* EPName()	{ return "test"; }
+	virtual const char* EPDescr()	{ return "reconnection test input"; }
+};
+
+class CBlockedReader
+{	// sits in a single read of an empty buffer until it times out
+public:
+	enum { TIMEOUT_MS = 1000 };
+
+	CBlockedReader(CInEndpointBase* in)
+		:m_in(in),m_numRead(0),m_thread(Thread<>::delegate_type(this, &CBlockedReader::start))
+	{
+		m_thread.launch();
+	}
+
+	unsigned wait()
+	{
+		m_thread.close();
+		return m_numRead;
+	}
+
+private:
+	CInEndpointBase* m_in;
+	unsigned m_numRead;
+	Thread<> m_thread;
+
+	void start()
+	{
+		std::complex<float> buffer[100];
+		m_numRead = m_in->Read(signals::etypComplex, buffer, _countof(buffer), FALSE, TIMEOUT_MS);
+	}
+};
+
+static int testReconnect()
+{
+	enum { SETTLE_MS = 100 };
+
+	CStressDevice* dev = new CStressDevice;
+	dev->AddRef();
+	signals::IOutEndpoint* outEPs[6];
+	VERIFY(dev->Outgoing(outEPs, _countof(outEPs)) == _countof(outEPs));
+	signals::IOutEndpoint* recv = outEPs[2];
+	signals::IEPBuffer* buff = recv->CreateBuffer();
+	recv->Connect(buff);
+
+	bool failed = false;
+	{
+		CTestIncoming in(dev);
+		in.Connect(buff);
+
+		// the buffer is disconnected and connected again while a read is still waiting on it
+		CBlockedReader reader(&in);
+		Sleep(SETTLE_MS);
+		in.Disconnect();
+		in.Connect(buff);
+		recv->Disconnect();
+		recv->Connect(buff);
+		unsigned numStale = reader.wait();		// the read times out and its connection is retired
+
+		bool attachGood = buff->InputAttributes() != NULL;
+		printf("%s: buffer still attached after the blocked read ended\n", attachGood ? "pass" : "FAIL");
+
+		byte frame[512];
+		noiseFrame(frame, sizeof(frame));
+		unsigned numFed = dev->feed(frame);
+		dev->flush();
+		std::complex<float> buffer[1000];
+		unsigned numRead = in.Read(signals::etypComplex, buffer, _countof(buffer), FALSE, SETTLE_MS);
+		bool flowGood = !numStale && numFed && numRead == numFed;
+		printf("%s: %u of %u samples read through the reconnected buffer\n", flowGood ? "pass" : "FAIL", numRead, numFed);
+
+		in.Disconnect();
+		bool detachGood = buff->InputAttributes() == NULL;
+		printf("%s: buffer detached on disconnect\n", detachGood ? "pass" : "FAIL");
+
+		// a read blocked on a buffer its owner lets go of keeps the buffer alive until it returns (the debug heap
+		// catches it if not)
+		in.Connect(buff);
+		signals::IEPBuffer* other = recv->CreateBuffer();
+		{
+			CBlockedReader lateReader(&in);
+			Sleep(SETTLE_MS);
+			in.Connect(other);
+			recv->Connect(other);
+			buff->Release();
+			buff = other;
+			numStale = lateReader.wait();
+		}
+		bool switchGood = !numStale && other->InputAttributes() != NULL;
+		printf("%s: blocked read outlived the buffer's last owner\n", switchGood ? "pass" : "FAIL");
+		in.Disconnect();
+		failed = !attachGood || !flowGood || !detachGood || !switchGood;
+	}
+
+	recv->Disconnect();
+	buff->Release();
+	VERIFY(!dev->Release());
+	return failed ? 1 : 0;
+}
+
+// ------------------------------------------------------------------ receive batching benchmark
+
+class CSampleCounter
+{	// reads a receiver's buffer as a consumer would, counting what it took to empty it
+public:
+	CSampleCounter(signals::IEPReceiver* buff)
+		:m_buff(buff),m_bThreadOkay(true),m_samples(0),m_reads(0),m_cpu(0.0),m_thread(Thread<>::delegate_type(this, &CSampleCounter::start))
+	{
+		m_thread.launch(THREAD_PRIORITY_ABOVE_NORMAL);
+	}
+
+	~CSampleCounter()
+	{
+		if(m_bThreadOkay) stop();
+	}
+
+	double stop()
+	{
+		// returns the cpu seconds spent reading
+		m_bThreadOkay = false;
+		m_thread.close();
+		return m_cpu;
+	}
+
+	volatile unsigned m_samples;
+	volatile unsigned m_reads;
+
+private:
+	signals::IEPReceiver* m_buff;
+	volatile bool m_bThreadOkay;
+	double m_cpu;
+	Thread<> m_thread;
+
+	void start()
+	{
+		std::complex<float> buffer[10000];
+		while(m_bThreadOkay)
+		{
+			unsigned numRead = m_buff->Read(signals::etypComplex, buffer, _countof(buffer), FALSE, 100);
+			if(numRead)
+			{
+				m_samples += numRead;
+				m_reads++;
+			}
+		}
+		m_cpu = threadSeconds();
+	}
+};
+
+static int benchBatching()
+{
+	enum { NUM_FRAMES = 200000, NUM_RECEIVERS = 4 };
+
+	CStressDevice* dev = new CStressDevice;
+	dev->AddRef();
+	signals::IOutEndpoint* outEPs[6];
+	VERIFY(dev->Outgoing(outEPs, _countof(outEPs)) == _countof(outEPs));
+	signals::IOutEndpoint** recv = outEPs + 2;
+	signals::IEPBuffer* buff[NUM_RECEIVERS];
+	for(unsigned idx = 0; idx < NUM_RECEIVERS; idx++)
+	{
+		buff[idx] = recv[idx]->CreateBuffer();
+		recv[idx]->Connect(buff[idx]);
+
+		// let the batch size alone decide when samples are sent on
+		long latency = 1000;
+		recv[idx]->Attributes()->GetByName("batchLatency")->setValue(&latency);
+	}
+
+	byte frame[512];
+	noiseFrame(frame, sizeof(frame));
+
+	const long rate = *(const long*)dev->Attributes()->GetByName("recvRate")->getValue();
+
+	static const long batchSizes[] = { 1, 16, 64, 256, 1024, 4096 };
+	for(unsigned size = 0; size < _countof(batchSizes); size++)
+	{
+		const long batchSize = batchSizes[size];
+		for(unsigned idx = 0; idx < NUM_RECEIVERS; idx++)
+		{
+			recv[idx]->Attributes()->GetByName("batchSize")->setValue(&batchSize);
+		}
+
+		unsigned numSamples = 0, numReads = 0, numReceived = 0;
+		double decodeCpu, readCpu = 0.0;
+		{
+			CSampleCounter* counters[NUM_RECEIVERS];
+			for(unsigned idx = 0; idx < NUM_RECEIVERS; idx++) counters[idx] = new CSampleCounter(buff[idx]);
+
+			const double startCpu = threadSeconds();
+			for(unsigned idx = 0; idx < NUM_FRAMES; idx++)
+			{
+				numSamples += dev->feed(frame);
+			}
+			dev->flush();
+			decodeCpu = threadSeconds() - startCpu;
+			Sleep(200);
+
+			for(unsigned idx = 0; idx < NUM_RECEIVERS; idx++)
+			{
+				readCpu += counters[idx]->stop();
+				numReceived += counters[idx]->m_samples;
+				numReads += counters[idx]->m_reads;
+				delete counters[idx];
+			}
+		}
+
+		printf("batch %4ld: %6.2f us decode + %6.2f us read cpu/frame, %7u reads, %6.2f ms staged at most, %u of %u samples\n",
+			batchSize, decodeCpu * 1e6 / NUM_FRAMES, readCpu * 1e6 / NUM_FRAMES, numReads, double(batchSize) * 1000.0 / rate,
+			numReceived, numSamples * NUM_RECEIVERS);
+	}
+
+	// samples staged before a receiver is reconnected belong to the old connection and mustn't reach the new one,
+	// whether the stream goes quiet (flushing them) or carries on (staging more)
+	enum { STAGED_FRAMES = 10 };
+	signals::IEPBuffer* fresh = recv[0]->CreateBuffer();
+	for(unsigned idx = 0; idx < STAGED_FRAMES; idx++) dev->feed(frame);
+	recv[0]->Disconnect();
+	recv[0]->Connect(fresh);
+	dev->flush();
+	const unsigned numStale = fresh->Used();
+
+	for(unsigned idx = 0; idx < STAGED_FRAMES; idx++) dev->feed(frame);
+	recv[0]->Disconnect();
+	recv[0]->Connect(fresh);
+	unsigned numFed = 0;
+	for(unsigned idx = 0; idx < STAGED_FRAMES; idx++) numFed += dev->feed(frame);
+	dev->flush();
+	const unsigned numDelivered = fresh->Used();
+
+	const bool restageGood = !numStale && numDelivered == numFed;
+	printf("%s: %u stale samples flushed and %u of %u delivered after reconnecting\n", restageGood ? "pass" : "FAIL",
+		numStale, numDelivered, numFed);
+	recv[0]->Connect(buff[0]);
+	fresh->Release();
+
+	for(unsigned idx = 0; idx < NUM_RECEIVERS; idx++)
+	{
+		recv[idx]->Disconnect();
+		buff[idx]->Release();
+	}
+	VERIFY(!dev->Release());
+	return restageGood ? 0 : 1;
+}
+
+// ------------------------------------------------------------------ protocol 2 loopback simulation
+
+static unsigned simBE16(const byte* src)	{ return (src[0]<<8)|src[1]; }
+static unsigned simBE32(const byte* src)	{ return (src[0]<<24)|(src[1]<<16)|(src[2]<<8)|src[3]; }
+static void simWriteBE16(byte* dest, unsigned val)	{ dest[0] = byte(val>>8); dest[1] = byte(val); }
+static void simWriteBE32(byte* dest, unsigned val)	{ simWriteBE16(dest, val>>16); simWriteBE16(dest+2, val); }
+
+class CProtocol2Simulator
+{	// a protocol 2 radio on 127.0.0.1: answers discovery, follows the command packets and streams noise from
+	// every enabled DDC at its configured rate, leaving out one packet in DROP_EVERY from the first DDC
+public:
+	enum
+	{
+		NUM_DDC = 4,
+		IQ_SAMPLES = 238,
+		DROP_EVERY = 1000,
+		STATUS_MS = 100
+	};
+
+	struct DDC
+	{
+		bool enabled;
+		bool active;				// streaming, with start the time it began
+		long rateKhz;
+		long freq;
+		__int64 start;
+		__int64 owed;				// samples streamed (or dropped) since start
+		unsigned seq;
+		__int64 delivered;			// samples actually sent
+		unsigned dropped;			// packets left out
+	};
+
+	CProtocol2Simulator()
+		:m_bThreadOkay(true),m_running(false),m_hostKnown(false),m_phaseWords(false),m_numCommands(0),
+		 m_cmdThread(Thread<>::delegate_type(this, &CProtocol2Simulator::thread_cmd)),
+		 m_streamThread(Thread<>::delegate_type(this, &CProtocol2Simulator::thread_stream))
+	{
+		memset(m_ddc, 0, sizeof(m_ddc));
+		memset(&m_host, 0, sizeof(m_host));
+		m_sockGeneral = open(CHpsdr2Ethernet::GENERAL_PORT);
+		m_sockDDC = open(CHpsdr2Ethernet::DDC_CMD_PORT);
+		m_sockDUC = open(CHpsdr2Ethernet::DUC_CMD_PORT);
+		m_sockHighPri = open(CHpsdr2Ethernet::HIGH_PRI_CMD_PORT);
+		for(unsigned ddc = 0; ddc < NUM_DDC; ddc++) m_sockIQ[ddc] = open((unsigned short)(CHpsdr2Ethernet::DDC_IQ_PORT + ddc));
+		QueryPerformanceFrequency(&m_freq);
+		m_cmdThread.launch(THREAD_PRIORITY_ABOVE_NORMAL);
+		m_streamThread.launch(THREAD_PRIORITY_TIME_CRITICAL);
+	}
+
+	~CProtocol2Simulator()
+	{
+		m_bThreadOkay = false;
+		m_cmdThread.close();
+		m_streamThread.close();
+		closesocket(m_sockGeneral);
+		closesocket(m_sockDDC);
+		closesocket(m_sockDUC);
+		closesocket(m_sockHighPri);
+		for(unsigned ddc = 0; ddc < NUM_DDC; ddc++) closesocket(m_sockIQ[ddc]);
+	}
+
+	inline bool good() const
+	{
+		return m_sockGeneral != INVALID_SOCKET && m_sockDDC != INVALID_SOCKET && m_sockDUC != INVALID_SOCKET
+			&& m_sockHighPri != INVALID_SOCKET && m_sockIQ[NUM_DDC-1] != INVALID_SOCKET;
+	}
+
+	inline DDC ddc(unsigned idx)
+	{
+		Locker lock(m_lock);
+		return m_ddc[idx];
+	}
+
+	inline unsigned numCommands()
+	{
+		Locker lock(m_lock);
+		return m_numCommands;
+	}
+
+private:
+	Lock m_lock;
+	volatile bool m_bThreadOkay;
+	bool m_running;					// protected by m_lock
+	bool m_hostKnown;				// protected by m_lock
+	bool m_phaseWords;				// protected by m_lock, general byte 37 bit 3
+	sockaddr_in m_host;				// protected by m_lock
+	unsigned m_numCommands;			// protected by m_lock
+	DDC m_ddc[NUM_DDC];				// protected by m_lock
+	SOCKET m_sockGeneral, m_sockDDC, m_sockDUC, m_sockHighPri;
+	SOCKET m_sockIQ[NUM_DDC];
+	LARGE_INTEGER m_freq;
+	Thread<> m_cmdThread, m_streamThread;
+
+	static SOCKET open(unsigned short port)
+	{
+		SOCKET sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.S_un.S_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(port);
+		if(::bind(sock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+		{
+			closesocket(sock);
+			return INVALID_SOCKET;
+		}
+		return sock;
+	}
+
+	void thread_cmd()
+	{
+		byte packet[1500];
+		while(m_bThreadOkay)
+		{
+			fd_set fds;
+			FD_ZERO(&fds);
+			FD_SET(m_sockGeneral, &fds);
+			FD_SET(m_sockDDC, &fds);
+			FD_SET(m_sockDUC, &fds);
+			FD_SET(m_sockHighPri, &fds);
+			struct timeval tv;
+			tv.tv_sec = 0;
+			tv.tv_usec = 50000;
+			if(select(0, &fds, NULL, NULL, &tv) <= 0) continue;
+
+			SOCKET socks[] = { m_sockGeneral, m_sockDDC, m_sockDUC, m_sockHighPri };
+			for(unsigned idx = 0; idx < _countof(socks); idx++)
+			{
+				if(!FD_ISSET(socks[idx], &fds)) continue;
+				sockaddr_in from;
+				int fromSize = sizeof(from);
+				int size = ::recvfrom(socks[idx], (char*)packet, sizeof(packet), 0, (sockaddr*)&from, &fromSize);
+				if(size <= 0) continue;
+				command(socks[idx], packet, size, from);
+			}
+		}
+	}
+
+	void command(SOCKET sock, const byte* packet, int size, const sockaddr_in& from)
+	{
+		Locker lock(m_lock);
+		if(sock == m_sockGeneral && CHpsdr2Ethernet::isDiscoveryReply(packet, size))
+		{
+			// a discovery request looks like an idle reply
+			byte reply[60];
+			memset(reply, 0, sizeof(reply));
+			reply[4] = byte(m_running ? 0x03 : 0x02);
+			reply[5] = 0x00; reply[6] = 0x1C; reply[7] = 0xC0; reply[8] = 0xA2; reply[9] = 0x22; reply[10] = 0x5D;
+			reply[11] = 5;				// Orion MkII
+			reply[12] = 38;				// protocol version
+			reply[13] = 17;				// firmware version
+			reply[20] = NUM_DDC;
+			::sendto(sock, (const char*)reply, sizeof(reply), 0, (const sockaddr*)&from, sizeof(from));
+			return;
+		}
+
+		m_host = from;
+		m_hostKnown = true;
+		m_numCommands++;
+		if(sock == m_sockGeneral && size >= CHpsdr2Ethernet::GENERAL_SIZE && packet[4] == 0x00)
+		{
+			m_phaseWords = !!(packet[37] & 0x08);
+		}
+		else if(sock == m_sockDDC && size >= CHpsdr2Ethernet::DDC_CMD_SIZE)
+		{
+			for(unsigned ddc = 0; ddc < NUM_DDC; ddc++)
+			{
+				m_ddc[ddc].enabled = !!(packet[7] & (1 << ddc));
+				m_ddc[ddc].rateKhz = simBE16(packet + 17 + 6 * ddc + 1);
+			}
+		}
+		else if(sock == m_sockHighPri && size >= CHpsdr2Ethernet::HIGH_PRI_CMD_SIZE)
+		{
+			m_running = !!(packet[4] & 0x01);
+			for(unsigned ddc = 0; ddc < NUM_DDC; ddc++)
+			{
+				// bit 3 of general byte 37 set means phase words, f * 2^32 / 122.88MHz
+				const unsigned value = simBE32(packet + 9 + 4 * ddc);
+				m_ddc[ddc].freq = m_phaseWords ? long(value * 122880000.0 / 4294967296.0 + 0.5) : long(value);
+			}
+		}
+	}
+
+	void send(SOCKET sock, const byte* packet, unsigned size)
+	{
+		// ASSUMES m_lock IS HELD
+		::sendto(sock, (const char*)packet, size, 0, (const sockaddr*)&m_host, sizeof(m_host));
+	}
+
+	void thread_stream()
+	{
+		byte iq[CHpsdr2Ethernet::IQ_HEADER + IQ_SAMPLES * 6];
+		noiseFrame(iq, sizeof(iq));
+		memset(iq, 0, CHpsdr2Ethernet::IQ_HEADER);
+		simWriteBE16(iq + 12, 24);
+		simWriteBE16(iq + 14, IQ_SAMPLES);
+
+		byte mic[CHpsdr2Ethernet::MIC_SIZE];
+		noiseFrame(mic, sizeof(mic));
+		byte status[CHpsdr2Ethernet::STATUS_SIZE];
+		memset(status, 0, sizeof(status));
+		unsigned micSeq = 0, statusSeq = 0;
+		__int64 streamStart = 0, micOwed = 0, lastStatus = 0;
+		bool streaming = false;
+
+		while(m_bThreadOkay)
+		{
+			Sleep(1);
+			LARGE_INTEGER now;
+			QueryPerformanceCounter(&now);
+			Locker lock(m_lock);
+			if(!m_running || !m_hostKnown)
+			{
+				streaming = false;
+				for(unsigned ddc = 0; ddc < NUM_DDC; ddc++) m_ddc[ddc].active = false;
+				continue;
+			}
+			if(!streaming)
+			{
+				streaming = true;
+				streamStart = lastStatus = now.QuadPart;
+				micOwed = 0;
+				micSeq = statusSeq = 0;
+			}
+
+			for(unsigned idx = 0; idx < NUM_DDC; idx++)
+			{
+				DDC& ddc = m_ddc[idx];
+				if(!ddc.enabled || !ddc.rateKhz)
+				{
+					ddc.active = false;
+					continue;
+				}
+				if(!ddc.active)
+				{
+					ddc.active = true;
+					ddc.start = now.QuadPart;
+					ddc.owed = 0;
+					ddc.seq = 0;
+				}
+				const __int64 due = (now.QuadPart - ddc.start) * ddc.rateKhz * 1000 / m_freq.QuadPart;
+				while(ddc.owed + IQ_SAMPLES <= due)
+				{
+					simWriteBE32(iq, ddc.seq++);
+					ddc.owed += IQ_SAMPLES;
+					if(idx == 0 && ddc.seq % DROP_EVERY == 0)
+					{
+						ddc.dropped++;
+					} else {
+						send(m_sockIQ[idx], iq, sizeof(iq));
+						ddc.delivered += IQ_SAMPLES;
+					}
+				}
+			}
+
+			const __int64 micDue = (now.QuadPart - streamStart) * 48000 / m_freq.QuadPart;
+			while(micOwed + CHpsdr2Ethernet::MIC_SAMPLES <= micDue)
+			{
+				simWriteBE32(mic, micSeq++);
+				send(m_sockDUC, mic, sizeof(mic));
+				micOwed += CHpsdr2Ethernet::MIC_SAMPLES;
+			}
+
+			if((now.QuadPart - lastStatus) * 1000 >= STATUS_MS * m_freq.QuadPart)
+			{
+				lastStatus = now.QuadPart;
+				simWriteBE32(status, statusSeq++);
+				simWriteBE16(status + 14, 1234);		// forward power
+				send(m_sockDDC, status, sizeof(status));
+			}
+		}
+	}
+};
+
+static int simulateProtocol2()
+{
+	enum { RUN_MS = 5000, SETTLE_MS = 300, NUM_RECEIVERS = 3, FREQ = 7100000 };
+	static const long rates[NUM_RECEIVERS] = { 1536000, 384000, 48000 };
+
+	CProtocol2Simulator sim;
+	if(!sim.good())
+	{
+		std::cout << "could not open the simulator's ports" << std::endl;
+		return 1;
+	}
+	bool failed = false;
+
+	// discovery, sent straight to the simulator rather than broadcast
+	{
+		SOCKET sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		DWORD timeout = 1000;
+		::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.S_un.S_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(CHpsdr2Ethernet::GENERAL_PORT);
+		byte message[60];
+		CHpsdr2Ethernet::buildDiscovery(message);
+		::sendto(sock, (const char*)message, sizeof(message), 0, (const sockaddr*)&addr, sizeof(addr));
+		int size = ::recv(sock, (char*)message, sizeof(message), 0);
+		if(!CHpsdr2Ethernet::isDiscoveryReply(message, size) || message[20] != CProtocol2Simulator::NUM_DDC)
+		{
+			std::cout << "FAIL: no discovery reply" << std::endl;
+			failed = true;
+		}
+		closesocket(sock);
+	}
+
+	CHpsdr2Ethernet* dev = new CHpsdr2Ethernet(NULL, htonl(INADDR_LOOPBACK), 0x001CC0A2225D, 17, 5, CProtocol2Simulator::NUM_DDC);
+	dev->AddRef();
+	signals::IOutEndpoint* outEPs[CProtocol2Simulator::NUM_DDC + 1];
+	VERIFY(dev->Outgoing(outEPs, _countof(outEPs)) == _countof(outEPs));
+	signals::IOutEndpoint** recv = outEPs + 1;
+	signals::IEPBuffer* buff[NUM_RECEIVERS];
+	for(unsigned idx = 0; idx < NUM_RECEIVERS; idx++)
+	{
+		recv[idx]->Attributes()->GetByName("rate")->setValue(&rates[idx]);
+		buff[idx] = recv[idx]->CreateBuffer();
+		recv[idx]->Connect(buff[idx]);
+	}
+	const long freq = FREQ;
+	recv[0]->Attributes()->GetByName("freq")->setValue(&freq);
+
+	// the last receiver is disconnected while the radio runs on, after which its DDC should fall silent
+	const unsigned lastRecv = NUM_RECEIVERS - 1;
+	unsigned numReceived[NUM_RECEIVERS];
+	__int64 settled, afterSettle;
+	{
+		CSampleCounter* counters[NUM_RECEIVERS];
+		for(unsigned idx = 0; idx < NUM_RECEIVERS; idx++) counters[idx] = new CSampleCounter(buff[idx]);
+		dev->Start();
+		Sleep(RUN_MS);
+		recv[lastRecv]->Disconnect();
+		Sleep(SETTLE_MS);
+		settled = sim.ddc(lastRecv).delivered;
+		Sleep(SETTLE_MS);
+		afterSettle = sim.ddc(lastRecv).delivered;
+		dev->Stop();
+		Sleep(200);
+		for(unsigned idx = 0; idx < NUM_RECEIVERS; idx++)
+		{
+			counters[idx]->stop();
+			numReceived[idx] = counters[idx]->m_samples;
+			delete counters[idx];
+		}
+	}
+
+	for(unsigned idx = 0; idx < NUM_RECEIVERS; idx++)
+	{
+		const CProtocol2Simulator::DDC ddc = sim.ddc(idx);
+		const double expected = double(rates[idx]) * (idx == lastRecv ? RUN_MS : RUN_MS + 2 * SETTLE_MS) / 1000;
+
+		// whatever was still in flight when the radio was stopped may not have been read
+		const bool good = ddc.rateKhz * 1000 == rates[idx] && numReceived[idx] <= ddc.delivered
+			&& numReceived[idx] + expected * 0.02 >= ddc.delivered && numReceived[idx] > expected * 0.9 && numReceived[idx] < expected * 1.1;
+		printf("%s: recv%u at %7ld: %9u of %9u samples sent, %9.0f expected\n", good ? "pass" : "FAIL",
+			idx + 1, rates[idx], numReceived[idx], (unsigned)ddc.delivered, expected);
+		if(!good) failed = true;
+	}
+
+	const CProtocol2Simulator::DDC first = sim.ddc(0);
+	const long lost = *(const long*)recv[0]->Attributes()->GetByName("lostPackets")->getValue();
+	const long totalLost = *(const long*)dev->Attributes()->GetByName("lostPackets")->getValue();
+	const bool lostGood = (lost == (long)first.dropped || lost + 1 == (long)first.dropped) && totalLost == lost && lost > 0;
+	printf("%s: %ld packets lost on recv1 (%ld in total), %u dropped\n", lostGood ? "pass" : "FAIL", lost, totalLost, first.dropped);
+	if(!lostGood) failed = true;
+
+	const bool silentGood = settled == afterSettle && !sim.ddc(lastRecv).enabled;
+	printf("%s: recv%u's DDC %s after it was disconnected\n", silentGood ? "pass" : "FAIL", lastRecv + 1,
+		silentGood ? "stopped" : "kept streaming");
+	if(!silentGood) failed = true;
+
+	const bool freqGood = first.freq == FREQ;
+	printf("%s: recv1 tuned to %ld\n", freqGood ? "pass" : "FAIL", first.freq);
+	if(!freqGood) failed = true;
+
+	const short forward = *(const short*)dev->Attributes()->GetByName("AIN1")->getValue();
+	const bool statusGood = forward == 1234;
+	printf("%s: forward power %d from status\n", statusGood ? "pass" : "FAIL", forward);
+	if(!statusGood) failed = true;
+
+	for(unsigned idx = 0; idx < NUM_RECEIVERS; idx++)
+	{
+		recv[idx]->Disconnect();
+		buff[idx]->Release();
+	}
+	VERIFY(!dev->Release());
+	return failed ? 1 : 0;
+}
+
+// ------------------------------------------------------------------ discovery test
+
+// the radios' MACs have bytes past 0x80 in the middle, where a sign extending shift would corrupt the key
+static const __int64 DISCOVERY_MAC = 0x001CC0A22200;
+
+static void writeMac(byte* dest, __int64 mac)
+{
+	for(unsigned idx = 0; idx < 6; idx++) dest[idx] = byte(mac >> (40 - idx * 8));
+}
+
+static bool discoveredMacs(const CHpsdrDiscovery::TBoardList& boards)
+{
+	for(CHpsdrDiscovery::TBoardList::const_iterator trans = boards.begin(); trans != boards.end(); trans++)
+	{
+		if(trans->mac != (DISCOVERY_MAC | 0x01) && trans->mac != (DISCOVERY_MAC | 0x02)) return false;
+	}
+	return true;
+}
+
+class CDiscoveryResponder
+{	// answers discovery probes on 127.0.0.1 for a Metis radio and for one that speaks both protocols, ignoring
+	// the first few probes it's sent and, if asked, answering protocol 2 only after the Metis replies
+public:
+	CDiscoveryResponder(unsigned short port, unsigned ignore, DWORD lateP2Ms = 0)
+		:m_ignore(ignore),m_lateP2Ms(lateP2Ms),m_probes(0),m_bThreadOkay(true),m_thread(Thread<>::delegate_type(this, &CDiscoveryResponder::start))
+	{
+		m_sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.S_un.S_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(port);
+		DWORD timeout = 100;
+		::setsockopt(m_sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+		if(::bind(m_sock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+		{
+			closesocket(m_sock);
+			m_sock = INVALID_SOCKET;
+		}
+		else m_thread.launch(THREAD_PRIORITY_ABOVE_NORMAL);
+	}
+
+	~CDiscoveryResponder()
+	{
+		m_bThreadOkay = false;
+		m_thread.close();
+		if(m_sock != INVALID_SOCKET) closesocket(m_sock);
+	}
+
+	inline bool good() const { return m_sock != INVALID_SOCKET; }
+	volatile unsigned m_probes;
+
+private:
+	SOCKET m_sock;
+	unsigned m_ignore;
+	const DWORD m_lateP2Ms;
+	volatile bool m_bThreadOkay;
+	Thread<> m_thread;
+
+	void replyP2(const sockaddr_in& to)
+	{
+		// only the second radio speaks protocol 2
+		byte reply[60];
+		memset(reply, 0, sizeof(reply));
+		reply[4] = 0x02;
+		writeMac(reply + 5, DISCOVERY_MAC | 0x02);
+		reply[11] = 5;			// Orion MkII
+		reply[12] = 38;			// protocol version
+		reply[13] = 17;			// firmware version
+		reply[20] = 7;			// DDCs
+		::sendto(m_sock, (const char*)reply, sizeof(reply), 0, (const sockaddr*)&to, sizeof(to));
+	}
+
+	void start()
+	{
+		byte probe[100];
+		bool p2Owed = false;
+		sockaddr_in p2To;
+		while(m_bThreadOkay)
+		{
+			sockaddr_in from;
+			int fromSize = sizeof(from);
+			int size = ::recvfrom(m_sock, (char*)probe, sizeof(probe), 0, (sockaddr*)&from, &fromSize);
+			if(size <= 0) continue;
+			m_probes++;
+			if(m_ignore)
+			{
+				m_ignore--;
+				continue;
+			}
+
+			byte reply[60];
+			memset(reply, 0, sizeof(reply));
+			if(size == 63 && probe[0] == 0xEF && probe[1] == 0xFE && probe[2] == 0x02)
+			{
+				// both radios answer the Metis probe
+				reply[0] = 0xEF;
+				reply[1] = 0xFE;
+				reply[2] = 0x02;
+				writeMac(reply + 3, DISCOVERY_MAC | 0x01);
+				reply[9] = 25;			// firmware version
+				reply[10] = 1;			// Hermes
+				::sendto(m_sock, (const char*)reply, sizeof(reply), 0, (const sockaddr*)&from, sizeof(from));
+				reply[8] = 0x02;
+				reply[10] = 5;			// Orion MkII
+				::sendto(m_sock, (const char*)reply, sizeof(reply), 0, (const sockaddr*)&from, sizeof(from));
+				if(p2Owed)
+				{
+					Sleep(m_lateP2Ms);
+					replyP2(p2To);
+					p2Owed = false;
+				}
+			}
+			else if(size == 60 && CHpsdr2Ethernet::isDiscoveryReply(probe, size))
+			{
+				if(m_lateP2Ms)
+				{
+					p2Owed = true;
+					p2To = from;
+				}
+				else replyP2(from);
+			}
+		}
+	}
+};
+
+static double elapsedMs(const LARGE_INTEGER& start)
+{
+	LARGE_INTEGER now, freq;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	return double(now.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart;
+}
+
+static int testDiscovery()
+{
+	enum { PORT = CHpsdr2Ethernet::GENERAL_PORT, RETRIES = 3, RETRY_MS = 250, REFRESH_MS = 1000 };
+	static const char* CACHE_KEY = "Software\\modHpsdr\\DiscoveryTest";
+	const unsigned long loopback = htonl(INADDR_LOOPBACK);
+	const unsigned long nobody = htonl(INADDR_LOOPBACK + 1);
+	RegDeleteKeyA(HKEY_CURRENT_USER, CACHE_KEY);
+
+	bool failed = false;
+	CHpsdrDiscovery::TBoardList boards;
+	LARGE_INTEGER start;
+	double ms;
+	{
+		// the first pair of probes is lost, so the radios are found by the first retry
+		CDiscoveryResponder responder(PORT, 2);
+		if(!responder.good())
+		{
+			std::cout << "could not open the responder's port" << std::endl;
+			return 1;
+		}
+
+		{
+			CHpsdrDiscovery disc(CACHE_KEY);
+			disc.configure(RETRIES, RETRY_MS, REFRESH_MS);
+			disc.setTarget(loopback, PORT);
+
+			QueryPerformanceCounter(&start);
+			disc.find(boards, 2);
+			ms = elapsedMs(start);
+			bool good = boards.size() == 2 && discoveredMacs(boards) && ms >= RETRY_MS * 0.8 && ms < RETRY_MS * RETRIES;
+			for(CHpsdrDiscovery::TBoardList::const_iterator trans = boards.begin(); trans != boards.end(); trans++)
+			{
+				if(trans->protocol != ((trans->mac & 0xFF) == 0x02 ? 2 : 1)) good = false;
+			}
+			printf("%s: %u radios found in %.0f ms after a lost probe\n", good ? "pass" : "FAIL", (unsigned)boards.size(), ms);
+			if(!good) failed = true;
+
+			// let the search finish, then ask again
+			disc.find(boards, 0);
+			QueryPerformanceCounter(&start);
+			disc.find(boards, 0);
+			ms = elapsedMs(start);
+			good = boards.size() == 2 && ms < 20;
+			printf("%s: %u radios known in %.1f ms once searched\n", good ? "pass" : "FAIL", (unsigned)boards.size(), ms);
+			if(!good) failed = true;
+
+			const unsigned probes = responder.m_probes;
+			Sleep(REFRESH_MS + RETRY_MS * RETRIES + 200);
+			good = responder.m_probes > probes;
+			printf("%s: %u probes sent by the background refresh\n", good ? "pass" : "FAIL", responder.m_probes - probes);
+			if(!good) failed = true;
+		}
+
+		{
+			// restarting with the broadcast going nowhere, the radios are only found by checking the cache
+			CHpsdrDiscovery disc(CACHE_KEY);
+			disc.configure(RETRIES, RETRY_MS, REFRESH_MS);
+			disc.setTarget(nobody, PORT);
+
+			QueryPerformanceCounter(&start);
+			disc.find(boards, 2);
+			ms = elapsedMs(start);
+			const bool good = boards.size() == 2 && discoveredMacs(boards) && ms < RETRY_MS;
+			printf("%s: %u remembered radios confirmed in %.0f ms\n", good ? "pass" : "FAIL", (unsigned)boards.size(), ms);
+			if(!good) failed = true;
+		}
+	}
+
+	{
+		// with the radios gone, what's remembered isn't reported
+		CHpsdrDiscovery disc(CACHE_KEY);
+		disc.configure(RETRIES, RETRY_MS, REFRESH_MS);
+		disc.setTarget(nobody, PORT);
+		disc.find(boards, 2);
+		const bool good = boards.empty();
+		printf("%s: %u radios reported once they've gone\n", good ? "pass" : "FAIL", (unsigned)boards.size());
+		if(!good) failed = true;
+	}
+
+	{
+		// the radio speaking both protocols answers the Metis probe first, and is still offered as protocol 2
+		enum { LATE_P2_MS = 50 };
+		CDiscoveryResponder responder(PORT, 0, LATE_P2_MS);
+		CHpsdrDiscovery disc(NULL);
+		disc.configure(RETRIES, RETRY_MS, REFRESH_MS);
+		disc.setTarget(loopback, PORT);
+		disc.find(boards, 2);
+		bool good = responder.good() && boards.size() == 2 && discoveredMacs(boards);
+		for(CHpsdrDiscovery::TBoardList::const_iterator trans = boards.begin(); trans != boards.end(); trans++)
+		{
+			if(trans->protocol != ((trans->mac & 0xFF) == 0x02 ? 2 : 1)) good = false;
+		}
+		printf("%s: radio speaking both protocols found as protocol 2 behind its Metis reply\n", good ? "pass" : "FAIL");
+		if(!good) failed = true;
+	}
+
+	RegDeleteKeyA(HKEY_CURRENT_USER, CACHE_KEY);
+	return failed ? 1 : 0;
+}
+
 int _tmain(int argc, _TCHAR* argv[])
 {
 	_CrtSetDbgFlag ( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 
+	if(argc > 1 && _tcscmp(argv[1], _T("-bench")) == 0) return benchTransmit();
+	if(argc > 1 && _tcscmp(argv[1], _T("-pacer")) == 0) return simulatePacing();
+	if(argc > 1 && _tcscmp(argv[1], _T("-jitter")) == 0) return simulateJitter();
+	if(argc > 1 && _tcscmp(argv[1], _T("-stress")) == 0) return stressReceivers();
+	if(argc > 1 && _tcscmp(argv[1], _T("-reconnect")) == 0) return testReconnect();
+	if(argc > 1 && _tcscmp(argv[1], _T("-batch")) == 0) return benchBatching();
+	if(argc > 1 && _tcscmp(argv[1], _T("-sim2")) == 0) return simulateProtocol2();
+	if(argc > 1 && _tcscmp(argv[1], _T("-discover")) == 0) return testDiscovery();
+
 	signals::IBlock* devices[1];
 	int numDevices = DRIVER_HpsdrEthernet.Discover(devices, _countof(devices));
 	std::cout << numDevices << " devices found" << std::endl;
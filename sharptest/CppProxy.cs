@@ -372,6 +372,53 @@ namespace cppProxy
             }
         };
 
+        private class ComplexShort : ITypeMarshaller
+        {
+            public signals.EType type() { return signals.EType.ComplexShort; }
+            public int size(object val) { return 2 * sizeof(short); }
+            public Array makePinnableArray(int cnt) { return new short[cnt * 2]; }
+
+            public object fromNative(IntPtr val)
+            {
+                short[] buff = new short[2];
+                Marshal.Copy(val, buff, 0, 2);
+                return buff;
+            }
+            public void toNative(object src, IntPtr dest)
+            {
+                short[] val = new short[2] {
+                    Convert.ToInt16(((Array)src).GetValue(0)),
+                    Convert.ToInt16(((Array)src).GetValue(1))
+                };
+                Marshal.Copy(val, 0, dest, 2);
+            }
+
+            public Array toPinnableArray(Array src)
+            {
+                int len = src.Length;
+                short[] outBuff = new short[len * 2];
+                for (int inRef = 0, outRef = 0; inRef < len; inRef++, outRef += 2)
+                {
+                    Array inVal = (Array)src.GetValue(inRef);
+                    outBuff[outRef] = Convert.ToInt16(inVal.GetValue(0));
+                    outBuff[outRef + 1] = Convert.ToInt16(inVal.GetValue(1));
+                }
+                return outBuff;
+            }
+
+            public Array fromPinnableArray(Array pin, int cnt)
+            {
+                if (cnt == 0) return new Array[0];
+                short[] nativeBuff = (short[])pin;
+                Array[] outBuff = new Array[cnt];
+                for (int inRef = 0, outRef = 0; outRef < cnt; inRef += 2, outRef++)
+                {
+                    outBuff[outRef] = new short[2] { nativeBuff[inRef], nativeBuff[inRef + 1] };
+                }
+                return outBuff;
+            }
+        };
+
         private class ComplexDouble : ITypeMarshaller
         {
             public signals.EType type() { return signals.EType.CmplDbl; }
@@ -630,6 +677,10 @@ namespace cppProxy
                     return new Vector(typ, new Complex(signals.EType.Complex));
                 case signals.EType.VecLRSingle:
                     return new Vector(typ, new Complex(signals.EType.LRSingle));
+                case signals.EType.ComplexShort:
+                    return new ComplexShort();
+                case signals.EType.VecComplexShort:
+                    return new Vector(typ, new ComplexShort());
                 case signals.EType.CmplDbl:
                     return new ComplexDouble();
                 case signals.EType.VecCmplDbl:
@@ -105,6 +105,8 @@ namespace Layout
                     return "float";
                 case signals.EType.Double:
                     return "double";
+                case signals.EType.ComplexShort:
+                    return "complex(short)";
                 case signals.EType.Complex:
                     return "complex(float)";
                 case signals.EType.CmplDbl:
@@ -125,6 +127,8 @@ namespace Layout
                     return "array(float)";
                 case signals.EType.VecDouble:
                     return "array(double)";
+                case signals.EType.VecComplexShort:
+                    return "array(complex(short))";
                 case signals.EType.VecComplex:
                     return "array(complex(float))";
                 case signals.EType.VecCmplDbl:
@@ -39,6 +39,7 @@ namespace signals
         Int64	= 0x14,
 		Single	= 0x23,
 		Double	= 0x24,
+		ComplexShort = 0x33,
 		Complex	= 0x34,
         CmplDbl = 0x35,
 		LRSingle = 0x44,
@@ -50,6 +51,7 @@ namespace signals
         VecInt64    = 0x1C,
         VecSingle   = 0x2B,
         VecDouble   = 0x2C,
+        VecComplexShort = 0x3B,
         VecComplex  = 0x3C,
         VecCmplDbl  = 0x3D,
         VecLRSingle = 0x4C